@@ -15,6 +15,11 @@
 *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "repo_blob_files_handler.h"
+#include "repo/lib/repo_exception.h"
+#include <repo_log.h>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include "repo/lib/datastructure/repo_uuid.h"
 
 using namespace repo::core::handler::fileservice;
@@ -76,6 +81,50 @@ std::vector<uint8_t> BlobFilesHandler::readToBuffer(const DataRef &ref) {
 	return res;
 }
 
+struct BlobFilesHandler::MappedFile
+{
+	boost::interprocess::mapped_region region;
+};
+
+BlobView BlobFilesHandler::readToView(const DataRef &ref) {
+	auto it = mappedFiles.find(ref.fileName);
+	if (it == mappedFiles.end()) {
+		std::shared_ptr<MappedFile> mapped;
+		try
+		{
+			auto path = manager->getFilePath(manager->getFileRef(database, collection, ref.fileName));
+			if (!path.empty()) {
+				boost::interprocess::file_mapping file(path.c_str(), boost::interprocess::read_only);
+				mapped = std::make_shared<MappedFile>();
+				mapped->region = boost::interprocess::mapped_region(file, boost::interprocess::read_only);
+				mapped->region.advise(boost::interprocess::mapped_region::advice_sequential);
+			}
+		}
+		catch (const boost::interprocess::interprocess_exception& e)
+		{
+			repoTrace << "Could not map blob file " << ref.fileName << ", reading it instead: " << e.what();
+			mapped.reset();
+		}
+		it = mappedFiles.insert({ ref.fileName, mapped }).first;
+	}
+
+	BlobView view;
+	if (it->second) {
+		auto& region = it->second->region;
+		if (ref.startPos < 0 || ref.size < 0 || ref.startPos + ref.size > (int64_t)region.get_size()) {
+			throw repo::lib::RepoException("DataRef for " + ref.fileName + " is outside the bounds of the blob file.");
+		}
+		view.ptr = static_cast<const uint8_t*>(region.get_address()) + ref.startPos;
+		view.length = ref.size;
+	}
+	else {
+		view.buffer = readToBuffer(ref);
+		view.ptr = view.buffer.data();
+		view.length = view.buffer.size();
+	}
+	return view;
+}
+
 std::shared_ptr<FileManager>  BlobFilesHandler::getFileManager()
 {
 	return manager;
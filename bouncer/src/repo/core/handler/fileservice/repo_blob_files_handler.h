@@ -19,6 +19,9 @@
 
 #include <string>
 #include <fstream>
+#include <vector>
+#include <map>
+#include <memory>
 
 #include "repo_file_manager.h"
 #include "repo_data_ref.h"
@@ -28,6 +31,32 @@ namespace repo {
 		namespace handler {
 			namespace fileservice {
 				const static size_t MAX_FILE_SIZE_BYTES = 104857600; //100MB
+
+				/*
+				* A read-only view of the data referenced by a DataRef. When the blob file
+				* can be memory mapped, the view points directly into the mapping, which
+				* stays valid for the lifetime of the BlobFilesHandler that created it.
+				* Otherwise the data is read into a buffer owned by the view itself.
+				*/
+				class BlobView
+				{
+					friend class BlobFilesHandler;
+				public:
+					BlobView() = default;
+					BlobView(BlobView&&) = default;
+					BlobView& operator=(BlobView&&) = default;
+					BlobView(const BlobView&) = delete;
+					BlobView& operator=(const BlobView&) = delete;
+
+					const uint8_t* data() const { return ptr; }
+					size_t size() const { return length; }
+
+				private:
+					const uint8_t* ptr = nullptr;
+					size_t length = 0;
+					std::vector<uint8_t> buffer;
+				};
+
 				class BlobFilesHandler
 				{
 				public:
@@ -48,6 +77,13 @@ namespace repo {
 					DataRef insertBinary(const std::vector<uint8_t> &data);
 					std::vector<uint8_t> readToBuffer(const DataRef &ref);
 
+					/*
+					* Returns the referenced data without copying it where possible. Blob
+					* files are memory mapped in their entirety the first time they are read
+					* from, so reads should be ordered by file and offset where possible.
+					*/
+					BlobView readToView(const DataRef &ref);
+
 					std::shared_ptr<FileManager> getFileManager();
 
 				private:
@@ -68,6 +104,12 @@ namespace repo {
 					const FileManager::Metadata& metadata;
 
 					std::map<std::string, std::ifstream> readStreams;
+
+					// Memory mappings of the blob files read with readToView. A null entry
+					// indicates the file could not be mapped, so should be read from the stream.
+
+					struct MappedFile;
+					std::map<std::string, std::shared_ptr<MappedFile>> mappedFiles;
 				};
 			}
 		}
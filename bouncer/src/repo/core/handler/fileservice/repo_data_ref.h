@@ -36,6 +36,10 @@ namespace repo {
 					DataRef(const std::string &fileName, const int64_t &startPos, const int64_t &size)
 						: fileName(fileName), startPos(startPos), size(size) {}
 
+					const std::string& getFileName() const { return fileName; }
+					int64_t getStartPos() const { return startPos; }
+					int64_t getSize() const { return size; }
+
 					repo::core::model::RepoBSON serialise() const;
 
 					static DataRef deserialise(const repo::core::model::RepoBSON &serialisedObj);
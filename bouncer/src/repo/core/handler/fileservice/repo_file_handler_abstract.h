@@ -19,6 +19,8 @@
 
 #include <string>
 #include <fstream>
+#include <sstream>
+#include <functional>
 #include "../../../lib/repo_exception.h"
 #include "../repo_database_handler_abstract.h"
 
@@ -83,6 +85,23 @@ namespace repo {
 						const std::vector<uint8_t> &bin
 					) = 0;
 
+					/**
+					* Upload a file whose contents are written by a callback, so callers
+					* that generate a file need not hold all of it in memory. The callback
+					* may be invoked more than once if the upload is retried.
+					*/
+					virtual std::string uploadFile(
+						const std::string &database,
+						const std::string &collection,
+						const std::string &fileName,
+						const std::function<void(std::ostream&)> &writer
+					) {
+						std::ostringstream stream;
+						writer(stream);
+						auto contents = stream.str();
+						return uploadFile(database, collection, fileName, std::vector<uint8_t>(contents.begin(), contents.end()));
+					};
+
 					virtual repo::core::model::RepoRef::RefType getType() const = 0;
 
 				protected:
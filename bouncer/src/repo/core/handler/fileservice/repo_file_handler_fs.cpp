@@ -124,6 +124,18 @@ std::string FSFileHandler::uploadFile(
 	const std::string          &keyName,
 	const std::vector<uint8_t> &bin
 )
+{
+	return uploadFile(database, collection, keyName, [&](std::ostream& stream) {
+		stream.write((char*)bin.data(), bin.size());
+	});
+}
+
+std::string FSFileHandler::uploadFile(
+	const std::string          &database,
+	const std::string          &collection,
+	const std::string          &keyName,
+	const std::function<void(std::ostream&)> &writer
+)
 {
 	auto hierachy = level > 0 ? determineHierachy(keyName) : std::vector<std::string>();
 
@@ -143,7 +155,7 @@ std::string FSFileHandler::uploadFile(
 	bool failed;
 	do {
 		std::ofstream outs(path.string(), std::ios::out | std::ios::binary);
-		outs.write((char*)bin.data(), bin.size());
+		writer(outs);
 		outs.close();
 		if (failed = (!outs || !repo::lib::doesFileExist(path))) {
 			repoError << "Failed to write to file " << path.string() << ((retries + 1) < 3 ? ". Retrying... " : "");
@@ -67,6 +67,17 @@ namespace repo {
 						const std::vector<uint8_t> &bin
 					);
 
+					/**
+					 * Upload file to FS, streaming the contents directly from the writer
+					 * upon success, returns the link information for the file, empty otherwise.
+					 */
+					std::string uploadFile(
+						const std::string &database,
+						const std::string &collection,
+						const std::string &keyName,
+						const std::function<void(std::ostream&)> &writer
+					);
+
 					/**
 					 * Delete file from FS.
 					 */
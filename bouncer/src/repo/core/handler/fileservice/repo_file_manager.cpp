@@ -58,53 +58,60 @@ bool FileManager::uploadFileAndCommit(
 	const std::vector<uint8_t>                   &bin,
 	const Metadata                               &metadata,
 	const Encoding                               &encoding)
+{
+	return uploadFileAndCommit(databaseName, collectionNamePrefix, id, [&](std::ostream& stream) {
+			stream.write((const char*)bin.data(), bin.size());
+		},
+		metadata,
+		encoding
+	);
+}
+
+template<typename IdType>
+bool FileManager::uploadFileAndCommit(
+	const std::string                            &databaseName,
+	const std::string                            &collectionNamePrefix,
+	const IdType                                 &id,
+	const std::function<void(std::ostream&)>     &writer,
+	const Metadata                               &metadata,
+	const Encoding                               &encoding)
 {
 	bool success = true;
 	auto fileUUID = repo::lib::RepoUUID::createUUID();
 
-	// Create local references that can be reassigned, if we need to do any
-	// further processing...
-
-	const std::vector<uint8_t>* fileContents = &bin;
 	auto fileMetadata = metadata;
+	if (encoding == Encoding::Gzip) {
+		fileMetadata["encoding"] = std::string("gzip");
+	}
 
-	switch (encoding)
-	{
-		case Encoding::Gzip:
-		{
-			// Use stringstream as a binary container to hold the compressed data
-			std::ostringstream compressedstream;
-
-			// Bufferstream operates directly over the user provided array
-			boost::interprocess::bufferstream uncompressed((char*)bin.data(), bin.size());
-
-			// In stream form for filtering_istream
-			std::istream uncompressedStream(uncompressed.rdbuf());
-
-			boost::iostreams::filtering_istream in;
-			in.push(boost::iostreams::gzip_compressor());
-			in.push(uncompressedStream); // For some reason bufferstream is ambigous between stream and streambuf, so wrap it unambiguously
-
-			boost::iostreams::copy(in, compressedstream);
-
-			auto compresseddata = compressedstream.str();
-			fileContents = new std::vector<uint8_t>(compresseddata.begin(), compresseddata.end());
+	// The size is of the stored (i.e. compressed) file, so it is measured on the
+	// stream given by the file handler, after any filters have been flushed.
 
-			fileMetadata["encoding"] = std::string("gzip");
-		}
-		break;
-	}
+	size_t size = 0;
 
 	std::string linkName;
 	try {
-		linkName = fsHandler->uploadFile(databaseName, collectionNamePrefix, fileUUID.toString(), *fileContents);
+		linkName = fsHandler->uploadFile(databaseName, collectionNamePrefix, fileUUID.toString(), [&](std::ostream& stream) {
+			auto start = stream.tellp();
+			switch (encoding)
+			{
+				case Encoding::Gzip:
+				{
+					boost::iostreams::filtering_ostream out;
+					out.push(boost::iostreams::gzip_compressor());
+					out.push(stream);
+					writer(out);
+					out.reset(); // Closes the compressor, writing the gzip footer
+				}
+				break;
+				default:
+					writer(stream);
+			}
+			size = stream.tellp() - start;
+		});
 	}
 	catch (const std::exception& e)
 	{
-		if (fileContents != &bin)
-		{
-			delete fileContents;
-		}
 		std::throw_with_nested(repo::lib::RepoFileUploadException("Failed to upload " + fileUUID.toString()));
 	}
 
@@ -115,19 +122,10 @@ bool FileManager::uploadFileAndCommit(
 			id,
 			linkName,
 			fsHandler->getType(),
-			fileContents->size(),
+			size,
 			fileMetadata);
 	}
 
-	// If we've created a new vector, clean it up. metadata doesn't need to be
-	// deleted because Mongo BSONs have built in smart-pointers allowing them to
-	// be passed by value.
-
-	if (fileContents != &bin)
-	{
-		delete fileContents;
-	}
-
 	return success;
 }
 
@@ -391,6 +389,22 @@ template bool FileManager::uploadFileAndCommit<std::string>(
 	const Metadata&,
 	const Encoding&);
 
+template bool FileManager::uploadFileAndCommit<std::string>(
+	const std::string&,
+	const std::string&,
+	const std::string&,
+	const std::function<void(std::ostream&)>&,
+	const Metadata&,
+	const Encoding&);
+
+template bool FileManager::uploadFileAndCommit<repo::lib::RepoUUID>(
+	const std::string&,
+	const std::string&,
+	const repo::lib::RepoUUID&,
+	const std::function<void(std::ostream&)>&,
+	const Metadata&,
+	const Encoding&);
+
 template bool FileManager::uploadFileAndCommit<repo::lib::RepoUUID>(
 	const std::string&,
 	const std::string&,
@@ -18,6 +18,7 @@
 #pragma once
 
 #include <string>
+#include <functional>
 
 #include "repo_file_handler_abstract.h"
 #include "repo/core/model/bson/repo_bson_ref.h"
@@ -70,6 +71,23 @@ namespace repo {
 						const Encoding                               &encoding = Encoding::None
 					);
 
+					/**
+					 * Upload a file whose contents are produced by writer, and commit the
+					 * ref entry to the database. The contents are streamed to the file
+					 * store (through the compressor, if an encoding is given) rather than
+					 * being built in memory first. writer may be called more than once if
+					 * the upload has to be retried.
+					 */
+					template<typename IdType>
+					bool uploadFileAndCommit(
+						const std::string                            &databaseName,
+						const std::string                            &collectionNamePrefix,
+						const IdType								 &id,
+						const std::function<void(std::ostream&)>     &writer,
+						const repo::core::model::RepoRef::Metadata   &metadata = {},
+						const Encoding                               &encoding = Encoding::None
+					);
+
 					/**
 					 * Get the file base on the the ref entry in database
 					 */
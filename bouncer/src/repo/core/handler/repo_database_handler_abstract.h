@@ -17,11 +17,13 @@
 
 #pragma once
 
+#include <cstdint>
 #include <list>
 #include <map>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include "repo/lib/datastructure/repo_variant.h"
 #include "repo/core/handler/database/repo_query_fwd.h"
 
@@ -78,6 +80,18 @@ namespace repo {
 
 				using CursorPtr = std::unique_ptr<repo::core::handler::database::Cursor>;
 
+				/*
+				* Options controlling how the results of a find operation are returned.
+				* The defaults leave each behaviour up to the database.
+				*/
+				struct FindOptions
+				{
+					std::string sortField; // Results are unordered if this is empty
+					int sortOrder = 1; // 1 for ascending, -1 for descending
+					int64_t limit = 0; // 0 returns all matching documents
+					int32_t batchSize = 0; // The number of documents a Cursor reads ahead in one round trip. 0 for the database default.
+				};
+
 				/*
 				* An object that provides write access to a collection from a specific
 				* thread, that may be different to the one that owns the database handler.
@@ -91,6 +105,14 @@ namespace repo {
 				public:
 					virtual void insertDocument(repo::core::model::RepoBSON obj) = 0;
 
+					/*
+					* Writes the data to the blob files of this context, and returns the
+					* serialised DataRef that locates it. Any number of documents may then
+					* reference the range. Like documents, the data is only guaranteed to be
+					* readable once the context has been flushed.
+					*/
+					virtual repo::core::model::RepoBSON insertBinary(const std::vector<uint8_t>& data) = 0;
+
 					virtual void updateDocument(const database::query::RepoUpdate& obj) = 0;
 
 					/*
@@ -274,6 +296,23 @@ namespace repo {
 					const database::query::RepoQuery& projection,
 					const bool loadBinaries = false) = 0;
 
+				/**
+				* Given a search criteria,  find all the documents that passes this query
+				* @param database name of database
+				* @param collection name of collection
+				* @param criteria search criteria in a bson object
+				* @param projection to define the fiels in the returned document
+				* @param options the sort order, limit and batch size of the query
+				* @return a vector of RepoBSON objects satisfy the given criteria
+				*/
+				virtual std::vector<repo::core::model::RepoBSON> findAllByCriteria(
+					const std::string& database,
+					const std::string& collection,
+					const database::query::RepoQuery& filter,
+					const database::query::RepoQuery& projection,
+					const database::FindOptions& options,
+					const bool loadBinaries = false) = 0;
+
 
 
 				/**
@@ -302,6 +341,24 @@ namespace repo {
 					const database::query::RepoQuery& filter,
 					const database::query::RepoQuery& projection) = 0;
 
+				/**
+				* Given a search criteria,  find all the documents that passes this query
+				* The documents are streamed from the database in batches, of up to
+				* options.batchSize documents at a time, as the cursor is iterated.
+				* @param database name of database
+				* @param collection name of collection
+				* @param criteria search criteria in a bson object
+				* @param projection to define the fiels in the returned document
+				* @param options the sort order, limit and batch size of the query
+				* @return a Cursor allowing traversal of the documents that satisfy the given criteria
+				*/
+				virtual std::unique_ptr<database::Cursor> findCursorByCriteria(
+					const std::string& database,
+					const std::string& collection,
+					const database::query::RepoQuery& filter,
+					const database::query::RepoQuery& projection,
+					const database::FindOptions& options) = 0;
+
 				/**
 				* Given a search criteria,  find one documents that passes this query
 				* @param database name of database
@@ -0,0 +1,1831 @@
+/**
+*  Copyright (C) 2025 3D Repo Ltd
+*
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU Affero General Public License as
+*  published by the Free Software Foundation, either version 3 of the
+*  License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Affero General Public License for more details.
+*
+*  You should have received a copy of the GNU Affero General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+*  Embedded database handler
+*/
+
+#include <repo_log.h>
+#include "repo_database_handler_embedded.h"
+#include "fileservice/repo_file_manager.h"
+#include "fileservice/repo_blob_files_handler.h"
+#include "repo/core/model/bson/repo_bson.h"
+#include "repo/core/model/bson/repo_bson_builder.h"
+#include "repo/core/model/repo_model_global.h"
+#include "repo/lib/repo_exception.h"
+#include "repo/error_codes.h"
+#include "database/repo_query.h"
+
+#include <bsoncxx/document/view.hpp>
+#include <bsoncxx/document/value.hpp>
+#include <bsoncxx/array/view.hpp>
+#include <bsoncxx/types.hpp>
+#include <bsoncxx/types/bson_value/view.hpp>
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/array.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <set>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_set>
+#include <variant>
+
+using namespace repo::core::handler;
+using namespace repo::core::handler::fileservice;
+using namespace repo::core::handler::database;
+using namespace bsoncxx::builder::basic;
+
+static uint64_t MAX_EMBEDDED_BSON_SIZE = 16777216L;
+static uint64_t MAX_PARALLEL_BSON = 10000;
+
+// Each record in a log is a one byte operation code followed by the document.
+// Deletes hold just the _id of the document being removed.
+
+static const char OPERATION_WRITE = 'W';
+static const char OPERATION_DELETE = 'D';
+
+static const std::string LOG_EXTENSION = ".log";
+static const std::string INDEX_EXTENSION = ".idx";
+static const uint32_t INDEX_MAGIC = 0x58444952; // "RIDX"
+static const uint32_t INDEX_VERSION = 1;
+
+class EmbeddedDatabaseHandler::EmbeddedDatabaseHandlerException : public repo::lib::RepoException
+{
+public:
+	EmbeddedDatabaseHandlerException(const EmbeddedDatabaseHandler& handler, const std::string& method, const std::string& db, const std::string collection)
+		: RepoException("EmbeddedDatabaseHandler exception: in " + method + " on: " + db + "." + collection + " Path: " + handler.root.string())
+	{
+		errorCode = REPOERR_AUTH_FAILED; //If no outer exception sets the return code, signal this is database operation problem.
+	}
+
+	EmbeddedDatabaseHandlerException(const EmbeddedDatabaseHandler& handler, const std::string& method, const std::string& db)
+		: RepoException("EmbeddedDatabaseHandler exception: in " + method + " on: " + db + " Path: " + handler.root.string())
+	{
+		errorCode = REPOERR_AUTH_FAILED;
+	}
+
+	EmbeddedDatabaseHandlerException(const std::string& msg)
+		: RepoException("EmbeddedDatabaseHandler exception: " + msg)
+	{
+		errorCode = REPOERR_AUTH_FAILED;
+	}
+};
+
+static std::string toString(const bsoncxx::stdx::string_view& s)
+{
+	return std::string(s.data(), s.size());
+}
+
+static bool isUUID(const bsoncxx::types::b_binary& b)
+{
+	return b.sub_type == bsoncxx::binary_sub_type::k_uuid || b.sub_type == bsoncxx::binary_sub_type::k_uuid_deprecated;
+}
+
+/*
+* Returns the key under which a value is held in an index, or an empty string if
+* values of its type are not indexed. Keys are prefixed by type, so that, for
+* example, a UUID can never collide with a string.
+*/
+static std::string makeKey(const bsoncxx::types::bson_value::view& v)
+{
+	switch (v.type())
+	{
+	case bsoncxx::type::k_binary:
+		if (isUUID(v.get_binary())) {
+			return std::string("u") + std::string((const char*)v.get_binary().bytes, v.get_binary().size);
+		}
+		break;
+	case bsoncxx::type::k_string:
+		return std::string("s") + toString(v.get_string().value);
+	case bsoncxx::type::k_oid:
+		return std::string("o") + std::string(v.get_oid().value.bytes(), v.get_oid().value.size());
+	case bsoncxx::type::k_int32:
+		return std::string("i") + std::to_string(v.get_int32().value);
+	case bsoncxx::type::k_int64:
+		return std::string("i") + std::to_string(v.get_int64().value);
+	default:
+		break;
+	}
+	return {};
+}
+
+static std::string makeKey(const bsoncxx::document::view& doc, const std::string& field)
+{
+	auto it = doc.find(field);
+	if (it == doc.end()) {
+		return {};
+	}
+	return makeKey(it->get_value());
+}
+
+/*
+* Calls f for each value at a dotted path in the document, until it returns
+* true. As with Mongo, arrays along the path are traversed, and an array at the
+* end of the path is visited itself and then for each of its elements.
+* Returns true if f did.
+*/
+template<typename F>
+static bool forEachValue(const bsoncxx::document::view& doc, std::string_view path, F& f);
+
+template<typename F>
+static bool forEachValue(const bsoncxx::types::bson_value::view& v, std::string_view rest, F& f)
+{
+	if (rest.empty()) {
+		if (f(v)) {
+			return true;
+		}
+		if (v.type() == bsoncxx::type::k_array) {
+			for (auto e : v.get_array().value) {
+				if (f(e.get_value())) {
+					return true;
+				}
+			}
+		}
+	}
+	else if (v.type() == bsoncxx::type::k_document) {
+		return forEachValue(v.get_document().value, rest, f);
+	}
+	else if (v.type() == bsoncxx::type::k_array) {
+		for (auto e : v.get_array().value) {
+			if (e.type() == bsoncxx::type::k_document && forEachValue(e.get_document().value, rest, f)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+template<typename F>
+static bool forEachValue(const bsoncxx::document::view& doc, std::string_view path, F& f)
+{
+	auto dot = path.find('.');
+	auto key = path.substr(0, dot);
+	auto it = doc.find(bsoncxx::stdx::string_view(key.data(), key.size()));
+	if (it == doc.end()) {
+		return false;
+	}
+	return forEachValue(it->get_value(), dot == std::string_view::npos ? std::string_view() : path.substr(dot + 1), f);
+}
+
+static bool isNumber(const bsoncxx::types::bson_value::view& v)
+{
+	return v.type() == bsoncxx::type::k_int32 || v.type() == bsoncxx::type::k_int64 || v.type() == bsoncxx::type::k_double;
+}
+
+static double toDouble(const bsoncxx::types::bson_value::view& v)
+{
+	switch (v.type())
+	{
+	case bsoncxx::type::k_int32:
+		return v.get_int32().value;
+	case bsoncxx::type::k_int64:
+		return (double)v.get_int64().value;
+	default:
+		return v.get_double().value;
+	}
+}
+
+/*
+* Values are equal if they are the same, except numbers, which are compared by
+* value regardless of their type, as Mongo does.
+*/
+static bool equals(const bsoncxx::types::bson_value::view& a, const bsoncxx::types::bson_value::view& b)
+{
+	if (isNumber(a) && isNumber(b)) {
+		return toDouble(a) == toDouble(b);
+	}
+	return a == b;
+}
+
+/*
+* The relative order of the types when sorting, following Mongo's comparison
+* order for the types bouncer uses.
+*/
+static int typeOrder(const bsoncxx::types::bson_value::view& v)
+{
+	switch (v.type())
+	{
+	case bsoncxx::type::k_null:
+		return 0;
+	case bsoncxx::type::k_int32:
+	case bsoncxx::type::k_int64:
+	case bsoncxx::type::k_double:
+		return 1;
+	case bsoncxx::type::k_string:
+		return 2;
+	case bsoncxx::type::k_document:
+		return 3;
+	case bsoncxx::type::k_array:
+		return 4;
+	case bsoncxx::type::k_binary:
+		return 5;
+	case bsoncxx::type::k_oid:
+		return 6;
+	case bsoncxx::type::k_bool:
+		return 7;
+	case bsoncxx::type::k_date:
+		return 8;
+	default:
+		return 9;
+	}
+}
+
+/*
+* Returns <0, 0 or >0 if a is less than, equal to or greater than b.
+*/
+static int compare(const bsoncxx::types::bson_value::view& a, const bsoncxx::types::bson_value::view& b)
+{
+	auto ta = typeOrder(a);
+	auto tb = typeOrder(b);
+	if (ta != tb) {
+		return ta - tb;
+	}
+
+	switch (a.type())
+	{
+	case bsoncxx::type::k_int32:
+	case bsoncxx::type::k_int64:
+	case bsoncxx::type::k_double:
+	{
+		auto da = toDouble(a);
+		auto db = toDouble(b);
+		return da < db ? -1 : (da > db ? 1 : 0);
+	}
+	case bsoncxx::type::k_string:
+		return toString(a.get_string().value).compare(toString(b.get_string().value));
+	case bsoncxx::type::k_binary:
+	{
+		auto ba = a.get_binary();
+		auto bb = b.get_binary();
+		if (ba.size != bb.size) {
+			return ba.size < bb.size ? -1 : 1;
+		}
+		return std::memcmp(ba.bytes, bb.bytes, ba.size);
+	}
+	case bsoncxx::type::k_oid:
+		return a.get_oid().value.compare(b.get_oid().value);
+	case bsoncxx::type::k_bool:
+		return (int)a.get_bool().value - (int)b.get_bool().value;
+	case bsoncxx::type::k_date:
+	{
+		auto da = a.get_date().to_int64();
+		auto db = b.get_date().to_int64();
+		return da < db ? -1 : (da > db ? 1 : 0);
+	}
+	default:
+		return 0;
+	}
+}
+
+/*
+* A RepoQuery compiled for evaluation against the documents in a log. The values
+* of Eq conditions are encoded once, into a document, so they can be compared
+* directly with the elements of each candidate.
+*/
+class EmbeddedDatabaseHandler::Filter
+{
+public:
+	enum class Type { All, Eq, Exists, Or, And, ElemMatch };
+
+	Filter(const query::RepoQuery& query)
+	{
+		std::visit(*this, query);
+	}
+
+	void operator() (const query::Eq& n)
+	{
+		type = Type::Eq;
+		field = n.field;
+		repo::core::model::RepoBSONBuilder builder;
+		for (size_t i = 0; i < n.values.size(); i++) {
+			builder.appendRepoVariant(std::to_string(i), n.values[i]);
+		}
+		values = builder.obj();
+	}
+
+	void operator() (const query::Exists& n)
+	{
+		type = Type::Exists;
+		field = n.field;
+		exists = n.exists;
+	}
+
+	void operator() (const query::ArrayContains& n)
+	{
+		type = Type::ElemMatch;
+		field = n.field;
+		children.emplace_back(n.query());
+	}
+
+	void operator() (const query::Or& n)
+	{
+		type = Type::Or;
+		for (auto& q : n.conditions) {
+			children.emplace_back(q);
+		}
+	}
+
+	void operator() (const query::RepoQueryBuilder& n)
+	{
+		type = Type::And;
+		for (auto& q : n.conditions) {
+			children.emplace_back(q);
+		}
+	}
+
+	void operator() (const query::RepoProjectionBuilder& n)
+	{
+		throw repo::lib::RepoException("A projection cannot be used as a query filter.");
+	}
+
+	/*
+	* True if the query would build an empty filter document for Mongo. Find
+	* operations with such filters return nothing, to behave the same as the
+	* MongoDatabaseHandler.
+	*/
+	bool isEmpty() const
+	{
+		switch (type)
+		{
+		case Type::All:
+			return true;
+		case Type::Eq:
+			return values.isEmpty();
+		case Type::And:
+			return std::all_of(children.begin(), children.end(), [](const Filter& f) { return f.isEmpty(); });
+		default:
+			return false;
+		}
+	}
+
+	bool matches(const bsoncxx::document::view& doc) const
+	{
+		switch (type)
+		{
+		case Type::All:
+			return true;
+		case Type::Eq:
+		{
+			auto valuesView = getView(values);
+			if (valuesView.empty()) {
+				return true;
+			}
+			auto f = [&](const bsoncxx::types::bson_value::view& v) {
+				for (auto e : valuesView) {
+					if (equals(v, e.get_value())) {
+						return true;
+					}
+				}
+				return false;
+			};
+			return forEachValue(doc, field, f);
+		}
+		case Type::Exists:
+		{
+			auto f = [](const bsoncxx::types::bson_value::view&) { return true; };
+			return forEachValue(doc, field, f) == exists;
+		}
+		case Type::ElemMatch:
+		{
+			auto f = [&](const bsoncxx::types::bson_value::view& v) {
+				if (v.type() != bsoncxx::type::k_array) {
+					return false;
+				}
+				for (auto e : v.get_array().value) {
+					if (e.type() == bsoncxx::type::k_document && children[0].matches(e.get_document().value)) {
+						return true;
+					}
+				}
+				return false;
+			};
+			return forEachValue(doc, field, f);
+		}
+		case Type::Or:
+			return std::any_of(children.begin(), children.end(), [&](const Filter& c) { return c.matches(doc); });
+		case Type::And:
+			return std::all_of(children.begin(), children.end(), [&](const Filter& c) { return c.matches(doc); });
+		}
+		return false;
+	}
+
+	/*
+	* If the filter can only match documents with one of a set of values in an
+	* indexed field, returns true and populates the field and the index keys of
+	* the values.
+	*/
+	bool getIndexKeys(std::string& indexField, std::vector<std::string>& keys) const
+	{
+		if (type == Type::Eq && isIndexed(field)) {
+			keys.clear();
+			for (auto e : getView(values)) {
+				auto key = makeKey(e.get_value());
+				if (key.empty()) {
+					return false;
+				}
+				keys.push_back(key);
+			}
+			indexField = field;
+			return !keys.empty();
+		}
+		else if (type == Type::And) {
+			for (auto& c : children) {
+				if (c.getIndexKeys(indexField, keys)) {
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	static bool isIndexed(const std::string& field)
+	{
+		return field == REPO_LABEL_ID || field == REPO_NODE_LABEL_SHARED_ID || field == REPO_NODE_REVISION_ID;
+	}
+
+private:
+	Type type = Type::All;
+	std::string field;
+	repo::core::model::RepoBSON values;
+	bool exists = true;
+	std::vector<Filter> children;
+};
+
+/*
+* The in-memory state of one collection: the location of the latest version of
+* each document in the log, and the indexes over them.
+* Callers must hold the mutex, shared for reading the state, and exclusive for
+* writing.
+*/
+class EmbeddedDatabaseHandler::Collection
+{
+public:
+	struct Location
+	{
+		uint64_t offset;
+		uint32_t size;
+	};
+
+	/*
+	* Reads documents from the log. Records are never modified once written, so
+	* readers do not need to hold the lock after getting the locations they are
+	* interested in.
+	*/
+	class Reader
+	{
+	public:
+		Reader(const std::filesystem::path& path)
+			:stream(path, std::ios::binary)
+		{
+		}
+
+		// The view is valid until the next call to read
+		bsoncxx::document::view read(const Location& location)
+		{
+			buffer.resize(location.size);
+			stream.seekg(location.offset + 1);
+			if (!stream.read((char*)buffer.data(), location.size)) {
+				throw repo::lib::RepoException("Failed to read document at " + std::to_string(location.offset) + " from the log.");
+			}
+			return bsoncxx::document::view(buffer.data(), buffer.size());
+		}
+
+	private:
+		std::ifstream stream;
+		std::vector<uint8_t> buffer;
+	};
+
+	Collection(const std::filesystem::path& path)
+		:logPath(path.string() + LOG_EXTENSION),
+		indexPath(path.string() + INDEX_EXTENSION),
+		logLength(0),
+		modified(false)
+	{
+		uint64_t indexedLength = 0;
+		if (std::filesystem::exists(logPath)) {
+			try
+			{
+				indexedLength = loadIndex();
+			}
+			catch (const std::exception& e)
+			{
+				repoWarning << "Rebuilding the index of " << logPath.string() << ": " << e.what();
+				clear();
+				indexedLength = 0;
+			}
+			replay(indexedLength);
+		}
+	}
+
+	~Collection()
+	{
+		try
+		{
+			save();
+		}
+		catch (const std::exception& e)
+		{
+			repoError << "Failed to save the index of " << logPath.string() << ": " << e.what();
+		}
+	}
+
+	std::shared_mutex mutex;
+
+	Reader getReader() const
+	{
+		return Reader(logPath);
+	}
+
+	bool exists(const std::string& idKey) const
+	{
+		return ids.find(idKey) != ids.end();
+	}
+
+	bool find(const std::string& idKey, Location& location) const
+	{
+		auto it = ids.find(idKey);
+		if (it == ids.end()) {
+			return false;
+		}
+		location = { it->second, records.at(it->second).size };
+		return true;
+	}
+
+	/*
+	* Returns the locations of all the documents that could match the filter,
+	* in the order they were written. If the filter has a condition on an
+	* indexed field, this is the subset from the index, otherwise it is the
+	* whole collection.
+	*/
+	std::vector<Location> getCandidates(const Filter& filter) const
+	{
+		std::vector<Location> locations;
+		std::string field;
+		std::vector<std::string> keys;
+		if (filter.getIndexKeys(field, keys)) {
+			std::set<uint64_t> offsets;
+			for (auto& key : keys) {
+				if (field == REPO_LABEL_ID) {
+					auto it = ids.find(key);
+					if (it != ids.end()) {
+						offsets.insert(it->second);
+					}
+				}
+				else {
+					auto& index = field == REPO_NODE_LABEL_SHARED_ID ? sharedIds : revIds;
+					auto it = index.find(key);
+					if (it != index.end()) {
+						offsets.insert(it->second.begin(), it->second.end());
+					}
+				}
+			}
+			for (auto& o : offsets) {
+				locations.push_back({ o, records.at(o).size });
+			}
+		}
+		else {
+			locations.reserve(records.size());
+			for (auto& [o, r] : records) {
+				locations.push_back({ o, r.size });
+			}
+		}
+		return locations;
+	}
+
+	/*
+	* Appends a new version of the document to the log. Writes are buffered, so
+	* commit must be called before releasing the lock.
+	*/
+	void write(const bsoncxx::document::view& doc)
+	{
+		append(OPERATION_WRITE, doc);
+	}
+
+	void remove(const bsoncxx::document::view& doc)
+	{
+		append(OPERATION_DELETE, doc);
+	}
+
+	void commit()
+	{
+		if (stream.is_open()) {
+			stream.flush();
+			if (!stream) {
+				throw repo::lib::RepoException("Failed to write to " + logPath.string());
+			}
+		}
+	}
+
+	/*
+	* Writes the indexes to disk if they have changed. The index is written to a
+	* temporary file and moved into place, so it is never seen partially written.
+	*/
+	void save()
+	{
+		if (!modified) {
+			return;
+		}
+
+		commit();
+
+		auto temporary = indexPath;
+		temporary += ".tmp";
+		{
+			std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+			writeValue(out, INDEX_MAGIC);
+			writeValue(out, INDEX_VERSION);
+			writeValue(out, logLength);
+			writeValue(out, (uint64_t)records.size());
+			for (auto& [offset, record] : records) {
+				writeValue(out, offset);
+				writeValue(out, record.size);
+				writeString(out, record.id);
+				writeString(out, record.sharedId);
+				writeString(out, record.revId);
+			}
+			if (!out) {
+				throw repo::lib::RepoException("Failed to write " + temporary.string());
+			}
+		}
+		std::filesystem::rename(temporary, indexPath);
+		modified = false;
+	}
+
+	/*
+	* Deletes the files and clears the indexes.
+	*/
+	void drop()
+	{
+		stream.close();
+		std::filesystem::remove(logPath);
+		std::filesystem::remove(indexPath);
+		clear();
+		logLength = 0;
+		modified = false;
+	}
+
+	bool isEmpty() const
+	{
+		return records.empty();
+	}
+
+private:
+	struct Record
+	{
+		uint32_t size;
+		std::string id;
+		std::string sharedId;
+		std::string revId;
+	};
+
+	std::filesystem::path logPath;
+	std::filesystem::path indexPath;
+	std::ofstream stream;
+	uint64_t logLength;
+	bool modified;
+
+	// The live records, keyed by their offset in the log, so iterating the map
+	// gives the order in which the current versions were written.
+
+	std::map<uint64_t, Record> records;
+
+	std::unordered_map<std::string, uint64_t> ids;
+	std::unordered_map<std::string, std::set<uint64_t>> sharedIds;
+	std::unordered_map<std::string, std::set<uint64_t>> revIds;
+
+	template<typename T>
+	static void writeValue(std::ostream& out, const T& v)
+	{
+		out.write((const char*)&v, sizeof(T));
+	}
+
+	static void writeString(std::ostream& out, const std::string& s)
+	{
+		writeValue(out, (uint32_t)s.size());
+		out.write(s.data(), s.size());
+	}
+
+	template<typename T>
+	static void readValue(std::istream& in, T& v)
+	{
+		if (!in.read((char*)&v, sizeof(T))) {
+			throw repo::lib::RepoException("Index is truncated");
+		}
+	}
+
+	static void readString(std::istream& in, std::string& s)
+	{
+		uint32_t size;
+		readValue(in, size);
+		s.resize(size);
+		if (!in.read(s.data(), size)) {
+			throw repo::lib::RepoException("Index is truncated");
+		}
+	}
+
+	void clear()
+	{
+		records.clear();
+		ids.clear();
+		sharedIds.clear();
+		revIds.clear();
+	}
+
+	/*
+	* Loads the saved index, returning the length of the log it covers, or zero
+	* if there is no index.
+	*/
+	uint64_t loadIndex()
+	{
+		std::ifstream in(indexPath, std::ios::binary);
+		if (!in) {
+			return 0;
+		}
+
+		uint32_t magic, version;
+		uint64_t length, count;
+		readValue(in, magic);
+		readValue(in, version);
+		if (magic != INDEX_MAGIC || version != INDEX_VERSION) {
+			throw repo::lib::RepoException("Unrecognised index format");
+		}
+		readValue(in, length);
+		if (length > std::filesystem::file_size(logPath)) {
+			throw repo::lib::RepoException("Index is ahead of the log");
+		}
+		readValue(in, count);
+		for (uint64_t i = 0; i < count; i++) {
+			uint64_t offset;
+			Record record;
+			readValue(in, offset);
+			readValue(in, record.size);
+			readString(in, record.id);
+			readString(in, record.sharedId);
+			readString(in, record.revId);
+			add(offset, std::move(record));
+		}
+		return length;
+	}
+
+	/*
+	* Applies the records in the log from the given offset. If the log ends
+	* with an incomplete record, for example because the process was terminated
+	* while writing it, the record is discarded.
+	*/
+	void replay(uint64_t from)
+	{
+		auto fileSize = std::filesystem::file_size(logPath);
+
+		std::ifstream in(logPath, std::ios::binary);
+		in.seekg(from);
+
+		uint64_t position = from;
+		std::vector<uint8_t> buffer;
+		while (position < fileSize) {
+			char operation;
+			int32_t size;
+			if (!in.read(&operation, 1) || !in.read((char*)&size, sizeof(size))) {
+				break;
+			}
+			if ((operation != OPERATION_WRITE && operation != OPERATION_DELETE) || size < 5 || position + 1 + size > fileSize) {
+				break;
+			}
+			buffer.resize(size);
+			std::memcpy(buffer.data(), &size, sizeof(size));
+			if (!in.read((char*)buffer.data() + sizeof(size), size - sizeof(size))) {
+				break;
+			}
+			apply(position, operation, bsoncxx::document::view(buffer.data(), buffer.size()));
+			position += 1 + size;
+		}
+
+		if (position < fileSize) {
+			repoWarning << "Discarding " << (fileSize - position) << " bytes of incomplete records at the end of " << logPath.string();
+			in.close();
+			std::filesystem::resize_file(logPath, position);
+		}
+
+		logLength = position;
+		if (position != from) {
+			modified = true;
+		}
+	}
+
+	void append(char operation, const bsoncxx::document::view& doc)
+	{
+		if (!stream.is_open()) {
+			std::filesystem::create_directories(logPath.parent_path());
+			stream.open(logPath, std::ios::binary | std::ios::app);
+			if (!stream) {
+				throw repo::lib::RepoException("Failed to open " + logPath.string());
+			}
+		}
+
+		stream.write(&operation, 1);
+		stream.write((const char*)doc.data(), doc.length());
+		if (!stream) {
+			throw repo::lib::RepoException("Failed to write to " + logPath.string());
+		}
+
+		apply(logLength, operation, doc);
+		logLength += 1 + doc.length();
+		modified = true;
+	}
+
+	void apply(uint64_t offset, char operation, const bsoncxx::document::view& doc)
+	{
+		auto id = makeKey(doc, REPO_LABEL_ID);
+		if (!id.empty()) {
+			erase(id);
+		}
+		if (operation == OPERATION_WRITE) {
+			add(offset, {
+				(uint32_t)doc.length(),
+				id,
+				makeKey(doc, REPO_NODE_LABEL_SHARED_ID),
+				makeKey(doc, REPO_NODE_REVISION_ID)
+			});
+		}
+	}
+
+	void add(uint64_t offset, Record&& record)
+	{
+		if (!record.id.empty()) {
+			ids[record.id] = offset;
+		}
+		if (!record.sharedId.empty()) {
+			sharedIds[record.sharedId].insert(offset);
+		}
+		if (!record.revId.empty()) {
+			revIds[record.revId].insert(offset);
+		}
+		records[offset] = std::move(record);
+	}
+
+	static void eraseFromIndex(std::unordered_map<std::string, std::set<uint64_t>>& index, const std::string& key, uint64_t offset)
+	{
+		auto it = index.find(key);
+		if (it != index.end()) {
+			it->second.erase(offset);
+			if (it->second.empty()) {
+				index.erase(it);
+			}
+		}
+	}
+
+	void erase(const std::string& id)
+	{
+		auto it = ids.find(id);
+		if (it == ids.end()) {
+			return;
+		}
+		auto offset = it->second;
+		auto& record = records.at(offset);
+		eraseFromIndex(sharedIds, record.sharedId, offset);
+		eraseFromIndex(revIds, record.revId, offset);
+		records.erase(offset);
+		ids.erase(it);
+	}
+};
+
+/*
+* Applies a projection in the same way as Mongo: if any fields are included,
+* only those (and _id, unless it is excluded) are returned. Otherwise all the
+* fields except the excluded ones are returned. Only top level fields are
+* supported.
+*/
+static repo::core::model::RepoBSON project(
+	const bsoncxx::document::view& doc,
+	const query::RepoQuery& projection)
+{
+	auto builder = std::get_if<query::RepoProjectionBuilder>(&projection);
+	if (!builder) {
+		throw repo::lib::RepoException("Projections must be a RepoProjectionBuilder.");
+	}
+
+	if (builder->includedFields.empty() && builder->excludedFields.empty()) {
+		return repo::core::model::RepoBSON(doc);
+	}
+
+	std::unordered_set<std::string> included(builder->includedFields.begin(), builder->includedFields.end());
+	std::unordered_set<std::string> excluded(builder->excludedFields.begin(), builder->excludedFields.end());
+	if (included.size()) {
+		included.insert(REPO_LABEL_ID);
+	}
+
+	bsoncxx::builder::basic::document projected;
+	for (auto e : doc) {
+		auto key = toString(e.key());
+		if (excluded.count(key) || (included.size() && !included.count(key))) {
+			continue;
+		}
+		projected.append(kvp(e.key(), e.get_value()));
+	}
+	return repo::core::model::RepoBSON(projected.view());
+}
+
+/*
+* The cursor holds the locations of the documents that may match, and reads and
+* filters them as it is iterated. When the results are sorted, the filtering
+* has to happen up front, so the cursor is created with the sorted locations of
+* the matching documents only.
+* As with the MongoCursor, all iterators from one cursor move together.
+*/
+class EmbeddedDatabaseHandler::EmbeddedCursor : public database::Cursor
+{
+public:
+	class EmbeddedIteratorImpl : public database::Cursor::Iterator::Impl
+	{
+	public:
+		EmbeddedIteratorImpl(EmbeddedCursor* cursor, bool end)
+			:cursor(cursor),
+			end(end)
+		{
+		}
+
+		virtual const repo::core::model::RepoBSON operator*()
+		{
+			return cursor->current;
+		}
+
+		virtual void operator++()
+		{
+			cursor->next();
+		}
+
+		virtual bool operator!=(const database::Cursor::Iterator::Impl* other)
+		{
+			return isEnd() != static_cast<const EmbeddedIteratorImpl*>(other)->isEnd();
+		}
+
+	private:
+		EmbeddedCursor* cursor;
+		bool end;
+
+		bool isEnd() const
+		{
+			return end || cursor->exhausted;
+		}
+	};
+
+	EmbeddedCursor(
+		Collection::Reader&& reader,
+		std::vector<Collection::Location>&& locations,
+		std::unique_ptr<Filter> filter,
+		const query::RepoQuery& projection,
+		int64_t limit)
+		:reader(std::move(reader)),
+		locations(std::move(locations)),
+		filter(std::move(filter)),
+		projection(projection),
+		limit(limit),
+		_begin(this, false),
+		_end(this, true)
+	{
+	}
+
+	virtual database::Cursor::Iterator begin()
+	{
+		if (!started) {
+			started = true;
+			next();
+		}
+		return database::Cursor::Iterator(&_begin);
+	}
+
+	virtual database::Cursor::Iterator end()
+	{
+		return database::Cursor::Iterator(&_end);
+	}
+
+	/*
+	* Counts the remaining matches without projecting them.
+	*/
+	size_t count()
+	{
+		size_t n = 0;
+		for (; position < locations.size(); position++) {
+			if (!filter || filter->matches(reader.read(locations[position]))) {
+				n++;
+			}
+		}
+		return n;
+	}
+
+private:
+	Collection::Reader reader;
+	std::vector<Collection::Location> locations;
+	std::unique_ptr<Filter> filter;
+	query::RepoQuery projection;
+	int64_t limit;
+
+	size_t position = 0;
+	int64_t returned = 0;
+	bool started = false;
+	bool exhausted = false;
+	repo::core::model::RepoBSON current;
+
+	EmbeddedIteratorImpl _begin;
+	EmbeddedIteratorImpl _end;
+
+	void next()
+	{
+		while (position < locations.size() && (!limit || returned < limit)) {
+			auto doc = reader.read(locations[position++]);
+			if (!filter || filter->matches(doc)) {
+				current = project(doc, projection);
+				returned++;
+				return;
+			}
+		}
+		exhausted = true;
+		current = repo::core::model::RepoBSON();
+	}
+};
+
+/*
+* Applies the AddParent update to the document with the matching _id, if there
+* is one. As with $addToSet, parents that are already present are not added
+* again.
+*/
+struct EmbeddedUpdateVisitor
+{
+	std::function<bool(const std::string&, bsoncxx::document::view&)> find;
+	std::function<void(const bsoncxx::document::view&)> write;
+
+	void operator() (const query::AddParent& u)
+	{
+		bsoncxx::document::view existing;
+		auto idData = u.uniqueId.data();
+		auto id = std::string("u") + std::string(idData.begin(), idData.end());
+		if (!find(id, existing)) {
+			return;
+		}
+
+		auto appendParents = [&](bsoncxx::builder::basic::array& array, const std::vector<bsoncxx::types::bson_value::view>& current) {
+			for (auto& v : current) {
+				array.append(v);
+			}
+			for (auto& p : u.parentIds) {
+				auto data = p.data();
+				bsoncxx::types::b_binary binary{
+					bsoncxx::binary_sub_type::k_uuid_deprecated,
+					(uint32_t)data.size(),
+					data.data()
+				};
+				bool present = std::any_of(current.begin(), current.end(), [&](const bsoncxx::types::bson_value::view& v) {
+					return v == bsoncxx::types::bson_value::view(binary);
+				});
+				if (!present) {
+					array.append(binary);
+				}
+			}
+		};
+
+		bsoncxx::builder::basic::document doc;
+		bool hasParents = false;
+		for (auto e : existing) {
+			if (toString(e.key()) == REPO_NODE_LABEL_PARENTS) {
+				if (e.type() != bsoncxx::type::k_array) {
+					throw repo::lib::RepoException("Cannot add parents to a document whose parents field is not an array.");
+				}
+				std::vector<bsoncxx::types::bson_value::view> current;
+				for (auto p : e.get_array().value) {
+					current.push_back(p.get_value());
+				}
+				bsoncxx::builder::basic::array parents;
+				appendParents(parents, current);
+				doc.append(kvp(e.key(), bsoncxx::types::b_array{ parents.view() }));
+				hasParents = true;
+			}
+			else {
+				doc.append(kvp(e.key(), e.get_value()));
+			}
+		}
+		if (!hasParents) {
+			bsoncxx::builder::basic::array parents;
+			appendParents(parents, {});
+			doc.append(kvp(REPO_NODE_LABEL_PARENTS, bsoncxx::types::b_array{ parents.view() }));
+		}
+
+		write(doc.view());
+	}
+};
+
+/*
+* Implements the BulkWriteContext for the embedded handler. Operations are
+* queued and written to the log together, under one lock, when the queue gets
+* large, or when the context is flushed.
+*/
+class EmbeddedDatabaseHandler::EmbeddedWriteContext : public database::BulkWriteContext
+{
+	std::shared_ptr<Collection> collection;
+	fileservice::BlobFilesHandler blobHandler;
+	std::string name;
+
+	using Operation = std::variant<repo::core::model::RepoBSON, database::query::RepoUpdate>;
+	std::vector<Operation> operations;
+	size_t operationsSize;
+
+	// The blob files handler takes a reference to the metadata map, so make sure
+	// we have one
+	repo::core::handler::fileservice::FileManager::Metadata fileMetadata;
+
+public:
+	EmbeddedWriteContext(
+		EmbeddedDatabaseHandler* handler,
+		const std::string& database,
+		const std::string& collection) :
+		collection(handler->getCollection(database, collection)),
+		blobHandler(handler->fileManager, database, collection, fileMetadata),
+		name(database + "." + collection),
+		operationsSize(0)
+	{
+	}
+
+	~EmbeddedWriteContext()
+	{
+		flush();
+	}
+
+	void insertDocument(repo::core::model::RepoBSON obj) override
+	{
+		try {
+			auto data = obj.getBinariesAsBuffer();
+			if (data.second.size()) {
+				auto ref = blobHandler.insertBinary(data.second);
+				obj.replaceBinaryWithReference(ref.serialise(), data.first);
+			}
+			operationsSize += obj.objsize();
+			operations.push_back(std::move(obj));
+			checkOperations();
+		}
+		catch (...)
+		{
+			std::throw_with_nested(EmbeddedDatabaseHandlerException("EmbeddedWriteContext::insertDocument on " + name));
+		}
+	}
+
+	repo::core::model::RepoBSON insertBinary(const std::vector<uint8_t>& data) override
+	{
+		try {
+			return blobHandler.insertBinary(data).serialise();
+		}
+		catch (...)
+		{
+			std::throw_with_nested(EmbeddedDatabaseHandlerException("EmbeddedWriteContext::insertBinary on " + name));
+		}
+	}
+
+	void updateDocument(const database::query::RepoUpdate& update) override
+	{
+		operations.push_back(update);
+		checkOperations();
+	}
+
+	void flush() override
+	{
+		try {
+			executeOperations();
+			blobHandler.finished();
+			std::unique_lock lock(collection->mutex);
+			collection->save();
+		}
+		catch (...)
+		{
+			std::throw_with_nested(EmbeddedDatabaseHandlerException("EmbeddedWriteContext::flush on " + name));
+		}
+	}
+
+private:
+	void checkOperations()
+	{
+		if (operationsSize > 16 * 1024 * 1024 || operations.size() > MAX_PARALLEL_BSON)
+		{
+			executeOperations();
+		}
+	}
+
+	void executeOperations()
+	{
+		if (operations.empty()) {
+			return;
+		}
+
+		std::unique_lock lock(collection->mutex);
+		auto reader = collection->getReader();
+
+		EmbeddedUpdateVisitor visitor;
+		visitor.find = [&](const std::string& id, bsoncxx::document::view& doc) {
+			Collection::Location location;
+			if (!collection->find(id, location)) {
+				return false;
+			}
+			collection->commit(); // The document may be in the write buffer
+			doc = reader.read(location);
+			return true;
+		};
+		visitor.write = [&](const bsoncxx::document::view& doc) {
+			collection->write(doc);
+		};
+
+		for (auto& o : operations) {
+			if (auto doc = std::get_if<repo::core::model::RepoBSON>(&o)) {
+				auto view = getView(*doc);
+				auto id = makeKey(view, REPO_LABEL_ID);
+				if (!id.empty() && collection->exists(id)) {
+					throw repo::lib::RepoException("Duplicate key: a document with this _id already exists in " + name);
+				}
+				collection->write(view);
+			}
+			else {
+				std::visit(visitor, std::get<database::query::RepoUpdate>(o));
+			}
+		}
+		collection->commit();
+
+		operations.clear();
+		operationsSize = 0;
+	}
+};
+
+EmbeddedDatabaseHandler::EmbeddedDatabaseHandler(const std::string& directory) :
+	AbstractDatabaseHandler(MAX_EMBEDDED_BSON_SIZE),
+	root(directory)
+{
+	std::filesystem::create_directories(root);
+}
+
+EmbeddedDatabaseHandler::~EmbeddedDatabaseHandler()
+{
+	// The collections save their indexes when they are destroyed
+}
+
+std::shared_ptr<EmbeddedDatabaseHandler> EmbeddedDatabaseHandler::getHandler(
+	const std::string& directory)
+{
+	return std::make_shared<EmbeddedDatabaseHandler>(directory);
+}
+
+bsoncxx::document::view EmbeddedDatabaseHandler::getView(const repo::core::model::RepoBSON& bson)
+{
+	return bson.view();
+}
+
+/*
+* Database and collection names become file names, so they must not be able to
+* escape the root directory.
+*/
+static void checkName(const std::string& name)
+{
+	if (name.empty() || name == "." || name == ".." || name.find_first_of("/\\") != std::string::npos) {
+		throw repo::lib::RepoException("Invalid database or collection name: '" + name + "'");
+	}
+}
+
+std::shared_ptr<EmbeddedDatabaseHandler::Collection> EmbeddedDatabaseHandler::getCollection(
+	const std::string& database,
+	const std::string& collection)
+{
+	checkName(database);
+	checkName(collection);
+
+	std::scoped_lock lock(collectionsMutex);
+	auto& c = collections[database + "/" + collection];
+	if (!c) {
+		c = std::make_shared<Collection>(root / database / collection);
+	}
+	return c;
+}
+
+std::shared_ptr<FileManager> EmbeddedDatabaseHandler::getFileManager()
+{
+	return this->fileManager;
+}
+
+void EmbeddedDatabaseHandler::createIndex(const std::string& database, const std::string& collection, const database::index::RepoIndex& index)
+{
+	createIndex(database, collection, index, false);
+}
+
+void EmbeddedDatabaseHandler::createIndex(const std::string& database, const std::string& collection, const database::index::RepoIndex& index, bool sparse, bool suppressInfo /*= false*/)
+{
+	if (!suppressInfo) {
+		repoDebug << "Ignoring index for " << database << "." << collection << ": the embedded database only indexes _id, shared_id and rev_id.";
+	}
+}
+
+void EmbeddedDatabaseHandler::loadBinaryBuffers(const std::string& database,
+	const std::string& collection,
+	repo::core::model::RepoBSON& bson)
+{
+	fileservice::BlobFilesHandler blobHandler(fileManager, database, collection);
+
+	if (bson.hasFileReference()) {
+		auto ref = bson.getBinaryReference();
+		auto buffer = blobHandler.readToBuffer(fileservice::DataRef::deserialise(ref));
+		bson.initBinaryBuffer(buffer);
+	}
+}
+
+void EmbeddedDatabaseHandler::dropCollection(
+	const std::string &database,
+	const std::string &collection)
+{
+	try
+	{
+		if (!database.empty() && !collection.empty())
+		{
+			auto c = getCollection(database, collection);
+			std::unique_lock lock(c->mutex);
+			c->drop();
+		}
+	}
+	catch (...)
+	{
+		std::throw_with_nested(EmbeddedDatabaseHandlerException(*this, "dropCollection", database, collection));
+	}
+}
+
+void EmbeddedDatabaseHandler::dropDocument(
+	const repo::core::model::RepoBSON bson,
+	const std::string &database,
+	const std::string &collection)
+{
+	try
+	{
+		if (database.empty() || collection.empty())
+		{
+			return;
+		}
+
+		auto view = getView(bson);
+		auto value = view.find(REPO_LABEL_ID);
+		if (value == view.end())
+		{
+			throw repo::lib::RepoException("Cannot drop a document without an _id field");
+		}
+
+		auto c = getCollection(database, collection);
+		std::unique_lock lock(c->mutex);
+		if (c->exists(makeKey(value->get_value()))) {
+			c->remove(make_document(kvp(REPO_LABEL_ID, value->get_value())).view());
+			c->commit();
+		}
+	}
+	catch (...)
+	{
+		std::throw_with_nested(EmbeddedDatabaseHandlerException(*this, "dropDocument", database, collection));
+	}
+}
+
+void EmbeddedDatabaseHandler::insertDocument(
+	const std::string &database,
+	const std::string &collection,
+	const repo::core::model::RepoBSON &obj)
+{
+	try
+	{
+		if (obj.hasOversizeFiles())
+		{
+			throw repo::lib::RepoException("insertDocument cannot be used with BSONs holding binary files. Use insertManyDocuments instead.");
+		}
+
+		auto c = getCollection(database, collection);
+		auto view = getView(obj);
+		auto id = makeKey(view, REPO_LABEL_ID);
+
+		std::unique_lock lock(c->mutex);
+		if (!id.empty() && c->exists(id)) {
+			throw repo::lib::RepoException("Duplicate key: a document with this _id already exists.");
+		}
+		c->write(view);
+		c->commit();
+	}
+	catch (...)
+	{
+		std::throw_with_nested(EmbeddedDatabaseHandlerException(*this, "insertDocument", database, collection));
+	}
+}
+
+void EmbeddedDatabaseHandler::insertManyDocuments(
+	const std::string &database,
+	const std::string &collection,
+	const std::vector<repo::core::model::RepoBSON> &objs,
+	const Metadata& binaryStorageMetadata)
+{
+	try
+	{
+		auto c = getCollection(database, collection);
+
+		fileservice::BlobFilesHandler blobHandler(fileManager, database, collection, binaryStorageMetadata);
+
+		for (size_t i = 0; i < objs.size(); i += MAX_PARALLEL_BSON) {
+			auto last = std::min<size_t>(objs.size(), i + MAX_PARALLEL_BSON);
+			std::vector<repo::core::model::RepoBSON> toCommit;
+			for (auto j = i; j < last; j++) {
+				auto node = objs[j];
+				auto data = node.getBinariesAsBuffer();
+				if (data.second.size()) {
+					auto ref = blobHandler.insertBinary(data.second);
+					node.replaceBinaryWithReference(ref.serialise(), data.first);
+				}
+				toCommit.push_back(node);
+			}
+
+			repoInfo << "Inserting " << toCommit.size() << " documents...";
+
+			std::unique_lock lock(c->mutex);
+			for (auto& node : toCommit) {
+				auto view = getView(node);
+				auto id = makeKey(view, REPO_LABEL_ID);
+				if (!id.empty() && c->exists(id)) {
+					c->commit();
+					throw repo::lib::RepoException("Duplicate key: a document with this _id already exists.");
+				}
+				c->write(view);
+			}
+			c->commit();
+		}
+
+		blobHandler.finished();
+
+		std::unique_lock lock(c->mutex);
+		c->save();
+	}
+	catch (...)
+	{
+		std::throw_with_nested(EmbeddedDatabaseHandlerException(*this, "insertManyDocuments", database, collection));
+	}
+}
+
+/*
+* Applies the fields of update to the existing document in the same way as
+* Mongo's $set: existing fields keep their position, and new fields are appended.
+* If there is no existing document, the _id goes first.
+*/
+static bsoncxx::document::value mergeDocuments(
+	const bsoncxx::document::view& existing,
+	const bsoncxx::document::view& update)
+{
+	bsoncxx::builder::basic::document merged;
+	if (existing.empty()) {
+		auto id = update.find(REPO_LABEL_ID);
+		merged.append(kvp(id->key(), id->get_value()));
+	}
+	for (auto e : existing) {
+		auto u = update.find(e.key());
+		merged.append(kvp(e.key(), u != update.end() ? u->get_value() : e.get_value()));
+	}
+	for (auto e : update) {
+		if (existing.find(e.key()) == existing.end() && !(existing.empty() && toString(e.key()) == REPO_LABEL_ID)) {
+			merged.append(kvp(e.key(), e.get_value()));
+		}
+	}
+	return merged.extract();
+}
+
+void EmbeddedDatabaseHandler::upsertDocument(
+	const std::string &database,
+	const std::string &collection,
+	const repo::core::model::RepoBSON &obj,
+	const bool        &overwrite)
+{
+	try
+	{
+		if (obj.hasOversizeFiles())
+		{
+			throw repo::lib::RepoException("upsertDocument cannot be used with BSONs holding binary files.");
+		}
+
+		auto view = getView(obj);
+		auto id = makeKey(view, REPO_LABEL_ID);
+		if (id.empty())
+		{
+			throw repo::lib::RepoException("upsertDocument requires a document with an _id field of a supported type.");
+		}
+
+		auto c = getCollection(database, collection);
+		std::unique_lock lock(c->mutex);
+
+		if (overwrite)
+		{
+			c->write(view);
+		}
+		else
+		{
+			Collection::Location location;
+			if (c->find(id, location)) {
+				auto reader = c->getReader();
+				c->write(mergeDocuments(reader.read(location), view).view());
+			}
+			else {
+				c->write(mergeDocuments(bsoncxx::document::view(), view).view());
+			}
+		}
+		c->commit();
+	}
+	catch (...)
+	{
+		std::throw_with_nested(EmbeddedDatabaseHandlerException(*this, "upsertDocument", database, collection));
+	}
+}
+
+std::unique_ptr<EmbeddedDatabaseHandler::EmbeddedCursor> EmbeddedDatabaseHandler::makeCursor(
+	const std::string& database,
+	const std::string& collection,
+	const database::query::RepoQuery& filter,
+	const database::query::RepoQuery& projection,
+	const database::FindOptions& options)
+{
+	auto c = getCollection(database, collection);
+	auto f = std::make_unique<Filter>(filter);
+
+	std::shared_lock lock(c->mutex);
+	auto reader = c->getReader();
+	auto locations = c->getCandidates(*f);
+	lock.unlock();
+
+	if (!options.sortField.empty())
+	{
+		// To sort, every candidate has to be read to filter it and get its sort
+		// key. Only the keys and locations are kept, and the documents are read
+		// again when the cursor is iterated.
+
+		std::vector<std::pair<bsoncxx::document::value, Collection::Location>> matches;
+		for (auto& location : locations) {
+			auto doc = reader.read(location);
+			if (f->matches(doc)) {
+				bsoncxx::builder::basic::document key;
+				auto first = [&](const bsoncxx::types::bson_value::view& v) {
+					key.append(kvp("k", v));
+					return true;
+				};
+				forEachValue(doc, options.sortField, first);
+				matches.push_back({ key.extract(), location });
+			}
+		}
+
+		auto keyOf = [](const bsoncxx::document::value& d) {
+			auto view = d.view();
+			return view.empty() ? bsoncxx::types::bson_value::view() : view["k"].get_value();
+		};
+
+		std::stable_sort(matches.begin(), matches.end(), [&](const auto& a, const auto& b) {
+			auto order = compare(keyOf(a.first), keyOf(b.first));
+			return options.sortOrder < 0 ? order > 0 : order < 0;
+		});
+
+		locations.clear();
+		for (auto& m : matches) {
+			locations.push_back(m.second);
+		}
+		f.reset();
+	}
+
+	return std::make_unique<EmbeddedCursor>(std::move(reader), std::move(locations), std::move(f), projection, options.limit);
+}
+
+std::vector<repo::core::model::RepoBSON> EmbeddedDatabaseHandler::findAllByCriteria(
+	const std::string& database,
+	const std::string& collection,
+	const database::query::RepoQuery& filter,
+	const bool loadBinaries/* = false*/) {
+
+	return findAllByCriteria(database, collection, filter, database::query::RepoProjectionBuilder{}, loadBinaries);
+}
+
+std::vector<repo::core::model::RepoBSON> EmbeddedDatabaseHandler::findAllByCriteria(
+	const std::string& database,
+	const std::string& collection,
+	const database::query::RepoQuery& filter,
+	const database::query::RepoQuery& projection,
+	const bool loadBinaries/* = false*/)
+{
+	return findAllByCriteria(database, collection, filter, projection, FindOptions{}, loadBinaries);
+}
+
+std::vector<repo::core::model::RepoBSON> EmbeddedDatabaseHandler::findAllByCriteria(
+	const std::string& database,
+	const std::string& collection,
+	const database::query::RepoQuery& filter,
+	const database::query::RepoQuery& projection,
+	const database::FindOptions& findOptions,
+	const bool loadBinaries/* = false*/)
+{
+	try
+	{
+		std::vector<repo::core::model::RepoBSON> data;
+		if (!Filter(filter).isEmpty() && !database.empty() && !collection.empty())
+		{
+			auto cursor = makeCursor(database, collection, filter, projection, findOptions);
+			for (auto bson : *cursor) {
+				if (loadBinaries)
+					loadBinaryBuffers(database, collection, bson);
+
+				data.push_back(bson);
+			}
+		}
+		return data;
+	}
+	catch (...)
+	{
+		std::throw_with_nested(EmbeddedDatabaseHandlerException(*this, "findAllByCriteria", database, collection));
+	}
+}
+
+std::unique_ptr<Cursor> EmbeddedDatabaseHandler::findCursorByCriteria(
+	const std::string& database,
+	const std::string& collection,
+	const database::query::RepoQuery& criteria)
+{
+	return findCursorByCriteria(database, collection, criteria, database::query::RepoProjectionBuilder{});
+}
+
+std::unique_ptr<Cursor> EmbeddedDatabaseHandler::findCursorByCriteria(
+	const std::string& database,
+	const std::string& collection,
+	const database::query::RepoQuery& filter,
+	const database::query::RepoQuery& projection)
+{
+	return findCursorByCriteria(database, collection, filter, projection, FindOptions{});
+}
+
+std::unique_ptr<Cursor> EmbeddedDatabaseHandler::findCursorByCriteria(
+	const std::string& database,
+	const std::string& collection,
+	const database::query::RepoQuery& filter,
+	const database::query::RepoQuery& projection,
+	const database::FindOptions& findOptions)
+{
+	try
+	{
+		if (!Filter(filter).isEmpty() && !database.empty() && !collection.empty())
+		{
+			return makeCursor(database, collection, filter, projection, findOptions);
+		}
+		else
+		{
+			throw EmbeddedDatabaseHandlerException("Invalid call to findCursorByCriteria; all of database, collection, and criteria must be provided.");
+		}
+	}
+	catch (...)
+	{
+		std::throw_with_nested(EmbeddedDatabaseHandlerException(*this, "findCursorByCriteria", database, collection));
+	}
+}
+
+repo::core::model::RepoBSON EmbeddedDatabaseHandler::findOneByCriteria(
+	const std::string& database,
+	const std::string& collection,
+	const database::query::RepoQuery& filter,
+	const std::string& sortField)
+{
+	FindOptions options;
+	options.sortField = sortField;
+	options.sortOrder = -1;
+	options.limit = 1;
+
+	auto results = findAllByCriteria(database, collection, filter, database::query::RepoProjectionBuilder{}, options);
+	return results.size() ? results[0] : repo::core::model::RepoBSON();
+}
+
+repo::core::model::RepoBSON EmbeddedDatabaseHandler::findOneBySharedID(
+	const std::string& database,
+	const std::string& collection,
+	const repo::lib::RepoUUID& uuid,
+	const std::string& sortField)
+{
+	return findOneByCriteria(database, collection, database::query::Eq(REPO_NODE_LABEL_SHARED_ID, uuid), sortField);
+}
+
+repo::core::model::RepoBSON EmbeddedDatabaseHandler::findOneByUniqueID(
+	const std::string& database,
+	const std::string& collection,
+	const repo::lib::RepoUUID& id)
+{
+	return findOneByCriteria(database, collection, database::query::Eq(REPO_LABEL_ID, id));
+}
+
+repo::core::model::RepoBSON EmbeddedDatabaseHandler::findOneByUniqueID(
+	const std::string& database,
+	const std::string& collection,
+	const std::string& id)
+{
+	return findOneByCriteria(database, collection, database::query::Eq(REPO_LABEL_ID, id));
+}
+
+std::vector<repo::core::model::RepoBSON>
+EmbeddedDatabaseHandler::getAllFromCollectionTailable(
+	const std::string                             &database,
+	const std::string                             &collection,
+	const uint64_t                                &skip,
+	const uint32_t                                &limit,
+	const std::list<std::string>				  &fields,
+	const std::string							  &sortField,
+	const int									  &sortOrder)
+{
+	try
+	{
+		std::vector<repo::core::model::RepoBSON> bsons;
+
+		if (database.empty() || collection.empty())
+		{
+			return bsons;
+		}
+
+		query::RepoProjectionBuilder projection;
+		for (auto& f : fields) {
+			projection.includeField(f);
+		}
+
+		FindOptions options;
+		options.sortField = sortField;
+		options.sortOrder = sortOrder;
+		options.limit = limit ? skip + limit : 0;
+
+		auto cursor = makeCursor(database, collection, query::RepoQueryBuilder{}, projection, options);
+		uint64_t i = 0;
+		for (auto bson : *cursor) {
+			if (i++ >= skip) {
+				bsons.push_back(bson);
+			}
+		}
+
+		return bsons;
+	}
+	catch (...)
+	{
+		std::throw_with_nested(EmbeddedDatabaseHandlerException(*this, "getAllFromCollectionTailable", database, collection));
+	}
+}
+
+std::list<std::string> EmbeddedDatabaseHandler::getCollections(
+	const std::string &database)
+{
+	try
+	{
+		std::list<std::string> names;
+		if (database.empty())
+		{
+			return names;
+		}
+
+		checkName(database);
+		auto directory = root / database;
+		if (std::filesystem::is_directory(directory)) {
+			for (auto& entry : std::filesystem::directory_iterator(directory)) {
+				if (entry.is_regular_file() && entry.path().extension() == LOG_EXTENSION) {
+					names.push_back(entry.path().stem().string());
+				}
+			}
+		}
+
+		return names;
+	}
+	catch (...)
+	{
+		std::throw_with_nested(EmbeddedDatabaseHandlerException(*this, "getCollections", database));
+	}
+}
+
+size_t EmbeddedDatabaseHandler::count(
+	const std::string& database,
+	const std::string& collection,
+	const database::query::RepoQuery& criteria)
+{
+	try
+	{
+		return makeCursor(database, collection, criteria, query::RepoProjectionBuilder{}, FindOptions{})->count();
+	}
+	catch (...)
+	{
+		std::throw_with_nested(EmbeddedDatabaseHandlerException(*this, "count", database, collection));
+	}
+}
+
+std::unique_ptr<database::BulkWriteContext> EmbeddedDatabaseHandler::getBulkWriteContext(
+	const std::string& database,
+	const std::string& collection)
+{
+	return std::make_unique<EmbeddedWriteContext>(this, database, collection);
+}
\ No newline at end of file
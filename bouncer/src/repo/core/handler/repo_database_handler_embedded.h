@@ -0,0 +1,256 @@
+/**
+*  Copyright (C) 2025 3D Repo Ltd
+*
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU Affero General Public License as
+*  published by the Free Software Foundation, either version 3 of the
+*  License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Affero General Public License for more details.
+*
+*  You should have received a copy of the GNU Affero General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+*  Embedded database handler
+*/
+
+#pragma once
+
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <filesystem>
+
+#include "repo_database_handler_abstract.h"
+
+#include <bsoncxx/document/view-fwd.hpp>
+
+namespace repo {
+	namespace core {
+		namespace model {
+			class RepoBSON; // Forward declaration for document type
+		}
+		namespace handler {
+			namespace fileservice {
+				class FileManager;
+			}
+
+			/*
+			* EmbeddedDatabaseHandler keeps the collections in local files instead of
+			* on a database server, so jobs that only transform one revision can run
+			* without any network round trips.
+			*
+			* Each collection is an append-only log of BSON documents. Inserts, updates
+			* and deletes all append a record, and the last record for a given _id wins.
+			* The handler maintains indexes on _id, shared_id and rev_id, which are held
+			* in memory and written next to the log, along with the length of the log
+			* they cover, so opening a collection only needs to replay what was written
+			* after they were last saved. Queries that cannot use the indexes scan the
+			* log.
+			*
+			* Binary data goes to the blob files of the FileManager, the same as for
+			* the MongoDatabaseHandler.
+			*/
+
+			// This class is considered thread-safe.
+			class EmbeddedDatabaseHandler : public AbstractDatabaseHandler {
+			public:
+
+				/**
+				* @param directory the directory under which the databases are stored.
+				* It will be created if it does not exist.
+				*/
+				EmbeddedDatabaseHandler(const std::string& directory);
+
+				~EmbeddedDatabaseHandler();
+
+				/**
+				 * Returns a new instance of EmbeddedDatabaseHandler
+				 * @param directory the directory under which the databases are stored
+				 */
+				static std::shared_ptr<EmbeddedDatabaseHandler> getHandler(
+					const std::string& directory
+				);
+
+				/*
+				*	------------- Database info lookup --------------
+				*/
+
+				std::vector<repo::core::model::RepoBSON>
+					getAllFromCollectionTailable(
+						const std::string                             &database,
+						const std::string                             &collection,
+						const uint64_t                                &skip = 0,
+						const uint32_t								  &limit = 0,
+						const std::list<std::string>				  &fields = std::list<std::string>(),
+						const std::string							  &sortField = std::string(),
+						const int									  &sortOrder = -1);
+
+				std::list<std::string> getCollections(const std::string &database);
+
+				/*
+				*	------------- Database operations (insert/delete/update) --------------
+				*/
+
+				/**
+				* The indexes of the embedded handler are fixed, so these only log the
+				* request.
+				*/
+				virtual void createIndex(const std::string &database, const std::string &collection, const database::index::RepoIndex& index);
+
+				virtual void createIndex(const std::string& database, const std::string& collection, const database::index::RepoIndex& index, bool sparse, bool suppressInfo = false);
+
+				void dropCollection(
+					const std::string &database,
+					const std::string &collection);
+
+				void dropDocument(
+					const repo::core::model::RepoBSON bson,
+					const std::string &database,
+					const std::string &collection);
+
+				void insertDocument(
+					const std::string &database,
+					const std::string &collection,
+					const repo::core::model::RepoBSON &obj);
+
+				virtual void insertManyDocuments(
+					const std::string &database,
+					const std::string &collection,
+					const std::vector<repo::core::model::RepoBSON> &obj,
+					const Metadata& metadata = {});
+
+				void upsertDocument(
+					const std::string &database,
+					const std::string &collection,
+					const repo::core::model::RepoBSON &obj,
+					const bool        &overwrite);
+
+				/*
+				*	------------- Query operations --------------
+				*/
+
+				std::vector<repo::core::model::RepoBSON> findAllByCriteria(
+					const std::string& database,
+					const std::string& collection,
+					const database::query::RepoQuery& criteria,
+					const bool loadBinaries = false);
+
+				std::vector<repo::core::model::RepoBSON> findAllByCriteria(
+					const std::string& database,
+					const std::string& collection,
+					const database::query::RepoQuery& filter,
+					const database::query::RepoQuery& projection,
+					const bool loadBinaries = false);
+
+				std::vector<repo::core::model::RepoBSON> findAllByCriteria(
+					const std::string& database,
+					const std::string& collection,
+					const database::query::RepoQuery& filter,
+					const database::query::RepoQuery& projection,
+					const database::FindOptions& options,
+					const bool loadBinaries = false);
+
+				std::unique_ptr<database::Cursor> findCursorByCriteria(
+					const std::string& database,
+					const std::string& collection,
+					const database::query::RepoQuery& criteria);
+
+				std::unique_ptr<database::Cursor> findCursorByCriteria(
+					const std::string& database,
+					const std::string& collection,
+					const database::query::RepoQuery& filter,
+					const database::query::RepoQuery& projection);
+
+				/**
+				* Unless the results are sorted, the documents are read from the log as
+				* the cursor is iterated, so the batch size has no effect.
+				*/
+				std::unique_ptr<database::Cursor> findCursorByCriteria(
+					const std::string& database,
+					const std::string& collection,
+					const database::query::RepoQuery& filter,
+					const database::query::RepoQuery& projection,
+					const database::FindOptions& options);
+
+				repo::core::model::RepoBSON findOneByCriteria(
+					const std::string& database,
+					const std::string& collection,
+					const database::query::RepoQuery& criteria,
+					const std::string& sortField = ""
+				);
+
+				repo::core::model::RepoBSON findOneBySharedID(
+					const std::string& database,
+					const std::string& collection,
+					const repo::lib::RepoUUID& uuid,
+					const std::string& sortField);
+
+				repo::core::model::RepoBSON findOneByUniqueID(
+					const std::string& database,
+					const std::string& collection,
+					const repo::lib::RepoUUID& uuid);
+
+				repo::core::model::RepoBSON findOneByUniqueID(
+					const std::string& database,
+					const std::string& collection,
+					const std::string& id);
+
+				size_t count(
+					const std::string& database,
+					const std::string& collection,
+					const database::query::RepoQuery& criteria);
+
+				std::unique_ptr<database::BulkWriteContext> getBulkWriteContext(
+					const std::string& database,
+					const std::string& collection);
+
+				std::shared_ptr<repo::core::handler::fileservice::FileManager> getFileManager();
+
+				/*
+				* If a RepoBSON comes from somewhere else, populate the binaries.
+				*/
+				void loadBinaryBuffers(const std::string& database,
+					const std::string& collection,
+					repo::core::model::RepoBSON& bson);
+
+			private:
+				std::filesystem::path root;
+
+				class Collection;
+				class Filter;
+				class EmbeddedCursor;
+				class EmbeddedWriteContext;
+				class EmbeddedDatabaseHandlerException;
+				friend EmbeddedDatabaseHandlerException;
+
+				std::mutex collectionsMutex;
+				std::unordered_map<std::string, std::shared_ptr<Collection>> collections;
+
+				/*
+				* Returns the collection, opening it if this is the first time it has been
+				* used. Throws if the names cannot be used as file names.
+				*/
+				std::shared_ptr<Collection> getCollection(
+					const std::string& database,
+					const std::string& collection);
+
+				static bsoncxx::document::view getView(const repo::core::model::RepoBSON& bson);
+
+				std::unique_ptr<EmbeddedCursor> makeCursor(
+					const std::string& database,
+					const std::string& collection,
+					const database::query::RepoQuery& filter,
+					const database::query::RepoQuery& projection,
+					const database::FindOptions& options);
+			};
+		} /* namespace handler */
+	}
+}
\ No newline at end of file
@@ -449,11 +449,44 @@ std::vector<repo::core::model::RepoBSON> MongoDatabaseHandler::findAllByCriteria
 	return findAllByCriteria(database, collection, filter, database::query::RepoProjectionBuilder{}, loadBinaries);
 }
 
+/*
+* Builds the find options for a query. The projection is held by view, so
+* projectionBson must outlive the returned options.
+*/
+static mongocxx::options::find makeFindOptions(
+	const repo::core::model::RepoBSON& projectionBson,
+	const FindOptions& findOptions)
+{
+	mongocxx::options::find options;
+	options.projection(projectionBson.view());
+	if (!findOptions.sortField.empty()) {
+		options.sort(make_document(kvp(findOptions.sortField, findOptions.sortOrder)));
+	}
+	if (findOptions.limit) {
+		options.limit(findOptions.limit);
+	}
+	if (findOptions.batchSize) {
+		options.batch_size(findOptions.batchSize);
+	}
+	return options;
+}
+
+std::vector<repo::core::model::RepoBSON> MongoDatabaseHandler::findAllByCriteria(
+	const std::string& database,
+	const std::string& collection,
+	const database::query::RepoQuery& filter,
+	const database::query::RepoQuery& projection,
+	const bool loadBinaries/* = false*/)
+{
+	return findAllByCriteria(database, collection, filter, projection, FindOptions{}, loadBinaries);
+}
+
 std::vector<repo::core::model::RepoBSON> MongoDatabaseHandler::findAllByCriteria(
 	const std::string& database,
 	const std::string& collection,
 	const database::query::RepoQuery& filter,
 	const database::query::RepoQuery& projection,
+	const database::FindOptions& findOptions,
 	const bool loadBinaries/* = false*/)
 {
 	try
@@ -467,11 +500,10 @@ std::vector<repo::core::model::RepoBSON> MongoDatabaseHandler::findAllByCriteria
 			auto col = db.collection(collection);
 
 			repo::core::model::RepoBSON projectionBson = makeQueryFilterDocument(projection);
-			mongocxx::v_noabi::options::find options;
-			options.projection(projectionBson.view());
+			auto options = makeFindOptions(projectionBson, findOptions);
 
 			// Find all documents
-			auto cursor = col.find(criteria.view());
+			auto cursor = col.find(criteria.view(), options);
 			for (auto& doc : cursor) {
 				auto bson = repo::core::model::RepoBSON(doc);
 				if (loadBinaries)
@@ -902,6 +934,16 @@ std::unique_ptr<Cursor> repo::core::handler::MongoDatabaseHandler::findCursorByC
 	const std::string& collection,
 	const database::query::RepoQuery& filter,
 	const database::query::RepoQuery& projection)
+{
+	return findCursorByCriteria(database, collection, filter, projection, FindOptions{});
+}
+
+std::unique_ptr<Cursor> repo::core::handler::MongoDatabaseHandler::findCursorByCriteria(
+	const std::string& database,
+	const std::string& collection,
+	const database::query::RepoQuery& filter,
+	const database::query::RepoQuery& projection,
+	const database::FindOptions& findOptions)
 {
 	try
 	{
@@ -913,13 +955,12 @@ std::unique_ptr<Cursor> repo::core::handler::MongoDatabaseHandler::findCursorByC
 			auto col = db.collection(collection);
 
 			repo::core::model::RepoBSON projectionBson = makeQueryFilterDocument(projection);
-			mongocxx::v_noabi::options::find options;
-			options.projection(projectionBson.view());
+			auto options = makeFindOptions(projectionBson, findOptions);
 
 			// Find all documents and return cursor
 			// Some pointer magic, because we have to cast the mongo cursor to its base before returning it.
 			// Ownership will be the caller's after the two raw pointers go out of scope
-			MongoDatabaseHandler::MongoCursor* mongoCursor = new MongoDatabaseHandler::MongoCursor(std::move(col.find(criteria.view())), std::move(client), this);
+			MongoDatabaseHandler::MongoCursor* mongoCursor = new MongoDatabaseHandler::MongoCursor(std::move(col.find(criteria.view(), options)), std::move(client), this);
 			database::Cursor *baseCursor = mongoCursor;
 			return std::unique_ptr<database::Cursor>(baseCursor);
 		}
@@ -991,6 +1032,17 @@ public:
 		}
 	}
 
+	repo::core::model::RepoBSON insertBinary(const std::vector<uint8_t>& data) override
+	{
+		try {
+			return blobHandler.insertBinary(data).serialise();
+		}
+		catch (...)
+		{
+			std::throw_with_nested(MongoDatabaseHandlerException(std::string("MongoWriteContext::insertBinary on ") + collection.name().data()));
+		}
+	}
+
 	void updateDocument(const database::query::RepoUpdate& update) override
 	{
 		try {
@@ -275,6 +275,23 @@ namespace repo {
 					const database::query::RepoQuery& projection,
 					const bool loadBinaries = false);
 
+				/**
+				* Given a search criteria,  find all the documents that passes this query
+				* @param database name of database
+				* @param collection name of collection
+				* @param criteria search criteria in a bson object
+				* @param projection to define the fiels in the returned document
+				* @param options the sort order, limit and batch size of the query
+				* @return a vector of RepoBSON objects satisfy the given criteria
+				*/
+				std::vector<repo::core::model::RepoBSON> findAllByCriteria(
+					const std::string& database,
+					const std::string& collection,
+					const database::query::RepoQuery& filter,
+					const database::query::RepoQuery& projection,
+					const database::FindOptions& options,
+					const bool loadBinaries = false);
+
 				/**
 				* Given a search criteria,  find all the documents that passes this query
 				* @param database name of database
@@ -301,6 +318,22 @@ namespace repo {
 					const database::query::RepoQuery& filter,
 					const database::query::RepoQuery& projection);
 
+				/**
+				* Given a search criteria,  find all the documents that passes this query
+				* @param database name of database
+				* @param collection name of collection
+				* @param criteria search criteria in a bson object
+				* @param projection to define the fiels in the returned document
+				* @param options the sort order, limit and batch size of the query
+				* @return a MongoCursor allowing traversal of the documents that satisfy the given criteria
+				*/
+				std::unique_ptr<database::Cursor> findCursorByCriteria(
+					const std::string& database,
+					const std::string& collection,
+					const database::query::RepoQuery& filter,
+					const database::query::RepoQuery& projection,
+					const database::FindOptions& options);
+
 				/**
 				* Given a search criteria,  find one documents that passes this query
 				* @param database name of database
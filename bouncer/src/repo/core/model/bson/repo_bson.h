@@ -47,6 +47,7 @@ namespace repo {
 	namespace core {
 		namespace handler {
 			class MongoDatabaseHandler;
+			class EmbeddedDatabaseHandler;
 		}
 
 		namespace model {
@@ -54,6 +55,7 @@ namespace repo {
 			{
 				friend class RepoBSONBuilder;
 				friend class repo::core::handler::MongoDatabaseHandler;
+				friend class repo::core::handler::EmbeddedDatabaseHandler;
 
 			public:
 
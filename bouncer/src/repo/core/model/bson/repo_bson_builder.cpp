@@ -199,4 +199,14 @@ void RepoBSONBuilder::appendElementsUnique(RepoBSON bson)
 			view = core::view_document(); // If we change the document, we must update the view as the underlying memory may have moved
 		}
 	}
+}
+
+void RepoBSONBuilder::appendElements(RepoBSON bson, const std::set<std::string>& labels)
+{
+	for (auto& element : bson) {
+		if (labels.find(std::string(element.key().data(), element.key().size())) != labels.end()) {
+			key_view(element.key());
+			append(element.get_value());
+		}
+	}
 }
\ No newline at end of file
@@ -123,6 +123,12 @@ namespace repo {
 
 				void appendElementsUnique(RepoBSON bson);
 
+				/*
+				* Appends the fields of bson with the given labels. Labels that bson does
+				* not have are ignored.
+				*/
+				void appendElements(RepoBSON bson, const std::set<std::string>& labels);
+
 				void appendTimeStamp(std::string label);
 
 				void appendTime(std::string label, const tm& t);
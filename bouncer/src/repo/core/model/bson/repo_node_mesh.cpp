@@ -23,8 +23,15 @@
 #include "repo_node_mesh.h"
 #include "repo_bson_builder.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+
 using namespace repo::core::model;
 
+static std::atomic<bool> legacyFaces = false;
+
 MeshNode::MeshNode() :
 	RepoNode()
 {
@@ -60,34 +67,23 @@ void MeshNode::deserialise(RepoBSON& bson)
 
 	if (bson.hasBinField(REPO_NODE_MESH_LABEL_FACES) && bson.hasField(REPO_NODE_MESH_LABEL_FACES_COUNT))
 	{
-		std::vector <uint32_t> serializedFaces = std::vector<uint32_t>();
-		int32_t facesCount = bson.getIntField(REPO_NODE_MESH_LABEL_FACES_COUNT);
-		faces.reserve(facesCount);
-
-		bson.getBinaryFieldAsVector(REPO_NODE_MESH_LABEL_FACES, serializedFaces);
+		int32_t encoding = FaceEncoding::LEGACY;
+		if (bson.hasField(REPO_NODE_MESH_LABEL_FACES_ENCODING)) {
+			encoding = bson.getIntField(REPO_NODE_MESH_LABEL_FACES_ENCODING);
+		}
 
-		// Retrieve numbers of vertices for each face and subsequent
-		// indices into the vertex array.
-		// In API level 1, mesh is represented as
-		// [n1, v1, v2, ..., n2, v1, v2...]
+		// The faces are decoded straight from the binary held by the bson
 
-		int mNumIndicesIndex = 0;
-		while (serializedFaces.size() > mNumIndicesIndex)
+		auto& serialisedFaces = bson.getBinary(REPO_NODE_MESH_LABEL_FACES);
+		if (!deserialiseFaces(
+			serialisedFaces.data(),
+			serialisedFaces.size(),
+			encoding,
+			primitive,
+			bson.getIntField(REPO_NODE_MESH_LABEL_FACES_COUNT),
+			faces))
 		{
-			int mNumIndices = serializedFaces[mNumIndicesIndex];
-			if (serializedFaces.size() > mNumIndicesIndex + mNumIndices)
-			{
-				repo::lib::repo_face_t face;
-				face.resize(mNumIndices);
-				for (int i = 0; i < mNumIndices; ++i)
-					face[i] = serializedFaces[mNumIndicesIndex + 1 + i];
-				faces.push_back(face);
-				mNumIndicesIndex += mNumIndices + 1;
-			}
-			else
-			{
-				repoError << "Cannot copy all faces. Buffer size is smaller than expected!";
-			}
+			repoError << "Cannot copy all faces. Buffer size is smaller than expected!";
 		}
 	}
 
@@ -140,18 +136,35 @@ void appendVertices(RepoBSONBuilder& builder, const std::vector<repo::lib::RepoV
 	}
 }
 
+template<typename T>
+void appendFixedStrideFaces(RepoBSONBuilder& builder, const std::vector<repo::lib::repo_face_t>& faces, int stride)
+{
+	std::vector<T> indices(faces.size() * stride);
+	auto out = indices.data();
+	for (auto& face : faces) {
+		for (int i = 0; i < stride; i++) {
+			*out++ = (T)face[i];
+		}
+	}
+	builder.appendLargeArray(REPO_NODE_MESH_LABEL_FACES, indices);
+}
+
 void appendFaces(RepoBSONBuilder& builder, const std::vector<repo::lib::repo_face_t>& faces)
 {
 	if (faces.size() > 0)
 	{
 		builder.append(REPO_NODE_MESH_LABEL_FACES_COUNT, (int32_t)(faces.size()));
 
-		// In API LEVEL 1, faces are stored as
+		// Meshes of only lines or only triangles are stored with a fixed stride,
+		// and 16 bit indices if possible. Anything else, or everything if the
+		// legacy layout has been asked for, is stored as in API LEVEL 1, where
+		// faces are stored as
 		// [n1, v1, v2, ..., n2, v1, v2...]
 
 		MeshNode::Primitive primitive = MeshNode::Primitive::UNKNOWN;
+		bool uniform = true;
+		uint32_t maxIndex = 0;
 
-		std::vector<uint32_t> facesLevel1;
 		for (auto& face : faces) {
 			auto nIndices = face.size();
 			if (!nIndices)
@@ -169,6 +182,7 @@ void appendFaces(RepoBSONBuilder& builder, const std::vector<repo::lib::repo_fac
 				else // The primitive type is not one we support
 				{
 					repoWarning << "unsupported primitive type - only lines and triangles are supported but this face has " << nIndices << " indices!";
+					uniform = false;
 				}
 			}
 			else  // (otherwise check for consistency with the existing type)
@@ -176,18 +190,40 @@ void appendFaces(RepoBSONBuilder& builder, const std::vector<repo::lib::repo_fac
 				if (nIndices != static_cast<int>(primitive))
 				{
 					repoWarning << "mixing different primitives within a mesh is not supported!";
+					uniform = false;
 				}
 			}
-			facesLevel1.push_back(nIndices);
 			for (uint32_t ind = 0; ind < nIndices; ind++)
 			{
-				facesLevel1.push_back(face[ind]);
+				maxIndex = std::max(maxIndex, face[ind]);
 			}
 		}
 
 		builder.append(REPO_NODE_MESH_LABEL_PRIMITIVE, static_cast<int>(primitive));
 
-		builder.appendLargeArray(REPO_NODE_MESH_LABEL_FACES, facesLevel1);
+		if (uniform && primitive != MeshNode::Primitive::UNKNOWN && !legacyFaces)
+		{
+			if (maxIndex <= std::numeric_limits<uint16_t>::max()) {
+				builder.append(REPO_NODE_MESH_LABEL_FACES_ENCODING, (int32_t)(MeshNode::FIXED_STRIDE | MeshNode::INDEX_16));
+				appendFixedStrideFaces<uint16_t>(builder, faces, static_cast<int>(primitive));
+			}
+			else {
+				builder.append(REPO_NODE_MESH_LABEL_FACES_ENCODING, (int32_t)(MeshNode::FIXED_STRIDE));
+				appendFixedStrideFaces<uint32_t>(builder, faces, static_cast<int>(primitive));
+			}
+		}
+		else
+		{
+			std::vector<uint32_t> facesLevel1;
+			for (auto& face : faces) {
+				facesLevel1.push_back(face.size());
+				for (uint32_t ind = 0; ind < face.size(); ind++)
+				{
+					facesLevel1.push_back(face[ind]);
+				}
+			}
+			builder.appendLargeArray(REPO_NODE_MESH_LABEL_FACES, facesLevel1);
+		}
 	}
 }
 
@@ -255,6 +291,16 @@ void appendFilterTags(
 	builder.append(REPO_FILTER_OBJECT_NAME, matPropsBson.obj());
 }
 
+void MeshNode::setLegacyFaces(bool legacy)
+{
+	legacyFaces = legacy;
+}
+
+bool MeshNode::getLegacyFaces()
+{
+	return legacyFaces;
+}
+
 void MeshNode::serialise(repo::core::model::RepoBSONBuilder& builder) const
 {
 	RepoNode::serialise(builder);
@@ -318,12 +364,8 @@ void MeshNode::applyTransformation(
 {
 	if (!matrix.isIdentity())
 	{
-		boundingBox = repo::lib::RepoBounds();
-
-		for (auto& v : vertices) {
-			v = matrix * v;
-			boundingBox.encapsulate(v);
-		}
+		matrix.transformPoints(vertices, vertices);
+		updateBoundingBox();
 
 		transformNormals(normals, matrix);
 	}
@@ -367,13 +409,112 @@ void MeshNode::transformNormals(
 	data[3] = data[7] = data[11] = 0;
 	data[12] = data[13] = data[14] = 0;
 
+	worldMat.transformDirections(normals, normals);
+
 	for (auto& n : normals)
 	{
-		n = worldMat * n;
 		n.normalize();
 	}
 }
 
+namespace {
+	// Reads count faces of Stride indices of type T. The faces are written in
+	// place, and each is read with a single memcpy, so the buffer does not need
+	// to be aligned and the compiler can vectorise the widening.
+
+	template<typename T, int Stride>
+	void readFixedStrideFaces(const uint8_t* data, size_t count, repo::lib::repo_face_t* faces)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			T indices[Stride];
+			memcpy(indices, data + i * sizeof(indices), sizeof(indices));
+			auto& face = faces[i];
+			for (int j = 0; j < Stride; j++) {
+				face.indices[j] = indices[j];
+			}
+			face.sides = Stride;
+		}
+	}
+
+	template<typename T>
+	size_t readFixedStrideFaces(const uint8_t* data, size_t size, MeshNode::Primitive primitive, size_t count, std::vector<repo::lib::repo_face_t>& faces)
+	{
+		auto stride = static_cast<size_t>(primitive);
+		count = std::min(count, size / (stride * sizeof(T)));
+
+		auto offset = faces.size();
+		faces.resize(offset + count);
+
+		if (primitive == MeshNode::Primitive::TRIANGLES) {
+			readFixedStrideFaces<T, 3>(data, count, faces.data() + offset);
+		}
+		else {
+			readFixedStrideFaces<T, 2>(data, count, faces.data() + offset);
+		}
+
+		return count;
+	}
+}
+
+bool MeshNode::deserialiseFaces(
+	const uint8_t* data,
+	size_t size,
+	int32_t encoding,
+	Primitive primitive,
+	size_t count,
+	std::vector<repo::lib::repo_face_t>& faces)
+{
+	faces.reserve(faces.size() + count);
+
+	if (encoding & FaceEncoding::FIXED_STRIDE)
+	{
+		if (primitive != Primitive::LINES && primitive != Primitive::TRIANGLES)
+		{
+			repoError << "Fixed stride faces must be lines or triangles, but the primitive is " << static_cast<int>(primitive);
+			return false;
+		}
+
+		if (encoding & FaceEncoding::INDEX_16) {
+			return readFixedStrideFaces<uint16_t>(data, size, primitive, count, faces) == count;
+		}
+		else {
+			return readFixedStrideFaces<uint32_t>(data, size, primitive, count, faces) == count;
+		}
+	}
+
+	// Retrieve numbers of vertices for each face and subsequent
+	// indices into the vertex array.
+	// In API level 1, mesh is represented as
+	// [n1, v1, v2, ..., n2, v1, v2...]
+
+	auto numElements = size / sizeof(uint32_t);
+	auto readElement = [&](size_t index) {
+		uint32_t value;
+		memcpy(&value, data + index * sizeof(uint32_t), sizeof(uint32_t));
+		return value;
+	};
+
+	size_t mNumIndicesIndex = 0;
+	while (numElements > mNumIndicesIndex)
+	{
+		auto mNumIndices = readElement(mNumIndicesIndex);
+		if (mNumIndices > 3 || numElements <= mNumIndicesIndex + mNumIndices)
+		{
+			return false;
+		}
+
+		repo::lib::repo_face_t face;
+		face.resize(mNumIndices);
+		for (uint32_t i = 0; i < mNumIndices; ++i)
+			face[i] = readElement(mNumIndicesIndex + 1 + i);
+		faces.push_back(face);
+		mNumIndicesIndex += mNumIndices + 1;
+	}
+
+	return true;
+}
+
 uint32_t MeshNode::getMFormat(const bool isTransparent, const bool isInvisibleDefault) const
 {
 	/*
@@ -441,6 +582,25 @@ size_t MeshNode::getSize() const
 	return size;
 }
 
+void MeshNode::swapGeometry(MeshNode& other)
+{
+	std::swap(primitive, other.primitive);
+	faces.swap(other.faces);
+	vertices.swap(other.vertices);
+	normals.swap(other.normals);
+	channels.swap(other.channels);
+}
+
+void MeshNode::unloadGeometry()
+{
+	// Swap rather than clear so the capacity is released too
+
+	std::vector<repo::lib::repo_face_t>().swap(faces);
+	std::vector<repo::lib::RepoVector3D>().swap(vertices);
+	std::vector<repo::lib::RepoVector3D>().swap(normals);
+	std::vector<std::vector<repo::lib::RepoVector2D>>().swap(channels);
+}
+
 // Common constant used to get good hash scattering
 #define GOLDEN_RATIO 0x9e3779b9
 
@@ -39,6 +39,7 @@ namespace repo {
 #define REPO_NODE_MESH_LABEL_FACES					"faces" //<! faces array label
 #define REPO_NODE_MESH_LABEL_FACES_COUNT				"faces_count" //<! number of faces
 #define REPO_NODE_MESH_LABEL_FACES_BYTE_COUNT		"faces_byte_count"
+#define REPO_NODE_MESH_LABEL_FACES_ENCODING			"faces_encoding" //<! layout of the faces array, if not count prefixed
 			//------------------------------------------------------------------------------
 #define REPO_NODE_MESH_LABEL_NORMALS					"normals" //!< normals array label
 			//------------------------------------------------------------------------------
@@ -82,6 +83,22 @@ namespace repo {
 					TEXTUREDMAT = 3
 				};
 
+				/*
+				* The layout of the faces binary. In the original (API level 1) layout,
+				* each face is prefixed by its number of indices. Documents in this
+				* layout have no faces_encoding field.
+				* Meshes made of only lines or only triangles are written without the
+				* prefixes instead, with the stride given by the primitive. The flags
+				* say that the layout is fixed-stride, and whether the indices are 16 or
+				* 32 bit unsigned integers. The smaller type is used whenever all the
+				* indices fit.
+				*/
+				enum FaceEncoding : int32_t {
+					LEGACY = 0,
+					FIXED_STRIDE = 1 << 0,
+					INDEX_16 = 1 << 1,
+				};
+
 				/**
 				* Default constructor
 				*/
@@ -314,6 +331,19 @@ namespace repo {
 
 				size_t getSize() const;
 
+				/*
+				* Swaps the faces (and their primitive type), vertices, normals and uv
+				* channels of this node with those of another. The other properties,
+				* such as the bounds, are kept.
+				*/
+				void swapGeometry(MeshNode& other);
+
+				/*
+				* Releases the memory held by the faces, vertices, normals and uv
+				* channels, keeping the other properties such as the bounds.
+				*/
+				void unloadGeometry();
+
 				void updateBoundingBox();
 
 				/*
@@ -325,6 +355,31 @@ namespace repo {
 				static void transformBoundingBox(repo::lib::RepoBounds& bounds, const repo::lib::RepoMatrix& matrix);
 
 				static void transformNormals(std::vector<repo::lib::RepoVector3D>& normals, const repo::lib::RepoMatrix& matrix);
+
+				/*
+				* Decodes a faces binary written with any FaceEncoding into faces. The
+				* buffer does not need to be aligned. Returns false if the buffer does
+				* not hold as many faces as it should, in which case faces holds those
+				* that could be read.
+				*/
+				static bool deserialiseFaces(
+					const uint8_t* data,
+					size_t size,
+					int32_t encoding,
+					Primitive primitive,
+					size_t count,
+					std::vector<repo::lib::repo_face_t>& faces);
+
+				/*
+				* When set, all meshes serialised by this process write their faces in
+				* the LEGACY layout, with no faces_encoding field, so they can be read
+				* by versions of bouncer that predate the fixed-stride layout. This is
+				* off by default, and is set from RepoConfig when the manipulator is
+				* initialised.
+				*/
+				static void setLegacyFaces(bool legacy);
+
+				static bool getLegacyFaces();
 			};
 		} //namespace model
 	} //namespace core
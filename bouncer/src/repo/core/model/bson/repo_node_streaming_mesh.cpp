@@ -17,92 +17,110 @@
 
 #include "repo_node_streaming_mesh.h"
 
-repo::core::model::StreamingMeshNode::SupermeshingData::SupermeshingData(const repo::core::model::RepoBSON& bson, const std::vector<uint8_t>& buffer, const bool ignoreUVs)
+repo::core::model::StreamingMeshNode::SupermeshingData::SupermeshingData(const repo::core::model::RepoBSON& bson, const uint8_t* buffer, size_t bufferSize, const bool ignoreUVs)
 {
 	this->uniqueId = bson.getUUIDField(REPO_NODE_LABEL_ID);
-	deserialise(bson, buffer, ignoreUVs);
+	deserialise(bson, buffer, bufferSize, ignoreUVs);
 }
 
 void repo::core::model::StreamingMeshNode::SupermeshingData::bakeMeshes(const repo::lib::RepoMatrix& transform)
 {
-	// Vertices
-	for (int i = 0; i < vertices.size(); i++) {
-		vertices[i] = transform * vertices[i];
+	// Vertices. If they are still in the buffer, they are transformed as they
+	// are read, otherwise they are transformed in place. The buffer can only be
+	// read directly if it is suitably aligned.
+
+	if (vertexView.data && ((uintptr_t)vertexView.data % alignof(repo::lib::RepoVector3D)) == 0) {
+		vertices.resize(vertexView.count);
+		transform.transformPoints({ (const repo::lib::RepoVector3D*)vertexView.data, vertexView.count }, vertices);
+		vertexView = {};
+	}
+	else {
+		read();
+		transform.transformPoints(vertices, vertices);
 	}
 
 	// Normals
+	read();
 	repo::core::model::MeshNode::transformNormals(normals, transform);
 }
 
-void repo::core::model::StreamingMeshNode::SupermeshingData::deserialise(const repo::core::model::RepoBSON& bson, const std::vector<uint8_t>& buffer, const bool ignoreUVs)
+void repo::core::model::StreamingMeshNode::SupermeshingData::read()
+{
+	if (vertexView.data) {
+		vertices.resize(vertexView.count);
+		memcpy(vertices.data(), vertexView.data, vertexView.count * sizeof(repo::lib::RepoVector3D));
+		vertexView = {};
+	}
+	if (normalView.data) {
+		normals.resize(normalView.count);
+		memcpy(normals.data(), normalView.data, normalView.count * sizeof(repo::lib::RepoVector3D));
+		normalView = {};
+	}
+}
+
+void repo::core::model::StreamingMeshNode::SupermeshingData::deserialise(const repo::core::model::RepoBSON& bson, const uint8_t* buffer, size_t bufferSize, const bool ignoreUVs)
 {
 	auto blobRefBson = bson.getObjectField(REPO_LABEL_BINARY_REFERENCE);
 	auto elementsBson = blobRefBson.getObjectField(REPO_LABEL_BINARY_ELEMENTS);
 
 	if (elementsBson.hasField(REPO_NODE_MESH_LABEL_VERTICES)) {
 		auto vertBson = elementsBson.getObjectField(REPO_NODE_MESH_LABEL_VERTICES);
-		deserialiseVector(vertBson, buffer, vertices);
+		vertexView = getView<repo::lib::RepoVector3D>(vertBson, buffer, bufferSize);
 	}
 
 	if (elementsBson.hasField(REPO_NODE_MESH_LABEL_NORMALS)) {
 		auto normBson = elementsBson.getObjectField(REPO_NODE_MESH_LABEL_NORMALS);
-		deserialiseVector(normBson, buffer, normals);
+		normalView = getView<repo::lib::RepoVector3D>(normBson, buffer, bufferSize);
 	}
 
 	if (elementsBson.hasField(REPO_NODE_MESH_LABEL_FACES)) {
 
 		int32_t faceCount = bson.getIntField(REPO_NODE_MESH_LABEL_FACES_COUNT);
-		faces.reserve(faceCount);
 
-		std::vector<uint32_t> serialisedFaces = std::vector<uint32_t>();
-		auto faceBson = elementsBson.getObjectField(REPO_NODE_MESH_LABEL_FACES);
-		deserialiseVector(faceBson, buffer, serialisedFaces);
+		int32_t encoding = repo::core::model::MeshNode::FaceEncoding::LEGACY;
+		if (bson.hasField(REPO_NODE_MESH_LABEL_FACES_ENCODING)) {
+			encoding = bson.getIntField(REPO_NODE_MESH_LABEL_FACES_ENCODING);
+		}
 
-		// Retrieve numbers of vertices for each face and subsequent
-		// indices into the vertex array.
-		// In API level 1, mesh is represented as
-		// [n1, v1, v2, ..., n2, v1, v2...]
+		auto primitive = repo::core::model::MeshNode::Primitive::TRIANGLES;
+		if (bson.hasField(REPO_NODE_MESH_LABEL_PRIMITIVE)) {
+			primitive = static_cast<repo::core::model::MeshNode::Primitive>(bson.getIntField(REPO_NODE_MESH_LABEL_PRIMITIVE));
+		}
 
-		int mNumIndicesIndex = 0;
-		while (serialisedFaces.size() > mNumIndicesIndex)
+		// The faces are parsed directly from the buffer
+		auto faceBson = elementsBson.getObjectField(REPO_NODE_MESH_LABEL_FACES);
+		auto serialisedFaces = getView<uint8_t>(faceBson, buffer, bufferSize);
+
+		if (!repo::core::model::MeshNode::deserialiseFaces(
+			serialisedFaces.data,
+			serialisedFaces.count,
+			encoding,
+			primitive,
+			faceCount,
+			faces))
 		{
-			int mNumIndices = serialisedFaces[mNumIndicesIndex];
-			if (serialisedFaces.size() > mNumIndicesIndex + mNumIndices)
-			{
-				repo::lib::repo_face_t face;
-				face.resize(mNumIndices);
-				for (int i = 0; i < mNumIndices; ++i)
-					face[i] = serialisedFaces[mNumIndicesIndex + 1 + i];
-				faces.push_back(face);
-				mNumIndicesIndex += mNumIndices + 1;
-			}
-			else
-			{
-				repoError << "Cannot copy all faces. Buffer size is smaller than expected!";
-			}
+			repoError << "Cannot copy all faces. Buffer size is smaller than expected!";
 		}
 
 	}
 
 	if (!ignoreUVs && elementsBson.hasField(REPO_NODE_MESH_LABEL_UV_CHANNELS)) {
-		std::vector<repo::lib::RepoVector2D> serialisedChannels;
 		auto uvBson = elementsBson.getObjectField(REPO_NODE_MESH_LABEL_UV_CHANNELS);
-		deserialiseVector(uvBson, buffer, serialisedChannels);
+		auto serialisedChannels = getView<repo::lib::RepoVector2D>(uvBson, buffer, bufferSize);
 
-		if (serialisedChannels.size())
+		if (serialisedChannels.count)
 		{
-			//get number of channels and split the serialised.
+			//get number of channels and split the serialised, copying each
+			//channel straight out of the buffer.
 			uint32_t nChannels = bson.getIntField(REPO_NODE_MESH_LABEL_UV_CHANNELS_COUNT);
-			uint32_t vecPerChannel = serialisedChannels.size() / nChannels;
-			channels.reserve(nChannels);
+			uint32_t vecPerChannel = serialisedChannels.count / nChannels;
+			channels.resize(nChannels);
 			for (uint32_t i = 0; i < nChannels; i++)
 			{
-				channels.push_back(std::vector<repo::lib::RepoVector2D>());
-				channels[i].reserve(vecPerChannel);
-
-				uint32_t offset = i * vecPerChannel;
-				channels[i].insert(channels[i].begin(), serialisedChannels.begin() + offset,
-					serialisedChannels.begin() + offset + vecPerChannel);
+				channels[i].resize(vecPerChannel);
+				memcpy(channels[i].data(),
+					serialisedChannels.data + (size_t)i * vecPerChannel * sizeof(repo::lib::RepoVector2D),
+					vecPerChannel * sizeof(repo::lib::RepoVector2D));
 			}
 		}
 	}
@@ -136,7 +154,21 @@ void repo::core::model::StreamingMeshNode::loadSupermeshingData(const repo::core
 		unloadSupermeshingData();
 	}
 
-	supermeshingData = std::make_unique<SupermeshingData>(bson, buffer, ignoreUVs);
+	// The caller's buffer is not guaranteed to outlive this call, so read the
+	// arrays straight away.
+	supermeshingData = std::make_unique<SupermeshingData>(bson, buffer.data(), buffer.size(), ignoreUVs);
+	supermeshingData->read();
+}
+
+void repo::core::model::StreamingMeshNode::loadSupermeshingData(const repo::core::model::RepoBSON& bson, const uint8_t* buffer, size_t bufferSize, const bool ignoreUVs)
+{
+	if (supermeshingDataLoaded())
+	{
+		repoWarning << "StreamingMeshNode instructed to load geometry data, but geometry data is already loaded.";
+		unloadSupermeshingData();
+	}
+
+	supermeshingData = std::make_unique<SupermeshingData>(bson, buffer, bufferSize, ignoreUVs);
 }
 
 void repo::core::model::StreamingMeshNode::assertSupermeshingDataLoaded() {
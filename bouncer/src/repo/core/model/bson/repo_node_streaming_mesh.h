@@ -22,12 +22,23 @@
 #include <repo/lib/datastructure/repo_matrix.h>
 #include <repo/core/model/bson/repo_bson.h>
 #include <repo/core/model/bson/repo_node_mesh.h>
+#include <repo/lib/repo_exception.h>
+
+#include <cstring>
 
 namespace repo {
 	namespace core {
 		namespace model {
 			class StreamingMeshNode {
 
+				/*
+				* The geometry of a mesh node, read from its binary buffer. To avoid copying
+				* the geometry more than necessary, the vertices and normals are not read
+				* until the mesh is baked (or they are first accessed), at which point they
+				* are transformed directly from the buffer into their final arrays. This
+				* means the buffer must outlive the SupermeshingData, or at least remain
+				* valid until baking.
+				*/
 				class SupermeshingData {
 
 					repo::lib::RepoUUID uniqueId;
@@ -38,10 +49,22 @@ namespace repo {
 					std::vector<repo::lib::RepoVector3D> normals;
 					std::vector<std::vector<repo::lib::RepoVector2D>> channels;
 
+					// The locations of the vertex and normal arrays in the buffer, before
+					// they have been read.
+
+					struct View {
+						const uint8_t* data = nullptr;
+						size_t count = 0;
+					};
+
+					View vertexView;
+					View normalView;
+
 				public:
 					SupermeshingData(
 						const repo::core::model::RepoBSON& bson,
-						const std::vector<uint8_t>& buffer,
+						const uint8_t* buffer,
+						size_t bufferSize,
 						const bool ignoreUVs);
 
 					repo::lib::RepoUUID getUniqueId() const {
@@ -57,16 +80,18 @@ namespace repo {
 					}
 
 					std::uint32_t getNumVertices() const {
-						return vertices.size();
+						return vertexView.data ? vertexView.count : vertices.size();
 					}
-					const std::vector<repo::lib::RepoVector3D>& getVertices() const {
+					const std::vector<repo::lib::RepoVector3D>& getVertices() {
+						read();
 						return vertices;
 					}
 
 					void bakeMeshes(const repo::lib::RepoMatrix& transform);
 
-					const std::vector<repo::lib::RepoVector3D>& getNormals() const
+					const std::vector<repo::lib::RepoVector3D>& getNormals()
 					{
+						read();
 						return normals;
 					}
 
@@ -75,23 +100,37 @@ namespace repo {
 						return channels;
 					}
 
+					/*
+					* Reads any arrays still held as views into the buffer. After this, the
+					* buffer is no longer required.
+					*/
+					void read();
+
 				private:
 					void deserialise(
 						const repo::core::model::RepoBSON& bson,
-						const std::vector<uint8_t>& buffer,
+						const uint8_t* buffer,
+						size_t bufferSize,
 						const bool ignoreUVs);
 
+					/*
+					* Gets the location of an array in the buffer. The array may not be
+					* aligned for T, so the elements must be read with memcpy.
+					*/
 					template <class T>
-					void deserialiseVector(
+					View getView(
 						const repo::core::model::RepoBSON& bson,
-						const std::vector<uint8_t>& buffer,
-						std::vector<T>& vec)
+						const uint8_t* buffer,
+						size_t bufferSize)
 					{
 						auto start = bson.getLongField(REPO_LABEL_BINARY_START);
 						auto size = bson.getLongField(REPO_LABEL_BINARY_SIZE);
 
-						vec.resize(size / sizeof(T));
-						memcpy(vec.data(), buffer.data() + (sizeof(uint8_t) * start), size);
+						if (start < 0 || size < 0 || (size_t)(start + size) > bufferSize) {
+							throw repo::lib::RepoException("Binary reference is outside the bounds of the buffer.");
+						}
+
+						return { buffer + start, size / sizeof(T) };
 					}
 				};
 
@@ -125,6 +164,17 @@ namespace repo {
 					const std::vector<uint8_t>& buffer,
 					const bool ignoreUVs);
 
+				/*
+				* Loads the supermeshing data without copying the vertices or normals from
+				* the buffer until bakeLoadedMeshes is called, so the buffer must remain
+				* valid until then.
+				*/
+				void loadSupermeshingData(
+					const repo::core::model::RepoBSON& bson,
+					const uint8_t* buffer,
+					size_t bufferSize,
+					const bool ignoreUVs);
+
 				void unloadSupermeshingData() {
 					supermeshingData.reset();
 				}
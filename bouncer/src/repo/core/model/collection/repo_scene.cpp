@@ -1121,15 +1121,71 @@ bool RepoScene::loadScene(
 		if (!loadRevision(handler, errMsg)) return false;
 	}
 
-	std::vector<RepoBSON> nodes = handler->findAllByCriteria(
-		databaseName, projectName + "." + REPO_COLLECTION_SCENE, core::handler::database::query::Eq(REPO_NODE_STASH_REF, revNode->getUniqueID()), true
-	);
+	auto collection = projectName + "." + REPO_COLLECTION_SCENE;
+	auto filter = core::handler::database::query::Eq(REPO_NODE_STASH_REF, revNode->getUniqueID());
 
-	repoInfo << "# of nodes in this unoptimised scene = " << nodes.size();
+	std::vector<RepoBSON> nodes;
+	if (lazyLoading)
+	{
+		// Only the skeleton of the graph is read up-front. The binary buffers
+		// are not loaded, and the geometry is read one node at a time, through
+		// the geometry loader, by those that need it.
+
+		repo::core::handler::database::query::RepoProjectionBuilder projection;
+		projection.includeField(REPO_NODE_LABEL_ID);
+		projection.includeField(REPO_NODE_LABEL_SHARED_ID);
+		projection.includeField(REPO_NODE_LABEL_PARENTS);
+		projection.includeField(REPO_NODE_LABEL_TYPE);
+		projection.includeField(REPO_NODE_LABEL_NAME);
+		projection.includeField(REPO_NODE_MESH_LABEL_BOUNDING_BOX);
+		projection.includeField(REPO_NODE_LABEL_MATRIX);
+
+		nodes = handler->findAllByCriteria(databaseName, collection, filter, projection);
+
+		if (!geometryLoader)
+		{
+			auto database = databaseName;
+			geometryLoader = [handler, database, collection](const MeshNode& node) {
+				auto bson = handler->findOneByUniqueID(database, collection, node.getUniqueID());
+				handler->loadBinaryBuffers(database, collection, bson);
+				return MeshNode(bson);
+			};
+		}
+	}
+	else
+	{
+		nodes = handler->findAllByCriteria(databaseName, collection, filter, true);
+	}
+
+	repoInfo << "# of nodes in this unoptimised scene = " << nodes.size() << (lazyLoading ? " (lazy)" : "");
 
 	return populate(GraphType::DEFAULT, handler, nodes, errMsg);
 }
 
+void RepoScene::loadGeometry(MeshNode* node) const
+{
+	if (!lazyLoading || !node || node->getNumVertices())
+	{
+		return;
+	}
+
+	if (!geometryLoader)
+	{
+		throw repo::lib::RepoException("Cannot load geometry for " + node->getUniqueID().toString() + ": the scene has no geometry loader.");
+	}
+
+	auto loaded = geometryLoader(*node);
+	node->swapGeometry(loaded);
+}
+
+void RepoScene::unloadGeometry(MeshNode* node) const
+{
+	if (lazyLoading && node)
+	{
+		node->unloadGeometry();
+	}
+}
+
 bool RepoScene::loadStash(
 	repo::core::handler::AbstractDatabaseHandler *handler,
 	std::string &errMsg) {
@@ -22,12 +22,14 @@
 #pragma once
 
 #include <unordered_map>
+#include <functional>
 
 #include "repo/core/handler/repo_database_handler_abstract.h"
 #include "repo/core/handler/fileservice/repo_file_manager.h"
 #include "repo/core/model/bson/repo_bson_sequence.h"
 #include "repo/core/model/bson/repo_bson_task.h"
 #include "repo/core/model/bson/repo_node.h"
+#include "repo/core/model/bson/repo_node_mesh.h"
 #include "repo/core/model/bson/repo_node_transformation.h"
 #include "repo/core/model/bson/repo_node_model_revision.h"
 #include "repo/lib/datastructure/repo_bounds.h"
@@ -132,6 +134,51 @@ namespace repo {
 					loadExtFiles = false;
 				}
 
+				/**
+				* Returns the geometry for a MeshNode of a lazily loaded scene. The
+				* loader is given the skeleton node and returns a node with the same
+				* id that has its faces, vertices, normals and uv channels populated.
+				*/
+				using GeometryLoader = std::function<MeshNode(const MeshNode&)>;
+
+				/**
+				* Puts the scene into lazy mode. In lazy mode, loadScene reads only the
+				* skeleton of the graph (ids, parents, type, name, bounds and matrices)
+				* and no binary buffers. The geometry of individual meshes can then be
+				* read on demand with loadGeometry, and released with unloadGeometry.
+				* Must be called before loadScene.
+				*/
+				void setLazyLoading() {
+					lazyLoading = true;
+				}
+
+				bool isLazy() const {
+					return lazyLoading;
+				}
+
+				/**
+				* Overrides the loader used by loadGeometry. By default, loadScene
+				* installs one that reads the node from the database handler it was
+				* given, so that handler must outlive the scene.
+				*/
+				void setGeometryLoader(const GeometryLoader& loader) {
+					geometryLoader = loader;
+				}
+
+				/**
+				* Populates the geometry of a mesh node of a lazily loaded scene. This
+				* does nothing if the scene is fully loaded or the node already has
+				* geometry. The loader may be called concurrently for different nodes.
+				*/
+				void loadGeometry(MeshNode* node) const;
+
+				/**
+				* Releases the geometry of a mesh node of a lazily loaded scene, leaving
+				* the skeleton. This does nothing if the scene is fully loaded, as the
+				* geometry could not be retrieved again.
+				*/
+				void unloadGeometry(MeshNode* node) const;
+
 				/**
 				* Check if default scene graph is missing texture
 				* @return returns true if missing textures
@@ -439,7 +486,8 @@ namespace repo {
 
 				/**
 				* Load Scene into Scene graph object base on the
-				* revision/branch setting.
+				* revision/branch setting. If the scene is in lazy mode
+				* (see setLazyLoading) only the skeleton is loaded.
 				* @param handler database handler to perform this action
 				* @param errMsg message if it failed
 				* @return return true upon success
@@ -1019,6 +1067,8 @@ namespace repo {
 				repoGraphInstance stashGraph; //current state of the optimized graph, given the branch/revision
 				uint16_t status = 0; //health of the scene, 0 denotes healthy
 				bool loadExtFiles = true;
+				bool lazyLoading = false;
+				GeometryLoader geometryLoader;
 			};
 		}//namespace graph
 	}//namespace manipulator
@@ -107,6 +107,7 @@
 #define REPO_COLLECTION_STASH_JSON      "stash.json_mpc"
 #define REPO_COLLECTION_STASH_UNITY     "stash.unity3d" // This collection is no longer used but may still exist in the database
 #define REPO_COLLECTION_STASH_BUNDLE    "stash.repobundles"
+#define REPO_COLLECTION_STASH_CLASH     "stash.clash"
 #define REPO_COLLECTION_EXT_REF         "ref"
 #define REPO_COLLECTION_SEQUENCE        "sequences"
 #define REPO_COLLECTION_TASK            "activities"
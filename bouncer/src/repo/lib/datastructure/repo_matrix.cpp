@@ -16,10 +16,206 @@
 */
 
 #include "repo_matrix.h"
+#include "repo/lib/repo_exception.h"
 #include <repo_log.h>
 
+#if defined(__x86_64__) || defined(_M_X64)
+#define REPO_MATRIX_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define REPO_TARGET_AVX2
+#else
+#define REPO_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define REPO_MATRIX_NEON
+#include <arm_neon.h>
+#endif
+
 using namespace repo::lib;
 
+/*
+* The batch transform kernels. Each vector is transformed as r = c0 * x + c1 * y
+* + c2 * z (+ c3), where cn are the columns of the matrix, accumulating in the
+* same order as operator* so the results are the same. The vector kernels
+* compute one vector per iteration across the rows, so they work on the arrays
+* of structures directly, without any gathering or shuffling. No fused
+* operations are used, as these would change the rounding.
+*
+* The AVX2 kernels are selected at runtime, so the build flags are unchanged.
+* NEON is always present on AArch64.
+*/
+
+namespace {
+
+	template<typename In, typename Out, bool Translate>
+	void transformScalar(const double* m, const In* in, Out* out, size_t count)
+	{
+		using OutT = decltype(out->x);
+		for (size_t i = 0; i < count; i++) {
+			const double x = in[i].x;
+			const double y = in[i].y;
+			const double z = in[i].z;
+			double rx = m[0] * x + m[1] * y + m[2] * z;
+			double ry = m[4] * x + m[5] * y + m[6] * z;
+			double rz = m[8] * x + m[9] * y + m[10] * z;
+			if constexpr (Translate) {
+				rx += m[3];
+				ry += m[7];
+				rz += m[11];
+			}
+			out[i].x = (OutT)rx;
+			out[i].y = (OutT)ry;
+			out[i].z = (OutT)rz;
+		}
+	}
+
+#ifdef REPO_MATRIX_AVX2
+
+	bool hasAvx2()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) {
+			return false;
+		}
+		__cpuid(info, 1);
+		bool osxsave = info[2] & (1 << 27);
+		bool avx = info[2] & (1 << 28);
+		if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return info[1] & (1 << 5);
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+
+	const bool AVX2 = hasAvx2();
+
+	REPO_TARGET_AVX2 inline void load(const repo::lib::RepoVector3D& v, __m256d& x, __m256d& y, __m256d& z)
+	{
+		x = _mm256_set1_pd(v.x);
+		y = _mm256_set1_pd(v.y);
+		z = _mm256_set1_pd(v.z);
+	}
+
+	REPO_TARGET_AVX2 inline void load(const repo::lib::RepoVector3D64& v, __m256d& x, __m256d& y, __m256d& z)
+	{
+		x = _mm256_broadcast_sd(&v.x);
+		y = _mm256_broadcast_sd(&v.y);
+		z = _mm256_broadcast_sd(&v.z);
+	}
+
+	// The stores are masked to three lanes so they never touch the next element,
+	// which, when transforming in place, has not been read yet.
+
+	REPO_TARGET_AVX2 inline void store(repo::lib::RepoVector3D& v, __m256d r)
+	{
+		_mm_maskstore_ps(&v.x, _mm_setr_epi32(-1, -1, -1, 0), _mm256_cvtpd_ps(r));
+	}
+
+	REPO_TARGET_AVX2 inline void store(repo::lib::RepoVector3D64& v, __m256d r)
+	{
+		_mm256_maskstore_pd(&v.x, _mm256_setr_epi64x(-1, -1, -1, 0), r);
+	}
+
+	template<typename In, typename Out, bool Translate>
+	REPO_TARGET_AVX2 void transformAvx2(const double* m, const In* in, Out* out, size_t count)
+	{
+		const __m256d c0 = _mm256_setr_pd(m[0], m[4], m[8], 0);
+		const __m256d c1 = _mm256_setr_pd(m[1], m[5], m[9], 0);
+		const __m256d c2 = _mm256_setr_pd(m[2], m[6], m[10], 0);
+		const __m256d c3 = _mm256_setr_pd(m[3], m[7], m[11], 0);
+		for (size_t i = 0; i < count; i++) {
+			__m256d x, y, z;
+			load(in[i], x, y, z);
+			__m256d r = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(c0, x), _mm256_mul_pd(c1, y)), _mm256_mul_pd(c2, z));
+			if constexpr (Translate) {
+				r = _mm256_add_pd(r, c3);
+			}
+			store(out[i], r);
+		}
+	}
+
+#endif
+
+#ifdef REPO_MATRIX_NEON
+
+	// Each result is held in two registers: xy and z, with the fourth lane unused.
+
+	inline void store(repo::lib::RepoVector3D& v, float64x2_t xy, float64x2_t z)
+	{
+		vst1_f32(&v.x, vcvt_f32_f64(xy));
+		v.z = (float)vgetq_lane_f64(z, 0);
+	}
+
+	inline void store(repo::lib::RepoVector3D64& v, float64x2_t xy, float64x2_t z)
+	{
+		vst1q_f64(&v.x, xy);
+		v.z = vgetq_lane_f64(z, 0);
+	}
+
+	template<typename In, typename Out, bool Translate>
+	void transformNeon(const double* m, const In* in, Out* out, size_t count)
+	{
+		const float64x2_t c0 = { m[0], m[4] }, c0z = { m[8], 0 };
+		const float64x2_t c1 = { m[1], m[5] }, c1z = { m[9], 0 };
+		const float64x2_t c2 = { m[2], m[6] }, c2z = { m[10], 0 };
+		const float64x2_t c3 = { m[3], m[7] }, c3z = { m[11], 0 };
+		for (size_t i = 0; i < count; i++) {
+			const double x = in[i].x;
+			const double y = in[i].y;
+			const double z = in[i].z;
+			float64x2_t rxy = vaddq_f64(vaddq_f64(vmulq_n_f64(c0, x), vmulq_n_f64(c1, y)), vmulq_n_f64(c2, z));
+			float64x2_t rz = vaddq_f64(vaddq_f64(vmulq_n_f64(c0z, x), vmulq_n_f64(c1z, y)), vmulq_n_f64(c2z, z));
+			if constexpr (Translate) {
+				rxy = vaddq_f64(rxy, c3);
+				rz = vaddq_f64(rz, c3z);
+			}
+			store(out[i], rxy, rz);
+		}
+	}
+
+#endif
+
+	template<bool Translate, typename In, typename Out>
+	void transform(const double* m, std::span<const In> in, std::span<Out> out)
+	{
+		if (out.size() < in.size()) {
+			throw repo::lib::RepoException("Output of batch transform is smaller than the input.");
+		}
+
+#if defined(REPO_MATRIX_AVX2)
+		if (AVX2) {
+			transformAvx2<In, Out, Translate>(m, in.data(), out.data(), in.size());
+			return;
+		}
+#elif defined(REPO_MATRIX_NEON)
+		transformNeon<In, Out, Translate>(m, in.data(), out.data(), in.size());
+		return;
+#endif
+
+		transformScalar<In, Out, Translate>(m, in.data(), out.data(), in.size());
+	}
+
+	template<typename T>
+	void checkProjection(const _RepoMatrix<T>& matrix)
+	{
+		auto mat = matrix.getData();
+		float sig = 1e-5;
+		if (fabs(mat[12]) > sig || fabs(mat[13]) > sig || fabs(mat[14]) > sig || fabs(mat[15] - 1) > sig)
+		{
+			repoWarning << "Potentially incorrect transformation : does not expect the last row to have values!";
+			repoWarning << matrix.toString();
+			exit(0);
+		}
+	}
+}
+
 template<typename T>
 _RepoMatrix<T>::_RepoMatrix() {
 
@@ -219,6 +415,46 @@ repo::lib::RepoVector3D64 _RepoMatrix<T>::transformDirection(const repo::lib::Re
 	return result;
 }
 
+template<typename T>
+void _RepoMatrix<T>::transformPoints(std::span<const repo::lib::RepoVector3D> in, std::span<repo::lib::RepoVector3D> out) const
+{
+	checkProjection(*this);
+	transform<true>(data, in, out);
+}
+
+template<typename T>
+void _RepoMatrix<T>::transformPoints(std::span<const repo::lib::RepoVector3D> in, std::span<repo::lib::RepoVector3D64> out) const
+{
+	checkProjection(*this);
+	transform<true>(data, in, out);
+}
+
+template<typename T>
+void _RepoMatrix<T>::transformPoints(std::span<const repo::lib::RepoVector3D64> in, std::span<repo::lib::RepoVector3D> out) const
+{
+	checkProjection(*this);
+	transform<true>(data, in, out);
+}
+
+template<typename T>
+void _RepoMatrix<T>::transformPoints(std::span<const repo::lib::RepoVector3D64> in, std::span<repo::lib::RepoVector3D64> out) const
+{
+	checkProjection(*this);
+	transform<true>(data, in, out);
+}
+
+template<typename T>
+void _RepoMatrix<T>::transformDirections(std::span<const repo::lib::RepoVector3D> in, std::span<repo::lib::RepoVector3D> out) const
+{
+	transform<false>(data, in, out);
+}
+
+template<typename T>
+void _RepoMatrix<T>::transformDirections(std::span<const repo::lib::RepoVector3D64> in, std::span<repo::lib::RepoVector3D64> out) const
+{
+	transform<false>(data, in, out);
+}
+
 template<typename T>
 std::string _RepoMatrix<T>::toString() const {
 	std::stringstream ss;
@@ -394,14 +630,7 @@ repo::lib::RepoVector3D repo::lib::operator*(const _RepoMatrix<T>& matrix, const
 	result.y = (float)(mat[4] * (double)vec.x + mat[5] * (double)vec.y + mat[6] * (double)vec.z + mat[7]);
 	result.z = (float)(mat[8] * (double)vec.x + mat[9] * (double)vec.y + mat[10] * (double)vec.z + mat[11]);
 
-	float sig = 1e-5;
-
-	if (fabs(mat[12]) > sig || fabs(mat[13]) > sig || fabs(mat[14]) > sig || fabs(mat[15] - 1) > sig)
-	{
-		repoWarning << "Potentially incorrect transformation : does not expect the last row to have values!";
-		repoWarning << matrix.toString();
-		exit(0);
-	}
+	checkProjection(matrix);
 
 	return result;
 }
@@ -423,14 +652,7 @@ repo::lib::RepoVector3D64 repo::lib::operator*(const _RepoMatrix<T>& matrix, con
 	result.y = mat[4] * vec.x + mat[5] * vec.y + mat[6] * vec.z + mat[7];
 	result.z = mat[8] * vec.x + mat[9] * vec.y + mat[10] * vec.z + mat[11];
 
-	float sig = 1e-5;
-
-	if (fabs(mat[12]) > sig || fabs(mat[13]) > sig || fabs(mat[14]) > sig || fabs(mat[15] - 1) > sig)
-	{
-		repoWarning << "Potentially incorrect transformation : does not expect the last row to have values!";
-		repoWarning << matrix.toString();
-		exit(0);
-	}
+	checkProjection(matrix);
 
 	return result;
 }
@@ -19,6 +19,7 @@
 
 #include <string>
 #include <vector>
+#include <span>
 #include "repo_vector.h"
 
 namespace repo {
@@ -54,6 +55,27 @@ namespace repo {
 
 			repo::lib::RepoVector3D64 transformDirection(const repo::lib::RepoVector3D64& vec) const;
 
+			/*
+			* Batch versions of operator* and transformDirection, for transforming
+			* whole arrays of vertices or normals. These give the same results as
+			* the single vector versions, but use SIMD where available, and check
+			* the projective row of the matrix once per call rather than per vector.
+			* out must have at least as many elements as in. It may be the same
+			* array, to transform in place, but otherwise must not overlap with in.
+			*/
+
+			void transformPoints(std::span<const repo::lib::RepoVector3D> in, std::span<repo::lib::RepoVector3D> out) const;
+
+			void transformPoints(std::span<const repo::lib::RepoVector3D> in, std::span<repo::lib::RepoVector3D64> out) const;
+
+			void transformPoints(std::span<const repo::lib::RepoVector3D64> in, std::span<repo::lib::RepoVector3D> out) const;
+
+			void transformPoints(std::span<const repo::lib::RepoVector3D64> in, std::span<repo::lib::RepoVector3D64> out) const;
+
+			void transformDirections(std::span<const repo::lib::RepoVector3D> in, std::span<repo::lib::RepoVector3D> out) const;
+
+			void transformDirections(std::span<const repo::lib::RepoVector3D64> in, std::span<repo::lib::RepoVector3D64> out) const;
+
 			std::string toString() const;
 
 			_RepoMatrix<T> transpose() const;
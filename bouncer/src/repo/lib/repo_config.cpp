@@ -89,14 +89,36 @@ RepoConfig RepoConfig::fromFile(const std::string &filePath) {
 		auto dbConn = dbTree->get<std::string>("connectionString", "");
 		auto username = dbTree->get<std::string>("username", "");
 		auto password = dbTree->get<std::string>("password", "");
+		auto dbEngine = dbTree->get<std::string>("engine", "mongo");
+		auto dbPath = dbTree->get<std::string>("path", "");
+
+		// The embedded database must be asked for explicitly, so a config that
+		// also holds server details cannot switch away from the server unnoticed.
+
+		if (dbEngine != "mongo" && dbEngine != "embedded") {
+			throw RepoException("Unrecognised database engine '" + dbEngine + "' within configuration file.");
+		}
+
+		auto embedded = dbEngine == "embedded";
+		if (embedded && dbPath.empty()) {
+			throw RepoException("The embedded database engine requires a path within configuration file.");
+		}
+
+		if (!embedded && !dbPath.empty()) {
+			throw RepoException("Database path is only used by the embedded database engine; set 'engine' to 'embedded' to use it.");
+		}
 
 		auto useHostAndPort = !dbAddr.empty() && dbPort > 0;
-		if (!useHostAndPort && dbConn.empty()) {
+		if (!useHostAndPort && dbConn.empty() && !embedded) {
 			throw RepoException("Database address and port not specified within configuration file.");
 		}
 
 		repo::lib::RepoConfig config = useHostAndPort ? RepoConfig(dbAddr, dbPort, username, password) : RepoConfig(dbConn, username, password);
 
+		if (embedded) {
+			config.configureEmbeddedDatabase(dbPath);
+		}
+
 		auto useAsDefault = jsonTree.get<std::string>("defaultStorage", "");
 
 		//Read FS configuirations if found
@@ -109,6 +131,8 @@ RepoConfig RepoConfig::fromFile(const std::string &filePath) {
 				config.configureFS(path, level, useAsDefault == "fs" || useAsDefault.empty());
 		}
 
+		config.configureLegacyFaces(jsonTree.get<bool>("legacyFaces", false));
+
 		return config;
 	}
 	catch (...)
@@ -117,8 +141,21 @@ RepoConfig RepoConfig::fromFile(const std::string &filePath) {
 	}
 }
 
+void RepoConfig::configureEmbeddedDatabase(
+	const std::string& directory)
+{
+	dbConf.embedded = true;
+	dbConf.path = directory;
+}
+
+void RepoConfig::configureLegacyFaces(
+	const bool legacy)
+{
+	legacyFaces = legacy;
+}
+
 bool RepoConfig::validate() const {
-	const bool validDBConn = !dbConf.connString.empty() || (!dbConf.addr.empty() && dbConf.port > 0);
+	const bool validDBConn = !dbConf.connString.empty() || (!dbConf.addr.empty() && dbConf.port > 0) || (dbConf.embedded && !dbConf.path.empty());
 	const bool dbOk = validDBConn && (dbConf.username.empty() == dbConf.password.empty());
 	const bool fsOk = !fsConf.configured || (!fsConf.dir.empty() && fsConf.nLevel >= 0);
 
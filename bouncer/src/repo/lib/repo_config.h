@@ -33,6 +33,8 @@ namespace repo {
 				std::string connString;
 				std::string username;
 				std::string password;
+				bool embedded = false; // If set, the databases are kept in path by the EmbeddedDatabaseHandler, instead of on a server
+				std::string path;
 			};
 
 			struct fs_config_t {
@@ -85,6 +87,24 @@ namespace repo {
 				const bool useAsDefault = true
 			);
 
+			/**
+			* Store the databases in local files, in the given directory, instead of
+			* connecting to a database server
+			* @params directory directory to hold the databases
+			*/
+			void REPO_API_EXPORT configureEmbeddedDatabase(
+				const std::string &directory
+			);
+
+			/**
+			* Write mesh faces in the original count-prefixed layout, so they can be
+			* read by versions of bouncer that predate the fixed-stride layout
+			* @params legacy whether to write the legacy layout
+			*/
+			void REPO_API_EXPORT configureLegacyFaces(
+				const bool legacy
+			);
+
 			const database_config_t getDatabaseConfig() const { return dbConf; }
 			const fs_config_t getFSConfig() const { return fsConf; }
 
@@ -94,12 +114,15 @@ namespace repo {
 			*/
 			FileStorageEngine getDefaultStorageEngine() const { return defaultStorage; }
 
+			bool getLegacyFaces() const { return legacyFaces; }
+
 			bool validate() const;
 
 		private:
 			database_config_t dbConf;
 			fs_config_t fsConf;
 			FileStorageEngine defaultStorage;
+			bool legacyFaces = false;
 		};
 	}
 }
@@ -283,13 +283,8 @@ void RepoMeshBuilder::extractMeshes(std::vector<MeshNode>& nodes, const repo::li
 			repo::core::model::MeshNode::transformNormals(normals32, m);
 		}
 
-		std::vector<repo::lib::RepoVector3D> vertices32;
-		vertices32.reserve(meshData->vertexMap.vertices.size());
-
-		for (int i = 0; i < meshData->vertexMap.vertices.size(); ++i) {
-			auto v = m * meshData->vertexMap.vertices[i];
-			vertices32.push_back({ (float)(v.x), (float)(v.y), (float)(v.z) });
-		}
+		std::vector<repo::lib::RepoVector3D> vertices32(meshData->vertexMap.vertices.size());
+		m.transformPoints(meshData->vertexMap.vertices, vertices32);
 
 		auto meshNode = repo::core::model::RepoBSONFactory::makeMeshNode(
 			vertices32,
@@ -24,6 +24,11 @@
 #include <ranges>
 #include <iomanip>
 #include <filesystem>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/copy.hpp>
 #include <boost/iostreams/filter/gzip.hpp>
@@ -44,6 +49,8 @@ using namespace repo::manipulator::modelconvertor::repoHelper;
 using namespace rapidjson;
 
 const static int REPO_VERSION_LENGTH = 6;
+const static size_t READ_AHEAD_CHUNK_SIZE = 4 * 1024 * 1024;
+const static size_t READ_AHEAD_NUM_CHUNKS = 8;
 
 RepoModelImport::RepoModelImport(const ModelImportConfig& settings) :
 	AbstractModelImport(settings)
@@ -158,6 +165,134 @@ struct IndicesView : public MeshAttributeView<uint32_t>
 	}
 };
 
+/*
+* A streambuf that decompresses its source on a separate thread, ahead of the
+* reader. Decompressed data is held in a bounded ring of fixed size chunks, so
+* inflating the data section overlaps with building and committing the nodes,
+* without holding more than numChunks * chunkSize bytes in memory at any time.
+* The source must not be used by anything else while the buffer exists.
+*/
+class ReadAheadBuffer : public std::streambuf
+{
+public:
+	ReadAheadBuffer(std::istream& source, size_t chunkSize, size_t numChunks) :
+		source(source),
+		chunkSize(chunkSize),
+		numChunks(numChunks)
+	{
+		thread = std::thread(&ReadAheadBuffer::work, this);
+	}
+
+	~ReadAheadBuffer()
+	{
+		{
+			std::scoped_lock lock(mutex);
+			stopped = true;
+		}
+		drained.notify_all();
+		thread.join();
+	}
+
+protected:
+	int_type underflow() override
+	{
+		if (gptr() < egptr()) {
+			return traits_type::to_int_type(*gptr());
+		}
+
+		std::unique_lock lock(mutex);
+
+		// Return the exhausted chunk to the producer to avoid reallocating it
+		if (current.capacity()) {
+			spare.push_back(std::move(current));
+			current = {};
+		}
+
+		filled.wait(lock, [&] {
+			return !chunks.empty() || finished;
+		});
+
+		if (chunks.empty()) {
+			if (exception) {
+				std::rethrow_exception(exception);
+			}
+			return traits_type::eof();
+		}
+
+		current = std::move(chunks.front());
+		chunks.pop_front();
+		drained.notify_one();
+
+		setg(current.data(), current.data(), current.data() + current.size());
+		return traits_type::to_int_type(*gptr());
+	}
+
+private:
+	std::istream& source;
+	size_t chunkSize;
+	size_t numChunks;
+
+	std::vector<char> current;
+	std::deque<std::vector<char>> chunks;
+	std::vector<std::vector<char>> spare;
+
+	bool stopped = false;
+	bool finished = false;
+	std::exception_ptr exception;
+
+	std::mutex mutex;
+	std::condition_variable filled;
+	std::condition_variable drained;
+	std::thread thread;
+
+	void work()
+	{
+		try
+		{
+			while (true) {
+				std::vector<char> chunk;
+				{
+					std::unique_lock lock(mutex);
+					drained.wait(lock, [&] {
+						return stopped || chunks.size() < numChunks;
+					});
+					if (stopped) {
+						break;
+					}
+					if (spare.size()) {
+						chunk = std::move(spare.back());
+						spare.pop_back();
+					}
+				}
+
+				chunk.resize(chunkSize);
+				source.read(chunk.data(), chunkSize);
+				chunk.resize(source.gcount());
+
+				if (chunk.empty()) {
+					break;
+				}
+
+				{
+					std::scoped_lock lock(mutex);
+					chunks.push_back(std::move(chunk));
+				}
+				filled.notify_one();
+			}
+		}
+		catch (...) {
+			std::scoped_lock lock(mutex);
+			exception = std::current_exception();
+		}
+
+		{
+			std::scoped_lock lock(mutex);
+			finished = true;
+		}
+		filled.notify_all();
+	}
+};
+
 /*
 * A subclass of RepoSceneBuilder with a dictionary for mapping local indices.
 */
@@ -168,11 +303,15 @@ public:
 	Builder(std::shared_ptr<repo::core::handler::AbstractDatabaseHandler> handler,
 		const std::string& database,
 		const std::string& project,
-		const repo::lib::RepoUUID& revisionId) :
+		const repo::lib::RepoUUID& revisionId,
+		int numWriters) :
 		RepoSceneBuilder(handler, database, project, revisionId),
 		minBufferSize(0),
 		numMaterials(0)
 	{
+		if (numWriters > 0) {
+			setNumWriters(numWriters);
+		}
 		createIndexes();
 	}
 
@@ -194,9 +333,10 @@ public:
 	std::unordered_map<int, Ids> textureIds;
 	std::unordered_map<repo::lib::RepoUUID, std::vector<std::shared_ptr<repo::core::model::MeshNode>>, repo::lib::RepoUUIDHasher> matToMeshNodes;	
 	size_t numMaterials;
-	std::vector<View*> dataMap;
+	std::vector<std::unique_ptr<View>> dataMap;
 	size_t minBufferSize;
 	repo::lib::RepoVector3D64 offset; // Applied to the vertex data
+	bool hasOffset = false;
 
 	/* 
 	* Used to set the parents once all nodes have been read in. This is used
@@ -268,18 +408,18 @@ public:
 				parentIds = { node->getSharedID() };
 			}
 
-			dataMap.push_back(new VerticesView(r.geometry.vertices, node, matrix));
+			dataMap.push_back(std::make_unique<VerticesView>(r.geometry.vertices, node, matrix));
 
 			if (r.geometry.indices.size()) {
-				dataMap.push_back(new IndicesView(r.geometry.indices, node, r.geometry.primitive));
+				dataMap.push_back(std::make_unique<IndicesView>(r.geometry.indices, node, r.geometry.primitive));
 			}
 
 			if (r.geometry.normals.size()) {
-				dataMap.push_back(new NormalsView(r.geometry.normals, node, matrix.inverse().transpose().rotation()));
+				dataMap.push_back(std::make_unique<NormalsView>(r.geometry.normals, node, matrix.inverse().transpose().rotation()));
 			}
 
 			if (r.geometry.uv.size()) {
-				dataMap.push_back(new UvsView(r.geometry.uv, node));
+				dataMap.push_back(std::make_unique<UvsView>(r.geometry.uv, node));
 			}
 
 			auto& material = materialIds[r.geometry.material];
@@ -327,7 +467,7 @@ public:
 	void createTexture(const TextureRecord& t) override
 	{
 		if (t.isOK()) {
-			dataMap.push_back(new TextureView(t)); // The node and blobs are created together for textures
+			dataMap.push_back(std::make_unique<TextureView>(t)); // The node and blobs are created together for textures
 		}
 		else {
 			setMissingTextures();
@@ -336,10 +476,10 @@ public:
 
 	void prepareDataMap()
 	{
-		std::ranges::sort(dataMap, {}, &View::begin);
+		std::ranges::sort(dataMap, {}, [](const std::unique_ptr<View>& v) { return v->begin; });
 
 		minBufferSize = 0;
-		for (auto view : dataMap) {
+		for (auto& view : dataMap) {
 			minBufferSize = std::max(minBufferSize, view->size());
 		}
 
@@ -354,6 +494,18 @@ public:
 		if (auto view = dynamic_cast<VerticesView*>(v))
 		{
 			auto vertices64 = view->vector(buffer);
+
+			// In BIM004 and below the bounds are not set, so the offset is not known
+			// until all the vertices have been read. Rather than reading the data
+			// section twice, the first vertex is used as the offset. This is within
+			// the extents of the model, so the vertices keep the same precision as
+			// they would relative to the minimum of the bounds.
+
+			if (!hasOffset && vertices64.size()) {
+				offset = vertices64[0];
+				hasOffset = true;
+			}
+
 			std::vector<repo::lib::RepoVector3D> vertices32(vertices64.size());
 			for (auto i = 0; i < vertices32.size(); i++) {
 				vertices32[i] = vertices64[i] - offset;
@@ -397,62 +549,33 @@ public:
 		}
 	}
 
+	/*
+	* Reads the data section in a single pass. The views are released as soon
+	* as they have been read, so the nodes can be committed while the rest of
+	* the section is still being decompressed.
+	*/
 	void readData(std::istream* fin)
 	{
-		auto buffer = new char[minBufferSize];
+		std::vector<char> buffer(minBufferSize);
 
 		size_t position = 0;
-		for (auto view : dataMap)
+		for (auto& view : dataMap)
 		{
 			auto skip = view->begin - position;
 			fin->ignore(skip);
 			position += skip;
 
-			fin->read(buffer, view->size());
+			fin->read(buffer.data(), view->size());
 			position += view->size();
 
-			readView(view, buffer);
+			readView(view.get(), buffer.data());
 
-			delete view;
+			view.reset();
 		}
 
-		delete[] buffer;
-
 		dataMap.clear();
 	}
 
-	/*
-	* Gets the bounds of the vertices, in the local space of the .bim, without
-	* changing the data map - this is used to get the scene bounds for BIM004
-	* and below, which are not set in the nodes.
-	*/
-	repo::lib::RepoBounds readBoundsFromData(std::istream* fin)
-	{
-		auto buffer = new char[minBufferSize];
-		repo::lib::RepoBounds bounds;
-
-		size_t position = 0;
-		for (auto v : dataMap)
-		{
-			if (auto view = dynamic_cast<VerticesView*>(v)) {
-				auto skip = view->begin - position;
-				fin->ignore(skip);
-				position += skip;
-
-				fin->read(buffer, view->size());
-				position += view->size();
-
-				for (auto& v : view->vector(buffer)) {
-					bounds.encapsulate(v);
-				}
-			}
-		}
-
-		delete[] buffer;
-
-		return bounds;
-	}
-
 	void finalise()
 	{
 		for (auto& r : references) {
@@ -488,7 +611,7 @@ repo::core::model::RepoScene* RepoModelImport::importModel(std::string filePath,
 	std::ifstream finCompressed(path, std::ios_base::in | std::ios::binary);
 	if (finCompressed)
 	{
-		auto inbuf = new boost::iostreams::filtering_istream();
+		auto inbuf = std::make_unique<boost::iostreams::filtering_istream>();
 		inbuf->push(boost::iostreams::gzip_decompressor());
 		inbuf->push(finCompressed);
 
@@ -520,59 +643,44 @@ repo::core::model::RepoScene* RepoModelImport::importModel(std::string filePath,
 		repoInfo << std::left << std::setw(30) << "\"textures\" array size: " << file_meta.textureStart << " bytes";
 		repoInfo << std::left << std::setw(30) << "Number of parts to process:" << file_meta.numChildren;
 
-		auto builder = new Builder(
+		auto builder = std::make_unique<Builder>(
 			handler,
 			settings.getDatabaseName(),
 			settings.getProjectName(),
-			settings.getRevisionId()
+			settings.getRevisionId(),
+			settings.getNumWriters()
 		);
 
 		repoInfo << "Reading Json header...";
 
 		// Stream in Json tree
 
-		char* jsonBuf = new char[file_meta.jsonSize + 1];
-		inbuf->read(jsonBuf, file_meta.jsonSize);
+		std::vector<char> jsonBuf(file_meta.jsonSize + 1);
+		inbuf->read(jsonBuf.data(), file_meta.jsonSize);
 		jsonBuf[file_meta.jsonSize] = '\0';
 
-		TreeParser::ParseJson(jsonBuf, builder);
+		TreeParser::ParseJson(jsonBuf.data(), builder.get());
+		jsonBuf.clear();
+		jsonBuf.shrink_to_fit();
 
 		builder->prepareDataMap();
-		
-		repoInfo << "Pre-processing scene bounds (BIM004 and below)...";
 
-		// Get offset
-
-		// In BIM004 and below, the bounds are not set, meaning we need to get
-		// them from the geometry directly. We do this by reading the data section
-		// once then resetting the stream.
+		// In BIM004 and below, the bounds are not set, so the offset is taken
+		// from the geometry as it is read (see readView).
 
 		// For BIM005, we should introduce instancing, and along with that, the
 		// primary offset applied at the root node transform.
 		// https://github.com/3drepo/3D-Repo-Product-Team/issues/794
 
-		auto bounds = builder->readBoundsFromData(inbuf);
-		builder->offset = bounds.min();
-
-		// Now reset the file stream for the actual data read
-
-		delete inbuf;
-
-		finCompressed.seekg(0, std::ios::beg);
-		
-		inbuf = new boost::iostreams::filtering_istream();
-		inbuf->push(boost::iostreams::gzip_decompressor());
-		inbuf->push(finCompressed);
-
-		inbuf->ignore(REPO_VERSION_LENGTH);
-		inbuf->ignore(metaSize);
-		inbuf->ignore(file_meta.jsonSize);
-
 		repoInfo << "Reading data buffer...";
 
-		builder->readData(inbuf);
+		{
+			ReadAheadBuffer readAhead(*inbuf, READ_AHEAD_CHUNK_SIZE, READ_AHEAD_NUM_CHUNKS);
+			std::istream data(&readAhead);
+			builder->readData(&data);
+		}
 
-		delete inbuf;
+		inbuf.reset();
 
 		repoInfo << "Create scene";
 
@@ -595,8 +703,6 @@ repo::core::model::RepoScene* RepoModelImport::importModel(std::string filePath,
 			err = REPOERR_LOAD_SCENE_MISSING_TEXTURE;
 		}
 
-		delete builder;
-
 		return scene;
 	}
 	else {
@@ -32,6 +32,7 @@ ModelImportConfig::ModelImportConfig() :
 	revisionId(repo::lib::RepoUUID::defaultValue),
 	lod(0),
 	numThreads(0),
+	numWriters(0),
 	splitByFloor(true)
 {}
 
@@ -74,6 +75,7 @@ std::string ModelImportConfig::prettyPrint()
 		+ " lod: " + std::to_string(lod)
 		+ " revisionId: " + revisionId.toString()
 		+ " num threads: " + std::to_string(numThreads)
+		+ " num writers: " + std::to_string(numWriters)
 		+ " view name: " + (viewName.empty() ? "NONE" : viewName)
 		+ " split by floor: " + (splitByFloor ? "true" : "false")
 	);
@@ -44,6 +44,7 @@ namespace repo {
 				std::string databaseName;
 				std::string projectName;
 				int numThreads;
+				int numWriters;
 				std::string viewName;
 				std::string viewStyle;
 				bool splitByFloor;
@@ -74,6 +75,7 @@ namespace repo {
 				std::string getDatabaseName() const { return databaseName; }
 				std::string getProjectName() const { return projectName; }
 				int getNumThreads() const { return numThreads; }
+				int getNumWriters() const { return numWriters; }
 				std::string getViewName() const { return viewName; }
 
 				std::string prettyPrint();
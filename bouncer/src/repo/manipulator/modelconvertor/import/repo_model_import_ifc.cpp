@@ -51,6 +51,9 @@ repo::core::model::RepoScene* IFCModelImport::importModel(std::string filePath,
 		settings.getProjectName(),
 		settings.getRevisionId()
 		);
+	if (settings.getNumWriters() > 0) {
+		sceneBuilder->setNumWriters(settings.getNumWriters());
+	}
 	sceneBuilder->createIndexes();
 
 	auto serialiser = ifcUtils::IfcUtils::CreateSerialiser(filePath);
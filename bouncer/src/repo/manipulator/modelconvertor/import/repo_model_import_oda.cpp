@@ -60,6 +60,9 @@ repo::core::model::RepoScene* OdaModelImport::importModel(std::string filePath,
 		settings.getProjectName(),
 		settings.getRevisionId()
 	);
+	if (settings.getNumWriters() > 0) {
+		sceneBuilder->setNumWriters(settings.getNumWriters());
+	}
 	sceneBuilder->createIndexes();
 
 	odaProcessor = odaHelper::FileProcessor::getFileProcessor(filePath, sceneBuilder.get(), settings);
@@ -17,8 +17,18 @@
 
 #ifdef SYNCHRO_SUPPORT
 #include <memory>
+#include <thread>
+#include <sstream>
+#include <string_view>
+#include <algorithm>
 #include "repo_model_import_synchro.h"
 
+#define RAPIDJSON_HAS_STDSTRING 1
+
+#include "repo/lib/rapidjson/rapidjson.h"
+#include "repo/lib/rapidjson/writer.h"
+#include "repo/lib/rapidjson/stringbuffer.h"
+
 #include "repo/core/model/bson/repo_bson_factory.h"
 #include <repo_log.h>
 #include "repo/lib/repo_units.h"
@@ -67,6 +77,71 @@ public:
 	const bool isPerspective;
 };
 
+/*
+* FrameCache builds the state buffers for the frames of a sequence. The state
+* of each frame is captured in a compact form as the animation is played
+* through, then written to JSON in parallel, one batch at a time, so only a
+* bounded number of captured states are held at once.
+* A frame whose state is the same as the previous frame's tells the viewer
+* nothing new, so it is dropped, and frames with identical states anywhere in
+* the sequence share one buffer.
+*/
+class SynchroModelImport::FrameCache
+{
+public:
+	struct FrameState
+	{
+		uint64_t timestamp;
+		std::vector<std::pair<float, std::vector<std::string>>> transparency;
+		std::vector<std::pair<std::vector<float>, std::vector<repo::lib::RepoUUID>>> colour;
+		std::vector<std::pair<std::vector<double>, const std::vector<repo::lib::RepoUUID>*>> transformation;
+		std::vector<std::pair<repo::lib::RepoUUID, std::pair<repo::lib::RepoVector3D64, repo::lib::RepoVector3D64>>> clip;
+		std::shared_ptr<CameraChange> camera;
+	};
+
+	FrameCache(
+		std::unordered_map<std::string, std::vector<uint8_t>>& stateBuffers,
+		std::vector<repo::core::model::RepoSequence::FrameData>& frameData)
+		:stateBuffers(stateBuffers),
+		frameData(frameData),
+		numThreads(std::max(1u, std::thread::hardware_concurrency())),
+		numDropped(0)
+	{
+	}
+
+	void add(FrameState&& state)
+	{
+		states.push_back(std::move(state));
+		if (states.size() >= FRAME_CACHE_BATCH_SIZE) {
+			flush();
+		}
+	}
+
+	// Must be called once all the frames have been added
+	void flush();
+
+	size_t getNumDropped() const
+	{
+		return numDropped;
+	}
+
+private:
+	static const size_t FRAME_CACHE_BATCH_SIZE = 1024;
+
+	std::unordered_map<std::string, std::vector<uint8_t>>& stateBuffers;
+	std::vector<repo::core::model::RepoSequence::FrameData>& frameData;
+	unsigned numThreads;
+	size_t numDropped;
+
+	std::vector<FrameState> states;
+	std::unordered_multimap<size_t, std::string> idsByHash;
+	std::string previousId;
+
+	static std::vector<uint8_t> serialise(const FrameState& state);
+
+	const std::string& getStateId(std::vector<uint8_t>&& buffer);
+};
+
 repo::core::model::RepoScene* SynchroModelImport::importModel(std::string filePath, std::shared_ptr<repo::core::handler::AbstractDatabaseHandler> handler, uint8_t &errCode) {
 	orgFile = filePath;
 	reader = std::make_shared<synchro_reader::SynchroReader>(filePath, settings.getTimeZone());
@@ -426,87 +501,222 @@ std::vector<float> SynchroModelImport::colourFrom32Bit(const uint32_t &color) co
 	return{ (float)colorArr[0] / 255.f, (float)colorArr[1] / 255.f, (float)colorArr[2] / 255.f };
 }
 
-std::string SynchroModelImport::generateCache(
+void SynchroModelImport::generateCache(
 	const std::unordered_map<std::string, std::vector<repo::lib::RepoUUID>> &resourceIDsToSharedIDs,
 	const std::unordered_map<float, std::set<std::string>> &alphaValueToIDs,
 	const std::unordered_map<repo::lib::RepoUUID, std::pair<uint32_t, std::vector<float>>, repo::lib::RepoUUIDHasher> &meshColourState,
 	const std::unordered_map<std::string, std::vector<double>> &resourceIDTransState,
 	const std::unordered_map<repo::lib::RepoUUID, std::pair<repo::lib::RepoVector3D64, repo::lib::RepoVector3D64>, repo::lib::RepoUUIDHasher> &clipState,
 	const std::shared_ptr<CameraChange> &cam,
-	std::unordered_map<std::string, std::vector<uint8_t>> &stateBuffers) {
-	std::vector<repo::lib::PropertyTree> transparencyStates, colourStates, transformationStates, clipPlaneStates;
-	std::unordered_map<float, std::vector<std::string>> transToIDs;
-	std::unordered_map<uint32_t, std::vector<std::string>> colorToIDs;
+	uint64_t timestamp,
+	FrameCache &cache) {
+	FrameCache::FrameState state;
+	state.timestamp = timestamp;
+
+	// The entries are sorted, so that identical states give identical buffers
+	// regardless of the order of the maps.
 
+	std::unordered_map<uint32_t, std::vector<repo::lib::RepoUUID>> colorToIDs;
 	for (const auto &entry : meshColourState) {
 		if (!entry.second.second.size()) continue;
 		auto value = colourIn32Bit(entry.second.second);
 		if (value != entry.second.first) {
-			if (colorToIDs.find(value) == colorToIDs.end()) {
-				colorToIDs[value] = { entry.first.toString() };
-			}
-			else {
-				colorToIDs[value].push_back(entry.first.toString());
-			}
+			colorToIDs[value].push_back(entry.first);
 		}
 	}
+	for (auto &entry : colorToIDs) {
+		std::sort(entry.second.begin(), entry.second.end());
+		state.colour.push_back({ colourFrom32Bit(entry.first), std::move(entry.second) });
+	}
+	std::sort(state.colour.begin(), state.colour.end());
+
 	if (settings.shouldImportAnimations()) {
 		for (const auto &entry : resourceIDTransState) {
-			if (resourceIDsToSharedIDs.find(entry.first) != resourceIDsToSharedIDs.end()
-				&& resourceIDsToSharedIDs.at(entry.first).size()) {
-				repo::lib::PropertyTree transformTree;
-				transformTree.addToTree(SEQ_CACHE_LABEL_VALUE, entry.second);
-				std::vector<repo::lib::RepoUUID> idArr = resourceIDsToSharedIDs.at(entry.first);
-				transformTree.addToTree(SEQ_CACHE_LABEL_SHARED_IDS, idArr);
-				transformationStates.push_back(transformTree);
+			auto ids = resourceIDsToSharedIDs.find(entry.first);
+			if (ids != resourceIDsToSharedIDs.end() && ids->second.size()) {
+				state.transformation.push_back({ entry.second, &ids->second });
 			}
 		}
+		std::sort(state.transformation.begin(), state.transformation.end());
 	}
 
 	for (const auto &entry : clipState) {
-		repo::lib::PropertyTree clipTree, valueTree;
-		valueTree.addToTree(SEQ_CACHE_LABEL_POSITION, entry.second.first);
-		valueTree.addToTree(SEQ_CACHE_LABEL_DIRECTION, entry.second.second);
-		clipTree.mergeSubTree(SEQ_CACHE_LABEL_VALUE, valueTree);
-		std::vector<repo::lib::RepoUUID> idArr = { entry.first };
-		clipTree.addToTree(SEQ_CACHE_LABEL_SHARED_IDS, idArr);
-		clipPlaneStates.push_back(clipTree);
+		state.clip.push_back(entry);
 	}
+	std::sort(state.clip.begin(), state.clip.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
 
 	for (const auto &entry : alphaValueToIDs) {
 		if (!entry.second.size()) continue;
-		repo::lib::PropertyTree transTree;
-		transTree.addToTree(SEQ_CACHE_LABEL_VALUE, entry.first);
-		transTree.addToTree(SEQ_CACHE_LABEL_SHARED_IDS, entry.second);
-		transparencyStates.push_back(transTree);
-	}
-
-	for (const auto &entry : colorToIDs) {
-		repo::lib::PropertyTree colTree;
-		colTree.addToTree(SEQ_CACHE_LABEL_VALUE, colourFrom32Bit(entry.first));
-		colTree.addToTree(SEQ_CACHE_LABEL_SHARED_IDS, entry.second);
-		colourStates.push_back(colTree);
-	}
-	repo::lib::PropertyTree bufferTree;
-	if (transparencyStates.size()) bufferTree.addArrayObjects(SEQ_CACHE_LABEL_TRANSPARENCY, transparencyStates);
-	if (colourStates.size()) bufferTree.addArrayObjects(SEQ_CACHE_LABEL_COLOR, colourStates);
-	if (transformationStates.size()) bufferTree.addArrayObjects(SEQ_CACHE_LABEL_TRANSFORMATION, transformationStates);
-	if (clipPlaneStates.size()) bufferTree.addArrayObjects(SEQ_CACHE_LABEL_CLIP, clipPlaneStates);
-
-	if (cam) {
-		repo::lib::PropertyTree camTree;
-		camTree.addToTree(SEQ_CACHE_LABEL_POSITION, cam->position);
-		camTree.addToTree(SEQ_CACHE_LABEL_FORWARD, cam->forward);
-		camTree.addToTree(SEQ_CACHE_LABEL_UP, cam->up);
-		camTree.addToTree(SEQ_CACHE_LABEL_PERSPECTIVE, cam->isPerspective ? "true" : "false");
-		camTree.addToTree(SEQ_CACHE_LABEL_FOV, cam->fov);
-		bufferTree.mergeSubTree(SEQ_CACHE_LABEL_CAMERA, camTree);
+		state.transparency.push_back({ entry.first, std::vector<std::string>(entry.second.begin(), entry.second.end()) });
+	}
+	std::sort(state.transparency.begin(), state.transparency.end());
+
+	state.camera = cam;
+
+	cache.add(std::move(state));
+}
+
+static std::string vectorToString(const repo::lib::RepoVector3D64& v)
+{
+	std::stringstream ss;
+	ss << v.x << " " << v.y << " " << v.z;
+	return ss.str();
+}
+
+static std::string vectorToString(const repo::lib::RepoVector3D& v)
+{
+	std::stringstream ss;
+	ss << v.x << " " << v.y << " " << v.z;
+	return ss.str();
+}
+
+std::vector<uint8_t> SynchroModelImport::FrameCache::serialise(const FrameState& state)
+{
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+	auto writeIds = [&](const std::vector<repo::lib::RepoUUID>& ids) {
+		writer.Key(SEQ_CACHE_LABEL_SHARED_IDS);
+		writer.StartArray();
+		for (const auto& id : ids) {
+			writer.String(id.toString());
+		}
+		writer.EndArray();
+	};
+
+	writer.StartObject();
+
+	if (state.transparency.size()) {
+		writer.Key(SEQ_CACHE_LABEL_TRANSPARENCY);
+		writer.StartArray();
+		for (const auto& entry : state.transparency) {
+			writer.StartObject();
+			writer.Key(SEQ_CACHE_LABEL_VALUE); writer.Double(entry.first);
+			writer.Key(SEQ_CACHE_LABEL_SHARED_IDS);
+			writer.StartArray();
+			for (const auto& id : entry.second) {
+				writer.String(id);
+			}
+			writer.EndArray();
+			writer.EndObject();
+		}
+		writer.EndArray();
+	}
+
+	if (state.colour.size()) {
+		writer.Key(SEQ_CACHE_LABEL_COLOR);
+		writer.StartArray();
+		for (const auto& entry : state.colour) {
+			writer.StartObject();
+			writer.Key(SEQ_CACHE_LABEL_VALUE);
+			writer.StartArray();
+			for (auto c : entry.first) {
+				writer.Double(c);
+			}
+			writer.EndArray();
+			writeIds(entry.second);
+			writer.EndObject();
+		}
+		writer.EndArray();
+	}
+
+	if (state.transformation.size()) {
+		writer.Key(SEQ_CACHE_LABEL_TRANSFORMATION);
+		writer.StartArray();
+		for (const auto& entry : state.transformation) {
+			writer.StartObject();
+			writer.Key(SEQ_CACHE_LABEL_VALUE);
+			writer.StartArray();
+			for (auto d : entry.first) {
+				writer.Double(d);
+			}
+			writer.EndArray();
+			writeIds(*entry.second);
+			writer.EndObject();
+		}
+		writer.EndArray();
+	}
+
+	if (state.clip.size()) {
+		writer.Key(SEQ_CACHE_LABEL_CLIP);
+		writer.StartArray();
+		for (const auto& entry : state.clip) {
+			writer.StartObject();
+			writer.Key(SEQ_CACHE_LABEL_VALUE);
+			writer.StartObject();
+			writer.Key(SEQ_CACHE_LABEL_POSITION); writer.String(vectorToString(entry.second.first));
+			writer.Key(SEQ_CACHE_LABEL_DIRECTION); writer.String(vectorToString(entry.second.second));
+			writer.EndObject();
+			writeIds({ entry.first });
+			writer.EndObject();
+		}
+		writer.EndArray();
+	}
+
+	if (state.camera) {
+		auto& cam = *state.camera;
+		writer.Key(SEQ_CACHE_LABEL_CAMERA);
+		writer.StartObject();
+		writer.Key(SEQ_CACHE_LABEL_POSITION); writer.String(vectorToString(cam.position));
+		writer.Key(SEQ_CACHE_LABEL_FORWARD); writer.String(vectorToString(cam.forward));
+		writer.Key(SEQ_CACHE_LABEL_UP); writer.String(vectorToString(cam.up));
+		writer.Key(SEQ_CACHE_LABEL_PERSPECTIVE); writer.String(cam.isPerspective ? "true" : "false");
+		writer.Key(SEQ_CACHE_LABEL_FOV); writer.Double(cam.fov);
+		writer.EndObject();
+	}
+
+	writer.EndObject();
+
+	return std::vector<uint8_t>(buffer.GetString(), buffer.GetString() + buffer.GetSize());
+}
+
+const std::string& SynchroModelImport::FrameCache::getStateId(std::vector<uint8_t>&& buffer)
+{
+	auto hash = std::hash<std::string_view>()(std::string_view((const char*)buffer.data(), buffer.size()));
+	auto range = idsByHash.equal_range(hash);
+	for (auto it = range.first; it != range.second; it++) {
+		if (stateBuffers.at(it->second) == buffer) {
+			return it->second;
+		}
 	}
 
 	auto id = repo::lib::RepoUUID::createUUID().toString();
+	stateBuffers[id] = std::move(buffer);
+	return idsByHash.insert({ hash, id })->second;
+}
 
-	stateBuffers[id] = bufferTree.writeJsonToBuffer();
-	return id;
+void SynchroModelImport::FrameCache::flush()
+{
+	// Serialisation is independent for each frame, so the batch is split
+	// between the threads. Assigning the ids is done afterwards, in order.
+
+	std::vector<std::vector<uint8_t>> buffers(states.size());
+	{
+		auto n = std::min<size_t>(numThreads, states.size());
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < n; t++) {
+			threads.emplace_back([&, t]() {
+				for (size_t i = t; i < states.size(); i += n) {
+					buffers[i] = serialise(states[i]);
+				}
+			});
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+	}
+
+	for (size_t i = 0; i < states.size(); i++) {
+		auto& id = getStateId(std::move(buffers[i]));
+		if (id == previousId) {
+			numDropped++;
+			continue;
+		}
+		frameData.push_back(repo::core::model::RepoSequence::FrameData(id, states[i].timestamp));
+		previousId = id;
+	}
+
+	states.clear();
 }
 
 repo::lib::RepoMatrix SynchroModelImport::convertMatrixTo3DRepoWorld(
@@ -804,6 +1014,7 @@ repo::core::model::RepoScene* SynchroModelImport::generateRepoScene(uint8_t &err
 		std::unordered_map<std::string, repo::lib::RepoMatrix> resourceIDLastTrans;
 		std::unordered_map<std::string, std::vector<uint8_t>> stateBuffers;
 		std::vector<repo::core::model::RepoSequence::FrameData> frameData;
+		FrameCache frameCache(stateBuffers, frameData);
 		std::set<repo::lib::RepoUUID> defaultInvisible;
 		auto origin = reader->getGlobalOffset();
 		std::vector<double> offset = { origin.x, origin.z , -origin.y };
@@ -870,10 +1081,7 @@ repo::core::model::RepoScene* SynchroModelImport::generateRepoScene(uint8_t &err
 			resourceIDTransState.size()) {
 			//First animation frame is bigger than the task frame
 			//And we have animations... need to reset the state of the transforms.
-			repo::core::model::RepoSequence::FrameData data;
-			data.ref = generateCache(resourceIDsToSharedIDs, alphaValueToIDs, meshColourState, resourceIDTransState, clipState, cam, stateBuffers);
-			data.timestamp = firstFrame;
-			frameData.push_back(data);
+			generateCache(resourceIDsToSharedIDs, alphaValueToIDs, meshColourState, resourceIDTransState, clipState, cam, firstFrame, frameCache);
 		}
 
 		for (const auto &currentFrame : animation.frames) {
@@ -882,15 +1090,15 @@ repo::core::model::RepoScene* SynchroModelImport::generateRepoScene(uint8_t &err
 			lastFrame = std::max(lastFrame, currentTime * 1000);
 
 			updateFrameState(currentFrame.second, resourceIDsToSharedIDs, resourceIDLastTrans, alphaValueToIDs, meshAlphaState, meshColourState, resourceIDTransState, clipState, cam, transformingResources, offset);
-			repo::core::model::RepoSequence::FrameData data;
-			data.ref = generateCache(resourceIDsToSharedIDs, alphaValueToIDs, meshColourState, resourceIDTransState, clipState, cam, stateBuffers);
-			data.timestamp = currentTime;
-			frameData.push_back(data);
+			generateCache(resourceIDsToSharedIDs, alphaValueToIDs, meshColourState, resourceIDTransState, clipState, cam, currentTime, frameCache);
 			if (++count % step == 0) {
 				repoInfo << "Processed " << count << " of " << total << " frames";
 			};
 		}
 
+		frameCache.flush();
+		repoInfo << "Frames with unchanged state: " << frameCache.getNumDropped() << ", unique states: " << stateBuffers.size();
+
 		repoInfo << "transforming Mesh: " << transformingResources.size();
 		for (const auto &resourceID : transformingResources) {
 			for (const auto &mesh : resourceIDsToSharedIDs[resourceID]) {
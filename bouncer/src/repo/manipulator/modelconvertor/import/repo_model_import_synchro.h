@@ -65,6 +65,7 @@ namespace repo {
 
 			private:
 				class CameraChange;
+				class FrameCache;
 
 				struct SequenceTask {
 					repo::lib::RepoUUID id;
@@ -129,14 +130,19 @@ namespace repo {
 
 				std::vector<float> colourFrom32Bit(const uint32_t &color) const;
 
-				std::string generateCache(
+				/*
+				* Captures the current animation state and adds it to the cache as the
+				* state of the frame at timestamp.
+				*/
+				void generateCache(
 					const std::unordered_map<std::string, std::vector<repo::lib::RepoUUID>> &resourceIDsToSharedIDs,
 					const std::unordered_map<float, std::set<std::string>> &alphaValueToIDs,
 					const std::unordered_map<repo::lib::RepoUUID, std::pair<uint32_t, std::vector<float>>, repo::lib::RepoUUIDHasher> &meshColourState,
 					const std::unordered_map<std::string, std::vector<double>> &resourceIDTransState,
 					const std::unordered_map<repo::lib::RepoUUID, std::pair<repo::lib::RepoVector3D64, repo::lib::RepoVector3D64>, repo::lib::RepoUUIDHasher> &clipState,
 					const std::shared_ptr<CameraChange> &cam,
-					std::unordered_map<std::string, std::vector<uint8_t>> &stateBuffers);
+					uint64_t timestamp,
+					FrameCache &cache);
 
 				void updateFrameState(
 					const std::vector<std::shared_ptr<synchro_reader::AnimationTask>> &tasks,
@@ -31,6 +31,10 @@
 
 #include <algorithm>
 #include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
 
 using namespace repo::lib;
 using namespace repo::manipulator::modeloptimizer;
@@ -54,7 +58,9 @@ MultipartOptimizer::MultipartOptimizer(
 ):
 	handler(handler),
 	exporter(exporter),
-	splitByFloor(splitByFloor)
+	splitByFloor(splitByFloor),
+	numThreads(0),
+	memoryBudget(REPO_MP_DEFAULT_MEMORY_BUDGET)
 {
 }
 
@@ -103,19 +109,58 @@ void MultipartOptimizer::processScene(
 	// Process jobs
 	repoInfo << "Processing Jobs";
 
-	for (auto job : jobs) {
-		clusterAndSupermesh(
-			database,
-			collection,
-			transformMap,
-			matPropMap,
-			job);
+	auto threads = getNumThreads();
+
+	// The jobs are clustered concurrently first. This is mostly waiting on the
+	// database, and the StreamingMeshNodes only hold bounds so are small.
+
+	std::vector<std::vector<ClusteredGroup>> clusteredJobs(jobs.size());
+	parallelFor(threads, jobs.size(), [&](size_t i) {
+		clusteredJobs[i] = clusterJob(database, collection, transformMap, jobs[i]);
+	});
+
+	// Each cluster becomes a task, in the order they would have been processed
+	// sequentially.
+
+	std::vector<ClusterTask> tasks;
+	for (auto& groups : clusteredJobs) {
+		for (auto& group : groups) {
+			for (auto& cluster : group.clusters) {
+				ClusterTask task;
+				task.group = &group;
+				task.cluster = &cluster;
+				task.cost = 0;
+				for (auto index : cluster) {
+					task.cost += (size_t)group.nodes[index].getNumVertices() * REPO_MP_BYTES_PER_VERTEX;
+				}
+				tasks.push_back(task);
+			}
+		}
 	}
 
+	repoInfo << "Creating Supermeshes from " << tasks.size() << " clusters on " << threads << " threads";
+
+	createSuperMeshes(database, collection, transformMap, matPropMap, tasks, threads);
+
 	// Finalise export
 	exporter->finalise();
 }
 
+void MultipartOptimizer::setNumThreads(int numThreads)
+{
+	this->numThreads = numThreads;
+}
+
+void MultipartOptimizer::setMemoryBudget(size_t budget)
+{
+	this->memoryBudget = budget;
+}
+
+size_t MultipartOptimizer::getNumThreads() const
+{
+	return numThreads > 0 ? numThreads : std::max(1u, std::thread::hardware_concurrency());
+}
+
 MultipartOptimizer::TransformMap MultipartOptimizer::getAllTransforms(
 	const std::string &database,
 	const std::string &collection,
@@ -381,11 +426,10 @@ MultipartOptimizer::ProcessingJob repo::manipulator::modeloptimizer::MultipartOp
 	return ProcessingJob({ description, filter, texId });
 }
 
-void MultipartOptimizer::clusterAndSupermesh(
+std::vector<MultipartOptimizer::ClusteredGroup> MultipartOptimizer::clusterJob(
 	const std::string &database,
 	const std::string &collection,
 	const TransformMap& transformMap,
-	const MaterialPropMap& matPropMap,
 	const MultipartOptimizer::ProcessingJob &job
 ) {
 	repoInfo << "Processing Job: " << job.description;
@@ -447,138 +491,333 @@ void MultipartOptimizer::clusterAndSupermesh(
 		group.emplace_back(std::move(node));
 	}
 
+	std::vector<ClusteredGroup> clustered;
+
 	if (groups.size() == 0) {
 		repoInfo << "No groups to process for this job. Returning.";
-		return;
+		return clustered;
 	}
 
-	// Process the mesh groups
+	// Cluster the mesh groups
 	for (auto& group : groups) {
 		auto& branchGroup = group.first.branch;
-		auto& nodes = group.second;
 
-		// Cluster the mesh nodes
-		repoInfo << "Clustering Nodes";
-		auto clusters = clusterMeshNodes(nodes);
+		ClusteredGroup c;
+		c.nodes = std::move(group.second);
+		c.clusters = clusterMeshNodes(c.nodes);
+		c.texId = job.isTexturedJob() ? job.texId : repo::lib::RepoUUID();
+		c.tag = branchGroup ? branchGroup->name : std::string(); // Resource groups never contribute to the name, only branch groups
+		clustered.push_back(std::move(c));
+	}
+
+	return clustered;
+}
+
+namespace {
+	/*
+	* Limits the estimated memory held by the clusters being processed, or waiting
+	* to be handed to the exporter. A single task is always allowed, even if it is
+	* larger than the budget on its own, so an oversized cluster cannot stall.
+	*/
+	class MemoryBudget
+	{
+	public:
+		MemoryBudget(size_t budget)
+			:budget(budget)
+		{
+		}
+
+		void acquire(size_t size)
+		{
+			std::unique_lock lock(mutex);
+			available.wait(lock, [&] {
+				return cancelled || outstanding == 0 || outstanding + size <= budget;
+			});
+			outstanding += size;
+		}
+
+		void release(size_t size)
+		{
+			{
+				std::scoped_lock lock(mutex);
+				outstanding -= size;
+			}
+			available.notify_all();
+		}
+
+		void cancel()
+		{
+			{
+				std::scoped_lock lock(mutex);
+				cancelled = true;
+			}
+			available.notify_all();
+		}
+
+	private:
+		size_t budget;
+		size_t outstanding = 0;
+		bool cancelled = false;
+		std::mutex mutex;
+		std::condition_variable available;
+	};
+}
+
+void MultipartOptimizer::parallelFor(size_t numThreads, size_t count, std::function<void(size_t)> func)
+{
+	std::atomic<size_t> next = 0;
+	std::atomic<bool> aborted = false;
+	std::exception_ptr exception;
+	std::mutex exceptionMutex;
+
+	auto work = [&]() {
+		size_t i;
+		while (!aborted && (i = next++) < count) {
+			try {
+				func(i);
+			}
+			catch (...) {
+				std::scoped_lock lock(exceptionMutex);
+				if (!exception) {
+					exception = std::current_exception();
+				}
+				aborted = true;
+			}
+		}
+	};
+
+	{
+		std::vector<std::jthread> threads;
+		for (size_t i = 0; i < std::min(numThreads, count); i++) {
+			threads.emplace_back(work);
+		}
+	}
 
-		// Create Supermeshes from the clusters
-		repoInfo << "Creating Supermeshes from clustered Nodes";
-		auto texId = job.isTexturedJob() ? job.texId : repo::lib::RepoUUID();
-		auto tag = branchGroup ? branchGroup->name : std::string(); // Resource groups never contribute to the name, only branch groups
-		createSuperMeshes(database, collection, transformMap, matPropMap, nodes, clusters, texId, tag);
+	if (exception) {
+		std::rethrow_exception(exception);
 	}
 }
 
+void MultipartOptimizer::createSuperMeshes(
+	const std::string& database,
+	const std::string& collection,
+	const TransformMap& transformMap,
+	const MaterialPropMap& matPropMap,
+	std::vector<ClusterTask>& tasks,
+	size_t numThreads)
+{
+	// The clusters are processed concurrently, but their supermeshes are given to
+	// the exporter in the order of the tasks, so the output is the same as if they
+	// were processed one at a time.
+	//
+	// Tasks are admitted one at a time, in order, against the memory budget. The
+	// budget for a task is only released once its supermeshes have been handed
+	// over, so it also accounts for any output held while waiting on earlier
+	// tasks. As the earliest outstanding task is always admitted before any that
+	// follow it, it can always complete, and so the workers cannot deadlock.
+
+	MemoryBudget budget(memoryBudget);
+
+	std::mutex admissionMutex;
+	size_t next = 0;
+
+	std::mutex outputMutex;
+	std::vector<Supermeshes> outputs(tasks.size());
+	std::vector<bool> complete(tasks.size());
+	size_t nextOutput = 0;
+
+	auto handOver = [&](size_t index, Supermeshes output) {
+		std::scoped_lock lock(outputMutex);
+		outputs[index] = std::move(output);
+		complete[index] = true;
+		while (nextOutput < tasks.size() && complete[nextOutput]) {
+			for (auto& supermesh : outputs[nextOutput]) {
+				exporter->addSupermesh(supermesh.get());
+			}
+			outputs[nextOutput].clear();
+			budget.release(tasks[nextOutput].cost);
+			nextOutput++;
+		}
+	};
+
+	// If a worker fails, the budget is cancelled so none of the others are left
+	// waiting on tasks that will never be handed over.
+
+	std::atomic<bool> aborted = false;
+
+	parallelFor(numThreads, numThreads, [&](size_t) {
+		try {
+			while (true) {
+				size_t index;
+				{
+					std::scoped_lock lock(admissionMutex);
+					if (aborted || next >= tasks.size()) {
+						return;
+					}
+					index = next++;
+					budget.acquire(tasks[index].cost);
+				}
+
+				if (aborted) {
+					return;
+				}
+
+				auto& task = tasks[index];
+				Supermeshes output;
+				createSuperMeshes(
+					database,
+					collection,
+					transformMap,
+					matPropMap,
+					task.group->nodes,
+					*task.cluster,
+					task.group->texId,
+					task.group->tag,
+					output
+				);
+				handOver(index, std::move(output));
+			}
+		}
+		catch (...) {
+			aborted = true;
+			budget.cancel();
+			throw;
+		}
+	});
+}
+
 void repo::manipulator::modeloptimizer::MultipartOptimizer::createSuperMeshes(
 	const std::string &database,
 	const std::string &collection,
 	const TransformMap& transformMap,
 	const MaterialPropMap& matPropMap,
 	std::vector<repo::core::model::StreamingMeshNode>& meshNodes,
-	const std::vector<std::vector<int>>& clusters,
+	const std::vector<int>& cluster,
 	const repo::lib::RepoUUID &texId,
-	const std::string& namedGrouping)
+	const std::string& namedGrouping,
+	Supermeshes& output)
 {
 	// Get blobHandler
 	auto sceneCollection = collection + "." + REPO_COLLECTION_SCENE;
 	repo::core::handler::fileservice::BlobFilesHandler blobHandler(handler->getFileManager(), database, sceneCollection);
 
-	for (auto cluster : clusters) {
-
-		std::unordered_map<repo::lib::RepoUUID, int, repo::lib::RepoUUIDHasher> clusterMap;
-		std::vector<repo::lib::RepoUUID> sharedIdsInCluster;
-		for (auto& index : cluster) {
-			auto& node = meshNodes[index];
-			auto sharedId = node.getSharedId();
-			clusterMap.insert({ sharedId, index });
+	std::unordered_map<repo::lib::RepoUUID, int, repo::lib::RepoUUIDHasher> clusterMap;
+	std::vector<repo::lib::RepoUUID> sharedIdsInCluster;
+	for (auto& index : cluster) {
+		auto& node = meshNodes[index];
+		auto sharedId = node.getSharedId();
+		clusterMap.insert({ sharedId, index });
 
-			sharedIdsInCluster.push_back(sharedId);
-		}
+		sharedIdsInCluster.push_back(sharedId);
+	}
 
-		// Create filter
-		auto filter = repo::core::handler::database::query::Eq(REPO_NODE_LABEL_SHARED_ID, sharedIdsInCluster);
+	// Create filter
+	auto filter = repo::core::handler::database::query::Eq(REPO_NODE_LABEL_SHARED_ID, sharedIdsInCluster);
 
-		// Create projection
-		repo::core::handler::database::query::RepoProjectionBuilder projection;
-		projection.excludeField(REPO_NODE_LABEL_ID);
-		projection.includeField(REPO_NODE_LABEL_SHARED_ID);
-		projection.includeField(REPO_NODE_MESH_LABEL_VERTICES_COUNT);
-		projection.includeField(REPO_NODE_MESH_LABEL_FACES_COUNT);
-		projection.includeField(REPO_NODE_MESH_LABEL_UV_CHANNELS_COUNT);
-		projection.includeField(REPO_NODE_MESH_LABEL_PRIMITIVE);
-		projection.includeField(REPO_LABEL_BINARY_REFERENCE);
+	// Create projection
+	repo::core::handler::database::query::RepoProjectionBuilder projection;
+	projection.includeField(REPO_NODE_LABEL_ID); // The unique ids are used in the supermesh mappings
+	projection.includeField(REPO_NODE_LABEL_SHARED_ID);
+	projection.includeField(REPO_NODE_MESH_LABEL_VERTICES_COUNT);
+	projection.includeField(REPO_NODE_MESH_LABEL_FACES_COUNT);
+	projection.includeField(REPO_NODE_MESH_LABEL_FACES_ENCODING);
+	projection.includeField(REPO_NODE_MESH_LABEL_UV_CHANNELS_COUNT);
+	projection.includeField(REPO_NODE_MESH_LABEL_PRIMITIVE);
+	projection.includeField(REPO_LABEL_BINARY_REFERENCE);
+
+	auto binNodes = handler->findAllByCriteria(database, sceneCollection, filter, projection);
+
+	// Read the geometry in the order it is laid out in the blob files, so each
+	// mapped file is read through sequentially.
+
+	std::vector<repo::core::handler::fileservice::DataRef> dataRefs;
+	std::vector<size_t> readOrder;
+	dataRefs.reserve(binNodes.size());
+	for (size_t i = 0; i < binNodes.size(); i++) {
+		dataRefs.push_back(repo::core::handler::fileservice::DataRef::deserialise(binNodes[i].getBinaryReference()));
+		readOrder.push_back(i);
+	}
 
-		auto binNodes = handler->findAllByCriteria(database, sceneCollection, filter, projection);
+	std::sort(readOrder.begin(), readOrder.end(), [&](size_t a, size_t b) {
+		auto& refA = dataRefs[a];
+		auto& refB = dataRefs[b];
+		if (refA.getFileName() != refB.getFileName()) {
+			return refA.getFileName() < refB.getFileName();
+		}
+		return refA.getStartPos() < refB.getStartPos();
+	});
 
-		// Iterate over the meshes and decide what to do with each. The options are
-		// to append to the existing supermesh, start a new supermesh, or split into
-		// multiple supermeshes.
+	// Iterate over the meshes and decide what to do with each. The options are
+	// to append to the existing supermesh, start a new supermesh, or split into
+	// multiple supermeshes.
 
-		mapped_mesh_t currentSupermesh;
+	mapped_mesh_t currentSupermesh;
 
-		for (auto& nodeBson : binNodes) {
+	for (auto index : readOrder) {
+		auto& nodeBson = binNodes[index];
+		auto& dataRef = dataRefs[index];
 
-			// Find streamed node
-			auto sharedId = nodeBson.getUUIDField(REPO_NODE_LABEL_SHARED_ID);
-			auto nodeIndex = clusterMap.at(sharedId);
-			auto& sNode = meshNodes[nodeIndex];
+		// Find streamed node
+		auto sharedId = nodeBson.getUUIDField(REPO_NODE_LABEL_SHARED_ID);
+		auto nodeIndex = clusterMap.at(sharedId);
+		auto& sNode = meshNodes[nodeIndex];
 
-			// Load geometry for this node.
-			// Placed In its own scope so that buffer can be discarded as soon as it is processed
-			{
-				auto binRef = nodeBson.getBinaryReference();
-				auto dataRef = repo::core::handler::fileservice::DataRef::deserialise(binRef);
-				auto buffer = blobHandler.readToBuffer(dataRef);
+		// Load geometry for this node.
+		// Placed In its own scope so that the view can be released as soon as the
+		// node is baked. The vertices and normals are read directly from the view
+		// by the baking, so it must be kept until then.
+		{
+			auto view = blobHandler.readToView(dataRef);
 
-				// If there is no texture present, we ignore UV values.
-				// This allows us to group more meshes together.
-				bool ignoreUVs = texId.isDefaultValue();
+			// If there is no texture present, we ignore UV values.
+			// This allows us to group more meshes together.
+			bool ignoreUVs = texId.isDefaultValue();
 
-				sNode.loadSupermeshingData(nodeBson, buffer, ignoreUVs);
-			}
+			sNode.loadSupermeshingData(nodeBson, view.data(), view.size(), ignoreUVs);
 
 			// Bake the streaming mesh node by applying the transformation to the vertices
 			// Note that the bounds have already been transformed by calling transformBounds earlier
 			auto transform = transformMap.at(sNode.getParent());
 			sNode.bakeLoadedMeshes(transform.matrix);
-
-			if (currentSupermesh.vertices.size() + sNode.getNumLoadedVertices() <= REPO_MP_MAX_VERTEX_COUNT)
-			{
-				// The current node can be added to the supermesh OK				
-				appendMesh(sNode, matPropMap, currentSupermesh, texId);
-			}
-			else if (sNode.getNumLoadedVertices() > REPO_MP_MAX_VERTEX_COUNT)
-			{
-				// The node is too big to fit into any supermesh, so it must be split
-				splitMesh(sNode, matPropMap, texId, namedGrouping);
-			}
-			else
-			{
-				// The node is small enough to fit within one supermesh, just not this one
-				createSuperMesh(currentSupermesh, namedGrouping);
-				currentSupermesh = mapped_mesh_t();
-				appendMesh(sNode, matPropMap, currentSupermesh, texId);
-			}
-
-			// Unload the streaming node
-			sNode.unloadSupermeshingData();
 		}
 
-		// Add the last supermesh to be built
-		if (currentSupermesh.vertices.size()) {
-			createSuperMesh(currentSupermesh, namedGrouping);
+		if (currentSupermesh.vertices.size() + sNode.getNumLoadedVertices() <= REPO_MP_MAX_VERTEX_COUNT)
+		{
+			// The current node can be added to the supermesh OK				
+			appendMesh(sNode, matPropMap, currentSupermesh, texId);
+		}
+		else if (sNode.getNumLoadedVertices() > REPO_MP_MAX_VERTEX_COUNT)
+		{
+			// The node is too big to fit into any supermesh, so it must be split
+			splitMesh(sNode, matPropMap, texId, namedGrouping, output);
 		}
+		else
+		{
+			// The node is small enough to fit within one supermesh, just not this one
+			createSuperMesh(currentSupermesh, namedGrouping, output);
+			currentSupermesh = mapped_mesh_t();
+			appendMesh(sNode, matPropMap, currentSupermesh, texId);
+		}
+
+		// Unload the streaming node
+		sNode.unloadSupermeshingData();
+	}
+
+	// Add the last supermesh to be built
+	if (currentSupermesh.vertices.size()) {
+		createSuperMesh(currentSupermesh, namedGrouping, output);
 	}
 }
 
 void MultipartOptimizer::createSuperMesh(
-	const mapped_mesh_t& mappedMesh, const std::string& tag)
+	const mapped_mesh_t& mappedMesh, const std::string& tag, Supermeshes& output)
 {
-	// Create supermesh node
+	// Create supermesh node. This is handed to the exporter once all the
+	// clusters before it have been processed.
 	auto supermeshNode = createSupermeshNode(mappedMesh);
 	supermeshNode->setGrouping(tag);
 
-	exporter->addSupermesh(supermeshNode.get());
+	output.push_back(std::move(supermeshNode));
 }
 
 void MultipartOptimizer::appendMesh(
@@ -808,7 +1047,8 @@ void MultipartOptimizer::createSupermeshFromBranch(
 	const repo::lib::RepoUUID& texId,
 	std::set<uint32_t>* globalVertexIndices,
 	std::vector<uint32_t>* primitives,
-	const std::string& namedGrouping
+	const std::string& namedGrouping,
+	Supermeshes& output
 )
 {
 	const auto& faces = node.getLoadedFaces();
@@ -894,14 +1134,15 @@ void MultipartOptimizer::createSupermeshFromBranch(
 
 	mapped.meshMapping.push_back(mapping);
 
-	createSuperMesh(mapped, namedGrouping);
+	createSuperMesh(mapped, namedGrouping, output);
 }
 
 void MultipartOptimizer::splitMesh(
 	repo::core::model::StreamingMeshNode& node,
 	const MaterialPropMap& matPropMap,
 	const repo::lib::RepoUUID& texId,
-	const std::string& namedGrouping
+	const std::string& namedGrouping,
+	Supermeshes& output
 )
 {
 	// Note: Explanation of the advancing front approach in header.
@@ -992,7 +1233,8 @@ void MultipartOptimizer::splitMesh(
 					texId,
 					leftVerts.get(),
 					leftPrimitives.get(),
-					namedGrouping);
+					namedGrouping,
+					output);
 				meshesCreated++;
 
 				// Release vertex and primitive indices from memory
@@ -1018,7 +1260,8 @@ void MultipartOptimizer::splitMesh(
 					texId,
 					rightVerts.get(),
 					rightPrimitives.get(),
-					namedGrouping);
+					namedGrouping,
+					output);
 				meshesCreated++;
 
 				// Release vertex and primitive indices from memory
@@ -1066,7 +1309,8 @@ void MultipartOptimizer::splitMesh(
 						texId,
 						leftVerts.get(),
 						leftPrimitives.get(),
-						namedGrouping);
+						namedGrouping,
+						output);
 					meshesCreated++;
 				}
 
@@ -1078,7 +1322,8 @@ void MultipartOptimizer::splitMesh(
 						texId,
 						rightVerts.get(),
 						rightPrimitives.get(),
-						namedGrouping);
+						namedGrouping,
+						output);
 					meshesCreated++;
 				}
 
@@ -1106,7 +1351,8 @@ void MultipartOptimizer::splitMesh(
 			texId,
 			leftoverVerts.get(),
 			leftoverPrimitives.get(),
-			namedGrouping);
+			namedGrouping,
+			output);
 		meshesCreated++;
 	}
 
@@ -34,6 +34,8 @@
 #include <repo/core/model/bson/repo_bson.h>
 #include <repo/core/model/bson/repo_node_streaming_mesh.h>
 
+#include <functional>
+
 namespace repo {
 	namespace manipulator {
 		namespace modeloptimizer {
@@ -42,6 +44,14 @@ namespace repo {
 			// This figure is empirically set to end up with an average bundle size of 24 Mb.
 			#define REPO_MP_MAX_VERTEX_COUNT 1200000
 
+			// An estimate of the memory used by each vertex of a cluster while it is
+			// processed, including its share of the faces and the supermesh it ends up in.
+			#define REPO_MP_BYTES_PER_VERTEX 128
+
+			// The default limit on the estimated memory of the clusters that are being
+			// processed concurrently (2 Gb).
+			#define REPO_MP_DEFAULT_MEMORY_BUDGET ((size_t)2 * 1024 * 1024 * 1024)
+
 			class MultipartOptimizer
 			{
 				typedef float Scalar;
@@ -64,8 +74,26 @@ namespace repo {
 					repo::lib::RepoUUID revId
 				);
 
+				/*
+				* The number of threads used to process the jobs and clusters. If zero or
+				* less, the hardware concurrency is used.
+				*/
+				void setNumThreads(int numThreads);
+
+				/*
+				* The limit on the estimated memory held by clusters that are being
+				* processed, or are waiting to be handed to the exporter, at any one time.
+				*/
+				void setMemoryBudget(size_t budget);
+
 			private:
 				bool splitByFloor;
+				int numThreads;
+				size_t memoryBudget;
+
+				size_t getNumThreads() const;
+
+				typedef std::vector<std::unique_ptr<repo::core::model::SupermeshNode>> Supermeshes;
 
 				/**
 				* Represents a batched set of geometry.
@@ -160,28 +188,73 @@ namespace repo {
 					const repo::lib::RepoUUID &texId
 				);
 
-				void clusterAndSupermesh(
+				/*
+				* The mesh nodes of one group of a job, and the clusters they have been
+				* split into. Each cluster becomes one or more supermeshes.
+				*/
+				struct ClusteredGroup {
+					std::vector<repo::core::model::StreamingMeshNode> nodes;
+					std::vector<std::vector<int>> clusters;
+					repo::lib::RepoUUID texId;
+					std::string tag;
+
+					// RepoUUID's copy constructor is not noexcept, so the move
+					// must be declared explicitly for vectors of groups to move
+					// rather than copy the (move-only) nodes when they grow.
+					ClusteredGroup() = default;
+					ClusteredGroup(ClusteredGroup&&) noexcept = default;
+					ClusteredGroup& operator=(ClusteredGroup&&) noexcept = default;
+				};
+
+				struct ClusterTask {
+					ClusteredGroup* group;
+					const std::vector<int>* cluster;
+					size_t cost; // Estimated memory, in bytes
+				};
+
+				/*
+				* Runs func for each index in [0, count) on up to numThreads threads. If any
+				* call throws, the remaining indices are skipped and the first exception is
+				* rethrown on the calling thread.
+				*/
+				static void parallelFor(size_t numThreads, size_t count, std::function<void(size_t)> func);
+
+				std::vector<ClusteredGroup> clusterJob(
 					const std::string &database,
 					const std::string &collection,
 					const TransformMap& transformMap,
-					const MaterialPropMap& matPropMap,
 					const ProcessingJob &job
 				);
 
+				/*
+				* Creates the supermeshes for all the tasks concurrently, and hands them to
+				* the exporter in the order of the tasks.
+				*/
+				void createSuperMeshes(
+					const std::string& database,
+					const std::string& collection,
+					const TransformMap& transformMap,
+					const MaterialPropMap& matPropMap,
+					std::vector<ClusterTask>& tasks,
+					size_t numThreads
+				);
+
 				void createSuperMeshes(
 					const std::string &database,
 					const std::string &collection,
 					const TransformMap& transformMap,
 					const MaterialPropMap& matPropMap,
 					std::vector<repo::core::model::StreamingMeshNode>& meshNodes,
-					const std::vector<std::vector<int>>& clusters,
+					const std::vector<int>& cluster,
 					const repo::lib::RepoUUID &texId,
-					const std::string& namedGrouping
+					const std::string& namedGrouping,
+					Supermeshes& output
 				);
 
 				void createSuperMesh(
 					const mapped_mesh_t& mappedMesh,
-					const std::string& tag
+					const std::string& tag,
+					Supermeshes& output
 				);
 
 				void appendMesh(					
@@ -251,7 +324,8 @@ namespace repo {
 					repo::core::model::StreamingMeshNode& node,
 					const MaterialPropMap& matPropMap,
 					const repo::lib::RepoUUID& texId,
-					const std::string& namedGrouping
+					const std::string& namedGrouping,
+					Supermeshes& output
 				);
 
 				void createSupermeshFromBranch(
@@ -260,7 +334,8 @@ namespace repo {
 					const repo::lib::RepoUUID& texId,
 					std::set<uint32_t>* globalVertexIndices,
 					std::vector<uint32_t>* primitives,
-					const std::string& namedGrouping
+					const std::string& namedGrouping,
+					Supermeshes& output
 				);
 
 				/**
@@ -22,6 +22,8 @@
 
 #include "repo/manipulator/modeloptimizer/bvh/sweep_sah_builder.hpp"
 
+#include <deque>
+
 using namespace bvh;
 
 void Traversal::operator()(const bvh::Bvh<double>& a, const bvh::Bvh<double>& b) {
@@ -181,6 +183,179 @@ void Traversal::operator()(const bvh::Bvh<double>& a) {
 	}
 }
 
+namespace {
+	/*
+	* Pushes the pairs of children to continue a traversal between two nodes,
+	* at least one of which is a branch.
+	*/
+	template<typename Container>
+	void expand(Container& tasks,
+		size_t idxLeft, const bvh::Bvh<double>::Node& left,
+		size_t idxRight, const bvh::Bvh<double>::Node& right)
+	{
+		if (left.is_leaf()) {
+			tasks.push_back({ idxLeft, right.first_child_or_primitive + 0, false });
+			tasks.push_back({ idxLeft, right.first_child_or_primitive + 1, false });
+		}
+		else if (right.is_leaf()) {
+			tasks.push_back({ left.first_child_or_primitive + 0, idxRight, false });
+			tasks.push_back({ left.first_child_or_primitive + 1, idxRight, false });
+		}
+		else {
+			tasks.push_back({ left.first_child_or_primitive + 0, right.first_child_or_primitive + 0, false });
+			tasks.push_back({ left.first_child_or_primitive + 0, right.first_child_or_primitive + 1, false });
+			tasks.push_back({ left.first_child_or_primitive + 1, right.first_child_or_primitive + 0, false });
+			tasks.push_back({ left.first_child_or_primitive + 1, right.first_child_or_primitive + 1, false });
+		}
+	}
+
+	/*
+	* The overlaps within a branch are those within each of its children, and
+	* those between the two children.
+	*/
+	template<typename Container>
+	void expand(Container& tasks, const bvh::Bvh<double>::Node& node)
+	{
+		tasks.push_back({ node.first_child_or_primitive + 0, node.first_child_or_primitive + 0, true });
+		tasks.push_back({ node.first_child_or_primitive + 1, node.first_child_or_primitive + 1, true });
+		tasks.push_back({ node.first_child_or_primitive + 0, node.first_child_or_primitive + 1, false });
+	}
+
+	template<typename Predicate>
+	std::vector<Traversal::Task> split(
+		const bvh::Bvh<double>& a,
+		const bvh::Bvh<double>& b,
+		Traversal::Task root,
+		size_t count,
+		Predicate intersect)
+	{
+		// Tasks that cannot be expanded any further (because they refer only to
+		// leaves) are moved to the output straight away, so the loop ends when
+		// there are enough tasks overall, or none left to expand.
+
+		std::vector<Traversal::Task> tasks;
+		std::deque<Traversal::Task> queue;
+		queue.push_back(root);
+
+		while (!queue.empty() && tasks.size() + queue.size() < count) {
+			auto task = queue.front();
+			queue.pop_front();
+
+			auto& left = a.nodes[task.a];
+			auto& right = b.nodes[task.b];
+
+			if (task.self) {
+				if (left.is_leaf()) {
+					tasks.push_back(task);
+				}
+				else {
+					expand(queue, left);
+				}
+				continue;
+			}
+
+			if (!intersect(left, right)) {
+				continue;
+			}
+
+			if (left.is_leaf() && right.is_leaf()) {
+				tasks.push_back(task);
+			}
+			else {
+				expand(queue, task.a, left, task.b, right);
+			}
+		}
+
+		tasks.insert(tasks.end(), queue.begin(), queue.end());
+		return tasks;
+	}
+}
+
+std::vector<Traversal::Task> Traversal::split(
+	const bvh::Bvh<double>& a,
+	const bvh::Bvh<double>& b,
+	size_t count)
+{
+	if (!a.node_count || !b.node_count) {
+		return {};
+	}
+	return ::split(a, b, { 0, 0, false }, count, [&](auto& l, auto& r) {
+		return intersect(l, r);
+	});
+}
+
+std::vector<Traversal::Task> Traversal::split(
+	const bvh::Bvh<double>& a,
+	size_t count)
+{
+	if (a.node_count < 2) { // A single-node tree cannot have internal overlaps.
+		return {};
+	}
+	return ::split(a, a, { 0, 0, true }, count, [&](auto& l, auto& r) {
+		return intersect(l, r);
+	});
+}
+
+bool Traversal::operator()(
+	const bvh::Bvh<double>& a,
+	const bvh::Bvh<double>& b,
+	const Task& task)
+{
+	// This is the same as the inter-bvh traversal, except that it can also
+	// start from (and so must be able to expand) a self Task. Self Tasks give a
+	// simpler intra-bvh traversal than the frontier approach, as each branch
+	// is expanded exactly once by construction.
+
+	std::vector<Task> tasks;
+	tasks.push_back(task);
+	while (!tasks.empty()) {
+		auto [idxLeft, idxRight, self] = tasks.back();
+		tasks.pop_back();
+
+		auto& left = a.nodes[idxLeft];
+		auto& right = b.nodes[idxRight];
+
+		if (self) {
+			if (!left.is_leaf()) {
+				expand(tasks, left);
+				continue;
+			}
+			for (size_t l = 0; l < left.primitive_count; l++) {
+				for (size_t r = l + 1; r < left.primitive_count; r++) {
+					if (intersect(
+						a.primitive_indices[left.first_child_or_primitive + l],
+						a.primitive_indices[left.first_child_or_primitive + r]
+					)) {
+						return true;
+					}
+				}
+			}
+			continue;
+		}
+
+		if (!intersect(left, right)) {
+			continue;
+		}
+
+		if (left.is_leaf() && right.is_leaf()) {
+			for (size_t l = 0; l < left.primitive_count; l++) {
+				for (size_t r = 0; r < right.primitive_count; r++) {
+					if (intersect(
+						a.primitive_indices[left.first_child_or_primitive + l],
+						b.primitive_indices[right.first_child_or_primitive + r]
+					)) {
+						return true;
+					}
+				}
+			}
+		}
+		else {
+			expand(tasks, idxLeft, left, idxRight, right);
+		}
+	}
+	return false;
+}
+
 namespace {
 	bvh::BoundingBox<double> overlap(const bvh::BoundingBox<double>& a,
 		const bvh::BoundingBox<double>& b)
@@ -280,6 +455,69 @@ bool IntersectQuery::intersect(
 	return predicates::intersects(a, b);
 }
 
+template<size_t N>
+void DistanceQuery::operator()(const WideBvh<N>& a, const WideBvh<N>& b)
+{
+	// d is read for every test, as the primitive tests may reduce it
+
+	wide::traverse(a, b,
+		[&](const typename WideBvh<N>::Box& box, const typename WideBvh<N>::Node& node) {
+			return wide::within<N>(box, node, d);
+		},
+		[&](size_t primA, size_t primB) {
+			return intersect(primA, primB);
+		}
+	);
+}
+
+template<size_t N>
+void DistanceQuery::operator()(const WideBvh<N>& a)
+{
+	wide::traverse(a,
+		[&](const typename WideBvh<N>::Box& box, const typename WideBvh<N>::Node& node) {
+			return wide::within<N>(box, node, d);
+		},
+		[&](size_t primA, size_t primB) {
+			return intersect(primA, primB);
+		}
+	);
+}
+
+template<size_t N>
+void IntersectQuery::operator()(const WideBvh<N>& a, const WideBvh<N>& b)
+{
+	wide::traverse(a, b,
+		[](const typename WideBvh<N>::Box& box, const typename WideBvh<N>::Node& node) {
+			return wide::intersects<N>(box, node);
+		},
+		[&](size_t primA, size_t primB) {
+			return intersect(primA, primB);
+		}
+	);
+}
+
+template<size_t N>
+void IntersectQuery::operator()(const WideBvh<N>& a)
+{
+	wide::traverse(a,
+		[](const typename WideBvh<N>::Box& box, const typename WideBvh<N>::Node& node) {
+			return wide::intersects<N>(box, node);
+		},
+		[&](size_t primA, size_t primB) {
+			return intersect(primA, primB);
+		}
+	);
+}
+
+template void DistanceQuery::operator()<4>(const WideBvh4& a, const WideBvh4& b);
+template void DistanceQuery::operator()<8>(const WideBvh8& a, const WideBvh8& b);
+template void DistanceQuery::operator()<4>(const WideBvh4& a);
+template void DistanceQuery::operator()<8>(const WideBvh8& a);
+template void IntersectQuery::operator()<4>(const WideBvh4& a, const WideBvh4& b);
+template void IntersectQuery::operator()<8>(const WideBvh8& a, const WideBvh8& b);
+template void IntersectQuery::operator()<4>(const WideBvh4& a);
+template void IntersectQuery::operator()<8>(const WideBvh8& a);
+
 void bvh::builders::build(bvh::Bvh<double>& bvh,
 	const std::vector<repo::lib::RepoVector3D64>& vertices,
 	const std::vector<repo::lib::repo_face_t>& faces)
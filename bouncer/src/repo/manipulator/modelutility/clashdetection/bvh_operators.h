@@ -18,10 +18,12 @@
 #pragma once
 
 #include "repo/manipulator/modeloptimizer/bvh/bvh.hpp"
+#include "bvh_wide.h"
 #include "repo/lib/datastructure/repo_vector.h"
 #include "repo/lib/datastructure/repo_triangle_fwd.h"
 
 #include <stack>
+#include <vector>
 #include <utility>
 #include <ranges>
 
@@ -106,6 +108,43 @@ namespace bvh {
 		*/
 		void operator()(
 			const bvh::Bvh<double>& a);
+
+		/*
+		* A pair of nodes from which a traversal can continue independently of the
+		* rest of it. If self is set, a and b are the same node, and the task is to
+		* find the overlaps within that node's subtree.
+		*/
+		struct Task {
+			size_t a;
+			size_t b;
+			bool self;
+		};
+
+		/*
+		* Expands the top of a traversal breadth-first into at least count Tasks
+		* (or as many as the trees allow). Branch pairs are only expanded if they
+		* intersect, so running all the Tasks finds the same primitive pairs as the
+		* full traversal, though in a different order. The second overload splits
+		* an intra-bvh traversal.
+		*/
+		std::vector<Task> split(
+			const bvh::Bvh<double>& a,
+			const bvh::Bvh<double>& b,
+			size_t count);
+
+		std::vector<Task> split(
+			const bvh::Bvh<double>& a,
+			size_t count);
+
+		/*
+		* Runs the part of a traversal given by a Task returned by split. For the
+		* Tasks of an intra-bvh traversal, a and b should be the same tree.
+		* Returns true if the traversal was terminated by the primitive intersect.
+		*/
+		bool operator()(
+			const bvh::Bvh<double>& a,
+			const bvh::Bvh<double>& b,
+			const Task& task);
 	};
 
 	/*
@@ -174,6 +213,18 @@ namespace bvh {
 		*/
 		virtual bool intersect(size_t primA, size_t primB) = 0;
 
+		using Traversal::operator();
+
+		/*
+		* The same queries over collapsed BVHs, where each node test is made against
+		* all the children of a node at once.
+		*/
+		template<size_t N>
+		void operator()(const WideBvh<N>& a, const WideBvh<N>& b);
+
+		template<size_t N>
+		void operator()(const WideBvh<N>& a);
+
 	private:
 		bool intersect(
 			const bvh::Bvh<double>::Node& a,
@@ -188,6 +239,18 @@ namespace bvh {
 	{
 		virtual bool intersect(size_t primA, size_t primB) = 0;
 
+		using Traversal::operator();
+
+		/*
+		* The same queries over collapsed BVHs, where each node test is made against
+		* all the children of a node at once.
+		*/
+		template<size_t N>
+		void operator()(const WideBvh<N>& a, const WideBvh<N>& b);
+
+		template<size_t N>
+		void operator()(const WideBvh<N>& a);
+
 	private:
 		bool intersect(
 			const bvh::Bvh<double>::Node& a,
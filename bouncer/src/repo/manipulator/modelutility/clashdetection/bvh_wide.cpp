@@ -0,0 +1,499 @@
+/**
+*  Copyright (C) 2025 3D Repo Ltd
+*
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU Affero General Public License as
+*  published by the Free Software Foundation, either version 3 of the
+*  License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Affero General Public License for more details.
+*
+*  You should have received a copy of the GNU Affero General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bvh_wide.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define REPO_BVH_SSE
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define REPO_TARGET_AVX
+#else
+#define REPO_TARGET_AVX __attribute__((target("avx")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define REPO_BVH_NEON
+#include <arm_neon.h>
+#endif
+
+using namespace bvh;
+
+/*
+* The lane tests are written for groups of four lanes, using SSE on x64 and NEON
+* on AArch64, both of which are always present. An eight wide node is tested as
+* two groups, unless AVX is available, which is checked at runtime so the build
+* flags are unchanged.
+*/
+
+namespace {
+
+	// The slack on comparisons of values computed in single precision, which is
+	// larger than the accumulated rounding error of any of the tests below.
+
+	const float SLACK = 1.0f + std::ldexp(1.0f, -20);
+
+	// These always step one float past the rounded value, so the result is on
+	// the right side of v even allowing for the error in computing v itself (in
+	// double precision, from the coordinates and the tree origin).
+
+	float roundDown(double v)
+	{
+		return std::nextafter((float)v, -std::numeric_limits<float>::infinity());
+	}
+
+	float roundUp(double v)
+	{
+		return std::nextafter((float)v, std::numeric_limits<float>::infinity());
+	}
+
+	/*
+	* The planes of a node that a ray enters and leaves each slab by, chosen by
+	* the sign of the ray direction. This keeps the inverted bounds of empty lanes
+	* inverted, so they are always missed.
+	*/
+	template<size_t N>
+	struct Slabs
+	{
+		const float* near[3];
+		const float* far[3];
+		float nearPadding[3];
+		float farPadding[3];
+
+		Slabs(const wide::Ray& ray, const typename WideBvh<N>::Node& node)
+		{
+			for (int k = 0; k < 3; k++) {
+				if (ray.inverse[k] >= 0) {
+					near[k] = node.min[k];
+					far[k] = node.max[k];
+					nearPadding[k] = -ray.padding[k];
+					farPadding[k] = ray.padding[k];
+				}
+				else {
+					near[k] = node.max[k];
+					far[k] = node.min[k];
+					nearPadding[k] = ray.padding[k];
+					farPadding[k] = -ray.padding[k];
+				}
+			}
+		}
+	};
+
+	template<size_t N>
+	uint32_t intersectsScalar(const typename WideBvh<N>::Box& box, const typename WideBvh<N>::Node& node, size_t offset)
+	{
+		uint32_t mask = 0;
+		for (size_t i = 0; i < 4; i++) {
+			auto l = offset + i;
+			bool hit = true;
+			for (int k = 0; k < 3; k++) {
+				hit &= node.min[k][l] <= box.max[k] && node.max[k][l] >= box.min[k];
+			}
+			mask |= (uint32_t)hit << i;
+		}
+		return mask;
+	}
+
+	template<size_t N>
+	uint32_t withinScalar(const typename WideBvh<N>::Box& box, const typename WideBvh<N>::Node& node, size_t offset, float threshold)
+	{
+		uint32_t mask = 0;
+		for (size_t i = 0; i < 4; i++) {
+			auto l = offset + i;
+			float sq = 0;
+			for (int k = 0; k < 3; k++) {
+				auto gap = std::max({ node.min[k][l] - box.max[k], box.min[k] - node.max[k][l], 0.0f });
+				sq += gap * gap;
+			}
+			mask |= (uint32_t)(sq <= threshold) << i;
+		}
+		return mask;
+	}
+
+	template<size_t N>
+	uint32_t intersectsScalar(const wide::Ray& ray, const Slabs<N>& slabs, size_t offset)
+	{
+		uint32_t mask = 0;
+		for (size_t i = 0; i < 4; i++) {
+			auto l = offset + i;
+			float tnear = 0;
+			float tfar = std::numeric_limits<float>::infinity();
+			for (int k = 0; k < 3; k++) {
+				tnear = std::max(tnear, (slabs.near[k][l] + slabs.nearPadding[k] - ray.origin[k]) * ray.inverse[k]);
+				tfar = std::min(tfar, (slabs.far[k][l] + slabs.farPadding[k] - ray.origin[k]) * ray.inverse[k]);
+			}
+			mask |= (uint32_t)(tnear <= tfar * SLACK) << i;
+		}
+		return mask;
+	}
+
+#ifdef REPO_BVH_SSE
+
+	bool hasAvx()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		bool osxsave = info[2] & (1 << 27);
+		bool avx = info[2] & (1 << 28);
+		return osxsave && avx && (_xgetbv(0) & 0x6) == 0x6;
+#else
+		return __builtin_cpu_supports("avx");
+#endif
+	}
+
+	const bool AVX = hasAvx();
+
+	template<size_t N>
+	uint32_t intersects4(const typename WideBvh<N>::Box& box, const typename WideBvh<N>::Node& node, size_t offset)
+	{
+		__m128 r = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int k = 0; k < 3; k++) {
+			auto lo = _mm_cmple_ps(_mm_load_ps(node.min[k] + offset), _mm_set1_ps(box.max[k]));
+			auto hi = _mm_cmpge_ps(_mm_load_ps(node.max[k] + offset), _mm_set1_ps(box.min[k]));
+			r = _mm_and_ps(r, _mm_and_ps(lo, hi));
+		}
+		return _mm_movemask_ps(r);
+	}
+
+	template<size_t N>
+	uint32_t within4(const typename WideBvh<N>::Box& box, const typename WideBvh<N>::Node& node, size_t offset, float threshold)
+	{
+		__m128 sq = _mm_setzero_ps();
+		for (int k = 0; k < 3; k++) {
+			auto a = _mm_sub_ps(_mm_load_ps(node.min[k] + offset), _mm_set1_ps(box.max[k]));
+			auto b = _mm_sub_ps(_mm_set1_ps(box.min[k]), _mm_load_ps(node.max[k] + offset));
+			auto gap = _mm_max_ps(_mm_max_ps(a, b), _mm_setzero_ps());
+			sq = _mm_add_ps(sq, _mm_mul_ps(gap, gap));
+		}
+		return _mm_movemask_ps(_mm_cmple_ps(sq, _mm_set1_ps(threshold)));
+	}
+
+	template<size_t N>
+	uint32_t intersects4(const wide::Ray& ray, const Slabs<N>& slabs, size_t offset)
+	{
+		__m128 tnear = _mm_setzero_ps();
+		__m128 tfar = _mm_set1_ps(std::numeric_limits<float>::infinity());
+		for (int k = 0; k < 3; k++) {
+			auto o = _mm_set1_ps(ray.origin[k]);
+			auto inv = _mm_set1_ps(ray.inverse[k]);
+			auto n = _mm_add_ps(_mm_load_ps(slabs.near[k] + offset), _mm_set1_ps(slabs.nearPadding[k]));
+			auto f = _mm_add_ps(_mm_load_ps(slabs.far[k] + offset), _mm_set1_ps(slabs.farPadding[k]));
+			tnear = _mm_max_ps(tnear, _mm_mul_ps(_mm_sub_ps(n, o), inv));
+			tfar = _mm_min_ps(tfar, _mm_mul_ps(_mm_sub_ps(f, o), inv));
+		}
+		return _mm_movemask_ps(_mm_cmple_ps(tnear, _mm_mul_ps(tfar, _mm_set1_ps(SLACK))));
+	}
+
+	REPO_TARGET_AVX uint32_t intersects8(const WideBvh8::Box& box, const WideBvh8::Node& node)
+	{
+		__m256 r = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int k = 0; k < 3; k++) {
+			auto lo = _mm256_cmp_ps(_mm256_load_ps(node.min[k]), _mm256_set1_ps(box.max[k]), _CMP_LE_OQ);
+			auto hi = _mm256_cmp_ps(_mm256_load_ps(node.max[k]), _mm256_set1_ps(box.min[k]), _CMP_GE_OQ);
+			r = _mm256_and_ps(r, _mm256_and_ps(lo, hi));
+		}
+		return _mm256_movemask_ps(r);
+	}
+
+	REPO_TARGET_AVX uint32_t within8(const WideBvh8::Box& box, const WideBvh8::Node& node, float threshold)
+	{
+		__m256 sq = _mm256_setzero_ps();
+		for (int k = 0; k < 3; k++) {
+			auto a = _mm256_sub_ps(_mm256_load_ps(node.min[k]), _mm256_set1_ps(box.max[k]));
+			auto b = _mm256_sub_ps(_mm256_set1_ps(box.min[k]), _mm256_load_ps(node.max[k]));
+			auto gap = _mm256_max_ps(_mm256_max_ps(a, b), _mm256_setzero_ps());
+			sq = _mm256_add_ps(sq, _mm256_mul_ps(gap, gap));
+		}
+		return _mm256_movemask_ps(_mm256_cmp_ps(sq, _mm256_set1_ps(threshold), _CMP_LE_OQ));
+	}
+
+	REPO_TARGET_AVX uint32_t intersects8(const wide::Ray& ray, const Slabs<8>& slabs)
+	{
+		__m256 tnear = _mm256_setzero_ps();
+		__m256 tfar = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+		for (int k = 0; k < 3; k++) {
+			auto o = _mm256_set1_ps(ray.origin[k]);
+			auto inv = _mm256_set1_ps(ray.inverse[k]);
+			auto n = _mm256_add_ps(_mm256_load_ps(slabs.near[k]), _mm256_set1_ps(slabs.nearPadding[k]));
+			auto f = _mm256_add_ps(_mm256_load_ps(slabs.far[k]), _mm256_set1_ps(slabs.farPadding[k]));
+			tnear = _mm256_max_ps(tnear, _mm256_mul_ps(_mm256_sub_ps(n, o), inv));
+			tfar = _mm256_min_ps(tfar, _mm256_mul_ps(_mm256_sub_ps(f, o), inv));
+		}
+		return _mm256_movemask_ps(_mm256_cmp_ps(tnear, _mm256_mul_ps(tfar, _mm256_set1_ps(SLACK)), _CMP_LE_OQ));
+	}
+
+#elif defined(REPO_BVH_NEON)
+
+	inline uint32_t movemask(uint32x4_t m)
+	{
+		const uint32x4_t bits = { 1, 2, 4, 8 };
+		return vaddvq_u32(vandq_u32(m, bits));
+	}
+
+	template<size_t N>
+	uint32_t intersects4(const typename WideBvh<N>::Box& box, const typename WideBvh<N>::Node& node, size_t offset)
+	{
+		uint32x4_t r = vdupq_n_u32(0xFFFFFFFF);
+		for (int k = 0; k < 3; k++) {
+			auto lo = vcleq_f32(vld1q_f32(node.min[k] + offset), vdupq_n_f32(box.max[k]));
+			auto hi = vcgeq_f32(vld1q_f32(node.max[k] + offset), vdupq_n_f32(box.min[k]));
+			r = vandq_u32(r, vandq_u32(lo, hi));
+		}
+		return movemask(r);
+	}
+
+	template<size_t N>
+	uint32_t within4(const typename WideBvh<N>::Box& box, const typename WideBvh<N>::Node& node, size_t offset, float threshold)
+	{
+		float32x4_t sq = vdupq_n_f32(0);
+		for (int k = 0; k < 3; k++) {
+			auto a = vsubq_f32(vld1q_f32(node.min[k] + offset), vdupq_n_f32(box.max[k]));
+			auto b = vsubq_f32(vdupq_n_f32(box.min[k]), vld1q_f32(node.max[k] + offset));
+			auto gap = vmaxq_f32(vmaxq_f32(a, b), vdupq_n_f32(0));
+			sq = vaddq_f32(sq, vmulq_f32(gap, gap));
+		}
+		return movemask(vcleq_f32(sq, vdupq_n_f32(threshold)));
+	}
+
+	template<size_t N>
+	uint32_t intersects4(const wide::Ray& ray, const Slabs<N>& slabs, size_t offset)
+	{
+		float32x4_t tnear = vdupq_n_f32(0);
+		float32x4_t tfar = vdupq_n_f32(std::numeric_limits<float>::infinity());
+		for (int k = 0; k < 3; k++) {
+			auto o = vdupq_n_f32(ray.origin[k]);
+			auto inv = vdupq_n_f32(ray.inverse[k]);
+			auto n = vaddq_f32(vld1q_f32(slabs.near[k] + offset), vdupq_n_f32(slabs.nearPadding[k]));
+			auto f = vaddq_f32(vld1q_f32(slabs.far[k] + offset), vdupq_n_f32(slabs.farPadding[k]));
+			tnear = vmaxq_f32(tnear, vmulq_f32(vsubq_f32(n, o), inv));
+			tfar = vminq_f32(tfar, vmulq_f32(vsubq_f32(f, o), inv));
+		}
+		return movemask(vcleq_f32(tnear, vmulq_f32(tfar, vdupq_n_f32(SLACK))));
+	}
+
+#else
+
+	template<size_t N>
+	uint32_t intersects4(const typename WideBvh<N>::Box& box, const typename WideBvh<N>::Node& node, size_t offset)
+	{
+		return intersectsScalar<N>(box, node, offset);
+	}
+
+	template<size_t N>
+	uint32_t within4(const typename WideBvh<N>::Box& box, const typename WideBvh<N>::Node& node, size_t offset, float threshold)
+	{
+		return withinScalar<N>(box, node, offset, threshold);
+	}
+
+	template<size_t N>
+	uint32_t intersects4(const wide::Ray& ray, const Slabs<N>& slabs, size_t offset)
+	{
+		return intersectsScalar<N>(ray, slabs, offset);
+	}
+
+#endif
+
+	float threshold(double d)
+	{
+		return roundUp(d * d) * SLACK;
+	}
+}
+
+template<size_t N>
+typename WideBvh<N>::Box wide::translate(const typename WideBvh<N>::Box& box, const Vector3<double>& offset)
+{
+	if (offset[0] == 0 && offset[1] == 0 && offset[2] == 0) {
+		return box;
+	}
+	typename WideBvh<N>::Box result;
+	for (int k = 0; k < 3; k++) {
+		result.min[k] = roundDown((double)box.min[k] + offset[k]);
+		result.max[k] = roundUp((double)box.max[k] + offset[k]);
+	}
+	return result;
+}
+
+template WideBvh4::Box wide::translate<4>(const WideBvh4::Box& box, const Vector3<double>& offset);
+template WideBvh8::Box wide::translate<8>(const WideBvh8::Box& box, const Vector3<double>& offset);
+
+wide::Ray::Ray(const bvh::Vector3<double>& o, const bvh::Vector3<double>& d, const bvh::Vector3<double>& frame)
+{
+	for (int k = 0; k < 3; k++) {
+		auto relative = o[k] - frame[k];
+		origin[k] = (float)relative;
+		padding[k] = roundUp(std::abs((double)origin[k] - relative) + (std::abs(o[k]) + std::abs(frame[k])) * std::ldexp(1.0, -50));
+		if (d[k] == 0) {
+			inverse[k] = std::numeric_limits<float>::max(); // Avoids 0 * inf for lanes that touch the origin
+		}
+		else {
+			inverse[k] = (float)(1.0 / d[k]);
+		}
+	}
+}
+
+template<>
+uint32_t wide::intersects<4>(const WideBvh4::Box& box, const WideBvh4::Node& node)
+{
+	return intersects4<4>(box, node, 0);
+}
+
+template<>
+uint32_t wide::intersects<8>(const WideBvh8::Box& box, const WideBvh8::Node& node)
+{
+#ifdef REPO_BVH_SSE
+	if (AVX) {
+		return intersects8(box, node);
+	}
+#endif
+	return intersects4<8>(box, node, 0) | (intersects4<8>(box, node, 4) << 4);
+}
+
+template<>
+uint32_t wide::within<4>(const WideBvh4::Box& box, const WideBvh4::Node& node, double d)
+{
+	return within4<4>(box, node, 0, threshold(d));
+}
+
+template<>
+uint32_t wide::within<8>(const WideBvh8::Box& box, const WideBvh8::Node& node, double d)
+{
+#ifdef REPO_BVH_SSE
+	if (AVX) {
+		return within8(box, node, threshold(d));
+	}
+#endif
+	auto t = threshold(d);
+	return within4<8>(box, node, 0, t) | (within4<8>(box, node, 4, t) << 4);
+}
+
+template<>
+uint32_t wide::intersects<4>(const wide::Ray& ray, const WideBvh4::Node& node)
+{
+	return intersects4<4>(ray, Slabs<4>(ray, node), 0);
+}
+
+template<>
+uint32_t wide::intersects<8>(const wide::Ray& ray, const WideBvh8::Node& node)
+{
+	Slabs<8> slabs(ray, node);
+#ifdef REPO_BVH_SSE
+	if (AVX) {
+		return intersects8(ray, slabs);
+	}
+#endif
+	return intersects4<8>(ray, slabs, 0) | (intersects4<8>(ray, slabs, 4) << 4);
+}
+
+template<size_t N>
+void bvh::builders::collapse(const bvh::Bvh<double>& binary, WideBvh<N>& wide)
+{
+	wide.nodes.clear();
+	wide.primitive_indices.clear();
+	wide.bounds = BoundingBox<double>::empty();
+	wide.origin = Vector3<double>(0, 0, 0);
+
+	if (!binary.node_count) {
+		return;
+	}
+
+	wide.bounds = binary.nodes[0].bounding_box_proxy();
+	wide.origin = wide.bounds.center();
+
+	size_t numPrimitives = 0;
+
+	// Each entry is a binary branch node whose children are to become the lanes
+	// of the given wide node. A binary leaf at the root becomes the only lane.
+
+	std::vector<std::pair<size_t, uint32_t>> stack;
+	wide.nodes.emplace_back();
+	stack.push_back({ 0, 0 });
+
+	std::vector<size_t> children;
+	while (!stack.empty()) {
+		auto [index, target] = stack.back();
+		stack.pop_back();
+
+		auto& source = binary.nodes[index];
+
+		children.clear();
+		if (source.is_leaf()) {
+			children.push_back(index);
+		}
+		else {
+			children.push_back(source.first_child_or_primitive + 0);
+			children.push_back(source.first_child_or_primitive + 1);
+		}
+
+		while (children.size() < N) {
+			auto largest = children.end();
+			double area = -1;
+			for (auto it = children.begin(); it != children.end(); it++) {
+				auto& c = binary.nodes[*it];
+				if (!c.is_leaf() && c.bounding_box_proxy().half_area() > area) {
+					area = c.bounding_box_proxy().half_area();
+					largest = it;
+				}
+			}
+			if (largest == children.end()) {
+				break;
+			}
+			auto first = binary.nodes[*largest].first_child_or_primitive;
+			*largest = first;
+			children.push_back(first + 1);
+		}
+
+		typename WideBvh<N>::Node node;
+		for (size_t i = 0; i < N; i++) {
+			for (int k = 0; k < 3; k++) {
+				node.min[k][i] = std::numeric_limits<float>::infinity();
+				node.max[k][i] = -std::numeric_limits<float>::infinity();
+			}
+			node.first[i] = 0;
+			node.count[i] = 0;
+		}
+
+		for (size_t i = 0; i < children.size(); i++) {
+			auto& c = binary.nodes[children[i]];
+			for (int k = 0; k < 3; k++) {
+				node.min[k][i] = roundDown(c.bounds[k * 2 + 0] - wide.origin[k]);
+				node.max[k][i] = roundUp(c.bounds[k * 2 + 1] - wide.origin[k]);
+			}
+			if (c.is_leaf()) {
+				node.first[i] = (uint32_t)c.first_child_or_primitive;
+				node.count[i] = (uint32_t)c.primitive_count;
+				numPrimitives = std::max(numPrimitives, (size_t)(c.first_child_or_primitive + c.primitive_count));
+			}
+			else {
+				node.first[i] = (uint32_t)wide.nodes.size();
+				wide.nodes.emplace_back();
+				stack.push_back({ children[i], node.first[i] });
+			}
+		}
+
+		wide.nodes[target] = node;
+	}
+
+	wide.primitive_indices.assign(binary.primitive_indices.get(), binary.primitive_indices.get() + numPrimitives);
+}
+
+template void bvh::builders::collapse<4>(const bvh::Bvh<double>& binary, WideBvh4& wide);
+template void bvh::builders::collapse<8>(const bvh::Bvh<double>& binary, WideBvh8& wide);
\ No newline at end of file
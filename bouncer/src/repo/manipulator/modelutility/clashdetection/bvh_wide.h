@@ -0,0 +1,433 @@
+/**
+*  Copyright (C) 2025 3D Repo Ltd
+*
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU Affero General Public License as
+*  published by the Free Software Foundation, either version 3 of the
+*  License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Affero General Public License for more details.
+*
+*  You should have received a copy of the GNU Affero General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "repo/manipulator/modeloptimizer/bvh/bvh.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace bvh {
+
+	/*
+	* A collapsed BVH with a branching factor of N (4 or 8), built from a binary
+	* Bvh<double>. Each node holds the bounds of all of its children in SoA form,
+	* so that a box can be tested against every child at once with a single SIMD
+	* comparison per axis.
+	*
+	* The child bounds are stored as floats relative to the centre of the tree,
+	* rounded outwards, so they always enclose the double-precision bounds they
+	* came from. Tests against them are conservative: they may accept a child the
+	* binary BVH would have rejected, but never the other way around. Storing the
+	* bounds relative to the tree keeps the precision independent of where the
+	* mesh is in project coordinates. This also halves the size of each box, and
+	* since a WideBvh has around a third of the nodes of the binary tree, the
+	* overall footprint is a fraction of the original.
+	*
+	* Leaves are not nodes themselves. Each child lane is either a branch, in which
+	* case first is the index of the child node, or a leaf, in which case first and
+	* count give a range of primitive_indices. Unused lanes have count zero, first
+	* zero (the root can never be a child) and inverted bounds, so never pass a test.
+	*/
+	template<size_t N>
+	struct WideBvh
+	{
+		static_assert(N == 4 || N == 8, "WideBvh supports widths of 4 and 8");
+
+		static constexpr size_t Width = N;
+
+		struct alignas(N * sizeof(float)) Node
+		{
+			float min[3][N];
+			float max[3][N];
+			uint32_t first[N];
+			uint32_t count[N];
+
+			bool isLeaf(size_t lane) const { return count[lane] != 0; }
+			bool isEmpty(size_t lane) const { return count[lane] == 0 && first[lane] == 0; }
+		};
+
+		/*
+		* The bounds of a single child, as stored in a Node. These are used as the
+		* query when testing against the lanes of another node.
+		*/
+		struct Box
+		{
+			float min[3];
+			float max[3];
+		};
+
+		std::vector<Node> nodes;
+		std::vector<size_t> primitive_indices;
+
+		/*
+		* The exact bounds of the whole tree.
+		*/
+		BoundingBox<double> bounds = BoundingBox<double>::empty();
+
+		/*
+		* The point the node bounds are relative to.
+		*/
+		Vector3<double> origin = Vector3<double>(0, 0, 0);
+
+		Box getBox(uint32_t node, size_t lane) const
+		{
+			auto& n = nodes[node];
+			return {
+				{ n.min[0][lane], n.min[1][lane], n.min[2][lane] },
+				{ n.max[0][lane], n.max[1][lane], n.max[2][lane] }
+			};
+		}
+
+	};
+
+	using WideBvh4 = WideBvh<4>;
+	using WideBvh8 = WideBvh<8>;
+
+	namespace builders {
+
+		/*
+		* Builds a WideBvh from a binary Bvh (e.g. from builders::build). Each node
+		* absorbs the children of its largest branch children until it is full, so
+		* the shallow, large boxes are expanded first.
+		*/
+		template<size_t N>
+		void collapse(const bvh::Bvh<double>& binary, WideBvh<N>& wide);
+
+	} // namespace builders
+
+	namespace wide {
+
+		/*
+		* Each of these tests a box against all the lanes of a node, returning a
+		* mask with the bit for each lane set if it passes.
+		*/
+
+		/*
+		* If the box overlaps the lane's bounds.
+		*/
+		template<size_t N>
+		uint32_t intersects(const typename WideBvh<N>::Box& box, const typename WideBvh<N>::Node& node);
+
+		/*
+		* If the minimum distance between the box and the lane's bounds could be
+		* d or less. The comparison allows for the rounding error of computing the
+		* distance in single precision.
+		*/
+		template<size_t N>
+		uint32_t within(const typename WideBvh<N>::Box& box, const typename WideBvh<N>::Node& node, double d);
+
+		/*
+		* Moves a Box from the frame of one tree to that of another, given the
+		* difference between their origins, rounding outwards.
+		*/
+		template<size_t N>
+		typename WideBvh<N>::Box translate(const typename WideBvh<N>::Box& box, const Vector3<double>& offset);
+
+		/*
+		* A ray prepared for testing against the lanes of a WideBvh. The origin is
+		* held in single precision, relative to the tree, so the boxes are padded
+		* by the error of doing so.
+		*/
+		struct Ray
+		{
+			template<size_t N>
+			Ray(const WideBvh<N>& bvh, const bvh::Vector3<double>& origin, const bvh::Vector3<double>& direction)
+				:Ray(origin, direction, bvh.origin)
+			{
+			}
+
+			Ray(const bvh::Vector3<double>& origin, const bvh::Vector3<double>& direction, const bvh::Vector3<double>& frame);
+
+			float origin[3];
+			float inverse[3];
+			float padding[3];
+		};
+
+		/*
+		* If the ray hits the lane's bounds at any positive distance along it.
+		*/
+		template<size_t N>
+		uint32_t intersects(const Ray& ray, const typename WideBvh<N>::Node& node);
+
+		/*
+		* A dual tree traversal between two WideBvhs. NodeTest is called with a Box
+		* from one tree and a Node of the other, and should return the mask of the
+		* lanes to continue with. PrimitiveTest is called with the primitive indices
+		* of every pair of overlapping leaves, and returning true terminates the
+		* traversal.
+		*/
+		template<size_t N, typename NodeTest, typename PrimitiveTest>
+		void traverse(
+			const WideBvh<N>& a,
+			const WideBvh<N>& b,
+			NodeTest test,
+			PrimitiveTest primitives)
+		{
+			if (a.nodes.empty() || b.nodes.empty()) {
+				return;
+			}
+
+			struct Slot {
+				uint32_t node;
+				uint32_t lane;
+			};
+
+			// Boxes are moved into the frame of the tree whose node they are being
+			// tested against.
+
+			auto aToB = a.origin - b.origin;
+			auto bToA = b.origin - a.origin;
+
+			std::vector<std::pair<Slot, Slot>> pairs;
+
+			auto& rootA = a.nodes[0];
+			for (uint32_t i = 0; i < N; i++) {
+				if (!rootA.isEmpty(i)) {
+					auto mask = test(translate<N>(a.getBox(0, i), aToB), b.nodes[0]);
+					for (uint32_t j = 0; j < N; j++) {
+						if (mask & (1u << j)) {
+							pairs.push_back({ { 0, i }, { 0, j } });
+						}
+					}
+				}
+			}
+
+			// Each pair on the stack has already been tested. The branch with the
+			// larger box is the one descended, testing the other box against all of
+			// its children at once.
+
+			auto extent = [](const typename WideBvh<N>::Box& box) {
+				return (box.max[0] - box.min[0]) + (box.max[1] - box.min[1]) + (box.max[2] - box.min[2]);
+			};
+
+			while (!pairs.empty()) {
+				auto [sa, sb] = pairs.back();
+				pairs.pop_back();
+
+				auto& nodeA = a.nodes[sa.node];
+				auto& nodeB = b.nodes[sb.node];
+				bool leafA = nodeA.isLeaf(sa.lane);
+				bool leafB = nodeB.isLeaf(sb.lane);
+
+				if (leafA && leafB) {
+					for (size_t l = 0; l < nodeA.count[sa.lane]; l++) {
+						for (size_t r = 0; r < nodeB.count[sb.lane]; r++) {
+							if (primitives(
+								a.primitive_indices[nodeA.first[sa.lane] + l],
+								b.primitive_indices[nodeB.first[sb.lane] + r]
+							)) {
+								return;
+							}
+						}
+					}
+					continue;
+				}
+
+				auto boxA = a.getBox(sa.node, sa.lane);
+				auto boxB = b.getBox(sb.node, sb.lane);
+
+				if (!leafA && (leafB || extent(boxA) >= extent(boxB))) {
+					auto child = nodeA.first[sa.lane];
+					auto mask = test(translate<N>(boxB, bToA), a.nodes[child]);
+					for (uint32_t i = 0; i < N; i++) {
+						if (mask & (1u << i)) {
+							pairs.push_back({ { child, i }, sb });
+						}
+					}
+				}
+				else {
+					auto child = nodeB.first[sb.lane];
+					auto mask = test(translate<N>(boxA, aToB), b.nodes[child]);
+					for (uint32_t j = 0; j < N; j++) {
+						if (mask & (1u << j)) {
+							pairs.push_back({ sa, { child, j } });
+						}
+					}
+				}
+			}
+		}
+
+		/*
+		* The intra-bvh version of the above, finding all pairs of primitives in one
+		* tree that pass the tests. Each node is expanded once: the overlaps within
+		* it are those within each of its children, plus those between each pair of
+		* children.
+		*/
+		template<size_t N, typename NodeTest, typename PrimitiveTest>
+		void traverse(
+			const WideBvh<N>& a,
+			NodeTest test,
+			PrimitiveTest primitives)
+		{
+			if (a.nodes.empty()) {
+				return;
+			}
+
+			struct Slot {
+				uint32_t node;
+				uint32_t lane;
+			};
+
+			std::vector<uint32_t> selves;
+			std::vector<std::pair<Slot, Slot>> pairs;
+
+			auto leaf = [&](uint32_t node, uint32_t lane) {
+				auto& n = a.nodes[node];
+				for (size_t l = 0; l < n.count[lane]; l++) {
+					for (size_t r = l + 1; r < n.count[lane]; r++) {
+						if (primitives(
+							a.primitive_indices[n.first[lane] + l],
+							a.primitive_indices[n.first[lane] + r]
+						)) {
+							return true;
+						}
+					}
+				}
+				return false;
+			};
+
+			selves.push_back(0);
+			while (!selves.empty()) {
+				auto node = selves.back();
+				selves.pop_back();
+
+				auto& n = a.nodes[node];
+				for (uint32_t i = 0; i < N; i++) {
+					if (n.isEmpty(i)) {
+						continue;
+					}
+					if (n.isLeaf(i)) {
+						if (leaf(node, i)) {
+							return;
+						}
+					}
+					else {
+						selves.push_back(n.first[i]);
+					}
+
+					// Only the lanes after this one, so each pair is found once
+
+					auto mask = test(a.getBox(node, i), n) & ~((2u << i) - 1);
+					for (uint32_t j = i + 1; j < N; j++) {
+						if (mask & (1u << j)) {
+							pairs.push_back({ { node, i }, { node, j } });
+						}
+					}
+				}
+			}
+
+			// What remains is the same as a traversal between two trees, apart from
+			// both sides being this one.
+
+			auto extent = [](const typename WideBvh<N>::Box& box) {
+				return (box.max[0] - box.min[0]) + (box.max[1] - box.min[1]) + (box.max[2] - box.min[2]);
+			};
+
+			while (!pairs.empty()) {
+				auto [sa, sb] = pairs.back();
+				pairs.pop_back();
+
+				auto& nodeA = a.nodes[sa.node];
+				auto& nodeB = a.nodes[sb.node];
+				bool leafA = nodeA.isLeaf(sa.lane);
+				bool leafB = nodeB.isLeaf(sb.lane);
+
+				if (leafA && leafB) {
+					for (size_t l = 0; l < nodeA.count[sa.lane]; l++) {
+						for (size_t r = 0; r < nodeB.count[sb.lane]; r++) {
+							if (primitives(
+								a.primitive_indices[nodeA.first[sa.lane] + l],
+								a.primitive_indices[nodeB.first[sb.lane] + r]
+							)) {
+								return;
+							}
+						}
+					}
+					continue;
+				}
+
+				auto boxA = a.getBox(sa.node, sa.lane);
+				auto boxB = a.getBox(sb.node, sb.lane);
+
+				if (!leafA && (leafB || extent(boxA) >= extent(boxB))) {
+					auto child = nodeA.first[sa.lane];
+					auto mask = test(boxB, a.nodes[child]);
+					for (uint32_t i = 0; i < N; i++) {
+						if (mask & (1u << i)) {
+							pairs.push_back({ { child, i }, sb });
+						}
+					}
+				}
+				else {
+					auto child = nodeB.first[sb.lane];
+					auto mask = test(boxA, a.nodes[child]);
+					for (uint32_t j = 0; j < N; j++) {
+						if (mask & (1u << j)) {
+							pairs.push_back({ sa, { child, j } });
+						}
+					}
+				}
+			}
+		}
+
+		/*
+		* Calls primitive for the leaves of every lane the ray intersects. Returning
+		* true from primitive terminates the traversal.
+		*/
+		template<size_t N, typename PrimitiveTest>
+		void traverse(
+			const WideBvh<N>& a,
+			const Ray& ray,
+			PrimitiveTest primitive)
+		{
+			if (a.nodes.empty()) {
+				return;
+			}
+
+			// The ray should have been made for this tree
+
+			std::vector<uint32_t> nodes;
+			nodes.push_back(0);
+			while (!nodes.empty()) {
+				auto& n = a.nodes[nodes.back()];
+				nodes.pop_back();
+
+				auto mask = intersects<N>(ray, n);
+				for (uint32_t i = 0; i < N; i++) {
+					if (!(mask & (1u << i))) {
+						continue;
+					}
+					if (n.isLeaf(i)) {
+						for (size_t p = 0; p < n.count[i]; p++) {
+							if (primitive(a.primitive_indices[n.first[i] + p])) {
+								return;
+							}
+						}
+					}
+					else {
+						nodes.push_back(n.first[i]);
+					}
+				}
+			}
+		}
+
+	} // namespace wide
+
+} // namespace bvh
\ No newline at end of file
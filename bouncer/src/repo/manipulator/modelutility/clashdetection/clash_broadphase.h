@@ -0,0 +1,188 @@
+/**
+*  Copyright (C) 2025 3D Repo Ltd
+*
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU Affero General Public License as
+*  published by the Free Software Foundation, either version 3 of the
+*  License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Affero General Public License for more details.
+*
+*  You should have received a copy of the GNU Affero General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "clash_pipelines.h"
+#include "clash_task_pool.h"
+#include "bvh_operators.h"
+
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <iterator>
+#include <functional>
+
+namespace repo {
+	namespace manipulator {
+		namespace modelutility {
+			namespace clash {
+
+				/*
+				* ParallelBroadphase runs a set of broadphase traversals over the scene
+				* BVHs on a TaskPool. Each traversal is split into independent subtree
+				* Tasks (see bvh::Traversal::split), and every Task gets its own Query
+				* and its own results buffer, so the workers share no state.
+				*
+				* Query should be a bvh::Traversal that collects the primitive pairs into
+				* a BroadphaseResults member called results, and makes the task operator
+				* accessible. Each traversal is given a function to convert those pairs
+				* into the type the pipeline wants (e.g. composite objects), filtering them
+				* if necessary. This is called on the worker threads, so must not modify
+				* any shared state.
+				*/
+				template<typename Query, typename Result>
+				class ParallelBroadphase
+				{
+				public:
+					using Map = std::function<void(size_t primA, size_t primB, std::vector<Result>& results)>;
+
+					ParallelBroadphase(std::function<Query()> makeQuery, int numThreads)
+						:makeQuery(makeQuery),
+						numThreads(numThreads)
+					{
+					}
+
+					/*
+					* Adds a traversal between two BVHs.
+					*/
+					void add(const Bvh& a, const Bvh& b, Map map)
+					{
+						traversals.push_back({ &a, &b, false, map });
+					}
+
+					/*
+					* Adds an intra-bvh traversal.
+					*/
+					void add(const Bvh& a, Map map)
+					{
+						traversals.push_back({ &a, &a, true, map });
+					}
+
+					/*
+					* Runs all traversals added so far, and returns the results buffers of
+					* the individual Tasks. The buffers may contain the same pairs if the
+					* traversals overlap.
+					*/
+					std::vector<std::vector<Result>> run()
+					{
+						TaskPool<Task> pool(numThreads);
+
+						// Making a few times more Tasks than there are workers lets the pool
+						// balance the load, as the subtrees will have very different costs.
+
+						auto count = pool.numThreads() * tasksPerThread;
+
+						std::vector<Task> tasks;
+						auto query = makeQuery();
+						for (size_t i = 0; i < traversals.size(); i++) {
+							auto& t = traversals[i];
+							auto split = t.internal ? query.split(*t.a, count) : query.split(*t.a, *t.b, count);
+							for (auto& s : split) {
+								tasks.push_back({ i, tasks.size(), s });
+							}
+						}
+
+						std::vector<std::vector<Result>> buffers(tasks.size());
+
+						pool.push(tasks);
+						pool.run([&](Task& task) {
+							auto& t = traversals[task.traversal];
+							auto query = makeQuery();
+							query(*t.a, *t.b, task.node);
+							auto& buffer = buffers[task.buffer];
+							for (auto [a, b] : query.results) {
+								t.map(a, b, buffer);
+							}
+						});
+
+						traversals.clear();
+						return buffers;
+					}
+
+				private:
+					static constexpr size_t tasksPerThread = 8;
+
+					struct Traversal
+					{
+						const Bvh* a;
+						const Bvh* b;
+						bool internal;
+						Map map;
+					};
+
+					struct Task
+					{
+						size_t traversal;
+						size_t buffer;
+						bvh::Traversal::Task node;
+					};
+
+					std::function<Query()> makeQuery;
+					int numThreads;
+					std::vector<Traversal> traversals;
+				};
+
+				/*
+				* Returns the sorted union of a set of buffers, without duplicates. The
+				* buffers are sorted concurrently, then merged pairwise, with the merges
+				* in each round also running concurrently.
+				*/
+				template<typename T>
+				std::vector<T> sortUnique(std::vector<std::vector<T>> buffers, int numThreads)
+				{
+					if (buffers.empty()) {
+						return {};
+					}
+
+					auto parallel = [&](size_t count, std::function<void(size_t&)> func) {
+						std::vector<size_t> indices(count);
+						std::iota(indices.begin(), indices.end(), 0);
+						TaskPool<size_t> pool(numThreads);
+						pool.push(indices);
+						pool.run(func);
+					};
+
+					parallel(buffers.size(), [&](size_t& i) {
+						auto& b = buffers[i];
+						std::sort(b.begin(), b.end());
+						b.erase(std::unique(b.begin(), b.end()), b.end());
+					});
+
+					while (buffers.size() > 1) {
+						std::vector<std::vector<T>> merged((buffers.size() + 1) / 2);
+						parallel(merged.size(), [&](size_t& i) {
+							auto& first = buffers[i * 2];
+							if (i * 2 + 1 >= buffers.size()) {
+								merged[i] = std::move(first);
+								return;
+							}
+							auto& second = buffers[i * 2 + 1];
+							merged[i].reserve(first.size() + second.size());
+							std::set_union(first.begin(), first.end(), second.begin(), second.end(), std::back_inserter(merged[i]));
+							first = {};
+							second = {};
+						});
+						buffers = std::move(merged);
+					}
+
+					return std::move(buffers[0]);
+				}
+			}
+		}
+	}
+}
\ No newline at end of file
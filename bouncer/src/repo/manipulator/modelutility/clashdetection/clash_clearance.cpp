@@ -16,13 +16,15 @@
 */
 
 #include <stack>
-#include <queue>
 #include <thread>
 #include <mutex>
 #include <shared_mutex>
+#include <optional>
+#include <algorithm>
 
 #include "clash_clearance.h"
 #include "geometry_tests.h"
+#include "geometry_tests_batch.h"
 #include "geometry_tests_closed.h"
 #include "geometry_utils.h"
 #include "geometry_exceptions.h"
@@ -30,6 +32,10 @@
 #include "clash_scheduler.h"
 #include "clash_node_cache.h"
 #include "clash_pipelines_utils.h"
+#include "clash_task_pool.h"
+#include "clash_prefetcher.h"
+#include "clash_mesh_store.h"
+#include "clash_broadphase.h"
 
 #include "repo/lib/datastructure/repo_matrix.h"
 #include "repo/lib/datastructure/repo_triangle.h"
@@ -39,14 +45,20 @@ using namespace repo::manipulator::modelutility::clash;
 using namespace repo::lib;
 
 namespace {
-	struct Cached : public geometry::MeshView
+	// The number of triangle pairs given to the batched separation test at once.
+	const size_t SEPARATION_BATCH_SIZE = 64;
+
+	struct Cached : public geometry::WideMeshView
 	{
 		Graph::Node* node;
-		Bvh bvh;
+		WideBvh bvh;
 		geometry::RepoIndexedMesh mesh;
 		repo::lib::RepoBounds bounds;
 		std::vector<size_t> indicesForContainsTests;
 		bool isClosed = false;
+		bool initialised = false;
+		MeshStore* store = nullptr;
+		GeometryCounters* counters = nullptr;
 		std::shared_mutex mutex;
 
 		// Initialises everything the narrowphase (or this objects own methods) needs
@@ -54,25 +66,66 @@ namespace {
 
 		void initialise(std::shared_ptr<repo::core::handler::AbstractDatabaseHandler> handler) {
 
-			if (mesh.vertices.size()) { // (Already initialised)
+			if (initialised) {
+				return;
+			}
+
+			// The binary Bvh is only needed to build the collapsed one (and is what
+			// the store persists), so it is released before the entry is used.
+
+			Bvh binary;
+
+			if (store && store->load(*node, mesh, binary, isClosed, indicesForContainsTests)) {
+				bounds = repo::lib::RepoBounds(mesh.vertices.data(), mesh.vertices.size());
+				bvh::builders::collapse(binary, bvh);
+				initialised = true;
 				return;
 			}
 
+			auto start = std::chrono::steady_clock::now();
+
 			geometry::RepoIndexedMeshBuilder builder(mesh);
-			PipelineUtils::loadGeometry(handler, *node, builder);
+			auto bytes = PipelineUtils::loadGeometry(handler, *node, builder);
+
+			auto loaded = std::chrono::steady_clock::now();
 
 			bounds = repo::lib::RepoBounds(mesh.vertices.data(), mesh.vertices.size());
 			isClosed = geometry::isClosedAndManifold(mesh.faces);
 
-			bvh::builders::build(bvh, mesh.vertices, mesh.faces);
+			bvh::builders::build(binary, mesh.vertices, mesh.faces);
+			bvh::builders::collapse(binary, bvh);
+
+			counters->add(1, bytes, loaded - start, std::chrono::steady_clock::now() - loaded);
+
+			// When the structures are persisted, the vertex order is computed up-front
+			// so that later runs never need to, even if this one does not.
+
+			if (store) {
+				orderVerticesForContainsTests();
+				store->store(*node, mesh, binary, isClosed, indicesForContainsTests);
+			}
+
+			initialised = true;
 		}
 
 		bool isInitialised()
 		{
-			return mesh.vertices.size();
+			return initialised;
+		}
+
+		// Releases everything built by initialise. The node is kept, so the entry
+		// can be initialised again if needed after being evicted.
+
+		void unload()
+		{
+			bvh = WideBvh();
+			mesh = geometry::RepoIndexedMesh();
+			indicesForContainsTests = std::vector<size_t>();
+			isClosed = false;
+			initialised = false;
 		}
 
-		const Bvh& getBvh() const override {
+		const WideBvh& getBvh() const override {
 			return bvh;
 		}
 
@@ -97,12 +150,23 @@ namespace {
 		const std::vector<size_t>& getOrderedVertices() {
 			return indicesForContainsTests;
 		}
+
+		size_t getMemoryUsage() const {
+			return PipelineUtils::getMemoryUsage(mesh) +
+				PipelineUtils::getMemoryUsage(bvh) +
+				indicesForContainsTests.capacity() * sizeof(size_t);
+		}
 	};
 
 	struct Cache : public ResourceCache<Graph::Node, Cached> 
 	{
+		MeshStore* store = nullptr;
+		GeometryCounters* counters = nullptr;
+
 		void initialise(const Graph::Node& key, Cached* entry) const override {
 			entry->node = const_cast<Graph::Node*>(&key); // We need to cast away const here in order to load the binary buffers into the contained bson
+			entry->store = store;
+			entry->counters = counters;
 		}
 	};
 
@@ -135,6 +199,17 @@ namespace {
 			bvh::DistanceQuery::operator()(a);
 		}
 
+		void operator()(const Bvh& a, const Bvh& b, const Task& task) {
+			bvh::DistanceQuery::operator()(a, b, task);
+		}
+
+		void operator()(const WideBvh& a, const WideBvh& b) {
+			results.clear();
+			bvh::DistanceQuery::operator()(a, b);
+		}
+
+		using bvh::DistanceQuery::split;
+
 		bool intersect(size_t primA, size_t primB) override {
 			results.push_back({ primA, primB });
 			return false; // Don't terminate traversal, we want to find all pairs within the tolerance
@@ -145,31 +220,44 @@ namespace {
 void Clearance::run(const Graph& graphA, const Graph& graphB, const Graph& graphC)
 {
 	Cache cache;
-	ClearanceBroadphase broadphase(tolerance);
-	std::vector<std::pair<Cache::Record*, Cache::Record*>> broadphaseResults;
+	cache.counters = &geometry;
+
+	std::unique_ptr<MeshStore> store;
+	if (config.meshStore) {
+		store = std::make_unique<MeshStore>(handler);
+		cache.store = store.get();
+	}
+
+	auto residency = std::make_shared<ResidencyManager<Cached>>(config.cacheMemory);
+	cache.setResidencyManager(residency);
+	StageTimer broadphaseTimer(*this, statistics.broadphase, "broadphase");
 
 	// The broadphase is run three times: between A and B, within A, and  within B.
 	// A single node may appear in both intra and inter set tests, so we collect
 	// and schedule all of these as one.
 
+	// The traversals run on the worker threads, and return the nodes. The reuse
+	// tracking and the cache are not thread safe, so the records are resolved
+	// afterwards on this thread. Each pair of nodes is only found once, so unlike
+	// Hard, there is nothing to deduplicate.
+
+	using NodePair = std::pair<const Graph::Node*, const Graph::Node*>;
+
+	ParallelBroadphase<ClearanceBroadphase, NodePair> broadphase(
+		[&]() { return ClearanceBroadphase(tolerance); },
+		config.numThreads
+	);
+
 	auto interBroadphase = [&](const Graph& gA, const Graph& gB) {
-		broadphase.operator()(gA.bvh, gB.bvh);
-		for (auto [a, b] : broadphase.results) {
-			broadphaseResults.push_back({
-				cache.get(gA.getNode(a)),
-				cache.get(gB.getNode(b))
-			});
-		}
+		broadphase.add(gA.bvh, gB.bvh, [&](size_t a, size_t b, std::vector<NodePair>& results) {
+			results.push_back({ &gA.getNode(a), &gB.getNode(b) });
+		});
 	};
 
 	auto intraBroadphase = [&](const Graph& graph) {
-		broadphase.operator()(graph.bvh);
-		for (auto [a, b] : broadphase.results) {
-			broadphaseResults.push_back({
-				cache.get(graph.getNode(a)),
-				cache.get(graph.getNode(b))
-			});
-		}
+		broadphase.add(graph.bvh, [&](size_t a, size_t b, std::vector<NodePair>& results) {
+			results.push_back({ &graph.getNode(a), &graph.getNode(b) });
+		});
 	};
 
 	interBroadphase(graphA, graphB);
@@ -186,175 +274,205 @@ void Clearance::run(const Graph& graphA, const Graph& graphB, const Graph& graph
 
 	intraBroadphase(graphC);
 
-	ClashScheduler::schedule(broadphaseResults);
+	auto buffers = broadphase.run();
+	broadphaseTimer.stop();
 
-	// When we take references to the records, we take shared ownership for their
-	// nodes. After the caches are released (below), we are the sole owner and
-	// when all the Cache::Entry objects for a given Node are destroyed,
-	// that Node will be cleaned up.
+	StageTimer schedulingTimer(*this, statistics.scheduling, "scheduling");
+
+	std::vector<std::pair<Cache::Record*, Cache::Record*>> broadphaseResults;
+	for (auto& buffer : buffers) {
+		statistics.pairs.broadphase += buffer.size();
+		for (auto [a, b] : buffer) {
+			if (reuse(*a->compositeObject, *b->compositeObject)) {
+				continue;
+			}
+			broadphaseResults.push_back({
+				cache.get(*a),
+				cache.get(*b)
+			});
+		}
+	}
+	buffers.clear();
+
+	ClashScheduler::schedule(broadphaseResults, config.numThreads);
 
 	using Narrowphase = std::pair<
 		Cache::Entry,
 		Cache::Entry
 	>;
 
-	std::queue<Narrowphase> narrowphaseTests;
+	TaskPool<Narrowphase> pool(config.numThreads);
 
 	// When we take references to the records, we take shared ownership for their
 	// nodes. After the caches are released (below), we are the sole owner and
 	// when all the Cache::Entry objects for a given Node are destroyed,
 	// that Node will be cleaned up.
+	std::vector<Narrowphase> narrowphaseTests;
+	narrowphaseTests.reserve(broadphaseResults.size());
 	for (auto r : broadphaseResults) {
-		narrowphaseTests.push({
+		narrowphaseTests.push_back({
 			r.first->getReference(),
 			r.second->getReference()
 		});
+		expectTest(narrowphaseTests.back().first->getCompositeObjectId(), narrowphaseTests.back().second->getCompositeObjectId());
 	}
 
+	schedulingTimer.stop();
+
+	StageTimer narrowphaseTimer(*this, statistics.narrowphase, "narrowphase");
+
+	// The prefetcher loads the meshes and builds their bvhs on separate threads
+	// in the order the workers are expected to reach them, so the narrowphase
+	// doesn't block on I/O.
+
+	Prefetcher<Cached, ResidencyManager<Cached>::Lease> prefetcher([&](Cached* entry) {
+			return residency->acquire(entry, handler);
+		},
+		config.prefetchMemory,
+		config.numPrefetchThreads
+	);
+	prefetcher.start(narrowphaseTests, pool.numThreads());
+
+	pool.push(narrowphaseTests);
+
 	// The finalisation will invalidate all these pointers
 	// so clear this vector
 	broadphaseResults.clear();
 
 	// Finalise caches
 	// From here on, the records are solely held by the shared pointers in the
-	// queue and will be deleted as they are removed.
+	// queues and will be deleted as they are removed.
 	cache.finalise();
 
-	// Mutexes
-	std::mutex queueMutex{};
-	std::mutex clashesMutex{};
-
-	// Define the thread behaviour
-	auto narrowPhaseThread = [&]
+	// Define the task behaviour
+	auto narrowphase = [&](Narrowphase& test)
 	{
-		// Broadphase object exlusive for this thread
+		auto& [a, b] = test;
+
+		// Broadphase object exlusive for this test
 		ClearanceBroadphase threadBroadphase(tolerance);
 
-		while (true) {
+		// Acquiring the entries initialises them if they are not already (or have
+		// been evicted since), and ensures they are not evicted for the duration
+		// of the test.
 
-			// Lock queue, check for samples, and retrieve it one is available
-			Cache::Entry a;
-			Cache::Entry b;
-			{
-				std::scoped_lock queueLock{ queueMutex };
+		auto leaseA = residency->acquire(a.get(), handler);
+		auto leaseB = residency->acquire(b.get(), handler);
 
-				// If we are out of samples, we unlock and terminate
-				if (narrowphaseTests.empty())
-				{
-					break;
-				}
+		// The prefetcher's leases are only released once the worker holds its own,
+		// so the entries cannot be evicted in between.
 
-				// Else, get the sample
-				std::tie(a, b) = std::move(narrowphaseTests.front());
-				narrowphaseTests.pop();
-			}
+		prefetcher.consume(a.get());
+		prefetcher.consume(b.get());
 
-			// Check initialisation status of entry a
-			bool aInitialised = false;
-			{
-				// Shared lock on the object so we can check the status
-				std::shared_lock lock{ a->mutex };
-				aInitialised = a->isInitialised();
-			}
-
-			// If a is not initialised, do it now.
-			if (!aInitialised)
-			{
-				// Lock exclusively
-				std::scoped_lock entryLock{ a->mutex };
+		if (a->bounds > b->bounds) {
+			std::swap(a, b);
+		}
 
-				// Now initialise the node
-				a->initialise(handler);
-			}
+		bool aHasOrderedVertices = false;
+		{
+			std::shared_lock lock{ a->mutex };
+			aHasOrderedVertices = a->hasOrderedVertices();
+		}
 
-			// Check initialisation status of entry b
-			bool bInitialised = false;
-			{
-				// Shared lock on the object so we can check the status
-				std::shared_lock lock{ b->mutex };
-				bInitialised = b->isInitialised();
-			}
+		if (!aHasOrderedVertices)
+		{
+			std::scoped_lock lock{ a->mutex };
+			a->orderVerticesForContainsTests();
+		}
 
-			// If b is not initialised, do it now.
-			if (!bInitialised)
+		{
+			// Acquire shared locks for both cache entries for the duration of the test.
+			// Can lock them sequentially, since there is no deadlock risk here.
+			// Other shared locks will not impede getting this shared lock.
+			// Neither node can be exclusively locked, since that can only happen on
+			// initialisation, which has passed at this point, and they cannot be
+			// evicted while leased.
+			std::shared_lock lockA{ a->mutex };
+			std::shared_lock lockB{ b->mutex };
+
+			try
 			{
-				// Lock exclusively
-				std::scoped_lock entryLock{ b->mutex };
+				if (b->isClosed && geometry::contains(a->mesh.vertices, a->getOrderedVertices(), a->bounds, *b)) {
+					// If a is completely inside b, the closest distance is zero so we can 
+					// terminate immediately.
+
+					updateClash<ClearanceClash>(a->getCompositeObjectId(), b->getCompositeObjectId(), [&](ClearanceClash& clash) {
+						clash.append({ a->bounds.center(), a->bounds.center() });
+					});
+					return;
+				}
 
-				// Now initialise the node
-				b->initialise(handler);
-			}
+				threadBroadphase.operator()(a->getBvh(), b->getBvh());
 
-			if (a->bounds > b->bounds) {
-				std::swap(a, b);
-			}
+				// The candidate pairs are first given a lower bound on their distance
+				// by the batched separation test, a block at a time. The exact test
+				// then only needs to run for those that could be both within the
+				// tolerance and closer than the closest pair found so far. The
+				// threshold keeps pairs whose bound is within rounding error of the
+				// limit, so the result is the same as testing every pair.
 
-			bool aHasOrderedVertices = false;
-			{
-				std::shared_lock lock{ a->mutex };
-				aHasOrderedVertices = a->hasOrderedVertices();
-			}
+				auto& results = threadBroadphase.results;
+				auto threshold = geometry::contactThreshold(a->bounds, b->bounds);
+				double limit = tolerance;
+				std::optional<repo::lib::RepoLine> closest;
 
-			if (!aHasOrderedVertices)
-			{
-				std::scoped_lock lock{ a->mutex };
-				a->orderVerticesForContainsTests();
-			}
+				geometry::TriangleBatch batchA;
+				geometry::TriangleBatch batchB;
+				double lowerBounds[SEPARATION_BATCH_SIZE];
 
-			{
-				// Acquire shared locks for both cache entries for the duration of the test.
-				// Can lock them sequentially, since there is no deadlock risk here.
-				// Other shared locks will not impede getting this shared lock.
-				// Neither node can be exclusively locked, since that can only happen on
-				// initialisation, which has passed at this point.
-				std::shared_lock lockA{ a->mutex };
-				std::shared_lock lockB{ b->mutex };
-				
-				try
+				for (size_t first = 0; first < results.size(); first += SEPARATION_BATCH_SIZE)
 				{
-					if (b->isClosed && geometry::contains(a->mesh.vertices, a->getOrderedVertices(), a->bounds, *b)) {
-						// If a is completely inside b, the closest distance is zero so we can 
-						// terminate immediately.
-							
-						// Lock the clashes map, then write the new clash
-						std::scoped_lock lockClashes{ clashesMutex };
-						createClash<ClearanceClash>(
-							a->getCompositeObjectId(),
-							b->getCompositeObjectId()
-						)->append({ a->bounds.center(), a->bounds.center() });
-						continue;
+					auto count = std::min(SEPARATION_BATCH_SIZE, results.size() - first);
+
+					batchA.clear();
+					batchB.clear();
+					for (size_t i = 0; i < count; i++) {
+						batchA.push_back(a->getTriangle(results[first + i].first));
+						batchB.push_back(b->getTriangle(results[first + i].second));
 					}
 
-					threadBroadphase.operator()(a->getBvh(), b->getBvh());
-					for (const auto& [aIndex, bIndex] : threadBroadphase.results)
-					{
+					geometry::separation(batchA, batchB, lowerBounds);
+
+					for (size_t i = 0; i < count; i++) {
+						if (lowerBounds[i] > limit + threshold) {
+							continue;
+						}
+						auto& [aIndex, bIndex] = results[first + i];
 						auto line = geometry::closestPoints(a->getTriangle(aIndex), b->getTriangle(bIndex));
-						if (line.magnitude() < tolerance) {
-							// Lock the clashes map, then write the new clash
-							std::scoped_lock lockClashes{ clashesMutex };
-							createClash<ClearanceClash>(
-								a->getCompositeObjectId(),
-								b->getCompositeObjectId()
-							)->append(line);
+						if (line.magnitude() < limit) {
+							limit = line.magnitude();
+							closest = line;
 						}
 					}
 				}
-				catch (const geometry::GeometryTestException& e) {
-					throw DegenerateTestException(a->getCompositeObjectId(), b->getCompositeObjectId(), e.what());
+
+				if (closest) {
+					updateClash<ClearanceClash>(a->getCompositeObjectId(), b->getCompositeObjectId(), [&](ClearanceClash& clash) {
+						clash.append(*closest);
+					});
 				}
 			}
+			catch (const geometry::GeometryTestException& e) {
+				throw DegenerateTestException(a->getCompositeObjectId(), b->getCompositeObjectId(), e.what());
+			}
 		}
 	};
 
-	// Create and launch the threads
-	int numThreads = config.numThreads ? config.numThreads : std::thread::hardware_concurrency();
-	std::vector<std::jthread> threads;
-	for (int i = 0; i < numThreads; i++)
-		threads.emplace_back(std::jthread(narrowPhaseThread));
+	pool.run([&](Narrowphase& test) {
+		narrowphase(test);
+		completeTest(test.first->getCompositeObjectId(), test.second->getCompositeObjectId());
+	});
+	prefetcher.stop();
+	narrowphaseTimer.stop();
 
-	// Wait for all threads to complete
-	for (auto& t : threads)
-		t.join();
+	statistics.narrowphaseThreads = pool.getStatistics();
+	statistics.cache = residency->getStatistics();
+
+	if (store) {
+		statistics.meshStore.hits = store->getHits();
+		statistics.meshStore.misses = store->getMisses();
+	}
 }
 
 void Clearance::ClearanceClash::append(const repo::lib::RepoLine& otherLine)
@@ -25,9 +25,10 @@
 #include "clash_scheduler.h"
 #include "clash_node_cache.h"
 #include "clash_pipelines_utils.h"
+#include "clash_task_pool.h"
+#include "clash_prefetcher.h"
+#include "clash_broadphase.h"
 
-#include <set>
-#include <queue>
 #include <thread>
 #include <mutex>
 #include <shared_mutex>
@@ -37,6 +38,13 @@ using namespace repo::manipulator::modelutility::clash;
 using namespace repo::lib;
 
 namespace {
+	// Pairs with more faces than this between them are given all of the
+	// narrowphase threads for their own DeformDepth search. A few such pairs
+	// can otherwise take longer than the rest of the job put together. When the
+	// other workers are still busy the machine is oversubscribed for a while,
+	// which costs much less than leaving the giant pair to one thread.
+	const size_t PARALLEL_DEFORMDEPTH_FACES = 250000;
+
 	struct CacheEntry
 	{
 		std::vector<Graph::Node*> nodes;
@@ -48,28 +56,47 @@ namespace {
 
 		geometry::RepoDeformDepth::Mesh mesh;
 
+		bool initialised = false;
+		GeometryCounters* counters = nullptr;
+
 		void initialise(DatabasePtr handler) {
 
-			if (!nodes.size()) { // (Already initialised)
+			if (initialised) {
 				return;
 			}
 
+			auto start = std::chrono::steady_clock::now();
+
 			geometry::RepoIndexedMeshBuilder builder(mesh);
 
+			size_t bytes = 0;
 			for (auto& node : nodes) {
-				auto start = mesh.faces.size();
-				PipelineUtils::loadGeometry(handler, *node, builder);
-				mesh.addFaceRange(start, mesh.faces.size()); // Keep a record of where this node's faces are in the combined mesh
+				auto first = mesh.faces.size();
+				bytes += PipelineUtils::loadGeometry(handler, *node, builder);
+				mesh.addFaceRange(first, mesh.faces.size()); // Keep a record of where this node's faces are in the combined mesh
 			}
 
+			auto loaded = std::chrono::steady_clock::now();
+
 			mesh.initialise();
 
-			nodes.clear();
+			counters->add(nodes.size(), bytes, loaded - start, std::chrono::steady_clock::now() - loaded);
+
+			initialised = true;
 		}
 
 		bool isInitialised()
 		{
-			return !nodes.size();
+			return initialised;
+		}
+
+		// Releases the geometry. The nodes are kept so the entry can be initialised
+		// again if it is needed after being evicted.
+
+		void unload()
+		{
+			mesh = geometry::RepoDeformDepth::Mesh();
+			initialised = false;
 		}
 
 		const std::string& getId() const {
@@ -79,21 +106,35 @@ namespace {
 		repo::lib::RepoBounds getBounds() const {
 			return mesh.bounds();
 		}
+
+		size_t getMemoryUsage() const {
+			auto size = PipelineUtils::getMemoryUsage(mesh);
+			size += mesh._vertices.capacity() * sizeof(repo::lib::RepoVector3D64);
+			size += mesh.pseudoNormals.capacity() * sizeof(repo::lib::RepoVector3D64);
+			for (auto& group : mesh.faceGroups) {
+				size += PipelineUtils::getMemoryUsage(group.bvh);
+				size += group.orderedIndices.capacity() * sizeof(size_t);
+			}
+			return size;
+		}
 	};
 
 	struct Cache : public ResourceCache<CompositeObject, CacheEntry>
 	{
-		Cache(const Graph& graph)
-			: graph(graph) {
+		Cache(const Graph& graph, GeometryCounters& counters)
+			: graph(graph),
+			counters(counters) {
 		}
 
 		const Graph& graph;
+		GeometryCounters& counters;
 
 		void initialise(const CompositeObject& composite, CacheEntry* entry) const override {
 			for(auto& meshRef : composite.meshes) {
 				entry->nodes.push_back(&graph.getNode(meshRef.uniqueId));
 			}
 			entry->compositeObject = &composite;
+			entry->counters = &counters;
 		}
 	};
 
@@ -121,6 +162,24 @@ namespace {
 			results.clear();
 			bvh::IntersectQuery::operator()(a);
 		}
+
+		void operator()(const Bvh& a, const Bvh& b, const Task& task) {
+			bvh::IntersectQuery::operator()(a, b, task);
+		}
+	};
+
+	/*
+	* A potentially intersecting pair of composite objects, along with the caches
+	* of the graphs they came from.
+	*/
+	struct CompositePair
+	{
+		Cache* cacheA;
+		const CompositeObject* a;
+		Cache* cacheB;
+		const CompositeObject* b;
+
+		auto operator<=>(const CompositePair&) const = default;
 	};
 }
 
@@ -131,41 +190,54 @@ void Hard::run(const Graph& graphA, const Graph& graphB, const Graph& graphC)
 	// phase, which will work out penetration depth - if any - based on all the
 	// meshes in the composite object.
 
-	Cache cacheA(graphA);
-	Cache cacheB(graphB);
-	Cache cacheC(graphC);
+	Cache cacheA(graphA, geometry);
+	Cache cacheB(graphB, geometry);
+	Cache cacheC(graphC, geometry);
 
-	std::set<std::pair<Cache::Record*, Cache::Record*>> compositePairs;
+	// The geometry of all composites, regardless of the graph they are from,
+	// shares one memory budget.
 
-	HardBroadphase broadphase;
+	auto residency = std::make_shared<ResidencyManager<CacheEntry>>(config.cacheMemory);
+	cacheA.setResidencyManager(residency);
+	cacheB.setResidencyManager(residency);
+	cacheC.setResidencyManager(residency);
+
+	StageTimer broadphaseTimer(*this, statistics.broadphase, "broadphase");
+
+	// The traversals run on the worker threads, which resolve the primitives to
+	// their composite objects, so the results can be deduplicated before going
+	// near the caches (which are not thread safe) or the reuse tracking.
+
+	ParallelBroadphase<HardBroadphase, CompositePair> broadphase(
+		[]() { return HardBroadphase(); },
+		config.numThreads
+	);
 
 	auto interBroadphase = [&](const Graph& gA, const Graph& gB,
 		Cache& cA, Cache& cB)
 	{
-		broadphase.operator()(gA.bvh, gB.bvh);
-		for (auto& [a, b] : broadphase.results) {
-			compositePairs.insert({
-				cA.get(gA.getCompositeObject(a)),
-				cB.get(gB.getCompositeObject(b))
+		broadphase.add(gA.bvh, gB.bvh, [&](size_t a, size_t b, std::vector<CompositePair>& results) {
+			results.push_back({
+				&cA, &gA.getCompositeObject(a),
+				&cB, &gB.getCompositeObject(b)
 			});
-		}
+		});
 	};
 
 	auto intraBroadphase = [&](const Graph& graph, Cache& cache) {
-		broadphase.operator()(graph.bvh);
-		for (auto& [a, b] : broadphase.results) {
+		broadphase.add(graph.bvh, [&](size_t a, size_t b, std::vector<CompositePair>& results) {
 			auto& compA = graph.getCompositeObject(a);
 			auto& compB = graph.getCompositeObject(b);
 
 			if(compA.id == compB.id) {
-				continue;
+				return;
 			}
 
-			compositePairs.insert({
-				cache.get(compA),
-				cache.get(compB)
+			results.push_back({
+				&cache, &compA,
+				&cache, &compB
 			});
-		}
+		});
 	};
 
 	interBroadphase(graphA, graphB, cacheA, cacheB);
@@ -182,40 +254,74 @@ void Hard::run(const Graph& graphA, const Graph& graphB, const Graph& graphC)
 
 	intraBroadphase(graphC, cacheC);
 
-	std::vector<std::pair<Cache::Record*, Cache::Record*>> orderedCompositePairs(
-		compositePairs.begin(),
-		compositePairs.end()
-	);
+	auto buffers = broadphase.run();
+	for (auto& buffer : buffers) {
+		statistics.pairs.broadphase += buffer.size();
+	}
+	auto compositePairs = sortUnique(std::move(buffers), config.numThreads);
+	broadphaseTimer.stop();
 
-	ClashScheduler::schedule(orderedCompositePairs);
+	StageTimer schedulingTimer(*this, statistics.scheduling, "scheduling");
+
+	std::vector<std::pair<Cache::Record*, Cache::Record*>> orderedCompositePairs;
+	orderedCompositePairs.reserve(compositePairs.size());
+	for (auto& p : compositePairs) {
+		if (reuse(*p.a, *p.b)) {
+			continue;
+		}
+		orderedCompositePairs.push_back({
+			p.cacheA->get(*p.a),
+			p.cacheB->get(*p.b)
+		});
+	}
+	compositePairs.clear();
+
+	ClashScheduler::schedule(orderedCompositePairs, config.numThreads);
 
 	using Narrowphase = std::pair<
 		Cache::Entry,
 		Cache::Entry
 	>;
 
-	// Prepare for splitting the samples accross queues for the threads
-	const int numThreads = config.numThreads ? config.numThreads : std::thread::hardware_concurrency();
-	std::vector<std::queue<Narrowphase>> narrowphaseQueues(numThreads);
-	int parcelSize = std::ceil(orderedCompositePairs.size() / (double) numThreads);
+	// The narrowphase tests are distributed between the workers in the order
+	// given by the scheduler, with work stealing to pick up the long tail when
+	// a few pairs are much more expensive than the rest.
+
+	TaskPool<Narrowphase> pool(config.numThreads);
 
 	// When we take references to the records, we take shared ownership for their
 	// nodes. After the caches are released (below), we are the sole owner and
 	// when all the Cache::Entry objects for a given Node are destroyed,
 	// that Node will be cleaned up.
-	int sampleCount = 0;
+	std::vector<Narrowphase> narrowphaseTests;
+	narrowphaseTests.reserve(orderedCompositePairs.size());
 	for (auto [a, b] : orderedCompositePairs) {
-		int queueIndex = std::floor(sampleCount / parcelSize);
-		narrowphaseQueues[queueIndex].push({
+		narrowphaseTests.push_back({
 			a->getReference(),
 			b->getReference()
 		});
-		sampleCount++;
+		expectTest(narrowphaseTests.back().first->getId(), narrowphaseTests.back().second->getId());
 	}
 
+	schedulingTimer.stop();
+
+	StageTimer narrowphaseTimer(*this, statistics.narrowphase, "narrowphase");
+
+	// The prefetcher loads the composites on separate threads in the order the
+	// workers are expected to reach them, so the narrowphase doesn't block on I/O.
+
+	Prefetcher<CacheEntry, ResidencyManager<CacheEntry>::Lease> prefetcher([&](CacheEntry* entry) {
+			return residency->acquire(entry, handler);
+		},
+		config.prefetchMemory,
+		config.numPrefetchThreads
+	);
+	prefetcher.start(narrowphaseTests, pool.numThreads());
+
+	pool.push(narrowphaseTests);
+
 	// The finalisation will invalidate all these pointers
-	// so clear compositePairs and orderedCompositePairs.
-	compositePairs.clear();
+	// so clear orderedCompositePairs.
 	orderedCompositePairs.clear();
 
 	// Finalise caches
@@ -225,100 +331,69 @@ void Hard::run(const Graph& graphA, const Graph& graphB, const Graph& graphC)
 	cacheB.finalise();
 	cacheC.finalise();
 
-	// Mutexes
-	std::mutex clashesMutex{};
-
-	// Define thread behaviour
-	auto narrowPhaseThread = [&](std::queue<Narrowphase>& queue)
+	// Define the task behaviour
+	auto narrowphase = [&](Narrowphase& test)
 	{
-		// Run intil we are out of samples, then terminate.
-		while (!queue.empty()) {
+		auto& [a, b] = test;
 
-			// Else, get sample from the queue exclusive to this thread
-			auto [a, b] = std::move(queue.front());
-			queue.pop();
+		// Acquiring the entries initialises them if they are not already (or have
+		// been evicted since), and ensures they are not evicted for the duration
+		// of the test.
 
-			// Check initialisation status of entry a
-			bool aInitialised = false;
-			{
-				// Shared lock on the object so we can check the status
-				std::shared_lock lock{ a->mutex };
-				aInitialised = a->isInitialised();
-			}
-
-			// If a is not initialised, do it now.
-			if (!aInitialised)
-			{
-				// Lock exclusively
-				std::scoped_lock entryLock{ a->mutex};
+		auto leaseA = residency->acquire(a.get(), handler);
+		auto leaseB = residency->acquire(b.get(), handler);
 
-				// Now initialise the node
-				a->initialise(handler);
-			}
+		// The prefetcher's leases are only released once the worker holds its own,
+		// so the entries cannot be evicted in between.
 
-			// Check initialisation status of entry b
-			bool bInitialised = false;
-			{
-				// Shared lock on the object so we can check the status
-				std::shared_lock lock{ b->mutex };
-				bInitialised = b->isInitialised();
-			}
+		prefetcher.consume(a.get());
+		prefetcher.consume(b.get());
 
-			// If b is not initialised, do it now.
-			if (!bInitialised)
-			{
-				// Lock exclusively
-				std::scoped_lock entryLock{b->mutex };
-
-				// Now initialise the node
-				b->initialise(handler);
-			}
+		// In DeformDepth, (b) is fixed, so consider the larger object the static one
+		// to make it easier to fit (a) into the free space around it.
+		if (a->getBounds() > b->getBounds()) {
+			std::swap(a, b);
+		}
 
-			// In DeformDepth, (b) is fixed, so consider the larger object the static one
-			// to make it easier to fit (a) into the free space around it.
-			if (a->getBounds() > b->getBounds()) {
-				std::swap(a, b);
-			}
+		{
+			// Acquire locks for both cache entries for the duration of the test.
+			// This needs to be an exclusive lock since RepoDeformDepth alters the mesh
+			std::scoped_lock lockEntries{ a->mutex, b->mutex };
 
+			try
 			{
-				// Acquire locks for both cache entries for the duration of the test.
-				// This needs to be an exclusive lock since RepoDeformDepth alters the mesh
-				std::scoped_lock lockEntries{ a->mutex, b->mutex };
-
-				try
-				{
-					geometry::RepoDeformDepth pd(
-						a->mesh,
-						b->mesh,
-						tolerance
-					);
-
-					double penDepth = pd.getPenetrationDepth();
-					if (penDepth > tolerance) {
-						// Lock the clashes map, then write the new clash
-						std::scoped_lock lockClashes{ clashesMutex };
-						auto clash = createClash<HardClash>(
-							a->getId(),
-							b->getId()
-						);
-						clash->contacts = pd.getContactManifold();
-					}
-				}
-				catch (const geometry::GeometryTestException& e) {
-					throw DegenerateTestException(a->getId(), b->getId(), e.what());
+				auto numFaces = a->mesh.faces.size() + b->mesh.faces.size();
+
+				geometry::RepoDeformDepth pd(
+					a->mesh,
+					b->mesh,
+					tolerance,
+					numFaces > PARALLEL_DEFORMDEPTH_FACES ? (int)pool.numThreads() : 1
+				);
+
+				double penDepth = pd.getPenetrationDepth();
+				if (penDepth > tolerance) {
+					auto contacts = pd.getContactManifold();
+					updateClash<HardClash>(a->getId(), b->getId(), [&](HardClash& clash) {
+						clash.contacts = std::move(contacts);
+					});
 				}
 			}
+			catch (const geometry::GeometryTestException& e) {
+				throw DegenerateTestException(a->getId(), b->getId(), e.what());
+			}
 		}
 	};
 
-	// Create and launch the threads
-	std::vector<std::jthread> threads;
-	for (int i = 0; i < numThreads; i++)
-		threads.emplace_back(std::jthread{ narrowPhaseThread, std::ref(narrowphaseQueues[i]) });
+	pool.run([&](Narrowphase& test) {
+		narrowphase(test);
+		completeTest(test.first->getId(), test.second->getId());
+	});
+	prefetcher.stop();
+	narrowphaseTimer.stop();
 
-	// Wait for all threads to complete
-	for (auto& t : threads)
-		t.join();
+	statistics.narrowphaseThreads = pool.getStatistics();
+	statistics.cache = residency->getStatistics();
 }
 
 void Hard::getClashPositions(const CompositeClash& clash, std::vector<RepoVector3D64>& positions) const
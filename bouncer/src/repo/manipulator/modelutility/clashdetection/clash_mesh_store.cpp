@@ -0,0 +1,275 @@
+/**
+*  Copyright (C) 2025 3D Repo Ltd
+*
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU Affero General Public License as
+*  published by the Free Software Foundation, either version 3 of the
+*  License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Affero General Public License for more details.
+*
+*  You should have received a copy of the GNU Affero General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "clash_mesh_store.h"
+
+#include <repo/core/handler/repo_database_handler_abstract.h>
+#include <repo/core/handler/fileservice/repo_file_manager.h>
+#include <repo/core/model/repo_model_global.h>
+#include <repo/lib/repo_exception.h>
+#include <repo_log.h>
+
+#include <cstring>
+#include <cstdint>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <iomanip>
+#include <type_traits>
+
+using namespace repo::manipulator::modelutility;
+using namespace repo::manipulator::modelutility::clash;
+
+/*
+* Records are written in the native layout of the machine, as they are only
+* ever read by the same build of bouncer. The magic number doubles as a byte
+* order check, and the version must be incremented whenever the layout, or
+* the way any of the structures are built, changes.
+*
+* Each array is stored in the layout of the structure it is read into, so it
+* can be read from the file directly into its destination. The structures own
+* their memory (and are unloaded or consumed independently of the record),
+* so they cannot refer into a mapping of the file instead.
+*/
+
+namespace {
+	const uint32_t MAGIC = 0x48534c43; // CLSH
+	const uint32_t VERSION = 2;
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		double matrix[16];
+		uint64_t numVertices;
+		uint64_t numFaces;
+		uint64_t numNodes;
+		uint64_t numOrderedVertices;
+		uint8_t closed;
+		uint8_t padding[7];
+	};
+
+	static_assert(sizeof(repo::lib::RepoVector3D64) == sizeof(double) * 3);
+	static_assert(sizeof(size_t) == sizeof(uint64_t));
+	static_assert(std::is_trivially_copyable_v<repo::lib::repo_face_t>);
+	static_assert(std::is_trivially_copyable_v<Bvh::Node>);
+
+	std::string getCollection(const sparse::Node& node)
+	{
+		return node.container->container + "." + REPO_COLLECTION_STASH_CLASH;
+	}
+
+	// The key must be the same between runs and builds, so the transform is
+	// hashed with FNV-1a rather than std::hash.
+
+	std::string getKey(const sparse::Node& node)
+	{
+		uint64_t hash = 0xcbf29ce484222325;
+		auto data = reinterpret_cast<const uint8_t*>(node.matrix.getData());
+		for (size_t i = 0; i < sizeof(double) * 16; i++) {
+			hash ^= data[i];
+			hash *= 0x100000001b3;
+		}
+
+		std::stringstream ss;
+		ss << node.uniqueId.toString() << "." << std::hex << std::setw(16) << std::setfill('0') << hash;
+		return ss.str();
+	}
+
+	struct Reader
+	{
+		std::ifstream& stream;
+		size_t remaining;
+
+		bool read(void* dest, size_t size)
+		{
+			if (size > remaining) {
+				return false;
+			}
+			stream.read(reinterpret_cast<char*>(dest), size);
+			remaining -= size;
+			return stream.good();
+		}
+	};
+
+	struct Writer
+	{
+		std::vector<uint8_t>& bin;
+
+		void write(const void* src, size_t size)
+		{
+			auto p = reinterpret_cast<const uint8_t*>(src);
+			bin.insert(bin.end(), p, p + size);
+		}
+	};
+}
+
+MeshStore::MeshStore(DatabasePtr handler)
+	:handler(handler)
+{
+}
+
+bool MeshStore::load(
+	const sparse::Node& node,
+	geometry::RepoIndexedMesh& mesh,
+	Bvh& bvh,
+	bool& isClosed,
+	std::vector<size_t>& orderedVertices)
+{
+	bool found = false;
+	try
+	{
+		found = read(node, mesh, bvh, isClosed, orderedVertices);
+	}
+	catch (const repo::lib::RepoRefMissingException&)
+	{
+		// There is no record for this node yet
+	}
+	catch (const std::exception& e)
+	{
+		repoWarning << "Could not read the stored clash geometry for " << node.uniqueId.toString() << ": " << e.what();
+	}
+
+	if (found) {
+		hits++;
+	}
+	else {
+		misses++;
+		mesh = geometry::RepoIndexedMesh();
+		bvh = Bvh();
+		isClosed = false;
+		orderedVertices.clear();
+	}
+
+	return found;
+}
+
+bool MeshStore::read(
+	const sparse::Node& node,
+	geometry::RepoIndexedMesh& mesh,
+	Bvh& bvh,
+	bool& isClosed,
+	std::vector<size_t>& orderedVertices)
+{
+	auto fileManager = handler->getFileManager();
+	auto ref = fileManager->getFileRef(node.container->teamspace, getCollection(node), getKey(node));
+	auto path = fileManager->getFilePath(ref);
+	if (path.empty()) {
+		return false;
+	}
+
+	std::ifstream stream(path, std::ios::in | std::ios::binary);
+	if (!stream.is_open()) {
+		return false;
+	}
+
+	Reader reader{ stream, std::filesystem::file_size(path) };
+
+	Header header;
+	if (!reader.read(&header, sizeof(header))) {
+		return false;
+	}
+
+	if (header.magic != MAGIC || header.version != VERSION) {
+		return false;
+	}
+
+	if (std::memcmp(header.matrix, node.matrix.getData(), sizeof(header.matrix))) {
+		return false;
+	}
+
+	// Check the sizes against the file before allocating anything, in case it
+	// has been truncated.
+
+	auto expected = header.numVertices * sizeof(repo::lib::RepoVector3D64) +
+		header.numFaces * sizeof(repo::lib::repo_face_t) +
+		header.numNodes * sizeof(Bvh::Node) +
+		header.numFaces * sizeof(uint64_t) +
+		header.numOrderedVertices * sizeof(uint64_t);
+
+	if (expected != reader.remaining || !header.numNodes) {
+		return false;
+	}
+
+	mesh.vertices.resize(header.numVertices);
+	mesh.faces.resize(header.numFaces);
+	bvh.node_count = header.numNodes;
+	bvh.nodes = std::make_unique<Bvh::Node[]>(header.numNodes);
+	bvh.primitive_indices = std::make_unique<size_t[]>(header.numFaces);
+	orderedVertices.resize(header.numOrderedVertices);
+
+	if (!reader.read(mesh.vertices.data(), header.numVertices * sizeof(repo::lib::RepoVector3D64)) ||
+		!reader.read(mesh.faces.data(), header.numFaces * sizeof(repo::lib::repo_face_t)) ||
+		!reader.read(bvh.nodes.get(), header.numNodes * sizeof(Bvh::Node)) ||
+		!reader.read(bvh.primitive_indices.get(), header.numFaces * sizeof(uint64_t)) ||
+		!reader.read(orderedVertices.data(), header.numOrderedVertices * sizeof(uint64_t))) {
+		return false;
+	}
+
+	isClosed = header.closed;
+
+	return true;
+}
+
+void MeshStore::store(
+	const sparse::Node& node,
+	const geometry::RepoIndexedMesh& mesh,
+	const Bvh& bvh,
+	bool isClosed,
+	const std::vector<size_t>& orderedVertices)
+{
+	Header header = {};
+	header.magic = MAGIC;
+	header.version = VERSION;
+	std::memcpy(header.matrix, node.matrix.getData(), sizeof(header.matrix));
+	header.numVertices = mesh.vertices.size();
+	header.numFaces = mesh.faces.size();
+	header.numNodes = bvh.node_count;
+	header.numOrderedVertices = orderedVertices.size();
+	header.closed = isClosed;
+
+	std::vector<uint8_t> bin;
+	bin.reserve(sizeof(header) +
+		mesh.vertices.size() * sizeof(repo::lib::RepoVector3D64) +
+		mesh.faces.size() * (sizeof(repo::lib::repo_face_t) + sizeof(uint64_t)) +
+		bvh.node_count * sizeof(Bvh::Node) +
+		orderedVertices.size() * sizeof(uint64_t));
+
+	Writer writer{ bin };
+	writer.write(&header, sizeof(header));
+	writer.write(mesh.vertices.data(), mesh.vertices.size() * sizeof(repo::lib::RepoVector3D64));
+	writer.write(mesh.faces.data(), mesh.faces.size() * sizeof(repo::lib::repo_face_t));
+	writer.write(bvh.nodes.get(), bvh.node_count * sizeof(Bvh::Node));
+	writer.write(bvh.primitive_indices.get(), mesh.faces.size() * sizeof(uint64_t));
+	writer.write(orderedVertices.data(), orderedVertices.size() * sizeof(uint64_t));
+
+	try
+	{
+		if (!handler->getFileManager()->uploadFileAndCommit(
+			node.container->teamspace,
+			getCollection(node),
+			getKey(node),
+			bin))
+		{
+			repoWarning << "Could not store the clash geometry for " << node.uniqueId.toString();
+		}
+	}
+	catch (const std::exception& e)
+	{
+		repoWarning << "Could not store the clash geometry for " << node.uniqueId.toString() << ": " << e.what();
+	}
+}
\ No newline at end of file
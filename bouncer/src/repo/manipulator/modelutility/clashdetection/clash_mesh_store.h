@@ -0,0 +1,105 @@
+/**
+*  Copyright (C) 2025 3D Repo Ltd
+*
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU Affero General Public License as
+*  published by the Free Software Foundation, either version 3 of the
+*  License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Affero General Public License for more details.
+*
+*  You should have received a copy of the GNU Affero General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <memory>
+
+#include "clash_pipelines.h"
+#include "geometry_utils.h"
+
+namespace repo {
+	namespace manipulator {
+		namespace modelutility {
+			namespace clash {
+
+				/*
+				* The MeshStore persists the structures the narrowphase derives from each
+				* mesh node in the file store, so later runs against the same revisions
+				* do not have to build them again. These are the indexed mesh in project
+				* coordinates, its Bvh, whether it is closed and manifold, and the order
+				* of its vertices for containment tests.
+				*
+				* Mesh nodes do not change once committed, so each record is keyed by the
+				* node's unique id and a hash of the transform that brings it into project
+				* coordinates. The transform is also stored in the record and compared
+				* when it is read, so a hash collision is only ever a miss. Records are
+				* written to the stash.clash collection of the mesh's container, and read
+				* back directly from the file.
+				*
+				* A MeshStore may be used from multiple threads. Failing to read or write
+				* a record is never an error; the caller just builds the structures itself.
+				*/
+				class MeshStore
+				{
+				public:
+					MeshStore(DatabasePtr handler);
+
+					/*
+					* Reads the record for the node into the given structures, returning
+					* false if there is no valid record.
+					*/
+					bool load(
+						const sparse::Node& node,
+						geometry::RepoIndexedMesh& mesh,
+						Bvh& bvh,
+						bool& isClosed,
+						std::vector<size_t>& orderedVertices
+					);
+
+					/*
+					* Writes a record for the node. The Bvh must be built over all the faces
+					* of the mesh.
+					*/
+					void store(
+						const sparse::Node& node,
+						const geometry::RepoIndexedMesh& mesh,
+						const Bvh& bvh,
+						bool isClosed,
+						const std::vector<size_t>& orderedVertices
+					);
+
+					size_t getHits() const
+					{
+						return hits;
+					}
+
+					size_t getMisses() const
+					{
+						return misses;
+					}
+
+				private:
+					DatabasePtr handler;
+					std::atomic<size_t> hits = 0;
+					std::atomic<size_t> misses = 0;
+
+					bool read(
+						const sparse::Node& node,
+						geometry::RepoIndexedMesh& mesh,
+						Bvh& bvh,
+						bool& isClosed,
+						std::vector<size_t>& orderedVertices
+					);
+				};
+			}
+		}
+	}
+}
\ No newline at end of file
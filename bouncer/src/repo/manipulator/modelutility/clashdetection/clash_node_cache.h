@@ -19,13 +19,249 @@
 
 #include <memory>
 #include <unordered_map>
+#include <list>
+#include <mutex>
+#include <shared_mutex>
 #include <stdexcept>
 
+#include <repo/manipulator/modelutility/repo_clash_detection_statistics.h>
+
 namespace repo {
 	namespace manipulator {
 		namespace modelutility {
 			namespace clash {
 
+				/*
+				* ResidencyManager keeps the memory used by the contents of cache nodes
+				* within a budget, by unloading the least recently used nodes when it is
+				* exceeded.
+				*
+				* Nodes remain alive for as long as they are referenced (see ResourceCache
+				* below), but their contents - geometry, bvhs, and so on - only need to be
+				* resident while a test is using them. The manager tracks which nodes are
+				* resident, and how much memory each uses. Nodes must be acquired through
+				* the manager before use: this loads them if necessary (including if they
+				* were previously evicted), and prevents them being evicted until the
+				* returned Lease is destroyed.
+				*
+				* Eviction only considers nodes that are not leased, so the budget is soft:
+				* it can be exceeded by the nodes in use at any one time.
+				*
+				* Node must have a member mutex (std::shared_mutex), and the methods
+				* isInitialised(), initialise(...), getMemoryUsage() and unload().
+				*/
+
+				template<typename Node>
+				class ResidencyManager
+				{
+				public:
+					using Statistics = CacheStatistics;
+
+					/*
+					* A budget of zero disables eviction.
+					*/
+					ResidencyManager(size_t budget)
+						:budget(budget)
+					{
+					}
+
+					class Lease
+					{
+					public:
+						Lease(ResidencyManager* manager, Node* node)
+							:manager(manager), node(node)
+						{
+						}
+
+						Lease(const Lease&) = delete;
+
+						Lease(Lease&& other) noexcept
+							:manager(other.manager), node(other.node)
+						{
+							other.node = nullptr;
+						}
+
+						~Lease()
+						{
+							if (node) {
+								manager->release(node);
+							}
+						}
+
+					private:
+						ResidencyManager* manager;
+						Node* node;
+					};
+
+					/*
+					* Ensures the node is resident, initialising it with the provided
+					* arguments if not, and prevents it from being evicted until the Lease
+					* is destroyed. The caller must not hold the node's lock.
+					*/
+					template<typename... Args>
+					[[nodiscard]] Lease acquire(Node* node, Args&&... args)
+					{
+						{
+							std::scoped_lock lock(mutex);
+							auto& r = records[node];
+							r.leases++;
+						}
+
+						Lease lease(this, node);
+
+						// The lease means the node cannot be evicted from here on, so if it is
+						// initialised it will stay so.
+
+						bool initialised = false;
+						bool loaded = false;
+						size_t size = 0;
+						{
+							std::shared_lock nodeLock(node->mutex);
+							initialised = node->isInitialised();
+							size = node->getMemoryUsage();
+						}
+
+						if (!initialised) {
+							std::scoped_lock nodeLock(node->mutex);
+							if (!node->isInitialised()) {
+								node->initialise(std::forward<Args>(args)...);
+								loaded = true;
+							}
+							size = node->getMemoryUsage();
+						}
+
+						std::scoped_lock lock(mutex);
+						auto& r = records[node];
+						if (loaded) {
+							if (r.loaded) {
+								statistics.reloads++;
+							}
+							else {
+								statistics.misses++;
+							}
+							r.loaded = true;
+						}
+						else {
+							statistics.hits++;
+						}
+						update(node, r, size);
+						evict();
+
+						return lease;
+					}
+
+					/*
+					* Should be called when a node is destroyed, in case it is still resident.
+					*/
+					void remove(Node* node)
+					{
+						std::scoped_lock lock(mutex);
+						auto it = records.find(node);
+						if (it != records.end()) {
+							if (it->second.resident) {
+								used -= it->second.size;
+								lru.erase(it->second.position);
+							}
+							records.erase(it);
+						}
+					}
+
+					Statistics getStatistics()
+					{
+						std::scoped_lock lock(mutex);
+						return statistics;
+					}
+
+					size_t getMemoryUsage()
+					{
+						std::scoped_lock lock(mutex);
+						return used;
+					}
+
+				private:
+					struct Record
+					{
+						size_t size = 0;
+						size_t leases = 0;
+						bool resident = false;
+						bool loaded = false;
+						typename std::list<Node*>::iterator position;
+					};
+
+					size_t budget;
+					size_t used = 0;
+					Statistics statistics;
+
+					std::mutex mutex;
+					std::unordered_map<Node*, Record> records;
+
+					// Resident nodes, most recently used at the front
+					std::list<Node*> lru;
+
+					void release(Node* node)
+					{
+						// Tests may build additional structures while holding the lease, so
+						// update the size when the node is released.
+
+						size_t size = 0;
+						{
+							std::shared_lock nodeLock(node->mutex);
+							size = node->getMemoryUsage();
+						}
+
+						std::scoped_lock lock(mutex);
+						auto& r = records[node];
+						r.leases--;
+						if (r.resident) {
+							update(node, r, size);
+						}
+						evict();
+					}
+
+					// The following must be called with the mutex held
+
+					void update(Node* node, Record& r, size_t size)
+					{
+						if (r.resident) {
+							used -= r.size;
+							lru.erase(r.position);
+						}
+						r.size = size;
+						r.resident = true;
+						lru.push_front(node);
+						r.position = lru.begin();
+						used += size;
+						statistics.peakMemory = std::max(statistics.peakMemory, used);
+					}
+
+					void evict()
+					{
+						if (!budget) {
+							return;
+						}
+
+						// Nodes that are not leased cannot be in use by anyone else, as all
+						// access goes through acquire(), so they can be unloaded without
+						// taking their locks.
+
+						auto it = lru.end();
+						while (used > budget && it != lru.begin()) {
+							--it;
+							auto node = *it;
+							auto& r = records[node];
+							if (r.leases) {
+								continue;
+							}
+							node->unload();
+							used -= r.size;
+							r.size = 0;
+							r.resident = false;
+							it = lru.erase(it);
+							statistics.evictions++;
+						}
+					}
+				};
+
 				/*
 				* ResourceCache is a simple resource manager for use by the Clash Pipeline
 				* implementations. It allows them to cache intermediate data that might be
@@ -58,9 +294,17 @@ namespace repo {
 						// Node must be default-constructible
 						Entry node;
 
-						Record()
+						Record(std::shared_ptr<ResidencyManager<Node>> residency)
 						{
-							node = std::make_shared<Node>();
+							if (residency) {
+								node = Entry(new Node(), [residency](Node* n) {
+									residency->remove(n);
+									delete n;
+								});
+							}
+							else {
+								node = std::make_shared<Node>();
+							}
 						}
 
 						Entry getReference()
@@ -78,7 +322,7 @@ namespace repo {
 
 						if (!map.contains(&key))
 						{
-							auto newRecord = std::make_unique<Record>();
+							auto newRecord = std::make_unique<Record>(residency);
 							initialise(key, newRecord->node.get());
 							map[&key] = std::move(newRecord);
 						}
@@ -110,7 +354,18 @@ namespace repo {
 					*/
 					virtual void initialise(const Key& key, Node* node) const = 0;
 
+					/*
+					* If set, the nodes created from this point will remove themselves from
+					* the manager when they are destroyed. The manager may be shared between
+					* caches.
+					*/
+					void setResidencyManager(std::shared_ptr<ResidencyManager<Node>> manager) {
+						residency = manager;
+					}
+
 				protected:
+					std::shared_ptr<ResidencyManager<Node>> residency;
+
 					// The map itself uses the pointers to the keying objects, as inbuilt hash
 					// and equality operators exist for pointers, but if we try and store
 					// references the map will expect operators for a semantic comparision of
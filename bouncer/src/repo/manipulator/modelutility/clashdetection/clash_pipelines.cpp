@@ -21,6 +21,8 @@
 #include "clash_exceptions.h"
 #include "clash_constants.h"
 #include "sparse_scene_graph.h"
+#include "clash_task_pool.h"
+#include "clash_pipelines_utils.h"
 
 #include <repo/lib/datastructure/repo_matrix.h>
 #include <repo/lib/datastructure/repo_bounds.h>
@@ -39,13 +41,13 @@
 
 #include <unordered_map>
 #include <unordered_set>
+#include <chrono>
+#include <condition_variable>
 
 using namespace repo::lib;
 using namespace repo::manipulator::modelutility;
 using namespace repo::manipulator::modelutility::clash;
 
-using ContainerGroups = std::unordered_map<repo::lib::Container*, std::vector<repo::lib::RepoUUID>>;
-
 Graph::Graph(std::vector<Node> nodes)
 	: meshes(std::move(nodes))
 {
@@ -94,40 +96,135 @@ const CompositeObject& Graph::getCompositeObject(size_t primitive) const
 }
 
 namespace {
-	std::unique_ptr<Graph> createSceneGraph(
+	// The number of shards the clashes are split between. This only needs to be
+	// large enough, relative to the number of narrowphase threads, that they
+	// rarely update the same shard at once.
+	const size_t NUM_SHARDS = 64;
+
+	/*
+	* Creates the Graphs for a number of sets of Composite Objects. The meshes
+	* of all the sets are loaded together, so each container's scene graph is
+	* only traversed once, and the containers are traversed concurrently.
+	*/
+	std::vector<std::unique_ptr<Graph>> createSceneGraphs(
 		DatabasePtr handler,
-		const std::vector<const CompositeObject*>& set)
+		const std::vector<const std::vector<const CompositeObject*>*>& sets,
+		int numThreads,
+		ClashDetectionStatistics& statistics)
 	{
-		ContainerGroups containers;
-		std::unordered_map<repo::lib::RepoUUID, size_t, repo::lib::RepoUUIDHasher> idToIndexMap;
-
-		for (size_t i = 0; i < set.size(); i++) {
-
-			auto& composite = set[i];
-			for (auto& mesh : composite->meshes)
-			{
-				containers[mesh.container].push_back(mesh.uniqueId);
-				auto [it, inserted] = idToIndexMap.insert({ mesh.uniqueId, i });
-				if (!inserted) {
-					throw DuplicateMeshIdsException(mesh.uniqueId);
+		struct Job
+		{
+			const repo::lib::Container* container = nullptr;
+			std::vector<repo::lib::RepoUUID> uniqueIds;
+			sparse::SceneGraph* scene = nullptr;
+		};
+
+		// Containers are grouped by value, as there may be multiple instances of
+		// the same container.
+
+		std::unordered_map<std::string, size_t> containerToJob;
+		std::vector<Job> jobs;
+
+		// The sets and composites each mesh belongs to. A mesh may only appear
+		// once in each set, but may appear in more than one set.
+
+		struct Owner
+		{
+			size_t set;
+			const CompositeObject* composite;
+		};
+
+		std::unordered_map<repo::lib::RepoUUID, std::vector<Owner>, repo::lib::RepoUUIDHasher> owners;
+
+		for (size_t s = 0; s < sets.size(); s++) {
+			std::unordered_set<repo::lib::RepoUUID, repo::lib::RepoUUIDHasher> seen;
+			for (auto composite : *sets[s]) {
+				for (auto& mesh : composite->meshes)
+				{
+					if (!seen.insert(mesh.uniqueId).second) {
+						throw DuplicateMeshIdsException(mesh.uniqueId);
+					}
+
+					auto& meshOwners = owners[mesh.uniqueId];
+					if (!meshOwners.size()) {
+						auto key = mesh.container->teamspace + "." + mesh.container->container + "." + mesh.container->revision.toString();
+						auto [it, inserted] = containerToJob.insert({ key, jobs.size() });
+						if (inserted) {
+							jobs.push_back({ mesh.container });
+						}
+						jobs[it->second].uniqueIds.push_back(mesh.uniqueId);
+					}
+					meshOwners.push_back({ s, composite });
 				}
 			}
 		}
 
-		sparse::SceneGraph scene;
-		for (auto& [container, uniqueIds] : containers)
-		{
-			scene.populate(handler, container, uniqueIds);
+		// The scene graphs are kept separate until all the containers have been
+		// loaded, so the threads don't need to synchronise, except through the
+		// cache of the root transforms.
+
+		std::vector<sparse::SceneGraph> scenes(jobs.size());
+		for (size_t i = 0; i < jobs.size(); i++) {
+			jobs[i].scene = &scenes[i];
 		}
 
-		std::vector<Graph::Node> nodes;
-		scene.getNodes(nodes);
+		sparse::RootTransformCache cache;
+		TaskPool<Job> pool(numThreads);
+		pool.push(jobs);
+		pool.run([&](Job& job) {
+			job.scene->populate(handler, job.container, job.uniqueIds, &cache);
+		});
+
+		std::vector<std::vector<Graph::Node>> nodes(sets.size());
+		for (auto& scene : scenes) {
+			std::vector<Graph::Node> sceneNodes;
+			scene.getNodes(sceneNodes);
+			for (auto& node : sceneNodes) {
+				auto it = owners.find(node.uniqueId);
+				if (it == owners.end()) {
+					continue;
+				}
+				for (auto& owner : it->second) {
+					nodes[owner.set].push_back(node);
+					nodes[owner.set].back().compositeObject = owner.composite;
+				}
+			}
+		}
+
+		std::vector<std::unique_ptr<Graph>> graphs;
+		for (auto& n : nodes) {
+			graphs.push_back(std::make_unique<Graph>(std::move(n)));
+		}
+
+		statistics.sceneGraph.containers = scenes.size();
+
+		return graphs;
+	}
 
-		for (auto& node : nodes) {
-			node.compositeObject = set[idToIndexMap[node.uniqueId]];
+	/*
+	* Computes the fingerprint of each Composite Object in the graph from the
+	* unique ids and transforms of its meshes. The mesh hashes are summed so that
+	* the fingerprint doesn't depend on the order the meshes were loaded in.
+	* The graph the object is in is included, as that determines which pairs it
+	* is tested against.
+	*/
+	void getFingerprints(const Graph& graph, int set, std::unordered_map<std::string, size_t>& fingerprints)
+	{
+		for (auto& node : graph.meshes) {
+			size_t hash = 0;
+			hash_combine(hash, set);
+			hash_combine(hash, RepoUUIDHasher()(node.uniqueId));
+			auto data = node.matrix.getData();
+			for (size_t i = 0; i < 16; i++) {
+				hash_combine(hash, data[i]);
+			}
+			fingerprints[node.compositeObject->id] += hash;
 		}
+	}
 
-		return std::make_unique<Graph>(std::move(nodes));
+	OrderedPair getKey(const std::string& a, const std::string& b)
+	{
+		return a < b ? OrderedPair(a, b) : OrderedPair(b, a);
 	}
 
 	bool isWithinLimits(const repo::lib::RepoVector3D64& v, double limit)
@@ -259,36 +356,283 @@ namespace {
 Pipeline::Pipeline(
 	DatabasePtr handler, const repo::manipulator::modelutility::ClashDetectionConfig& config)
 	: handler(handler),
-	config(config)
+	config(config),
+	shards(NUM_SHARDS)
 {
 }
 
 ClashDetectionReport Pipeline::runPipeline()
 {
+	started = std::chrono::steady_clock::now();
+
+	// The reporter stops when it goes out of scope, including if the run throws.
+
+	std::jthread reporter;
+	if (progressSink && config.progressInterval > 0) {
+		reporter = std::jthread([this](std::stop_token token) {
+			reportProgress(token);
+		});
+	}
+
 	CompositeObjectSets sets;
 	createDisjointSets(sets, config);
 
-	auto graphA = createSceneGraph(handler, sets.a);
-	auto graphB = createSceneGraph(handler, sets.b);
-	auto graphC = createSceneGraph(handler, sets.c);
+	StageTimer sceneGraphTimer(*this, statistics.sceneGraph, "sceneGraph");
+	auto graphs = createSceneGraphs(handler, { &sets.a, &sets.b, &sets.c }, config.numThreads, statistics);
+	auto& graphA = graphs[0];
+	auto& graphB = graphs[1];
+	auto& graphC = graphs[2];
+	sceneGraphTimer.stop();
 
+	StageTimer validationTimer(*this, statistics.validation, "validation");
 	validateSceneGraph(*graphA);
 	validateSceneGraph(*graphB);
 	validateSceneGraph(*graphC);
+	validationTimer.stop();
+
+	hash_combine(settings, static_cast<int>(config.type));
+	hash_combine(settings, config.tolerance);
+	hash_combine(settings, config.selfIntersectsA);
+	hash_combine(settings, config.selfIntersectsB);
+
+	getFingerprints(*graphA, 0, composites);
+	getFingerprints(*graphB, 1, composites);
+	getFingerprints(*graphC, 2, composites);
+
+	if (previous && previous->settings == settings) {
+		findUnchanged(sets.a);
+		findUnchanged(sets.b);
+		findUnchanged(sets.c);
+	}
 
 	run(*graphA, *graphB, *graphC);
 
+	// All tests have completed, so any clashes left are those of pipelines that
+	// don't report their tests.
+
 	ClashDetectionReport report;
-	report.clashes.reserve(clashes.size());
-	for (auto& [key, clash] : clashes)
+	for (auto& shard : shards) {
+		std::vector<std::pair<OrderedPair, CompositeClash*>> remaining(shard.clashes.begin(), shard.clashes.end());
+		shard.clashes.clear();
+		shard.pending.clear();
+		finalise(remaining, shard);
+
+		report.clashes.insert(report.clashes.end(), shard.results.begin(), shard.results.end());
+		shard.results.clear();
+	}
+
+	if (sink) {
+		for (auto& clash : reusedClashes) {
+			sink->write(clash);
+		}
+	}
+	else {
+		report.clashes.insert(report.clashes.end(), reusedClashes.begin(), reusedClashes.end());
+	}
+
+	statistics.pairs.narrowphase = expectedTests;
+	statistics.pairs.clashes = clashCount + reusedClashes.size();
+	statistics.geometry.meshes = geometry.meshes;
+	statistics.geometry.bytes = geometry.bytes;
+	statistics.geometry.load = geometry.load * 1e-9;
+	statistics.geometry.build = geometry.build * 1e-9;
+	statistics.peakMemory = PipelineUtils::getPeakMemoryUsage();
+
+	if (reporter.joinable()) {
+		reporter.request_stop();
+		reporter.join();
+		stage = "complete";
+		progressSink->progress(getProgress());
+	}
+
+	report.statistics = std::move(statistics);
+	report.settings = settings;
+	report.composites = std::move(composites);
+
+	return report;
+}
+
+void Pipeline::setPreviousReport(const ClashDetectionReport& report)
+{
+	previous = &report;
+	previousClashes.clear();
+	for (auto& clash : report.clashes) {
+		previousClashes[getKey(clash.idA, clash.idB)] = &clash;
+	}
+}
+
+void Pipeline::setSink(ClashResultsSink* sink)
+{
+	this->sink = sink;
+}
+
+void Pipeline::setProgressSink(ClashProgressSink* sink)
+{
+	progressSink = sink;
+}
+
+ClashDetectionProgress Pipeline::getProgress() const
+{
+	ClashDetectionProgress progress;
+	progress.stage = stage.load();
+	progress.completed = completedTests;
+	progress.total = expectedTests;
+	progress.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+	progress.peakMemory = PipelineUtils::getPeakMemoryUsage();
+	return progress;
+}
+
+void Pipeline::reportProgress(std::stop_token token)
+{
+	auto interval = std::chrono::duration<double>(config.progressInterval);
+
+	std::mutex mutex;
+	std::condition_variable_any wake;
+	std::unique_lock lock(mutex);
+
+	while (!wake.wait_for(lock, token, interval, [&] { return token.stop_requested(); })) {
+		progressSink->progress(getProgress());
+	}
+}
+
+Pipeline::StageTimer::StageTimer(Pipeline& pipeline, ClashDetectionStatistics::Stage& stage, const char* name)
+	:stage(&stage),
+	start(std::chrono::steady_clock::now()),
+	cpu(PipelineUtils::getProcessCpuTime())
+{
+	pipeline.stage = name;
+}
+
+Pipeline::StageTimer::~StageTimer()
+{
+	stop();
+}
+
+void Pipeline::StageTimer::stop()
+{
+	if (!stage) {
+		return;
+	}
+	stage->time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	stage->cpu = PipelineUtils::getProcessCpuTime() - cpu;
+	stage = nullptr;
+}
+
+void GeometryCounters::add(size_t meshes,
+	size_t bytes,
+	std::chrono::steady_clock::duration load,
+	std::chrono::steady_clock::duration build)
+{
+	this->meshes += meshes;
+	this->bytes += bytes;
+	this->load += std::chrono::duration_cast<std::chrono::nanoseconds>(load).count();
+	this->build += std::chrono::duration_cast<std::chrono::nanoseconds>(build).count();
+}
+
+Pipeline::Shard& Pipeline::getShard(const OrderedPair& pair)
+{
+	// The hash of an OrderedPair does not depend on the order of the ids.
+	return shards[pair.getHash() % shards.size()];
+}
+
+void Pipeline::expectTest(const std::string& a, const std::string& b)
+{
+	auto key = getKey(a, b);
+	getShard(key).pending[key]++;
+	expectedTests++;
+}
+
+void Pipeline::completeTest(const std::string& a, const std::string& b)
+{
+	completedTests++;
+
+	auto key = getKey(a, b);
+	auto& shard = getShard(key);
+
+	std::vector<std::pair<OrderedPair, CompositeClash*>> complete;
 	{
-		ClashDetectionResult r;
-		createClashReport(key, *clash, r);
+		std::scoped_lock lock(shard.mutex);
+		auto it = shard.pending.find(key);
+		if (it == shard.pending.end() || --it->second) {
+			return;
+		}
+		shard.pending.erase(it);
+
+		// Implementations may record the clash with the objects either way around
+
+		for (auto& pair : { OrderedPair(a, b), OrderedPair(b, a) }) {
+			auto clash = shard.clashes.find(pair);
+			if (clash != shard.clashes.end()) {
+				complete.push_back(*clash);
+				shard.clashes.erase(clash);
+			}
+		}
+	}
+
+	finalise(complete, shard);
+}
+
+void Pipeline::finalise(std::vector<std::pair<OrderedPair, CompositeClash*>>& clashes, Shard& shard)
+{
+	for (auto& [key, clash] : clashes) {
+		ClashDetectionResult result;
+		createClashReport(key, *clash, result);
 		delete clash;
-		report.clashes.push_back(r);
+		clashCount++;
+
+		if (sink) {
+			sink->write(result);
+		}
+		else {
+			std::scoped_lock lock(shard.mutex);
+			shard.results.push_back(std::move(result));
+		}
 	}
+	clashes.clear();
+}
 
-	return report;
+void Pipeline::findUnchanged(const std::vector<const CompositeObject*>& set)
+{
+	for (auto composite : set) {
+		auto it = previous->composites.find(composite->id);
+		if (it == previous->composites.end() || it->second != composites[composite->id]) {
+			continue;
+		}
+
+		bool sameRevisions = true;
+		for (auto& mesh : composite->meshes) {
+			auto revision = config.previousRevisions.find(mesh.container);
+			if (revision != config.previousRevisions.end() && revision->second != mesh.container->revision) {
+				sameRevisions = false;
+				break;
+			}
+		}
+
+		if (sameRevisions) {
+			unchanged.insert(composite);
+		}
+	}
+}
+
+bool Pipeline::reuse(const CompositeObject& a, const CompositeObject& b)
+{
+	if (!unchanged.contains(&a) || !unchanged.contains(&b)) {
+		return false;
+	}
+
+	// The broadphase may return the same pair many times (e.g. for different
+	// meshes), but the previous result should only be copied once.
+
+	auto key = getKey(a.id, b.id);
+	if (reusedPairs.insert(key).second) {
+		auto it = previousClashes.find(key);
+		if (it != previousClashes.end()) {
+			reusedClashes.push_back(*it->second);
+		}
+		statistics.reusedPairs++;
+	}
+
+	return true;
 }
 
 void Pipeline::createClashReport(const OrderedPair& objects, const CompositeClash& clash, ClashDetectionResult& result) const
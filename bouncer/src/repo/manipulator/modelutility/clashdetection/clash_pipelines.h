@@ -18,9 +18,17 @@
 #pragma once
 
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <stop_token>
 #include <repo/manipulator/modelutility/repo_clash_detection_engine.h>
 #include <repo/manipulator/modelutility/repo_clash_detection_config.h>
 #include <repo/manipulator/modeloptimizer/bvh/bvh.hpp>
+#include "bvh_wide.h"
 #include <repo/lib/datastructure/repo_triangle.h>
 #include "sparse_scene_graph.h"
 #include "ordered_pair.h"
@@ -34,6 +42,12 @@ namespace repo {
 				// types to share data between stages and the output.
 
 				using Bvh = bvh::Bvh<double>;
+
+				// The collapsed form of Bvh, used by the narrowphases for meshes that are
+				// not modified once built.
+
+				using WideBvh = bvh::WideBvh8;
+
 				using DatabasePtr = std::shared_ptr<repo::core::handler::AbstractDatabaseHandler>;
 
 				using BroadphaseResults = std::vector<std::pair<size_t, size_t>>;
@@ -43,6 +57,7 @@ namespace repo {
 
 				struct CompositeClash
 				{
+					virtual ~CompositeClash() = default;
 				};
 
 				// This graph object is what the pipeline implementations operate on, and
@@ -87,6 +102,24 @@ namespace repo {
 					const CompositeObject& getCompositeObject(size_t primitive) const;
 				};
 
+				/*
+				* Accumulates the geometry statistics of the narrowphase caches. Entries are
+				* initialised concurrently by the workers and the prefetcher, so the
+				* counters are atomic.
+				*/
+				struct GeometryCounters
+				{
+					std::atomic<size_t> meshes = 0;
+					std::atomic<size_t> bytes = 0;
+					std::atomic<int64_t> load = 0; // Nanoseconds
+					std::atomic<int64_t> build = 0;
+
+					void add(size_t meshes,
+						size_t bytes,
+						std::chrono::steady_clock::duration load,
+						std::chrono::steady_clock::duration build);
+				};
+
 				class Pipeline
 				{
 				public:
@@ -96,6 +129,25 @@ namespace repo {
 
 					ClashDetectionReport runPipeline();
 
+					/*
+					* For incremental runs, the report of a previous run. The report must
+					* outlive the call to runPipeline.
+					*/
+					void setPreviousReport(const ClashDetectionReport& report);
+
+					/*
+					* Where to send the clashes as they are found. If this is not set, they are
+					* returned in the report instead. The sink must outlive the call to
+					* runPipeline.
+					*/
+					void setSink(ClashResultsSink* sink);
+
+					/*
+					* Where to send the progress reports, if progressInterval is set in the
+					* config. The sink must outlive the call to runPipeline.
+					*/
+					void setProgressSink(ClashProgressSink* sink);
+
 				protected:
 					/*
 					* Perform the clash detection between the three graphs - all graphs will be
@@ -106,23 +158,148 @@ namespace repo {
 
 					void createClashReport(const OrderedPair& objects, const CompositeClash& clash, ClashDetectionResult& result) const;
 
+					/*
+					* Returns true if neither Composite Object has changed since the previous
+					* report, in which case any clash between them is copied from it, and the
+					* pair should not be tested again. This is not thread safe and should be
+					* called from the broadphase.
+					*/
+					bool reuse(const CompositeObject& a, const CompositeObject& b);
+
 					DatabasePtr handler;
 
 					const repo::manipulator::modelutility::ClashDetectionConfig& config;
 
-					std::unordered_map<OrderedPair, CompositeClash*, OrderedPairHasher> clashes;
+					// Implementations should fill this out as they run. It will be moved into
+					// the report when the pipeline completes.
+
+					ClashDetectionStatistics statistics;
+
+					// The caches should add to this as they initialise their entries.
+
+					GeometryCounters geometry;
+
+					/*
+					* Records the wall-clock and process CPU time between construction and
+					* stop() (or destruction) in a Stage of the statistics, and makes name
+					* the stage given by the progress reports in the meantime.
+					*/
+					class StageTimer
+					{
+					public:
+						StageTimer(Pipeline& pipeline, ClashDetectionStatistics::Stage& stage, const char* name);
+						~StageTimer();
+
+						void stop();
+
+					private:
+						ClashDetectionStatistics::Stage* stage;
+						std::chrono::steady_clock::time_point start;
+						double cpu;
+					};
+
+					/*
+					* Records that the narrowphase will run a test between the two Composite
+					* Objects. Their clash, if any, is final once as many tests have been
+					* completed. This is not thread safe and should be called before the
+					* narrowphase starts.
+					*/
+					void expectTest(const std::string& a, const std::string& b);
 
-					template<class T>
-					T* createClash(const std::string& a, const std::string& b) {
+					/*
+					* Records that a test between the two Composite Objects has finished. After
+					* the last one, their clash is passed to the sink, or kept for the report.
+					* This may be called from any thread.
+					*/
+					void completeTest(const std::string& a, const std::string& b);
+
+					/*
+					* Gets the clash between a and b, creating it if necessary, and calls update
+					* with it while holding the lock for that pair. This may be called from any
+					* thread.
+					*/
+					template<class T, class Update>
+					void updateClash(const std::string& a, const std::string& b, Update update) {
 						OrderedPair pair(a, b);
-						auto it = clashes.find(pair);
-						if (it == clashes.end())
+						auto& shard = getShard(pair);
+						std::scoped_lock lock(shard.mutex);
+						auto it = shard.clashes.find(pair);
+						if (it == shard.clashes.end())
 						{
-							auto clash = new T();
-							it = clashes.emplace(pair, std::move(clash)).first;
+							it = shard.clashes.emplace(pair, new T()).first;
 						}
-						return static_cast<T*>(it->second);
+						update(*static_cast<T*>(it->second));
 					}
+
+				private:
+					// The clashes are split between shards by their Composite Objects, each
+					// with its own lock, so the narrowphase threads only contend when they
+					// update clashes in the same shard at the same time. A pair is in the
+					// same shard whichever way around it is given.
+
+					struct Shard
+					{
+						std::mutex mutex;
+						std::unordered_map<OrderedPair, CompositeClash*, OrderedPairHasher> clashes;
+
+						// The number of tests yet to complete for each pair, keyed with the
+						// ids in lexicographical order.
+
+						std::unordered_map<OrderedPair, size_t, OrderedPairHasher> pending;
+
+						// Final clashes, when there is no sink.
+
+						std::vector<ClashDetectionResult> results;
+					};
+
+					std::vector<Shard> shards;
+
+					ClashResultsSink* sink = nullptr;
+
+					// The state given by the progress reports. These are read by the
+					// reporting thread while the pipeline runs.
+
+					ClashProgressSink* progressSink = nullptr;
+					std::chrono::steady_clock::time_point started;
+					std::atomic<const char*> stage = "starting";
+					std::atomic<size_t> expectedTests = 0;
+					std::atomic<size_t> completedTests = 0;
+					std::atomic<size_t> clashCount = 0;
+
+					ClashDetectionProgress getProgress() const;
+
+					/*
+					* Sends a progress report to the sink every progressInterval seconds, until
+					* a stop is requested.
+					*/
+					void reportProgress(std::stop_token token);
+
+					Shard& getShard(const OrderedPair& pair);
+
+					/*
+					* Converts the clashes into results and passes them on to the sink, or
+					* the shard's results, then deletes them.
+					*/
+					void finalise(std::vector<std::pair<OrderedPair, CompositeClash*>>& clashes, Shard& shard);
+
+					const ClashDetectionReport* previous = nullptr;
+
+					// The fingerprints of this run's inputs, and the Composite Objects whose
+					// fingerprints match those in the previous report.
+
+					size_t settings = 0;
+					std::unordered_map<std::string, size_t> composites;
+					std::unordered_set<const CompositeObject*> unchanged;
+
+					// The previous clashes, and the pairs reused from them so far, keyed with
+					// the ids in lexicographical order, as the previous run may have reported
+					// a pair either way around.
+
+					std::unordered_map<OrderedPair, const ClashDetectionResult*, OrderedPairHasher> previousClashes;
+					std::unordered_set<OrderedPair, OrderedPairHasher> reusedPairs;
+					std::vector<ClashDetectionResult> reusedClashes;
+
+					void findUnchanged(const std::vector<const CompositeObject*>& set);
 				};
 			}
 		}
@@ -19,7 +19,7 @@
 
 using namespace repo::manipulator::modelutility::clash;
 
-void PipelineUtils::loadGeometry(
+size_t PipelineUtils::loadGeometry(
 	DatabasePtr handler,
 	Graph::Node& node,
 	geometry::RepoIndexedMeshBuilder& builder
@@ -31,18 +31,104 @@ void PipelineUtils::loadGeometry(
 		node.mesh
 	);
 
+	size_t bytes = 0;
+	for (auto& [name, buffer] : node.mesh.getFilesMapping()) {
+		bytes += buffer.size();
+	}
+
 	auto mesh = repo::core::model::MeshNode(node.mesh);
 	const auto& faces = mesh.getFaces();
 	const auto& vertices = mesh.getVertices();
 
+	// Each vertex is transformed once up front, rather than every time a face
+	// references it.
+
+	std::vector<repo::lib::RepoVector3D64> transformed(vertices.size());
+	node.matrix.transformPoints(vertices, transformed);
+
 	for(const auto& face : faces) {
 		repo::lib::RepoTriangle tri(
-			node.matrix * repo::lib::RepoVector3D64(vertices[face[0]]),
-			node.matrix * repo::lib::RepoVector3D64(vertices[face[1]]),
-			node.matrix * repo::lib::RepoVector3D64(vertices[face[2]])
+			transformed[face[0]],
+			transformed[face[1]],
+			transformed[face[2]]
 		);
 		builder.append(tri);
 	}
 
 	node.mesh.unloadBinaryBuffers();
-}
\ No newline at end of file
+
+	return bytes;
+}
+
+size_t PipelineUtils::getMemoryUsage(const geometry::RepoIndexedMesh& mesh)
+{
+	return mesh.vertices.capacity() * sizeof(repo::lib::RepoVector3D64) +
+		mesh.faces.capacity() * sizeof(repo::lib::repo_face_t);
+}
+
+size_t PipelineUtils::getMemoryUsage(const Bvh& bvh)
+{
+	// The number of primitives is not stored, but will never exceed the number
+	// of nodes.
+	return bvh.node_count * (sizeof(Bvh::Node) + sizeof(size_t));
+}
+
+size_t PipelineUtils::getMemoryUsage(const WideBvh& bvh)
+{
+	return bvh.nodes.capacity() * sizeof(WideBvh::Node) +
+		bvh.primitive_indices.capacity() * sizeof(size_t);
+}
+
+// The process counters are defined at the end of the file, as Windows.h tends
+// to pollute a lot of defines.
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <Windows.h>
+#include <Psapi.h>
+
+double PipelineUtils::getProcessCpuTime()
+{
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+		return 0;
+	}
+	auto ticks = [](const FILETIME& t) {
+		return (static_cast<uint64_t>(t.dwHighDateTime) << 32) | t.dwLowDateTime;
+	};
+	return (ticks(kernel) + ticks(user)) * 1e-7; // FILETIMEs are in 100ns units
+}
+
+size_t PipelineUtils::getPeakMemoryUsage()
+{
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return 0;
+	}
+	return counters.PeakWorkingSetSize;
+}
+#else
+#include <sys/resource.h>
+
+double PipelineUtils::getProcessCpuTime()
+{
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage)) {
+		return 0;
+	}
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+		(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+size_t PipelineUtils::getPeakMemoryUsage()
+{
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage)) {
+		return 0;
+	}
+#if defined(__APPLE__) && defined(__MACH__)
+	return usage.ru_maxrss; // ru_maxrss is in bytes on macOS...
+#else
+	return usage.ru_maxrss * 1024; // ...and in kilobytes on Linux
+#endif
+}
+#endif
\ No newline at end of file
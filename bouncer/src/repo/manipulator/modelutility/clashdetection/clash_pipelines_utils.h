@@ -36,13 +36,33 @@ namespace repo {
 					* Gets the geometry for the node in project coordinates, adding new geometry
 					* to the IndexedMeshBuilder. All geometry read into the pipeline should be
 					* via an IndexedMeshBuilder, because this is necessary for closed mesh
-					* detection, which is a key part of both pipelines.
+					* detection, which is a key part of both pipelines. Returns the size in
+					* bytes of the binary buffers read for the node.
 					*/
-					static void loadGeometry(
+					static size_t loadGeometry(
 						DatabasePtr handler, 
 						Graph::Node& node,
 						geometry::RepoIndexedMeshBuilder& builder
 					);
+
+					/*
+					* Estimates of the heap memory held by the structures the pipelines cache
+					* for each mesh. These are used to budget the memory of the cache stages.
+					*/
+					static size_t getMemoryUsage(const geometry::RepoIndexedMesh& mesh);
+					static size_t getMemoryUsage(const Bvh& bvh);
+					static size_t getMemoryUsage(const WideBvh& bvh);
+
+					/*
+					* The user and kernel CPU time of the process so far, over all threads,
+					* in seconds.
+					*/
+					static double getProcessCpuTime();
+
+					/*
+					* The peak resident set size of the process so far, in bytes.
+					*/
+					static size_t getPeakMemoryUsage();
 				};
 			}
 		}
@@ -0,0 +1,283 @@
+/**
+*  Copyright (C) 2025 3D Repo Ltd
+*
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU Affero General Public License as
+*  published by the Free Software Foundation, either version 3 of the
+*  License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Affero General Public License for more details.
+*
+*  You should have received a copy of the GNU Affero General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <exception>
+#include <functional>
+#include <optional>
+
+namespace repo {
+	namespace manipulator {
+		namespace modelutility {
+			namespace clash {
+
+				/*
+				* The Prefetcher initialises cache entries on a set of background threads,
+				* ahead of the narrowphase workers, so that the workers spend their time
+				* on the CPU-bound tests rather than waiting on the database and file store.
+				*
+				* Entries are prefetched in the order the narrowphase is expected to first
+				* use them. The amount of memory held by entries that have been prefetched
+				* but not yet used by a worker is limited by a budget: once it is reached,
+				* the prefetch threads wait until workers consume some of them.
+				*
+				* Workers should call consume() for each entry when they pick up a test,
+				* after they have acquired it themselves. They should still load entries
+				* if they are not ready; if a prefetch thread is loading an entry at the
+				* time, the worker will block on its lock until it is done, which is never
+				* longer than loading it itself.
+				*
+				* Entries are loaded by the provided function, which should go through the
+				* same ResidencyManager as the workers, and return the Lease (Handle) that
+				* keeps the entry resident. The Prefetcher holds the Handle, and a reference
+				* to the entry, until the entry is consumed, so that prefetched entries are
+				* not evicted before a worker gets to them. Entry must have a
+				* std::shared_mutex member called mutex, and provide the method
+				* getMemoryUsage(), which is only read while the Handle is held.
+				*/
+
+				template<typename Entry, typename Handle>
+				class Prefetcher
+				{
+				public:
+					using Loader = std::function<Handle(Entry*)>;
+
+					Prefetcher(Loader load, size_t budget, int numThreads)
+						:load(load),
+						budget(budget),
+						numThreads(budget ? std::max(numThreads, 0) : 0)
+					{
+					}
+
+					~Prefetcher()
+					{
+						cancel();
+					}
+
+					/*
+					* Begins prefetching for a set of narrowphase tests, which will be split
+					* into the given number of contiguous parcels and executed concurrently
+					* (i.e. by a TaskPool). The expected order of first use interleaves the
+					* parcels. Must be called before the tests are moved to the pool.
+					*/
+					template<typename Test>
+					void start(const std::vector<Test>& tests, size_t numParcels)
+					{
+						if (!numThreads || !tests.size()) {
+							return;
+						}
+
+						std::unordered_set<Entry*> seen;
+						auto add = [&](const std::shared_ptr<Entry>& e) {
+							if (seen.insert(e.get()).second) {
+								order.push_back(e);
+							}
+						};
+
+						size_t parcelSize = (tests.size() + numParcels - 1) / numParcels;
+						for (size_t i = 0; i < parcelSize; i++) {
+							for (size_t p = 0; p < numParcels; p++) {
+								auto index = p * parcelSize + i;
+								if (index < tests.size()) {
+									add(tests[index].first);
+									add(tests[index].second);
+								}
+							}
+						}
+
+						for (int i = 0; i < numThreads; i++) {
+							threads.emplace_back(&Prefetcher::work, this);
+						}
+					}
+
+					/*
+					* Called by the narrowphase when it picks up a test using the entry. This
+					* releases the entry's share of the budget if it was prefetched.
+					*/
+					void consume(const Entry* entry)
+					{
+						if (!threads.size()) {
+							return;
+						}
+
+						// The entry is released outside the lock, as releasing the Handle may
+						// evict other entries.
+
+						std::optional<Prefetched> released;
+						{
+							std::scoped_lock lock(mutex);
+							auto it = pending.find(entry);
+							if (it != pending.end()) {
+								outstanding -= it->second.size;
+								released.emplace(std::move(it->second));
+								pending.erase(it);
+								available.notify_all();
+							}
+							else {
+								consumed.insert(entry);
+							}
+						}
+					}
+
+					/*
+					* Waits for the prefetch threads to exit and rethrows any exception that
+					* occurred while loading an entry.
+					*/
+					void stop()
+					{
+						cancel();
+						if (exception) {
+							std::rethrow_exception(exception);
+						}
+					}
+
+					size_t getPrefetchCount() const
+					{
+						return prefetched;
+					}
+
+				private:
+					Loader load;
+					size_t budget;
+					int numThreads;
+
+					std::vector<std::weak_ptr<Entry>> order;
+					size_t next = 0;
+
+					// An entry that has been loaded by the prefetcher, but not yet picked up
+					// by a worker. The Handle is declared after the entry so that it is
+					// released first.
+
+					struct Prefetched
+					{
+						std::shared_ptr<Entry> entry;
+						Handle handle;
+						size_t size;
+					};
+
+					// Entries that have been loaded by the prefetcher but not yet picked up
+					// by a worker, and those that have been picked up before the prefetcher
+					// got to them.
+
+					std::unordered_map<const Entry*, Prefetched> pending;
+					std::unordered_set<const Entry*> consumed;
+					size_t outstanding = 0;
+					size_t prefetched = 0;
+
+					bool stopped = false;
+					std::exception_ptr exception;
+
+					std::mutex mutex;
+					std::condition_variable available;
+					std::vector<std::jthread> threads;
+
+					void cancel()
+					{
+						{
+							std::scoped_lock lock(mutex);
+							stopped = true;
+						}
+						available.notify_all();
+						for (auto& t : threads) {
+							if (t.joinable()) {
+								t.join();
+							}
+						}
+
+						// Entries that were never consumed (e.g. because the narrowphase was
+						// interrupted) are released once the threads have exited.
+
+						std::unordered_map<const Entry*, Prefetched> remaining;
+						{
+							std::scoped_lock lock(mutex);
+							std::swap(remaining, pending);
+							outstanding = 0;
+						}
+					}
+
+					void work()
+					{
+						while (true) {
+							std::shared_ptr<Entry> entry;
+							{
+								std::unique_lock lock(mutex);
+
+								// Always allow at least one entry to be outstanding, so an entry
+								// larger than the budget cannot stall the prefetcher.
+
+								available.wait(lock, [&] {
+									return stopped || outstanding == 0 || outstanding < budget;
+								});
+
+								if (stopped || next >= order.size()) {
+									return;
+								}
+
+								entry = order[next++].lock();
+								if (!entry || consumed.contains(entry.get())) {
+									continue; // Already finished with, or picked up by a worker
+								}
+							}
+
+							std::optional<Handle> handle;
+							try
+							{
+								handle.emplace(load(entry.get()));
+							}
+							catch (...) {
+								std::scoped_lock lock(mutex);
+								exception = std::current_exception();
+								stopped = true;
+								available.notify_all();
+								return;
+							}
+
+							// The Handle keeps the entry resident, so its contents cannot be
+							// unloaded while the size is read.
+
+							size_t size = 0;
+							{
+								std::shared_lock entryLock{ entry->mutex };
+								size = entry->getMemoryUsage();
+							}
+
+							// If a worker has already picked up the entry, handle goes out of
+							// scope with the lock released, before entry does.
+
+							std::scoped_lock lock(mutex);
+							prefetched++;
+							if (!consumed.contains(entry.get()) && !stopped) {
+								pending.emplace(entry.get(), Prefetched{ entry, std::move(*handle), size });
+								handle.reset();
+								outstanding += size;
+							}
+						}
+					}
+				};
+			}
+		}
+	}
+}
@@ -18,152 +18,270 @@
 #include "clash_scheduler.h"
 
 #include <algorithm>
-#include <unordered_map>
-#include <queue>
+#include <numeric>
+#include <atomic>
+#include <thread>
 
 using namespace::repo::manipulator::modelutility::clash;
 
-class ClashSchedulerImpl
-{
-	struct Node;
-
-	using Edge = std::pair<Node*, Node*>;
+namespace {
+	using Index = uint32_t;
 
-	struct Node
+	class ClashSchedulerImpl
 	{
-		void* id;
-		std::vector<Edge> edges;
-
-		Node(void* id) :
-			id(id) {
+		const std::vector<std::pair<Index, Index>>& edges;
+
+		// The adjacency of each node: the edges incident on node n are
+		// incident[offsets[n]] to incident[offsets[n + 1]]. Self-edges are listed
+		// once.
+
+		std::vector<Index> offsets;
+		std::vector<Index> incident;
+
+		// The number of edges incident on each node that are yet to be scheduled.
+		// Scheduled edges are flagged in removed rather than erased from the
+		// adjacency. Each node and edge belongs to exactly one component, and each
+		// component is traversed by one thread, so these don't need to be guarded.
+		// (uint8_t is used instead of bool, as std::vector<bool> packs bits and
+		// neighbouring elements could not be written concurrently.)
+
+		std::vector<Index> degree;
+		std::vector<uint8_t> removed;
+
+		struct Component
+		{
+			Index seed;
+			size_t start;
+		};
+
+		std::vector<Component> components;
+
+	public:
+		std::vector<Index> order;
+
+		ClashSchedulerImpl(const std::vector<std::pair<Index, Index>>& edges, size_t numNodes)
+			:edges(edges),
+			offsets(numNodes + 1, 0),
+			incident(),
+			degree(numNodes, 0),
+			removed(edges.size(), 0),
+			order(edges.size())
+		{
+			createGraph();
+			createComponents();
 		}
 
-		bool remove(Edge e) {
-			edges.erase(std::remove(edges.begin(), edges.end(), e), edges.end());
-			return edges.size();
+		const std::vector<Component>& getComponents() const
+		{
+			return components;
 		}
-	};
 
-	// This manages the memory for the nodes, and its contents does not change
-	// after initialisation, though their edge count does. The pointer arrays
-	// below are used to track which nodes are live; they can be re-ordered,
-	// and have elements removed when the edge counts go to zero.
-
-	std::vector<Node> nodes;
+		void run(int numThreads)
+		{
+			if (numThreads <= 0) {
+				numThreads = std::max(1u, std::thread::hardware_concurrency());
+			}
+			numThreads = (int)std::min((size_t)numThreads, components.size());
 
-	std::vector<Node*> allNodes;
+			if (numThreads <= 1) {
+				Scratch scratch;
+				for (auto& c : components) {
+					traverse(c, scratch);
+				}
+				return;
+			}
 
-public:
-	std::vector<std::pair<void*, void*>> results;
+			// Components are taken in order by whichever thread is free; since the
+			// output location of each is known ahead of time, the result doesn't
+			// depend on which thread traverses which component.
+
+			std::atomic<size_t> next = 0;
+			std::vector<std::jthread> threads;
+			for (int i = 0; i < numThreads; i++) {
+				threads.emplace_back([&]() {
+					Scratch scratch;
+					for (auto c = next++; c < components.size(); c = next++) {
+						traverse(components[c], scratch);
+					}
+				});
+			}
+		}
 
-	ClashSchedulerImpl(std::vector<std::pair<void*, void*>> broadphaseResults)
-	{
-		createGraph(broadphaseResults);
+	private:
+		Index other(Index edge, Index node) const
+		{
+			auto& e = edges[edge];
+			return e.first == node ? e.second : e.first;
+		}
 
-		sortByEdges(allNodes);
+		void createGraph()
+		{
+			auto numNodes = degree.size();
 
-		std::queue<Node*> next;
-		while (allNodes.size()) {
-			next.push(allNodes.front());
+			for (const auto& [a, b] : edges) {
+				offsets[a + 1]++;
+				if (a != b) {
+					offsets[b + 1]++;
+				}
+			}
 
-			while (!next.empty()) {
-				auto node = next.front();
-				next.pop();
+			std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
 
-				if (!node->edges.size()) {
-					continue;
+			incident.resize(offsets[numNodes]);
+			std::vector<Index> cursor(offsets.begin(), offsets.end() - 1);
+			for (Index i = 0; i < edges.size(); i++) {
+				auto [a, b] = edges[i];
+				incident[cursor[a]++] = i;
+				if (a != b) {
+					incident[cursor[b]++] = i;
 				}
+			}
 
-				struct Other {
-					Node* node;
-					bool direction;
-				};
+			for (size_t n = 0; n < numNodes; n++) {
+				degree[n] = offsets[n + 1] - offsets[n];
+			}
+		}
 
-				std::vector<Other> others;
+		Index find(std::vector<Index>& parents, Index n)
+		{
+			while (parents[n] != n) {
+				parents[n] = parents[parents[n]];
+				n = parents[n];
+			}
+			return n;
+		}
 
-				for (auto& edge : node->edges) {
-					Other other;
-					other.direction = (node == edge.first);
-					other.node = other.direction ? edge.second : edge.first;
-					others.push_back(other);
+		/*
+		* Finds the connected components, and for each the node to start from (the
+		* one with the fewest edges) and where its edges start in the output. The
+		* components are ordered by the number of edges of their seed, as a single
+		* traversal over all nodes would be.
+		*/
+		void createComponents()
+		{
+			auto numNodes = degree.size();
+
+			std::vector<Index> parents(numNodes);
+			std::iota(parents.begin(), parents.end(), 0);
+			for (const auto& [a, b] : edges) {
+				auto ra = find(parents, a);
+				auto rb = find(parents, b);
+				if (ra != rb) {
+					parents[std::max(ra, rb)] = std::min(ra, rb);
 				}
+			}
 
-				// Sort by edges as above, but with an indirection to node
-
-				std::ranges::sort(others, [](const Other& a, const Other& b) {
-					return a.node->edges.size() < b.node->edges.size();
-				});
-
-				for (const auto& other : others) {
-					Edge edge = other.direction ? Edge(node, other.node) : Edge(other.node, node);
-					results.push_back({ edge.first->id, edge.second->id });
-					remove(edge);
-					next.push(other.node);
+			// With the union above, the root of each component is its lowest index
+			// node, so iterating in order visits roots before any of their members.
+
+			std::vector<Index> componentOfRoot(numNodes);
+			std::vector<size_t> sizes;
+			for (Index n = 0; n < numNodes; n++) {
+				auto root = find(parents, n);
+				if (root == n) {
+					componentOfRoot[n] = (Index)components.size();
+					components.push_back({ n, 0 });
+					sizes.push_back(0);
+				}
+				auto& c = components[componentOfRoot[root]];
+				if (degree[n] < degree[c.seed]) {
+					c.seed = n;
 				}
 			}
-		}
-	}
 
-	void sortByEdges(std::vector<Node*>&set)
-	{
-		std::ranges::sort(set, [](const Node* a, const Node* b) {
-			return a->edges.size() < b->edges.size();
-		});
-	}
+			for (const auto& e : edges) {
+				sizes[componentOfRoot[find(parents, e.first)]]++;
+			}
 
-	void addNode(void* id, std::unordered_map<void*, size_t>&map)
-	{
-		auto it = map.find(id);
-		if (it == map.end()) {
-			map[id] = nodes.size();
-			nodes.push_back(Node(id));
+			std::vector<size_t> sorted(components.size());
+			std::iota(sorted.begin(), sorted.end(), 0);
+			std::ranges::stable_sort(sorted, [&](size_t a, size_t b) {
+				return degree[components[a].seed] < degree[components[b].seed];
+			});
+
+			std::vector<Component> ordered;
+			ordered.reserve(components.size());
+			size_t start = 0;
+			for (auto c : sorted) {
+				ordered.push_back({ components[c].seed, start });
+				start += sizes[c];
+			}
+			components.swap(ordered);
 		}
-	}
 
-	void createGraph(std::vector<std::pair<void*, void*>> edges)
-	{
-		std::unordered_map<void*, size_t> map; // Pointer to node index
+		struct Scratch
+		{
+			std::vector<Index> queue;
+			std::vector<Index> others;
+		};
+
+		/*
+		* Breadth first traversal from the seed. Each node's remaining edges are
+		* written out together, ordered by the number of edges remaining on the
+		* node at the other end, and those nodes are visited next.
+		*/
+		void traverse(const Component& component, Scratch& scratch)
+		{
+			auto& queue = scratch.queue;
+			auto& others = scratch.others;
+			auto out = component.start;
+
+			queue.clear();
+			queue.push_back(component.seed);
+
+			for (size_t head = 0; head < queue.size(); head++) {
+				auto node = queue[head];
+
+				if (!degree[node]) {
+					continue;
+				}
 
-		for (const auto& e : edges) {
-			addNode(e.first, map);
-			addNode(e.second, map);
-		}
+				others.clear();
+				for (auto i = offsets[node]; i < offsets[node + 1]; i++) {
+					if (!removed[incident[i]]) {
+						others.push_back(incident[i]);
+					}
+				}
 
-		// From now, the nodes vector shall not change so we can take pointers to its
-		// contents.
+				// Ties are broken by edge index, to keep the order deterministic
+				// without the allocations of a stable sort.
 
-		for (const auto& e : edges) {
-			std::pair<Node*, Node*> edge(&nodes[map[e.first]], &nodes[map[e.second]]);
-			edge.first->edges.push_back(edge);
-			if(edge.first == edge.second) {
-				continue;
-			}
-			edge.second->edges.push_back(edge);
-		}
+				std::ranges::sort(others, [&](Index a, Index b) {
+					auto da = degree[other(a, node)];
+					auto db = degree[other(b, node)];
+					return da < db || (da == db && a < b);
+				});
 
-		for (auto& n : nodes) {
-			allNodes.push_back(&n);
+				for (auto e : others) {
+					auto [a, b] = edges[e];
+					order[out++] = e;
+					removed[e] = 1;
+					degree[a]--;
+					if (a != b) {
+						degree[b]--;
+					}
+					queue.push_back(other(e, node));
+				}
+			}
 		}
-	}
+	};
+}
 
-	void remove(Edge edge)
-	{
-		if (!edge.first->remove(edge)) {
-			remove(edge.first);
-		}
-		if (!edge.second->remove(edge)) {
-			remove(edge.second);
+void ClashScheduler::_schedule(
+	const std::vector<std::pair<Index, Index>>& edges,
+	size_t numNodes,
+	int numThreads,
+	std::vector<Index>& order,
+	std::vector<size_t>* components)
+{
+	ClashSchedulerImpl scheduler(edges, numNodes);
+	scheduler.run(numThreads);
+	order.swap(scheduler.order);
+
+	if (components) {
+		components->clear();
+		for (auto& c : scheduler.getComponents()) {
+			components->push_back(c.start);
 		}
 	}
-
-	void remove(Node * node)
-	{
-		allNodes.erase(std::remove(allNodes.begin(), allNodes.end(), node), allNodes.end());
-	}
-};
-
-void ClashScheduler::_schedule(std::vector<std::pair<void*, void*>>& broadphaseResults)
-{
-	ClashSchedulerImpl scheduler(broadphaseResults);
-	broadphaseResults.swap(scheduler.results);
-}
+}
\ No newline at end of file
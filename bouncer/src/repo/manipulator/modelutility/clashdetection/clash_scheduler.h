@@ -19,6 +19,11 @@
 
 #include <vector>
 #include <concepts>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <stdexcept>
 
 namespace repo {
 	namespace manipulator {
@@ -53,6 +58,16 @@ namespace repo {
 				* This hopefully makes the algorithm robust to the worst case, which is that
 				* of meshes alternating between Set A and Set B, laid out linearly and so
 				* making the graph of all Meshes fully connected.
+				*
+				* Each traversal above covers exactly one connected component of the graph,
+				* and the components share no nodes, so they are scheduled independently
+				* and concurrently. The output places each component contiguously, and can
+				* optionally return where each one starts so they may be handed to different
+				* threads.
+				*
+				* Internally, the graph is held in compressed sparse row form (arrays of
+				* offsets and incident edges), and edges are marked as removed rather than
+				* erased, so each edge and node is visited a constant number of times.
 				*/
 
 				template<typename T>
@@ -65,27 +80,71 @@ namespace repo {
 					// are not fungible). The pointers will never be dereferenced however, so
 					// any type of equivalent size will work. For example, indices could be
 					// provided instead.
+					//
+					// numThreads is the number of threads to schedule components on. Zero
+					// means one per core. If components is provided, it receives the index
+					// of the first edge of each connected component in the output.
 
 					template<ValidNodeIdentifer T>
-					static void schedule(std::vector<std::pair<T, T>>& broadphaseResults) {
-						// T must be the same size as void* but we must still cast the individual
-						// elements as the pairs/vectors are not type aliases. These loops should
-						// be optimised away by the compiler.
-						std::vector<std::pair<void*, void*>> r;
-						r.resize(broadphaseResults.size());
-						for (size_t i = 0; i < broadphaseResults.size(); i++) {
-							r[i].first = (void*)broadphaseResults[i].first;
-							r[i].second = (void*)broadphaseResults[i].second;
+					static void schedule(std::vector<std::pair<T, T>>& broadphaseResults,
+						int numThreads = 1,
+						std::vector<size_t>* components = nullptr)
+					{
+						// The implementation works on dense indices. These are assigned by
+						// sorting the endpoints of all edges by their id, so that each distinct
+						// id can be numbered in a single pass without a map.
+
+						if (broadphaseResults.size() >= std::numeric_limits<Index>::max() / 2) {
+							throw std::length_error("Too many broadphase results to schedule");
 						}
-						_schedule(r);
-						for (size_t i = 0; i < broadphaseResults.size(); i++) {
-							broadphaseResults[i].first = (T)r[i].first;
-							broadphaseResults[i].second = (T)r[i].second;
+
+						std::vector<std::pair<T, Index>> ends;
+						ends.reserve(broadphaseResults.size() * 2);
+						for (Index i = 0; i < broadphaseResults.size(); i++) {
+							ends.push_back({ broadphaseResults[i].first, i * 2 });
+							ends.push_back({ broadphaseResults[i].second, i * 2 + 1 });
+						}
+						std::sort(ends.begin(), ends.end(), [](const auto& a, const auto& b) {
+							return std::less<T>()(a.first, b.first);
+						});
+
+						std::vector<std::pair<Index, Index>> edges(broadphaseResults.size());
+						size_t numNodes = 0;
+						for (size_t i = 0; i < ends.size(); i++) {
+							if (i && ends[i].first != ends[i - 1].first) {
+								numNodes++;
+							}
+							auto& edge = edges[ends[i].second / 2];
+							(ends[i].second % 2 ? edge.second : edge.first) = (Index)numNodes;
 						}
+						if (ends.size()) {
+							numNodes++;
+						}
+						ends = {};
+
+						std::vector<Index> order;
+						_schedule(edges, numNodes, numThreads, order, components);
+
+						std::vector<std::pair<T, T>> r;
+						r.reserve(broadphaseResults.size());
+						for (auto i : order) {
+							r.push_back(broadphaseResults[i]);
+						}
+						broadphaseResults.swap(r);
 					}
 
 				private:
-					static void _schedule(std::vector<std::pair<void*, void*>>& broadphaseResults);
+					using Index = uint32_t;
+
+					/*
+					* Computes the order of the edges, as a permutation of their indices.
+					*/
+					static void _schedule(
+						const std::vector<std::pair<Index, Index>>& edges,
+						size_t numNodes,
+						int numThreads,
+						std::vector<Index>& order,
+						std::vector<size_t>* components);
 				};
 			}
 		}
@@ -0,0 +1,219 @@
+/**
+*  Copyright (C) 2025 3D Repo Ltd
+*
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU Affero General Public License as
+*  published by the Free Software Foundation, either version 3 of the
+*  License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Affero General Public License for more details.
+*
+*  You should have received a copy of the GNU Affero General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+
+#include <repo/manipulator/modelutility/repo_clash_detection_statistics.h>
+
+namespace repo {
+	namespace manipulator {
+		namespace modelutility {
+			namespace clash {
+
+				/*
+				* TaskPool executes a sequence of independent tasks on a fixed number of
+				* threads, using work stealing to balance the load.
+				*
+				* The tasks are expected to be given in the order produced by the
+				* ClashScheduler, which places tests that share meshes next to each other.
+				* To preserve this, each worker is seeded with a contiguous parcel of the
+				* sequence and consumes it from the front. A worker that runs out of tasks
+				* steals half of the remaining tasks from the back of another worker's
+				* queue - the ones that worker would have reached last - starting with its
+				* neighbours, whose parcels are closest in the schedule. Stolen blocks are
+				* contiguous, so the thief keeps the locality of the original order too.
+				*
+				* Each queue has its own lock, so contention only occurs when stealing.
+				* If a task throws, the remaining workers stop taking tasks and the first
+				* exception is rethrown from run() on the calling thread.
+				*/
+
+				template<typename Task>
+				class TaskPool
+				{
+				public:
+					TaskPool(int numThreads)
+						:workers(numThreads > 0 ? numThreads : std::max(1u, std::thread::hardware_concurrency()))
+					{
+					}
+
+					/*
+					* Distributes the tasks between the workers in contiguous parcels, in the
+					* order given. This must be called before run().
+					*/
+					void push(std::vector<Task>& tasks)
+					{
+						size_t parcelSize = (tasks.size() + workers.size() - 1) / workers.size();
+						for (size_t i = 0; i < tasks.size(); i++) {
+							workers[i / parcelSize].queue.push_back(std::move(tasks[i]));
+						}
+						tasks.clear();
+					}
+
+					/*
+					* Runs all tasks to completion, calling func(task) for each on one of
+					* the worker threads. Blocks until all workers have finished.
+					*/
+					void run(std::function<void(Task&)> func)
+					{
+						auto start = std::chrono::steady_clock::now();
+
+						std::vector<std::jthread> threads;
+						for (size_t i = 0; i < workers.size(); i++) {
+							threads.emplace_back(&TaskPool::work, this, i, std::ref(func));
+						}
+						for (auto& t : threads) {
+							t.join();
+						}
+
+						double total = seconds(std::chrono::steady_clock::now() - start);
+						for (auto& w : workers) {
+							w.statistics.idle = std::max(0.0, total - w.statistics.busy);
+						}
+
+						if (exception) {
+							std::rethrow_exception(exception);
+						}
+					}
+
+					size_t numThreads() const
+					{
+						return workers.size();
+					}
+
+					std::vector<WorkerStatistics> getStatistics() const
+					{
+						std::vector<WorkerStatistics> statistics;
+						for (auto& w : workers) {
+							statistics.push_back(w.statistics);
+						}
+						return statistics;
+					}
+
+				private:
+					struct Worker
+					{
+						std::deque<Task> queue;
+						std::mutex mutex;
+						WorkerStatistics statistics;
+					};
+
+					std::vector<Worker> workers;
+					std::atomic<bool> aborted = false;
+					std::exception_ptr exception;
+					std::mutex exceptionMutex;
+
+					static double seconds(std::chrono::steady_clock::duration d)
+					{
+						return std::chrono::duration<double>(d).count();
+					}
+
+					bool pop(Worker& worker, Task& task)
+					{
+						std::scoped_lock lock(worker.mutex);
+						if (worker.queue.empty()) {
+							return false;
+						}
+						task = std::move(worker.queue.front());
+						worker.queue.pop_front();
+						return true;
+					}
+
+					/*
+					* Moves up to half of the victims remaining tasks, from the back of its
+					* queue, to the front of the thief's queue. Returns false if there was
+					* nothing to steal.
+					*/
+					bool steal(Worker& thief, Worker& victim)
+					{
+						std::scoped_lock lock(thief.mutex, victim.mutex);
+						if (victim.queue.empty()) {
+							return false;
+						}
+						size_t count = (victim.queue.size() + 1) / 2;
+						auto first = victim.queue.end() - count;
+						thief.queue.insert(thief.queue.begin(),
+							std::make_move_iterator(first),
+							std::make_move_iterator(victim.queue.end()));
+						victim.queue.erase(first, victim.queue.end());
+						return true;
+					}
+
+					bool steal(size_t index)
+					{
+						// Alternate either side of the thief, moving outwards, so that the
+						// nearest parcels in the schedule are tried first.
+
+						auto n = workers.size();
+						for (size_t distance = 1; distance < n; distance++) {
+							if (steal(workers[index], workers[(index + distance) % n])) {
+								return true;
+							}
+							if (steal(workers[index], workers[(index + n - distance) % n])) {
+								return true;
+							}
+						}
+						return false;
+					}
+
+					void work(size_t index, std::function<void(Task&)>& func)
+					{
+						auto& worker = workers[index];
+						Task task;
+
+						// Tasks are never added once run() starts, so if there are none left
+						// to steal the worker can terminate.
+
+						while (!aborted) {
+							if (!pop(worker, task)) {
+								if (!steal(index)) {
+									break;
+								}
+								worker.statistics.steals++;
+								continue;
+							}
+
+							auto start = std::chrono::steady_clock::now();
+							try {
+								func(task);
+							}
+							catch (...) {
+								std::scoped_lock lock(exceptionMutex);
+								if (!exception) {
+									exception = std::current_exception();
+								}
+								aborted = true;
+							}
+							task = Task();
+							worker.statistics.busy += seconds(std::chrono::steady_clock::now() - start);
+							worker.statistics.tasks++;
+						}
+					}
+				};
+			}
+		}
+	}
+}
@@ -0,0 +1,325 @@
+/**
+*  Copyright (C) 2025 3D Repo Ltd
+*
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU Affero General Public License as
+*  published by the Free Software Foundation, either version 3 of the
+*  License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Affero General Public License for more details.
+*
+*  You should have received a copy of the GNU Affero General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "geometry_tests_batch.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define REPO_GEOMETRY_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define REPO_TARGET_AVX2
+#else
+#define REPO_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+using namespace geometry;
+
+/*
+* The scalar and vector kernels below perform exactly the same sequence of
+* operations, so return identical results. No fused operations are used, as
+* these would change the rounding, and the error bounds with it.
+*
+* The plane test computes the unnormalised normal of one triangle, n, and the
+* signed distances s = n.(q - p0) of the other's vertices. The error in each
+* is bounded by a small multiple of eps * m^2 * d, where m is the largest
+* edge component of the first triangle and d the largest component of any
+* q - p0, so these are subtracted from s, and added to |n|, before dividing.
+*/
+
+namespace {
+	const double EPSILON = std::numeric_limits<double>::epsilon();
+	const double SIGNED_DISTANCE_ERROR = 128 * EPSILON;
+	const double NORMAL_ERROR = 32 * EPSILON;
+
+	// Keeps the denominator positive for fully degenerate triangles, where the
+	// numerator is also zero.
+	const double TINY = std::numeric_limits<double>::min();
+
+	struct Triangle
+	{
+		double x[3];
+		double y[3];
+		double z[3];
+	};
+
+	Triangle get(const TriangleBatch& batch, size_t i)
+	{
+		return {
+			{ batch.ax[i], batch.bx[i], batch.cx[i] },
+			{ batch.ay[i], batch.by[i], batch.cy[i] },
+			{ batch.az[i], batch.bz[i], batch.cz[i] }
+		};
+	}
+
+	Triangle get(const repo::lib::RepoTriangle& t)
+	{
+		return {
+			{ t.a.x, t.b.x, t.c.x },
+			{ t.a.y, t.b.y, t.c.y },
+			{ t.a.z, t.b.z, t.c.z }
+		};
+	}
+
+	double max3(double a, double b, double c)
+	{
+		return std::max(a, std::max(b, c));
+	}
+
+	double min3(double a, double b, double c)
+	{
+		return std::min(a, std::min(b, c));
+	}
+
+	double absMax3(double a, double b, double c)
+	{
+		return max3(std::abs(a), std::abs(b), std::abs(c));
+	}
+
+	/*
+	* Returns the distance of q from the plane of p, if q lies entirely on one
+	* side of it, or a value less than or equal to zero otherwise.
+	*/
+	double planeSeparation(const Triangle& p, const Triangle& q)
+	{
+		double e1x = p.x[1] - p.x[0];
+		double e1y = p.y[1] - p.y[0];
+		double e1z = p.z[1] - p.z[0];
+		double e2x = p.x[2] - p.x[0];
+		double e2y = p.y[2] - p.y[0];
+		double e2z = p.z[2] - p.z[0];
+
+		double nx = e1y * e2z - e1z * e2y;
+		double ny = e1z * e2x - e1x * e2z;
+		double nz = e1x * e2y - e1y * e2x;
+
+		double lo = std::numeric_limits<double>::infinity();
+		double hi = -std::numeric_limits<double>::infinity();
+		double d = 0;
+
+		for (int i = 0; i < 3; i++) {
+			double dx = q.x[i] - p.x[0];
+			double dy = q.y[i] - p.y[0];
+			double dz = q.z[i] - p.z[0];
+			double s = nx * dx + ny * dy + nz * dz;
+			lo = std::min(lo, s);
+			hi = std::max(hi, s);
+			d = std::max(d, absMax3(dx, dy, dz));
+		}
+
+		double m = std::max(absMax3(e1x, e1y, e1z), absMax3(e2x, e2y, e2z));
+		double mm = m * m;
+		double s = std::max(lo, -hi);
+		double n = std::sqrt(nx * nx + ny * ny + nz * nz);
+
+		return (s - SIGNED_DISTANCE_ERROR * mm * d) / (n + NORMAL_ERROR * mm + TINY);
+	}
+
+	/*
+	* Returns the largest gap between the bounds of p and q along any axis, or a
+	* value less than or equal to zero if the bounds overlap.
+	*/
+	double boundsSeparation(const Triangle& p, const Triangle& q)
+	{
+		double gx = std::max(min3(q.x[0], q.x[1], q.x[2]) - max3(p.x[0], p.x[1], p.x[2]), min3(p.x[0], p.x[1], p.x[2]) - max3(q.x[0], q.x[1], q.x[2]));
+		double gy = std::max(min3(q.y[0], q.y[1], q.y[2]) - max3(p.y[0], p.y[1], p.y[2]), min3(p.y[0], p.y[1], p.y[2]) - max3(q.y[0], q.y[1], q.y[2]));
+		double gz = std::max(min3(q.z[0], q.z[1], q.z[2]) - max3(p.z[0], p.z[1], p.z[2]), min3(p.z[0], p.z[1], p.z[2]) - max3(q.z[0], q.z[1], q.z[2]));
+		return max3(gx, gy, gz);
+	}
+
+	double separation(const Triangle& a, const Triangle& b)
+	{
+		double g = boundsSeparation(a, b);
+		double pa = planeSeparation(a, b);
+		double pb = planeSeparation(b, a);
+		return std::max(0.0, max3(g, pa, pb));
+	}
+
+#ifdef REPO_GEOMETRY_AVX2
+
+	bool hasAvx2()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) {
+			return false;
+		}
+		__cpuid(info, 1);
+		bool osxsave = info[2] & (1 << 27);
+		bool avx = info[2] & (1 << 28);
+		if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return info[1] & (1 << 5);
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+
+	const bool AVX2 = hasAvx2();
+
+	struct Triangle4
+	{
+		__m256d x[3];
+		__m256d y[3];
+		__m256d z[3];
+	};
+
+	REPO_TARGET_AVX2 Triangle4 get4(const TriangleBatch& batch, size_t i)
+	{
+		return {
+			{ _mm256_loadu_pd(&batch.ax[i]), _mm256_loadu_pd(&batch.bx[i]), _mm256_loadu_pd(&batch.cx[i]) },
+			{ _mm256_loadu_pd(&batch.ay[i]), _mm256_loadu_pd(&batch.by[i]), _mm256_loadu_pd(&batch.cy[i]) },
+			{ _mm256_loadu_pd(&batch.az[i]), _mm256_loadu_pd(&batch.bz[i]), _mm256_loadu_pd(&batch.cz[i]) }
+		};
+	}
+
+	REPO_TARGET_AVX2 inline __m256d max3(__m256d a, __m256d b, __m256d c)
+	{
+		return _mm256_max_pd(a, _mm256_max_pd(b, c));
+	}
+
+	REPO_TARGET_AVX2 inline __m256d min3(__m256d a, __m256d b, __m256d c)
+	{
+		return _mm256_min_pd(a, _mm256_min_pd(b, c));
+	}
+
+	REPO_TARGET_AVX2 inline __m256d abs4(__m256d a)
+	{
+		return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a);
+	}
+
+	REPO_TARGET_AVX2 inline __m256d absMax3(__m256d a, __m256d b, __m256d c)
+	{
+		return max3(abs4(a), abs4(b), abs4(c));
+	}
+
+	REPO_TARGET_AVX2 __m256d planeSeparation(const Triangle4& p, const Triangle4& q)
+	{
+		__m256d e1x = _mm256_sub_pd(p.x[1], p.x[0]);
+		__m256d e1y = _mm256_sub_pd(p.y[1], p.y[0]);
+		__m256d e1z = _mm256_sub_pd(p.z[1], p.z[0]);
+		__m256d e2x = _mm256_sub_pd(p.x[2], p.x[0]);
+		__m256d e2y = _mm256_sub_pd(p.y[2], p.y[0]);
+		__m256d e2z = _mm256_sub_pd(p.z[2], p.z[0]);
+
+		__m256d nx = _mm256_sub_pd(_mm256_mul_pd(e1y, e2z), _mm256_mul_pd(e1z, e2y));
+		__m256d ny = _mm256_sub_pd(_mm256_mul_pd(e1z, e2x), _mm256_mul_pd(e1x, e2z));
+		__m256d nz = _mm256_sub_pd(_mm256_mul_pd(e1x, e2y), _mm256_mul_pd(e1y, e2x));
+
+		__m256d lo = _mm256_set1_pd(std::numeric_limits<double>::infinity());
+		__m256d hi = _mm256_set1_pd(-std::numeric_limits<double>::infinity());
+		__m256d d = _mm256_setzero_pd();
+
+		for (int i = 0; i < 3; i++) {
+			__m256d dx = _mm256_sub_pd(q.x[i], p.x[0]);
+			__m256d dy = _mm256_sub_pd(q.y[i], p.y[0]);
+			__m256d dz = _mm256_sub_pd(q.z[i], p.z[0]);
+			__m256d s = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(nx, dx), _mm256_mul_pd(ny, dy)), _mm256_mul_pd(nz, dz));
+			lo = _mm256_min_pd(lo, s);
+			hi = _mm256_max_pd(hi, s);
+			d = _mm256_max_pd(d, absMax3(dx, dy, dz));
+		}
+
+		__m256d m = _mm256_max_pd(absMax3(e1x, e1y, e1z), absMax3(e2x, e2y, e2z));
+		__m256d mm = _mm256_mul_pd(m, m);
+		__m256d s = _mm256_max_pd(lo, _mm256_sub_pd(_mm256_setzero_pd(), hi));
+		__m256d n = _mm256_sqrt_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(nx, nx), _mm256_mul_pd(ny, ny)), _mm256_mul_pd(nz, nz)));
+
+		__m256d numerator = _mm256_sub_pd(s, _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(SIGNED_DISTANCE_ERROR), mm), d));
+		__m256d denominator = _mm256_add_pd(_mm256_add_pd(n, _mm256_mul_pd(_mm256_set1_pd(NORMAL_ERROR), mm)), _mm256_set1_pd(TINY));
+		return _mm256_div_pd(numerator, denominator);
+	}
+
+	REPO_TARGET_AVX2 __m256d boundsSeparation(const Triangle4& p, const Triangle4& q, int axis)
+	{
+		auto& pa = axis == 0 ? p.x : axis == 1 ? p.y : p.z;
+		auto& qa = axis == 0 ? q.x : axis == 1 ? q.y : q.z;
+		return _mm256_max_pd(
+			_mm256_sub_pd(min3(qa[0], qa[1], qa[2]), max3(pa[0], pa[1], pa[2])),
+			_mm256_sub_pd(min3(pa[0], pa[1], pa[2]), max3(qa[0], qa[1], qa[2]))
+		);
+	}
+
+	REPO_TARGET_AVX2 void separationAvx2(const TriangleBatch& a, const TriangleBatch& b, double* results, size_t count)
+	{
+		for (size_t i = 0; i < count; i += 4) {
+			auto p = get4(a, i);
+			auto q = get4(b, i);
+			__m256d g = max3(boundsSeparation(p, q, 0), boundsSeparation(p, q, 1), boundsSeparation(p, q, 2));
+			__m256d pa = planeSeparation(p, q);
+			__m256d pb = planeSeparation(q, p);
+			_mm256_storeu_pd(results + i, _mm256_max_pd(_mm256_setzero_pd(), max3(g, pa, pb)));
+		}
+	}
+
+#endif
+}
+
+void TriangleBatch::push_back(const repo::lib::RepoTriangle& t)
+{
+	ax.push_back(t.a.x);
+	ay.push_back(t.a.y);
+	az.push_back(t.a.z);
+	bx.push_back(t.b.x);
+	by.push_back(t.b.y);
+	bz.push_back(t.b.z);
+	cx.push_back(t.c.x);
+	cy.push_back(t.c.y);
+	cz.push_back(t.c.z);
+}
+
+void TriangleBatch::clear()
+{
+	ax.clear();
+	ay.clear();
+	az.clear();
+	bx.clear();
+	by.clear();
+	bz.clear();
+	cx.clear();
+	cy.clear();
+	cz.clear();
+}
+
+double geometry::separation(const repo::lib::RepoTriangle& a, const repo::lib::RepoTriangle& b)
+{
+	return ::separation(get(a), get(b));
+}
+
+void geometry::separation(const TriangleBatch& a, const TriangleBatch& b, double* results)
+{
+	size_t i = 0;
+
+#ifdef REPO_GEOMETRY_AVX2
+	if (AVX2) {
+		i = a.size() - a.size() % 4;
+		separationAvx2(a, b, results, i);
+	}
+#endif
+
+	for (; i < a.size(); i++) {
+		results[i] = ::separation(get(a, i), get(b, i));
+	}
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+/**
+*  Copyright (C) 2025 3D Repo Ltd
+*
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU Affero General Public License as
+*  published by the Free Software Foundation, either version 3 of the
+*  License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Affero General Public License for more details.
+*
+*  You should have received a copy of the GNU Affero General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "repo/lib/datastructure/repo_triangle.h"
+#include <vector>
+#include <cstddef>
+
+namespace geometry {
+
+    /*
+    * Holds a sequence of triangles in structure-of-arrays form, so they can be
+    * processed several at a time by the batched tests below.
+    */
+    struct TriangleBatch
+    {
+        std::vector<double> ax, ay, az;
+        std::vector<double> bx, by, bz;
+        std::vector<double> cx, cy, cz;
+
+        void push_back(const repo::lib::RepoTriangle& t);
+
+        void clear();
+
+        size_t size() const
+        {
+            return ax.size();
+        }
+    };
+
+    /*
+    * Returns a lower bound on the distance between two triangles. The bound is
+    * the largest of the gap between the triangles' bounding boxes, and the
+    * distances of each triangle from the plane of the other, if it lies wholly
+    * on one side. Rounding error is accounted for, so the true distance is
+    * never less than the value returned.
+    *
+    * The bound is zero whenever the test is inconclusive - for example, if the
+    * triangles are close, intersecting, or either is degenerate - in which case
+    * closestPoints() or intersects() must be used to get an exact answer.
+    */
+    double separation(
+        const repo::lib::RepoTriangle& a,
+        const repo::lib::RepoTriangle& b
+    );
+
+    /*
+    * Computes separation() for each corresponding pair of triangles in a and b,
+    * which must be the same size, writing the bounds into results. Where the
+    * CPU supports AVX2, four pairs are tested at once. The results are the
+    * same as calling separation() for each pair individually.
+    */
+    void separation(
+        const TriangleBatch& a,
+        const TriangleBatch& b,
+        double* results
+    );
+}
\ No newline at end of file
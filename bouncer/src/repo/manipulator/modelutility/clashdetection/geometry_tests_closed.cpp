@@ -35,10 +35,10 @@ using Traverser_t = SingleRayTraverser<bvh::Bvh<double>, 64, bvh::RobustNodeInte
 #define DEGEN_RETRY_LIMIT 10
 
 namespace {
+	template<typename Mesh>
 	struct PrimitiveIntersector
 	{
-		const MeshView& mesh;
-		const bvh::Bvh<double>& bvh = mesh.getBvh();
+		const Mesh& mesh;
 
 		/*
 		* This is used with the return value of intersect() to control the early
@@ -53,7 +53,7 @@ namespace {
 		size_t numEdges = 0;
 		size_t numVertices = 0;
 
-		PrimitiveIntersector(const MeshView& mesh) :
+		PrimitiveIntersector(const Mesh& mesh) :
 			mesh(mesh)
 		{
 		}
@@ -85,23 +85,20 @@ namespace {
 		Result dummy;
 
 		/*
-		* Returns the result of the leaf intersection which the Single Ray Traverser
-		* will use to update the best hit. We don't care about the actual hits, so
-		* this always returns nullopt, ensuring the traversal continues until the end.
+		* Tests the ray against one triangle of the mesh, counting the feature it
+		* hits, if any. Returns true if the test was degenerate.
 		*/
-		std::optional<Result> intersect(size_t i, const Ray_t& ray) {
+		bool test(size_t primitive, const Vector_t& origin, const Vector_t& direction) {
 			auto edges = 0;
 			auto t = geometry::intersects(
-				reinterpret_cast<const repo::lib::RepoVector3D64&>(ray.origin),
-				reinterpret_cast<const repo::lib::RepoVector3D64&>(ray.direction),
-				mesh.getTriangle(bvh.primitive_indices[i]),
+				reinterpret_cast<const repo::lib::RepoVector3D64&>(origin),
+				reinterpret_cast<const repo::lib::RepoVector3D64&>(direction),
+				mesh.getTriangle(primitive),
 				&edges,
 				&degenerate);
 
 			if (degenerate) {
-				// If the test is degenerate, then we should exit right away and instruct
-				// the contains method to try again for this vertex with another ray.
-				return dummy;
+				return true;
 			}
 
 			if (t >= 0 && t < std::numeric_limits<double>::infinity()) {
@@ -119,6 +116,21 @@ namespace {
 				}
 			}
 
+			return false;
+		}
+
+		/*
+		* Returns the result of the leaf intersection which the Single Ray Traverser
+		* will use to update the best hit. We don't care about the actual hits, so
+		* this always returns nullopt, ensuring the traversal continues until the end.
+		*/
+		std::optional<Result> intersect(size_t i, const Ray_t& ray) {
+			if (test(mesh.getBvh().primitive_indices[i], ray.origin, ray.direction)) {
+				// If the test is degenerate, then we should exit right away and instruct
+				// the contains method to try again for this vertex with another ray.
+				return dummy;
+			}
+
 			// We have recorded the intersection; signal to the traverser to continue
 			// until we have explored the whole tree.
 
@@ -126,14 +138,14 @@ namespace {
 		}
 	};
 
-	bool encapsulates(const bvh::Bvh<double>::Node& node, const repo::lib::RepoBounds& bounds)
+	bool encapsulates(const bvh::BoundingBox<double>& box, const repo::lib::RepoBounds& bounds)
 	{
-		if (bounds.min().x < node.bounds[0]) return false;
-		if (bounds.max().x > node.bounds[1]) return false;
-		if (bounds.min().y < node.bounds[2]) return false;
-		if (bounds.max().y > node.bounds[3]) return false;
-		if (bounds.min().z < node.bounds[4]) return false;
-		if (bounds.max().z > node.bounds[5]) return false;
+		if (bounds.min().x < box.min[0]) return false;
+		if (bounds.max().x > box.max[0]) return false;
+		if (bounds.min().y < box.min[1]) return false;
+		if (bounds.max().y > box.max[1]) return false;
+		if (bounds.min().z < box.min[2]) return false;
+		if (bounds.max().z > box.max[2]) return false;
 		return true;
 	}
 
@@ -154,6 +166,86 @@ namespace {
 			return repo::lib::RepoVector3D64(x, y, z).normalized();
 		}
 	};
+
+	/*
+	* The point-in-mesh test, independent of the type of BVH. cast should trace
+	* the ray through the whole mesh, calling the intersector for each triangle
+	* that it may hit, until the intersector reports a degenerate test.
+	*/
+	template<typename Mesh, typename Cast>
+	bool contains(
+		const std::vector<repo::lib::RepoVector3D64>& vertices,
+		const std::vector<size_t>& indices,
+		const repo::lib::RepoBounds& bounds,
+		const bvh::BoundingBox<double>& meshBounds,
+		const Mesh& mesh,
+		const repo::lib::RepoVector3D64 offset,
+		Cast cast)
+	{
+		static RandomGenerator random;
+
+		// This method performs the ray-cast based point-in-mesh test:
+		// 
+		// If a point is inside a closed mesh, then ray-casting from that point in
+		// any direction will result in an odd number of intersections. This works
+		// for both convex and highly concave and complex objects.
+		//
+		// This method is compelling because it doesn't require holding the results
+		// for all points in memory, and it can terminate as soon as one point is
+		// identified to be outside the mesh. This can be made even more likely by
+		// reordering the points so the most extreme values are tested first.
+
+		// Before performing any tests, trivially check if this mesh can contain the
+		// point set at all. If the bounds of the points do not fit within the bounds
+		// of the closed mesh, there is no way that all their vertices can be within
+		// the surface as well.
+
+		if (!encapsulates(meshBounds, bounds + offset)) {
+			return false;
+		}
+
+		PrimitiveIntersector<Mesh> intersector(mesh);
+
+		auto d = random.direction();
+
+		for (const auto& i : indices) {
+			const auto& p = vertices[i];
+			size_t retryCounter = 0;
+			while(true) {
+				Ray_t ray(reinterpret_cast<const Vector_t&>(p), reinterpret_cast<const Vector_t&>(d));
+				ray.origin += reinterpret_cast<const Vector_t&>(offset);
+				intersector.reset();
+				cast(ray, intersector);
+
+				if (!intersector.degenerate) {
+					break;
+				}
+
+				// If the traversal terminated because of a degenerate test, we cannot make
+				// a reliable assertion about this point using this ray, so make another
+				// one to try again.
+
+				d = random.direction();
+
+				if (retryCounter++ > DEGEN_RETRY_LIMIT) {
+					// In normal use, finding a degenerate test for a randomly sampled ray is
+					// extremely unlikely. To do so 10 times is effectively impossible and
+					// suggests something is wrong with the mesh.
+
+					// This exception should be caught upstream and the mesh info appended for
+					// reporting back to the user.
+
+					throw GeometryTestException("Degenerate ray-triangle retry limit exceeded");
+				}
+			}
+
+			if (intersector.numFeatures() % 2 == 0) {
+				return false; // This point is outside the mesh. No need to test further.
+			}
+		}
+
+		return true;
+	}
 }
 
 bool geometry::contains(
@@ -163,75 +255,37 @@ bool geometry::contains(
 	const MeshView& mesh,
 	const repo::lib::RepoVector3D64 offset)
 {
-	static RandomGenerator random;
-
-	// This method uses the SingleRayTraverser of the bvh library to peform the
-	// ray-cast based point-in-mesh test:
-	// 
-	// If a point is inside a closed mesh, then ray-casting from that point in
-	// any direction will result in an odd number of intersections. This works
-	// for both convex and highly concave and complex objects.
-	//
-	// This method is compelling because it doesn't require holding the results
-	// for all points in memory, and it can terminate as soon as one point is
-	// identified to be outside the mesh. This can be made even more likely by
-	// reordering the points so the most extreme values are tested first.
-
-	// Before performing any tests, trivially check if this mesh can contain the
-	// point set at all. If the bounds of the points do not fit within the bounds
-	// of the closed mesh, there is no way that all their vertices can be within
-	// the surface as well.
+	// The binary BVH is traversed with the SingleRayTraverser of the bvh library.
 
 	const auto& bvh = mesh.getBvh();
-
-	if (!encapsulates(bvh.nodes[0], bounds + offset)) {
-		return false;
-	}
-
-	PrimitiveIntersector intersector(mesh);
 	Traverser_t traverser(bvh);
 
-	auto d = random.direction();
-
-	for (const auto& i : indices) {
-		const auto& p = vertices[i];
-		size_t retryCounter = 0;
-		while(true) {
-			Ray_t ray(reinterpret_cast<const Vector_t&>(p), reinterpret_cast<const Vector_t&>(d));
-			ray.origin += reinterpret_cast<const Vector_t&>(offset);
-			intersector.reset();
+	return ::contains(vertices, indices, bounds, bvh.nodes[0].bounding_box_proxy(), mesh, offset,
+		[&](const Ray_t& ray, PrimitiveIntersector<MeshView>& intersector) {
 			traverser.traverse(ray, intersector);
-
-			if (!intersector.degenerate) {
-				break;
-			}
-
-			// If the traversal terminated because of a degenerate test, we cannot make
-			// a reliable assertion about this point using this ray, so make another
-			// one to try again.
-
-			d = random.direction();
-
-			if (retryCounter++ > DEGEN_RETRY_LIMIT) {
-				// In normal use, finding a degenerate test for a randomly sampled ray is
-				// extremely unlikely. To do so 10 times is effectively impossible and
-				// suggests something is wrong with the mesh.
-
-				// This exception should be caught upstream and the mesh info appended for
-				// reporting back to the user.
-
-				throw GeometryTestException("Degenerate ray-triangle retry limit exceeded");
-			}
 		}
+	);
+}
 
-		if (intersector.numFeatures() % 2 == 0) {
-			return false; // This point is outside the mesh. No need to test further.
-		}
-	}
+bool geometry::contains(
+	const std::vector<repo::lib::RepoVector3D64>& vertices,
+	const std::vector<size_t>& indices,
+	const repo::lib::RepoBounds& bounds,
+	const WideMeshView& mesh,
+	const repo::lib::RepoVector3D64 offset)
+{
+	const auto& bvh = mesh.getBvh();
 
-	return true;
+	return ::contains(vertices, indices, bounds, bvh.bounds, mesh, offset,
+		[&](const Ray_t& ray, PrimitiveIntersector<WideMeshView>& intersector) {
+			bvh::wide::traverse(bvh, bvh::wide::Ray(bvh, ray.origin, ray.direction), [&](size_t primitive) {
+				return intersector.test(primitive, ray.origin, ray.direction);
+			});
+		}
+	);
 }
 
+
 namespace {
 	double score(const repo::lib::RepoVector3D64& v) {
 		return std::max({std::abs(v.x), std::abs(v.y), std::abs(v.z)});
@@ -23,6 +23,7 @@
 #include "repo/lib/datastructure/repo_vector3d.h"
 #include "repo/lib/datastructure/repo_bounds.h"
 #include "repo/manipulator/modeloptimizer/bvh/bvh.hpp"
+#include "bvh_wide.h"
 
 namespace geometry {
 	/*
@@ -35,6 +36,15 @@ namespace geometry {
 		virtual repo::lib::RepoTriangle getTriangle(size_t primitive) const = 0;
 	};
 
+	/*
+	* The same as MeshView, for meshes indexed by a collapsed (wide) BVH.
+	*/
+	struct WideMeshView
+	{
+		virtual const bvh::WideBvh8& getBvh() const = 0;
+		virtual repo::lib::RepoTriangle getTriangle(size_t primitive) const = 0;
+	};
+
 	/*
 	* Checks if a set of vertices is entirely contained in the mesh exposed by the
 	* MeshView. A bounds should be provided for the vertices to allow for early
@@ -57,6 +67,13 @@ namespace geometry {
 		const MeshView& mesh,
 		const repo::lib::RepoVector3D64 offset = repo::lib::RepoVector3D64(0,0,0));
 
+	bool contains(
+		const std::vector<repo::lib::RepoVector3D64>& vertices,
+		const std::vector<size_t>& indices,
+		const repo::lib::RepoBounds& bounds,
+		const WideMeshView& mesh,
+		const repo::lib::RepoVector3D64 offset = repo::lib::RepoVector3D64(0,0,0));
+
 	/*
 	* For a set of vertices of an open or closed mesh, create a set of indices
 	* so that the most extreme vertices are close to the beginning of the list. 
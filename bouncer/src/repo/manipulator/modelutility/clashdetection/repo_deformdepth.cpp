@@ -18,11 +18,16 @@
 #include "repo_deformdepth.h"
 #include "repo/lib/datastructure/repo_structs.h"
 #include "geometry_tests.h"
+#include "geometry_tests_batch.h"
 #include "repo/manipulator/modeloptimizer/bvh/sweep_sah_builder.hpp"
 #include "repo/manipulator/modeloptimizer/bvh/hierarchy_refitter.hpp"
 #include "bvh_operators.h"
 
 #include <set>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <exception>
 
 using namespace geometry;
 using namespace repo::lib;
@@ -30,6 +35,55 @@ using namespace repo::lib;
 using Bvh = bvh::Bvh<double>;
 
 namespace {
+	// When running in parallel, each face group pair's traversal is split into
+	// this many tasks per thread, so the threads stay balanced even if only one
+	// pair has any contacts.
+	const size_t TASKS_PER_THREAD = 8;
+
+	// The number of vertices each thread deflates at a time.
+	const size_t DEFLATE_BLOCK_SIZE = 4096;
+
+	/*
+	* Calls func(i) for every i in [0, count) on up to numThreads threads,
+	* including the calling one, and blocks until they are all done. Indices are
+	* handed out in order. If func throws, the remaining indices are skipped and
+	* the first exception is rethrown on the calling thread.
+	*/
+	template<typename Func>
+	void parallelFor(int numThreads, size_t count, Func func)
+	{
+		std::atomic<size_t> next = 0;
+		std::exception_ptr exception;
+		std::mutex mutex;
+
+		auto work = [&]() {
+			try {
+				for (auto i = next++; i < count; i = next++) {
+					func(i);
+				}
+			}
+			catch (...) {
+				std::scoped_lock lock(mutex);
+				if (!exception) {
+					exception = std::current_exception();
+				}
+				next = count;
+			}
+		};
+
+		{
+			std::vector<std::jthread> threads;
+			for (size_t i = 1; i < std::min<size_t>(std::max(numThreads, 1), count); i++) {
+				threads.emplace_back(work);
+			}
+			work();
+		}
+
+		if (exception) {
+			std::rethrow_exception(exception);
+		}
+	}
+
 	// Updates the Bvh bottom-up, refitting the bounds to the triangles under a given
 	// transformation. The Bvh is updated in-place, but the original triangles are
     // not modified.
@@ -79,11 +133,13 @@ namespace {
 RepoDeformDepth::RepoDeformDepth(
 	RepoDeformDepth::Mesh& a,
 	const RepoDeformDepth::Mesh& b,
-	double tolerance) :
+	double tolerance,
+	int numThreads) :
 	a(a),
 	b(b),
 	tolerance(tolerance),
-	distance(FLT_MAX)
+	distance(FLT_MAX),
+	numThreads(std::max(numThreads, 1))
 {
 	// If there is no intersection, there is nothing to do, which we signal by
 	// already setting the configuration distance to zero.
@@ -119,15 +175,39 @@ RepoDeformDepth::RepoDeformDepth(
 
 	auto localSearchStepSize = tolerance / static_cast<double>(numLocalSearchSteps);
 
+	std::vector<repo::lib::RepoVector3D64> offsets;
+	for (double istep = numLocalSearchSteps - 1; istep > 0; istep--) {
+		for (auto& axis : axes) {
+			for (int dir = -1; dir <= 1; dir += 2) {
+				offsets.push_back(axis * dir * (istep * localSearchStepSize));
+			}
+		}
+	}
+
 	auto performLocalSearch = [&]() {
-		for (double istep = numLocalSearchSteps - 1; istep > 0; istep--) {
-			for (auto& axis : axes) {
-				for (int dir = -1; dir <= 1; dir += 2) {
-					auto pqs = axis * dir * (istep * localSearchStepSize);
-					if (!intersect(pqs)) { // Local search has found an intersection free configuration
-						return pqs;
+		if (this->numThreads > 1) {
+			// The offsets are tested concurrently, each on one thread. The result is
+			// the first intersection free offset in the order of the serial search,
+			// so offsets after one already found are skipped, but those before it
+			// must still finish.
+
+			std::atomic<size_t> found = offsets.size();
+			parallelFor(this->numThreads, offsets.size(), [&](size_t i) {
+				if (i < found && !intersect(offsets[i], 1)) {
+					auto f = found.load();
+					while (i < f && !found.compare_exchange_weak(f, i)) {
 					}
 				}
+			});
+			if (found < offsets.size()) {
+				return offsets[found];
+			}
+		}
+		else {
+			for (auto& pqs : offsets) {
+				if (!intersect(pqs)) { // Local search has found an intersection free configuration
+					return pqs;
+				}
 			}
 		}
 		return repo::lib::RepoVector3D64(FLT_MAX, FLT_MAX, FLT_MAX);
@@ -184,55 +264,131 @@ namespace {
 		result.bounds[5] += offset.z;
 		return result;
 	}
+
+	/*
+	* Looks for contacts between the faces of a pair of groups, with those of (a)
+	* offset by m. All the queries of one intersect() share the flag, so when
+	* one finds a contact the others, which may be running on other threads,
+	* terminate as soon as they next check it.
+	*/
+	struct ContactQuery : public bvh::Traversal
+	{
+		const RepoDeformDepth::Mesh::Faces& ga;
+		const RepoDeformDepth::Mesh::Faces& gb;
+		const RepoVector3D64& m;
+		std::atomic<bool>& intersecting;
+
+		ContactQuery(const RepoDeformDepth::Mesh::Faces& ga,
+			const RepoDeformDepth::Mesh::Faces& gb,
+			const RepoVector3D64& m,
+			std::atomic<bool>& intersecting)
+			:ga(ga),
+			gb(gb),
+			m(m),
+			intersecting(intersecting)
+		{
+		}
+
+		using bvh::Traversal::operator();
+
+		bool intersect(const Bvh::Node& a, const Bvh::Node& b) override
+		{
+			if (intersecting) {
+				return false;
+			}
+			auto _a = a + m;
+			return bvh::predicates::contacts(_a, b);
+		}
+
+		bool intersect(size_t _a, size_t _b) override
+		{
+			if (intersecting) {
+				return true;
+			}
+
+			auto triA = ga.getTriangle(_a) + m;
+			auto triB = gb.getTriangle(_b);
+
+			// Most pairs reaching the leaves are clearly apart, which the
+			// separation test can show much more cheaply than the exact one.
+			// Pairs within twice the contact threshold are left to the exact test.
+
+			auto ct = geometry::contactThreshold(triA, triB);
+			if (geometry::separation(triA, triB) > ct * 2) {
+				return false;
+			}
+
+			auto d = geometry::closestPoints(triA, triB);
+			if (d.intersects || d.magnitude() < ct) {
+				intersecting = true;
+
+				// In hard mode, the configuration is either valid or it is not, so we can
+				// terminate the traversal the first time any intersection is found.
+				return true;
+			}
+
+			return false;
+		}
+	};
 }
 
 bool RepoDeformDepth::intersect(const repo::lib::RepoVector3D64& m)
 {
-	bool intersecting = false;
+	return intersect(m, numThreads);
+}
 
-	for (auto& ga : a.faceGroups) {
-		for (auto& gb : b.faceGroups) {
+bool RepoDeformDepth::intersect(const repo::lib::RepoVector3D64& m, int threads)
+{
+	std::atomic<bool> intersecting = false;
 
-			bvh::traverse(ga.getBvh(), gb.getBvh(),
-				[&](const Bvh::Node& a, const Bvh::Node& b)
-				{
-					auto _a = a + m;
-					return bvh::predicates::contacts(_a, b);
-				},
-				[&](size_t _a, size_t _b)
-				{
-					auto triA = ga.getTriangle(_a) + m;
-					auto triB = gb.getTriangle(_b);
-
-					auto d = geometry::closestPoints(triA, triB);
-					auto ct = geometry::contactThreshold(triA, triB);
-					if (d.intersects || d.magnitude() < ct) {
-						intersecting = true;
-
-						// In hard mode, the configuration is either valid or it is not, so we can
-						// terminate the traversal the first time any intersection is found.
-						return true;
-					}
+	if (threads > 1) {
+		// The traversals of all the group pairs are split into tasks up-front,
+		// so a single pair of large groups can still be shared between the
+		// threads.
 
-					return false;
+		struct Job
+		{
+			const Mesh::Faces* ga;
+			const Mesh::Faces* gb;
+			bvh::Traversal::Task task;
+		};
+
+		std::vector<Job> jobs;
+		for (auto& ga : a.faceGroups) {
+			for (auto& gb : b.faceGroups) {
+				ContactQuery query(ga, gb, m, intersecting);
+				for (auto& task : query.split(ga.getBvh(), gb.getBvh(), threads * TASKS_PER_THREAD)) {
+					jobs.push_back({ &ga, &gb, task });
 				}
-			);
-
-			if (intersecting) { 
-				break; 
 			}
 		}
 
-		if (intersecting) { 
-			break; 
+		parallelFor(threads, jobs.size(), [&](size_t i) {
+			if (intersecting) {
+				return;
+			}
+			auto& job = jobs[i];
+			ContactQuery query(*job.ga, *job.gb, m, intersecting);
+			query(job.ga->getBvh(), job.gb->getBvh(), job.task);
+		});
+	}
+	else {
+		for (auto& ga : a.faceGroups) {
+			for (auto& gb : b.faceGroups) {
+				ContactQuery query(ga, gb, m, intersecting);
+				query(ga.getBvh(), gb.getBvh());
+				if (intersecting) {
+					return true;
+				}
+			}
 		}
 	}
 
-	if (!intersecting) {
-		intersecting = contained(m);
+	if (intersecting) {
+		return true;
 	}
 
-	return intersecting;
+	return contained(m);
 }
 
 bool RepoDeformDepth::contained(const repo::lib::RepoVector3D64& m)
@@ -266,7 +422,7 @@ void RepoDeformDepth::iterate(int maxIterations)
 
 	for(int i = 0; i < maxIterations; i++) {
 		if (intersect()) {
-			a.deflate(tolerance * deflateStepSize);
+			a.deflate(tolerance * deflateStepSize, numThreads);
 
 			// If we've had to deform the mesh beyond the tolerance, there is no
 			// point in continuing further.
@@ -326,18 +482,25 @@ std::vector<size_t> RepoDeformDepth::Mesh::Faces::getIndices() const {
 	return orderedIndices;
 }
 
-void RepoDeformDepth::Mesh::deflate(double amount)
+void RepoDeformDepth::Mesh::deflate(double amount, int numThreads)
 {
-	for (auto vi = 0; vi < _vertices.size(); vi++) {
-		auto& v = _vertices[vi];
-		auto& n = pseudoNormals[vi];
-		v = v - n * amount;
-	}
+	auto numBlocks = (_vertices.size() + DEFLATE_BLOCK_SIZE - 1) / DEFLATE_BLOCK_SIZE;
+	parallelFor(numThreads, numBlocks, [&](size_t block) {
+		auto end = std::min(_vertices.size(), (block + 1) * DEFLATE_BLOCK_SIZE);
+		for (auto vi = block * DEFLATE_BLOCK_SIZE; vi < end; vi++) {
+			auto& v = _vertices[vi];
+			auto& n = pseudoNormals[vi];
+			v = v - n * amount;
+		}
+	});
 
-	for (auto& s : faceGroups) {
+	// Each group has its own Bvh, so they can be refit independently.
+
+	parallelFor(numThreads, faceGroups.size(), [&](size_t i) {
+		auto& s = faceGroups[i];
 		BvhRefitter refitter(s.bvh, _vertices, faces.data() + s.start);
 		refitter.refit();
-	}
+	});
 
 	deformed = true;
 }
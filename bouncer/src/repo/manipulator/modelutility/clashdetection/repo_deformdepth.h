@@ -140,8 +140,9 @@ namespace geometry {
 
 			/*
 			* Reduces mesh A along its outer surface by the absolute distance specified.
+			* The vertices and face groups are updated on up to numThreads threads.
 			*/
-			void deflate(double amount);
+			void deflate(double amount, int numThreads = 1);
 
 			/*
 			* Gets the distance of the current configuration from the starting
@@ -167,11 +168,16 @@ namespace geometry {
 		* deformed, and mesh (b) is static. Mesh (a) may be deflated, but will be
 		* reset before the constructor returns. The results of the search are found
 		* by calling getPenetrationDepth() and getContactManifold().
+		* If numThreads is greater than one, the search uses that many threads,
+		* including the calling one. This only pays off for very large meshes, so
+		* callers should decide based on the size of the pair. The results are the
+		* same regardless.
 		*/
 		RepoDeformDepth(
 			RepoDeformDepth::Mesh& a,
 			const RepoDeformDepth::Mesh& b,
-			double tolerance = 0.0);
+			double tolerance = 0.0,
+			int numThreads = 1);
 
 		double getPenetrationDepth() const;
 
@@ -203,6 +209,12 @@ namespace geometry {
 		bool intersect(const repo::lib::RepoVector3D64& m);
 		bool intersect();
 
+		/*
+		* As above, but with the traversals split between the given number of
+		* threads, instead of the number given to the constructor.
+		*/
+		bool intersect(const repo::lib::RepoVector3D64& m, int threads);
+
 		/*
 		* Returns true if under the current configuration, mesh (a) is entirely
 		* contained by mesh (b), or mesh (b) is entirely contained by mesh (a).
@@ -223,5 +235,10 @@ namespace geometry {
 		* tolerance.
 		*/
 		double deflateStepSize = 0.05;
+
+		/*
+		* The number of threads the search may use.
+		*/
+		int numThreads;
 	};
 }
\ No newline at end of file
@@ -36,7 +36,8 @@ using namespace repo::lib;
 void SceneGraph::populate(
 	std::shared_ptr<repo::core::handler::AbstractDatabaseHandler> handler,
 	const repo::lib::Container* container, 
-	const std::vector<repo::lib::RepoUUID>& uniqueIds
+	const std::vector<repo::lib::RepoUUID>& uniqueIds,
+	RootTransformCache* cache
 )
 {
 	// This method populates the sparse scene graph.
@@ -46,12 +47,20 @@ void SceneGraph::populate(
 	// requests in the worst case, but not reading the entire tree just for one
 	// or two nodes.
 
+	// The mesh documents are kept to load the geometry later, so must include
+	// the fields the MeshNode needs to interpret the binaries.
+
 	repo::core::handler::database::query::RepoProjectionBuilder projection;
+	projection.includeField(REPO_NODE_LABEL_SHARED_ID);
 	projection.includeField(REPO_NODE_LABEL_PARENTS);
 	projection.includeField(REPO_NODE_LABEL_MATRIX);
 	projection.includeField(REPO_NODE_LABEL_TYPE);
 	projection.includeField(REPO_LABEL_BINARY_REFERENCE);
 	projection.includeField(REPO_NODE_MESH_LABEL_BOUNDING_BOX);
+	projection.includeField(REPO_NODE_MESH_LABEL_PRIMITIVE);
+	projection.includeField(REPO_NODE_MESH_LABEL_FACES_COUNT);
+	projection.includeField(REPO_NODE_MESH_LABEL_FACES_ENCODING);
+	projection.includeField(REPO_NODE_MESH_LABEL_VERTICES_COUNT);
 
 	std::unordered_map<repo::lib::RepoUUID, std::vector<repo::lib::RepoUUID>, repo::lib::RepoUUIDHasher> parentToChild; // by Shared Id
 
@@ -129,27 +138,70 @@ void SceneGraph::populate(
 
 	// The final step is to premultiply the world offset and units
 
-	repo::core::model::ModelRevisionNode history(handler->findOneByCriteria(
-		container->teamspace,
-		container->container + "." + REPO_COLLECTION_HISTORY,
-		repo::core::handler::database::query::Eq(REPO_NODE_LABEL_ID, container->revision)
-	));
-	auto offset = history.getCoordOffset();
-
-	// In the future we may want to store the units with the revision node, as then
-	// it is unambiguous what scale was applied on import for BIM formats
-
-	repo::core::model::RepoProjectSettings settings(handler->findOneByCriteria(
-		container->teamspace,
-		REPO_COLLECTION_SETTINGS,
-		repo::core::handler::database::query::Eq(REPO_NODE_LABEL_ID, container->container)
-	));
-	auto scale = units::determineScaleFactor(settings.getUnits(), ModelUnits::MILLIMETRES);
-
-	auto rootTransform = repo::lib::RepoMatrix::scale(scale) * repo::lib::RepoMatrix::translate(offset);
+	RootTransformCache local;
+	auto rootTransform = (cache ? cache : &local)->getRootTransform(handler, container);
 	for(auto& id : uniqueIds)
 	{
 		auto& node = nodes[id];
 		node.matrix = rootTransform * node.matrix;
 	}
+}
+
+template<typename T, typename F>
+T RootTransformCache::get(std::unordered_map<std::string, std::shared_future<T>>& map, const std::string& key, F fetch)
+{
+	std::promise<T> promise;
+	std::shared_future<T> future;
+	bool fetcher = false;
+	{
+		std::scoped_lock lock(mutex);
+		auto it = map.find(key);
+		if (it == map.end()) {
+			future = promise.get_future().share();
+			map[key] = future;
+			fetcher = true;
+		}
+		else {
+			future = it->second;
+		}
+	}
+
+	if (fetcher) {
+		try {
+			promise.set_value(fetch());
+		}
+		catch (...) {
+			promise.set_exception(std::current_exception());
+		}
+	}
+
+	return future.get();
+}
+
+repo::lib::RepoMatrix RootTransformCache::getRootTransform(
+	std::shared_ptr<repo::core::handler::AbstractDatabaseHandler> handler,
+	const repo::lib::Container* container)
+{
+	auto offset = get(offsets, container->teamspace + "." + container->container + "." + container->revision.toString(), [&]() {
+		repo::core::model::ModelRevisionNode history(handler->findOneByCriteria(
+			container->teamspace,
+			container->container + "." + REPO_COLLECTION_HISTORY,
+			repo::core::handler::database::query::Eq(REPO_NODE_LABEL_ID, container->revision)
+		));
+		return repo::lib::RepoVector3D64(history.getCoordOffset());
+	});
+
+	// In the future we may want to store the units with the revision node, as then
+	// it is unambiguous what scale was applied on import for BIM formats
+
+	auto scale = get(scales, container->teamspace + "." + container->container, [&]() {
+		repo::core::model::RepoProjectSettings settings(handler->findOneByCriteria(
+			container->teamspace,
+			REPO_COLLECTION_SETTINGS,
+			repo::core::handler::database::query::Eq(REPO_NODE_LABEL_ID, container->container)
+		));
+		return units::determineScaleFactor(settings.getUnits(), ModelUnits::MILLIMETRES);
+	});
+
+	return repo::lib::RepoMatrix::scale(scale) * repo::lib::RepoMatrix::translate(offset);
 }
\ No newline at end of file
@@ -18,6 +18,9 @@
 #pragma once
 
 #include <unordered_map>
+#include <string>
+#include <mutex>
+#include <future>
 
 #include "repo/repo_bouncer_global.h"
 #include "repo/lib/datastructure/repo_container.h"
@@ -44,16 +47,48 @@ namespace repo {
 					const repo::lib::Container* container;
 				};
 
+				/*
+				* Holds the transform from each container's coordinate system into project
+				* coordinates, which is built from documents outside the scene collection:
+				* the world offset of the revision and the units of the project settings.
+				* This may be shared between SceneGraphs, including on different threads,
+				* so those documents are only requested once however many times the same
+				* container is referenced.
+				*/
+				REPO_API_EXPORT class RootTransformCache
+				{
+				public:
+					repo::lib::RepoMatrix getRootTransform(
+						std::shared_ptr<repo::core::handler::AbstractDatabaseHandler> handler,
+						const repo::lib::Container* container
+					);
+
+				private:
+					std::mutex mutex;
+
+					// By teamspace, container and revision for the offsets, and by teamspace
+					// and container for the scale. The first thread to request a value
+					// fetches it while any others wait on the future.
+
+					std::unordered_map<std::string, std::shared_future<repo::lib::RepoVector3D64>> offsets;
+					std::unordered_map<std::string, std::shared_future<double>> scales;
+
+					template<typename T, typename F>
+					T get(std::unordered_map<std::string, std::shared_future<T>>& map, const std::string& key, F fetch);
+				};
+
 				REPO_API_EXPORT struct SceneGraph
 				{
 				public:
 					/*
 					* Populates the scene graph starting at the leaf nodes. Can be called multiple times.
+					* If a cache is provided, the root transform is taken from it.
 					*/
 					void populate(
 						std::shared_ptr<repo::core::handler::AbstractDatabaseHandler> handler,
 						const repo::lib::Container* container,
-						const std::vector<repo::lib::RepoUUID>& uniqueIds
+						const std::vector<repo::lib::RepoUUID>& uniqueIds,
+						RootTransformCache* cache = nullptr
 					);
 
 					/*
@@ -43,6 +43,10 @@ public:
 		const std::string& teamspace,
 		const std::string& container,
 		const repo::lib::RepoUUID& revision) = 0;
+
+	virtual void setPreviousRevision(
+		const repo::lib::Container* container,
+		const repo::lib::RepoUUID& revision) = 0;
 };
 
 struct MeshIdsParser : public Parser
@@ -94,6 +98,7 @@ struct CompositeObjectSetParser : public ObjectParser, public ICompositeObjectSe
 	std::string teamspace;
 	std::string containerName;
 	repo::lib::RepoUUID revision;
+	repo::lib::RepoUUID previousRevision;
 
 	CompositeObjectMap& set;
 	IContainerSet* containers;
@@ -105,6 +110,7 @@ struct CompositeObjectSetParser : public ObjectParser, public ICompositeObjectSe
 		parsers["teamspace"] = new StringParser(teamspace);
 		parsers["container"] = new StringParser(containerName);
 		parsers["revision"] = new RepoUUIDParser(revision);
+		parsers["previousRevision"] = new RepoUUIDParser(previousRevision);
 		parsers["objects"] = new ArrayParser(new CompositeObjectParser(this));
 	}
 
@@ -115,11 +121,20 @@ struct CompositeObjectSetParser : public ObjectParser, public ICompositeObjectSe
 		return obj;
 	}
 
+	virtual void StartObject() override
+	{
+		// previousRevision is optional, so must not carry over from the last set
+		previousRevision = repo::lib::RepoUUID();
+	}
+
 	virtual Parser* Key(const std::string_view& key) override
 	{
 		// The objects field should always follow the container parameters
 		if (key == "objects") {
 			container = containers->getContainer(teamspace, containerName, revision);
+			if (previousRevision) {
+				containers->setPreviousRevision(container, previousRevision);
+			}
 		}
 		return ObjectParser::Key(key);
 	}
@@ -161,7 +176,13 @@ struct ClashConfigParser : public ObjectParser, public IContainerSet
 		parsers["type"] = new ClashTypeParser(config.type);
 		parsers["tolerance"] = new NumberParser<double>(config.tolerance);
 		parsers["numThreads"] = new NumberParser<int>(config.numThreads);
+		parsers["prefetchMemory"] = new NumberParser<size_t>(config.prefetchMemory);
+		parsers["numPrefetchThreads"] = new NumberParser<int>(config.numPrefetchThreads);
+		parsers["cacheMemory"] = new NumberParser<size_t>(config.cacheMemory);
+		parsers["meshStore"] = new BoolParser(config.meshStore);
+		parsers["progressInterval"] = new NumberParser<double>(config.progressInterval);
 		parsers["resultsFile"] = new StringParser(config.resultsFile);
+		parsers["previousResultsFile"] = new StringParser(config.previousResultsFile);
 		parsers["setA"] = new ArrayParser(new CompositeObjectSetParser(this, mapA));
 		parsers["setB"] = new ArrayParser(new CompositeObjectSetParser(this, mapB));
 		parsers["selfIntersectsA"] = new BoolParser(config.selfIntersectsA); 
@@ -191,6 +212,13 @@ struct ClashConfigParser : public ObjectParser, public IContainerSet
 		}
 	}
 
+	virtual void setPreviousRevision(
+		const repo::lib::Container* container,
+		const repo::lib::RepoUUID& revision) override
+	{
+		config.previousRevisions[container] = revision;
+	}
+
 	virtual void EndObject() override
 	{
 		config.setA.clear();
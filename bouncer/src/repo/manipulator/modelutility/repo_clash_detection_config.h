@@ -22,6 +22,7 @@
 #include <repo/lib/datastructure/repo_container.h>
 #include <vector>
 #include <memory>
+#include <unordered_map>
 
 namespace repo {
 	namespace manipulator {
@@ -95,6 +96,41 @@ namespace repo {
 
 				int numThreads = 0;
 
+				/*
+				* Meshes are loaded ahead of the narrowphase by a separate set of threads.
+				* prefetchMemory limits the size (in bytes) of the meshes that have been
+				* loaded ahead but are not yet in use. Setting either to zero disables the
+				* prefetch stage, in which case meshes are loaded by the narrowphase
+				* threads as they need them.
+				*/
+				size_t prefetchMemory = 512 * 1024 * 1024;
+
+				int numPrefetchThreads = 2;
+
+				/*
+				* The memory (in bytes) the narrowphase may use to hold the geometry and
+				* acceleration structures of meshes between tests. When exceeded, the least
+				* recently used meshes are unloaded, and will be loaded again if another test
+				* needs them. The limit is soft, as the meshes in use by the current tests,
+				* or loaded ahead of them by the prefetch stage, are never unloaded. Zero means no limit.
+				*/
+				size_t cacheMemory = 0;
+
+				/*
+				* When true, the structures built from each mesh for the narrowphase, such
+				* as its Bvh, are kept in the file store of its container. Later runs that
+				* reference the same mesh with the same transform read them back instead
+				* of loading and processing the mesh again. Currently this applies to
+				* Clearance tests only.
+				*/
+				bool meshStore = false;
+
+				/*
+				* How often (in seconds) to report the progress of the run. Zero disables
+				* the reports. See ClashDetectionEngine::runClashDetection.
+				*/
+				double progressInterval = 0;
+
 				/*
 				* Each clash test will compare all objects in set A against all objects in
 				* set B. All Objects will be compared in Project Coordinates. The sets must
@@ -120,6 +156,22 @@ namespace repo {
 				*/
 				std::string resultsFile;
 
+				/*
+				* For incremental runs, the results file of a previous run with the same
+				* type, tolerance and self-intersection flags. Pairs of Composite Objects
+				* whose meshes have the same unique ids and transforms as in that run are
+				* not tested again; their results are copied from it instead.
+				*/
+				std::string previousResultsFile;
+
+				/*
+				* The revisions of the containers the previous run was performed against.
+				* Meshes from a container whose revision differs are always considered to
+				* have changed. Containers not in this map rely on the unique ids and
+				* transforms alone.
+				*/
+				std::unordered_map<const repo::lib::Container*, repo::lib::RepoUUID> previousRevisions;
+
 				REPO_API_EXPORT static void ParseJsonFile(const std::string& jsonFilePath, ClashDetectionConfig& config);
 
 				/*
@@ -25,15 +25,33 @@
 #include "repo/lib/rapidjson/rapidjson.h"
 #include "repo/lib/rapidjson/document.h"
 #include "repo/lib/rapidjson/writer.h"
+#include "repo/lib/rapidjson/stringbuffer.h"
 #include "repo/lib/rapidjson/ostreamwrapper.h"
+#include "repo/lib/rapidjson/istreamwrapper.h"
+#include <repo_log.h>
 #include <fstream>
 
 using namespace repo::lib;
 using namespace repo::manipulator::modelutility;
 using namespace repo::manipulator::modelutility::clash;
 
+namespace {
+	/*
+	* Writes each progress report to the log, where the worker running the job
+	* can pick it up.
+	*/
+	class LogProgressSink : public ClashProgressSink
+	{
+	public:
+		void progress(const ClashDetectionProgress& progress) override
+		{
+			repoInfo << "Clash progress: " << ClashDetectionEngineUtils::toJson(progress);
+		}
+	};
+}
+
 ClashDetectionReport ClashDetectionEngine::runClashDetection
-	(const ClashDetectionConfig& config)
+	(const ClashDetectionConfig& config, ClashResultsSink* sink, ClashProgressSink* progress)
 {
 	std::unique_ptr<clash::Pipeline> pipeline;
 	switch (config.type) {
@@ -47,6 +65,24 @@ ClashDetectionReport ClashDetectionEngine::runClashDetection
 		throw std::invalid_argument("Unknown clash detection type");
 	}
 
+	// For incremental runs, the pipeline reuses the results of composites that
+	// haven't changed. If the previous results can't be read, all pairs are tested.
+
+	ClashDetectionReport previous;
+	if (!config.previousResultsFile.empty()) {
+		if (ClashDetectionEngineUtils::readJson(config.previousResultsFile, previous)) {
+			pipeline->setPreviousReport(previous);
+		}
+		else {
+			repoWarning << "Could not read previous clash results " << config.previousResultsFile << ", all pairs will be tested.";
+		}
+	}
+
+	pipeline->setSink(sink);
+
+	LogProgressSink log;
+	pipeline->setProgressSink(progress ? progress : &log);
+
 	ClashDetectionReport results;
 
 	try {
@@ -70,6 +106,143 @@ ClashDetectionEngine::ClashDetectionEngine(
 {
 }
 
+namespace {
+	template<typename Writer>
+	void writeClash(Writer& writer, const ClashDetectionResult& clash)
+	{
+		writer.StartObject();
+		writer.Key("a");
+		writer.String(clash.idA);
+		writer.Key("b");
+		writer.String(clash.idB);
+		writer.Key("positions");
+		writer.StartArray();
+		for (const auto& position : clash.positions)
+		{
+			writer.StartArray();
+			writer.Double(position.x);
+			writer.Double(position.y);
+			writer.Double(position.z);
+			writer.EndArray();
+		}
+		writer.EndArray();
+		writer.Key("fingerprint");
+		writer.String(std::to_string(clash.fingerprint));
+		writer.EndObject();
+	}
+
+	// Writes the members that follow the clashes and errors: the statistics and,
+	// for complete runs, the fingerprints.
+
+	template<typename Writer>
+	void writeStage(Writer& writer, const ClashDetectionStatistics::Stage& stage)
+	{
+		writer.Key("time");
+		writer.Double(stage.time);
+		writer.Key("cpu");
+		writer.Double(stage.cpu);
+	}
+
+	template<typename Writer>
+	void writeSummary(Writer& writer, const ClashDetectionReport& report)
+	{
+		writer.Key("statistics");
+		writer.StartObject();
+		writer.Key("sceneGraph");
+		writer.StartObject();
+		writer.Key("containers");
+		writer.Uint64(report.statistics.sceneGraph.containers);
+		writeStage(writer, report.statistics.sceneGraph);
+		writer.EndObject();
+		for (auto [name, stage] : {
+			std::make_pair("validation", &report.statistics.validation),
+			std::make_pair("broadphase", &report.statistics.broadphase),
+			std::make_pair("scheduling", &report.statistics.scheduling),
+			std::make_pair("narrowphase", &report.statistics.narrowphase)
+		}) {
+			writer.Key(name);
+			writer.StartObject();
+			writeStage(writer, *stage);
+			writer.EndObject();
+		}
+		writer.Key("pairs");
+		writer.StartObject();
+		writer.Key("broadphase");
+		writer.Uint64(report.statistics.pairs.broadphase);
+		writer.Key("narrowphase");
+		writer.Uint64(report.statistics.pairs.narrowphase);
+		writer.Key("clashes");
+		writer.Uint64(report.statistics.pairs.clashes);
+		writer.EndObject();
+		writer.Key("geometry");
+		writer.StartObject();
+		writer.Key("meshes");
+		writer.Uint64(report.statistics.geometry.meshes);
+		writer.Key("bytes");
+		writer.Uint64(report.statistics.geometry.bytes);
+		writer.Key("load");
+		writer.Double(report.statistics.geometry.load);
+		writer.Key("build");
+		writer.Double(report.statistics.geometry.build);
+		writer.EndObject();
+		writer.Key("narrowphaseThreads");
+		writer.StartArray();
+		for (auto& thread : report.statistics.narrowphaseThreads) {
+			writer.StartObject();
+			writer.Key("tasks");
+			writer.Uint64(thread.tasks);
+			writer.Key("steals");
+			writer.Uint64(thread.steals);
+			writer.Key("busy");
+			writer.Double(thread.busy);
+			writer.Key("idle");
+			writer.Double(thread.idle);
+			writer.EndObject();
+		}
+		writer.EndArray();
+		writer.Key("cache");
+		writer.StartObject();
+		writer.Key("hits");
+		writer.Uint64(report.statistics.cache.hits);
+		writer.Key("misses");
+		writer.Uint64(report.statistics.cache.misses);
+		writer.Key("reloads");
+		writer.Uint64(report.statistics.cache.reloads);
+		writer.Key("evictions");
+		writer.Uint64(report.statistics.cache.evictions);
+		writer.Key("peakMemory");
+		writer.Uint64(report.statistics.cache.peakMemory);
+		writer.EndObject();
+		writer.Key("meshStore");
+		writer.StartObject();
+		writer.Key("hits");
+		writer.Uint64(report.statistics.meshStore.hits);
+		writer.Key("misses");
+		writer.Uint64(report.statistics.meshStore.misses);
+		writer.EndObject();
+		writer.Key("reusedPairs");
+		writer.Uint64(report.statistics.reusedPairs);
+		writer.Key("peakMemory");
+		writer.Uint64(report.statistics.peakMemory);
+		writer.EndObject();
+
+		// The fingerprints are only useful to incremental runs if the clashes are
+		// complete, so are omitted along with them when there are errors.
+
+		if (!report.errors.size()) {
+			writer.Key("settings");
+			writer.String(std::to_string(report.settings));
+			writer.Key("composites");
+			writer.StartObject();
+			for (auto& [id, fingerprint] : report.composites) {
+				writer.Key(id);
+				writer.String(std::to_string(fingerprint));
+			}
+			writer.EndObject();
+		}
+	}
+}
+
 void ClashDetectionEngineUtils::writeJson(const ClashDetectionReport& report,
 	std::basic_ostream<char, std::char_traits<char>>& stream)
 {
@@ -84,25 +257,7 @@ void ClashDetectionEngineUtils::writeJson(const ClashDetectionReport& report,
 	if (!report.errors.size()) { // Don't bother to write loads of clash data if there were errors
 		for (const auto& clash : report.clashes)
 		{
-			writer.StartObject();
-			writer.Key("a");
-			writer.String(clash.idA);
-			writer.Key("b");
-			writer.String(clash.idB);
-			writer.Key("positions");
-			writer.StartArray();
-			for (const auto& position : clash.positions)
-			{
-				writer.StartArray();
-				writer.Double(position.x);
-				writer.Double(position.y);
-				writer.Double(position.z);
-				writer.EndArray();
-			}
-			writer.EndArray();
-			writer.Key("fingerprint");
-			writer.String(std::to_string(clash.fingerprint));
-			writer.EndObject();
+			writeClash(writer, clash);
 		}
 	}
 	writer.EndArray();
@@ -117,6 +272,8 @@ void ClashDetectionEngineUtils::writeJson(const ClashDetectionReport& report,
 		writer.EndArray();
 	}
 
+	writeSummary(writer, report);
+
 	writer.EndObject();
 }
 
@@ -131,3 +288,185 @@ void ClashDetectionEngineUtils::writeJson(const ClashDetectionReport& report,
 	writeJson(report, outFile);
 	outFile.close();
 }
+
+ClashDetectionJsonWriter::ClashDetectionJsonWriter(const std::string& filename)
+	:filename(filename)
+{
+}
+
+void ClashDetectionJsonWriter::open()
+{
+	if (stream.is_open()) {
+		return;
+	}
+	stream.open(filename, std::ios::out | std::ios::trunc);
+	if (!stream.is_open())
+	{
+		throw std::ios_base::failure("Failed to open file");
+	}
+	stream << "{\"clashes\":[";
+}
+
+void ClashDetectionJsonWriter::write(const ClashDetectionResult& result)
+{
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	writeClash(writer, result);
+
+	std::scoped_lock lock(mutex);
+	open();
+	if (!first) {
+		stream << ",";
+	}
+	stream.write(buffer.GetString(), buffer.GetSize());
+	first = false;
+}
+
+void ClashDetectionJsonWriter::finish(const ClashDetectionReport& report)
+{
+	std::scoped_lock lock(mutex);
+
+	if (report.errors.size()) {
+		if (stream.is_open()) {
+			stream.close();
+		}
+		stream.open(filename, std::ios::out | std::ios::trunc);
+		if (!stream.is_open())
+		{
+			throw std::ios_base::failure("Failed to open file");
+		}
+		ClashDetectionEngineUtils::writeJson(report, stream);
+		stream.close();
+		return;
+	}
+
+	open();
+
+	// Any clashes that were not streamed, such as those from a run without the
+	// sink, are written along with the rest of the report.
+
+	for (auto& clash : report.clashes) {
+		rapidjson::StringBuffer buffer;
+		rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+		writeClash(writer, clash);
+		if (!first) {
+			stream << ",";
+		}
+		stream.write(buffer.GetString(), buffer.GetSize());
+		first = false;
+	}
+
+	stream << "]";
+
+	// The summary is written as its own object, then spliced in without the
+	// opening brace, so it shares the clashes' closing brace.
+
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	writer.StartObject();
+	writeSummary(writer, report);
+	writer.EndObject();
+
+	stream << ",";
+	stream.write(buffer.GetString() + 1, buffer.GetSize() - 1);
+	stream.close();
+}
+
+
+bool ClashDetectionEngineUtils::readJson(std::basic_istream<char, std::char_traits<char>>& stream,
+	ClashDetectionReport& report)
+{
+	rapidjson::IStreamWrapper isw(stream);
+	rapidjson::Document doc;
+	doc.ParseStream(isw);
+
+	if (doc.HasParseError() || !doc.IsObject()) {
+		return false;
+	}
+
+	// Reports from runs that failed, or that predate incremental runs, don't have
+	// the fingerprints and so can't be used.
+
+	if (!doc.HasMember("settings") || !doc["settings"].IsString() ||
+		!doc.HasMember("composites") || !doc["composites"].IsObject() ||
+		!doc.HasMember("clashes") || !doc["clashes"].IsArray()) {
+		return false;
+	}
+
+	// The report is built separately and only handed over once all of it has
+	// been read, so a file that turns out to be malformed part way through does
+	// not leave a partial report behind.
+
+	ClashDetectionReport read;
+
+	try {
+		read.settings = std::stoull(doc["settings"].GetString());
+
+		for (auto& member : doc["composites"].GetObject()) {
+			if (!member.value.IsString()) {
+				return false;
+			}
+			read.composites[member.name.GetString()] = std::stoull(member.value.GetString());
+		}
+
+		for (auto& c : doc["clashes"].GetArray()) {
+			if (!c.IsObject() ||
+				!c.HasMember("a") || !c["a"].IsString() ||
+				!c.HasMember("b") || !c["b"].IsString() ||
+				!c.HasMember("positions") || !c["positions"].IsArray() ||
+				!c.HasMember("fingerprint") || !c["fingerprint"].IsString()) {
+				return false;
+			}
+
+			ClashDetectionResult clash;
+			clash.idA = c["a"].GetString();
+			clash.idB = c["b"].GetString();
+			for (auto& p : c["positions"].GetArray()) {
+				if (!p.IsArray() || p.Size() != 3 || !p[0].IsNumber() || !p[1].IsNumber() || !p[2].IsNumber()) {
+					return false;
+				}
+				clash.positions.push_back(RepoVector3D64(p[0].GetDouble(), p[1].GetDouble(), p[2].GetDouble()));
+			}
+			clash.fingerprint = std::stoull(c["fingerprint"].GetString());
+			read.clashes.push_back(clash);
+		}
+	}
+	catch (const std::logic_error&) { // Thrown by stoull for strings that are not numbers
+		return false;
+	}
+
+	report.settings = read.settings;
+	report.composites = std::move(read.composites);
+	report.clashes = std::move(read.clashes);
+
+	return true;
+}
+
+bool ClashDetectionEngineUtils::readJson(const std::string& filename, ClashDetectionReport& report)
+{
+	std::ifstream inFile(filename, std::ios::in);
+	if (!inFile.is_open())
+	{
+		return false;
+	}
+	return readJson(inFile, report);
+}
+
+std::string ClashDetectionEngineUtils::toJson(const ClashDetectionProgress& progress)
+{
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	writer.StartObject();
+	writer.Key("stage");
+	writer.String(progress.stage);
+	writer.Key("completed");
+	writer.Uint64(progress.completed);
+	writer.Key("total");
+	writer.Uint64(progress.total);
+	writer.Key("time");
+	writer.Double(progress.time);
+	writer.Key("peakMemory");
+	writer.Uint64(progress.peakMemory);
+	writer.EndObject();
+	return std::string(buffer.GetString(), buffer.GetSize());
+}
\ No newline at end of file
@@ -21,10 +21,15 @@
 #include <vector>
 #include <memory>
 #include <ostream>
+#include <istream>
+#include <unordered_map>
+#include <fstream>
+#include <mutex>
 #include <repo/repo_bouncer_global.h>
 #include <repo/lib/datastructure/repo_vector.h>
 #include <repo/manipulator/modelutility/repo_clash_detection_config_fwd.h>
 #include <repo/manipulator/modelutility/clashdetection/clash_exceptions.h>
+#include <repo/manipulator/modelutility/repo_clash_detection_statistics.h>
 #include <repo/core/handler/repo_database_handler_abstract.h>
 
 namespace repo {
@@ -61,10 +66,91 @@ namespace repo {
 				size_t fingerprint;
 			};
 
+			/*
+			* A snapshot of a run in progress. Completed and total count the narrowphase
+			* tests, so are only meaningful once the stage reaches the narrowphase.
+			* Time is wall-clock seconds since the run started, and peakMemory is as in
+			* ClashDetectionStatistics.
+			*/
+			struct ClashDetectionProgress
+			{
+				std::string stage;
+				size_t completed = 0;
+				size_t total = 0;
+				double time = 0;
+				size_t peakMemory = 0;
+			};
+
+			/*
+			* Receives periodic progress reports while the pipeline runs, every
+			* progressInterval seconds of the config, and once more when the run has
+			* completed. progress() is called from a background thread.
+			*/
+			class ClashProgressSink
+			{
+			public:
+				virtual ~ClashProgressSink() = default;
+
+				virtual void progress(const ClashDetectionProgress& progress) = 0;
+			};
+
 			struct ClashDetectionReport
 			{
 				std::vector<ClashDetectionResult> clashes;
 				std::vector<std::shared_ptr<clash::ClashDetectionException>> errors;
+				ClashDetectionStatistics statistics;
+
+				// Hashes of the inputs to the run, so a later incremental run can tell
+				// what has changed since. settings covers the type, tolerance and self-
+				// intersection flags, and composites, for each Composite Object, the set
+				// it is in and the unique ids and transforms of its meshes.
+
+				size_t settings = 0;
+				std::unordered_map<std::string, size_t> composites;
+			};
+
+			/*
+			* Receives clashes from the pipeline as soon as they are final, i.e. once
+			* all the narrowphase tests between the two Composite Objects have run,
+			* so that they do not need to be held until the end of the run. write()
+			* is called concurrently from the narrowphase threads.
+			*/
+			class ClashResultsSink
+			{
+			public:
+				virtual ~ClashResultsSink() = default;
+
+				virtual void write(const ClashDetectionResult& result) = 0;
+			};
+
+			/*
+			* Streams clashes into a results file, in the same layout as writeJson,
+			* as they are found. The file is not opened until the first clash arrives
+			* (or finish() is called), so it may be the same as previousResultsFile.
+			*
+			* Each clash is serialised on the calling thread; only appending it to the
+			* file is serialised between threads.
+			*
+			* finish() must be called with the report once the run has completed. This
+			* writes the remaining members. If the report has errors, the file is
+			* instead rewritten with just those, as writeJson would.
+			*/
+			REPO_API_EXPORT class ClashDetectionJsonWriter : public ClashResultsSink
+			{
+			public:
+				ClashDetectionJsonWriter(const std::string& filename);
+
+				void write(const ClashDetectionResult& result) override;
+
+				void finish(const ClashDetectionReport& report);
+
+			private:
+				std::string filename;
+				std::ofstream stream;
+				std::mutex mutex;
+				bool first = true;
+
+				void open();
 			};
 
 			REPO_API_EXPORT class ClashDetectionEngine
@@ -73,7 +159,17 @@ namespace repo {
 				ClashDetectionEngine(std::shared_ptr<repo::core::handler::AbstractDatabaseHandler> handler);
 				~ClashDetectionEngine() = default;
 
-				ClashDetectionReport runClashDetection(const ClashDetectionConfig& config);
+				/*
+				* Runs the clash test described by config. If a sink is given, clashes are
+				* passed to it as they are found, rather than returned in the report.
+				* If progressInterval is set in the config, progress is reported to the
+				* progress sink, or if none is given, written to the log as one line of
+				* json per report (prefixed with "Clash progress: "), for the worker to
+				* forward.
+				*/
+				ClashDetectionReport runClashDetection(const ClashDetectionConfig& config,
+					ClashResultsSink* sink = nullptr,
+					ClashProgressSink* progress = nullptr);
 
 			protected:
 				std::shared_ptr<repo::core::handler::AbstractDatabaseHandler> handler;
@@ -83,6 +179,19 @@ namespace repo {
 			public:
 				static void writeJson(const ClashDetectionReport& report, const ClashDetectionConfig& config);
 				static void writeJson(const ClashDetectionReport& report, std::basic_ostream<char, std::char_traits<char>>& stream);
+
+				/*
+				* Reads a report written by writeJson back in, for use by incremental runs.
+				* Only the clashes and fingerprints are read. Returns false if the file
+				* could not be read or parsed.
+				*/
+				static bool readJson(const std::string& filename, ClashDetectionReport& report);
+				static bool readJson(std::basic_istream<char, std::char_traits<char>>& stream, ClashDetectionReport& report);
+
+				/*
+				* Serialises a progress report as a single line of json.
+				*/
+				static std::string toJson(const ClashDetectionProgress& progress);
 			};
 
 		} // namespace modelutility
@@ -0,0 +1,157 @@
+/**
+*  Copyright (C) 2025 3D Repo Ltd
+*
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU Affero General Public License as
+*  published by the Free Software Foundation, either version 3 of the
+*  License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Affero General Public License for more details.
+*
+*  You should have received a copy of the GNU Affero General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+
+/*
+* The statistics gathered by a clash detection run. These are kept apart from
+* the engine's internals, so that including the engine does not also include
+* the task pool and cache the members are collected by.
+*/
+
+namespace repo {
+	namespace manipulator {
+		namespace modelutility {
+			namespace clash {
+
+				/*
+				* Per-worker counters collected by a TaskPool run. Times are wall-clock
+				* seconds. Busy time is spent inside the task function; idle time is the
+				* remainder of the run, i.e. looking for work, stealing, and waiting for
+				* the other workers to finish.
+				*/
+				struct WorkerStatistics
+				{
+					size_t tasks = 0;
+					size_t steals = 0;
+					double busy = 0;
+					double idle = 0;
+				};
+
+				/*
+				* Counters collected by the ResidencyManager over a run.
+				*/
+				struct CacheStatistics
+				{
+					// Acquired a node that was already resident
+					size_t hits = 0;
+
+					// Acquired a node that was not resident and had never been loaded
+					size_t misses = 0;
+
+					// Acquired a node that had to be loaded again after being evicted
+					size_t reloads = 0;
+
+					size_t evictions = 0;
+
+					// The most memory used by resident nodes at any one time (bytes)
+					size_t peakMemory = 0;
+				};
+			}
+
+			struct ClashDetectionStatistics
+			{
+				// How long a stage of the pipeline took, in wall-clock seconds, and the
+				// CPU time of the whole process over the same period. For the stages
+				// that run on multiple threads, the CPU time may exceed the wall-clock
+				// time.
+
+				struct Stage
+				{
+					double time = 0;
+					double cpu = 0;
+				};
+
+				// The number of containers whose scene graphs were loaded, and how long
+				// it took.
+
+				struct SceneGraph : public Stage
+				{
+					size_t containers = 0;
+				} sceneGraph;
+
+				// The remaining stages, in the order they run. Scheduling includes
+				// resolving the broadphase results to cache entries. Geometry loading and
+				// the narrowphase structure builds happen during the narrowphase.
+
+				Stage validation;
+				Stage broadphase;
+				Stage scheduling;
+				Stage narrowphase;
+
+				// The number of pairs remaining after each stage. The broadphase count is
+				// of its raw results (meshes for Clearance, Composite Objects for Hard),
+				// narrowphase is the number of tests run, and clashes the number of
+				// results, including those copied from the previous report.
+
+				struct Pairs
+				{
+					size_t broadphase = 0;
+					size_t narrowphase = 0;
+					size_t clashes = 0;
+				} pairs;
+
+				// The meshes loaded by the narrowphase (including reloads after eviction
+				// and those loaded by the prefetcher), the size of their binary buffers,
+				// and the time spent loading them and building their structures. The
+				// times are summed over all threads.
+
+				struct Geometry
+				{
+					size_t meshes = 0;
+					size_t bytes = 0;
+					double load = 0;
+					double build = 0;
+				} geometry;
+
+				// How the narrowphase tests were distributed between the worker threads,
+				// and how long each spent running tests versus waiting for them. This is
+				// used to tune the scheduling and numThreads.
+
+				std::vector<clash::WorkerStatistics> narrowphaseThreads;
+
+				// How often the narrowphase found meshes already loaded, and how often
+				// they had to be loaded again after being evicted to stay within
+				// cacheMemory.
+
+				clash::CacheStatistics cache;
+
+				// How many meshes' narrowphase structures were read from the file store,
+				// and how many had to be built (and were then stored), when meshStore is
+				// enabled.
+
+				struct MeshStore
+				{
+					size_t hits = 0;
+					size_t misses = 0;
+				} meshStore;
+
+				// The number of Composite Object pairs found by the broadphase whose
+				// results were copied from the previous report, rather than tested.
+
+				size_t reusedPairs = 0;
+
+				// The peak resident set size of the process in bytes, at the end of the
+				// run. This includes anything the process did before the run.
+
+				size_t peakMemory = 0;
+			};
+		} // namespace modelutility
+	} // namespace manipulator
+}
\ No newline at end of file
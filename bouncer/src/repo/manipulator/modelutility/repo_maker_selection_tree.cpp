@@ -21,7 +21,7 @@
 #include "repo/lib/rapidjson/rapidjson.h"
 #include "repo/lib/rapidjson/document.h"
 #include "repo/lib/rapidjson/writer.h"
-#include "repo/lib/rapidjson/stringbuffer.h"
+#include "repo/lib/rapidjson/ostreamwrapper.h"
 #include "repo/core/handler/database/repo_query.h"
 #include "repo/core/model/bson/repo_bson.h"
 
@@ -32,8 +32,16 @@ using namespace repo::manipulator::modelutility;
 #define REPO_VISIBILITY_STATE_HIDDEN "invisible"
 #define REPO_VISIBILITY_STATE_HALF_HIDDEN "parentOfInvisible"
 
+#define REPO_SELECTION_TREE_FULLTREE "fulltree.json"
+#define REPO_SELECTION_TREE_PATH "tree_path.json"
+#define REPO_SELECTION_TREE_IDMAP "idMap.json"
+#define REPO_SELECTION_TREE_IDTOMESHES "idToMeshes.json"
+#define REPO_SELECTION_TREE_MODELPROPERTIES "modelProperties.json"
+
 const static std::string IFC_TYPE_SPACE_LABEL = "(IFC Space)";
 
+using JsonWriter = rapidjson::Writer<rapidjson::OStreamWrapper>;
+
 SelectionTreeMaker::SelectionTreeMaker(
 	const repo::core::model::RepoScene *scene,
 	repo::core::handler::AbstractDatabaseHandler* handler)
@@ -63,12 +71,17 @@ static std::string nodeTypeToString(repo::core::model::NodeType type)
 	}
 }
 
-static std::string childPathToString(const SelectionTree::ChildPath& path)
+static std::string childPathToString(const SelectionTree::Node& node)
 {
+	std::vector<const SelectionTree::Node*> path;
+	for (auto n = &node; n; n = n->parent) {
+		path.push_back(n);
+	}
+
 	std::string result;
-	for (size_t i = 0; i < path.size(); ++i) {
-		result += path[i].toString();
-		if (i != path.size() - 1) {
+	for (auto it = path.rbegin(); it != path.rend(); it++) {
+		result += (*it)->_id.toString();
+		if (*it != &node) {
 			result += "__";
 		}
 	}
@@ -91,8 +104,6 @@ static std::string toggleStateToString(SelectionTree::Node::ToggleState state)
 void traversePtree(
 	SelectionTree::Node* node, 
 	bool& hasHiddenChildren,
-	SelectionTree::ChildPath currentPath,
-	std::vector<repo::lib::RepoUUID>& meshIds,
 	const repo::core::model::RepoScene* scene,
 	SelectionTreesSet& trees) 
 {
@@ -104,20 +115,19 @@ void traversePtree(
 		}
 	);
 
-	// currentPath is passed as a copy so we can update it directly
+	// Any meshes appended to trees.meshes from here until this node returns are
+	// in its subtree.
 
-	currentPath.push_back(node->_id);
-	node->path = currentPath;
+	node->meshStart = trees.meshes.size();
 
 	hasHiddenChildren = false;
 
 	for (auto& child : node->children) {
 
 		bool childIsHidden = false;
-		std::vector<repo::lib::RepoUUID> childMeshes;
-		traversePtree(child, childIsHidden, currentPath, childMeshes, scene, trees);
+		child->parent = node;
+		traversePtree(child, childIsHidden, scene, trees);
 		hasHiddenChildren |= childIsHidden;
-		meshIds.insert(meshIds.end(), childMeshes.begin(), childMeshes.end());
 	}
 
 	if (scene->isHiddenByDefault(node->_id) ||
@@ -138,13 +148,10 @@ void traversePtree(
 	}
 
 	if (node->type == repo::core::model::NodeType::MESH) {
-		meshIds.push_back(node->_id);
+		trees.meshes.push_back(node->_id);
 	}
 
-	trees.idToPath[node->_id] = currentPath;
-	trees.idToMeshes[node->_id] = meshIds;
-	trees.idToName[node->_id] = node->name;
-	trees.idMap[node->_id] = node->shared_id;
+	node->meshEnd = trees.meshes.size();
 }
 
 void SelectionTreeMaker::generateSelectionTrees()
@@ -167,6 +174,7 @@ void SelectionTreeMaker::generateSelectionTrees()
 	projection.includeField(REPO_NODE_LABEL_SHARED_ID);
 	projection.includeField(REPO_NODE_LABEL_PARENTS);
 	projection.includeField(REPO_NODE_LABEL_TYPE);
+	projection.includeField(REPO_NODE_LABEL_NAME);
 
 	auto sceneCollection = scene->getProjectName() + "." + REPO_COLLECTION_SCENE;
 	auto cursor = handler->findCursorByCriteria(scene->getDatabaseName(), sceneCollection, filter, projection);
@@ -240,15 +248,25 @@ void SelectionTreeMaker::generateSelectionTrees()
 	// Now that the tree is fully connected, we can update inter-dependent states
 	// such as the visibility.
 
-	// traversePtree is recursive and uses the following two parameters to pass
-	// information back between levels, so we need something to provide references
-	// of to start it off even if we don't care about their contents here.
+	// traversePtree is recursive and uses the following parameter to pass
+	// information back between levels, so we need something to provide a reference
+	// of to start it off even if we don't care about its contents here.
 	bool hasHiddenChildren = false;
-	std::vector<repo::lib::RepoUUID> meshIds;
-	traversePtree(trees.fullTree.root, hasHiddenChildren, {}, meshIds, scene, trees);
+	traversePtree(trees.fullTree.root, hasHiddenChildren, scene, trees);
+}
+
+// Calls func for each node in the tree, i.e. those reachable from the root
+
+template<typename Func>
+static void forEachNode(const SelectionTree::Node& node, Func& func)
+{
+	func(node);
+	for (auto& child : node.children) {
+		forEachNode(*child, func);
+	}
 }
 
-static void writePropertyTree(const SelectionTree::Node& node, const SelectionTree& tree, rapidjson::Writer<rapidjson::StringBuffer>& writer)
+static void writePropertyTree(const SelectionTree::Node& node, const SelectionTree& tree, JsonWriter& writer)
 {
 	writer.StartObject();
 
@@ -261,7 +279,7 @@ static void writePropertyTree(const SelectionTree::Node& node, const SelectionTr
 		writer.Key("name"); writer.String(node.name);
 	}
 
-	writer.Key("path");	writer.String(childPathToString(node.path));
+	writer.Key("path");	writer.String(childPathToString(node));
 	writer.Key("_id");	writer.String(node._id.toString());	
 	writer.Key("shared_id"); writer.String(node.shared_id.toString());
 
@@ -289,133 +307,96 @@ static void writePropertyTree(const SelectionTree::Node& node, const SelectionTr
 	writer.EndObject();
 }
 
-std::map<std::string, std::string> serialiseSelectionTreesToJson(const SelectionTreesSet& trees)
+std::vector<std::string> SelectionTreeMaker::getFileNames() const
 {
-	std::map<std::string, std::string> map;
+	std::vector<std::string> names = {
+		REPO_SELECTION_TREE_FULLTREE,
+		REPO_SELECTION_TREE_PATH,
+		REPO_SELECTION_TREE_IDMAP,
+		REPO_SELECTION_TREE_IDTOMESHES
+	};
+	if (trees.modelSettings.hiddenNodes.size()) {
+		names.push_back(REPO_SELECTION_TREE_MODELPROPERTIES);
+	}
+	return names;
+}
 
-	{
-		rapidjson::StringBuffer buffer;
-		rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+void SelectionTreeMaker::writeFile(const std::string& fileName, std::ostream& stream) const
+{
+	// Each file is written straight to the stream as it is generated, so the
+	// json is never held in memory in its entirety.
 
-		writer.StartObject();
+	rapidjson::OStreamWrapper wrapper(stream);
+	JsonWriter writer(wrapper);
+
+	const auto& root = *trees.fullTree.root;
+
+	writer.StartObject();
 
+	if (fileName == REPO_SELECTION_TREE_FULLTREE)
+	{
 		writer.Key("nodes");
-		writePropertyTree(*trees.fullTree.root, trees.fullTree, writer);
+		writePropertyTree(root, trees.fullTree, writer);
 
 		writer.Key("idToName");
 		writer.StartObject();
-		for (const auto& p : trees.idToName) {
-			writer.Key(p.first.toString());
-			writer.String(p.second);
-		}
-		writer.EndObject();
-
+		auto write = [&](const SelectionTree::Node& node) {
+			writer.Key(node._id.toString());
+			writer.String(node.name);
+		};
+		forEachNode(root, write);
 		writer.EndObject();
-
-		map["fulltree.json"] = std::string(buffer.GetString(), buffer.GetSize());
 	}
-	
+	else if (fileName == REPO_SELECTION_TREE_PATH)
 	{
-		rapidjson::StringBuffer buffer;
-		rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-
-		writer.StartObject();
-		
 		writer.Key("idToPath");
 		writer.StartObject();
-		for (auto& p : trees.idToPath) {
-			writer.Key(p.first.toString());
-			writer.String(childPathToString(p.second));
-		}
-		writer.EndObject();
-
+		auto write = [&](const SelectionTree::Node& node) {
+			writer.Key(node._id.toString());
+			writer.String(childPathToString(node));
+		};
+		forEachNode(root, write);
 		writer.EndObject();
-
-		map["tree_path.json"] = std::string(buffer.GetString(), buffer.GetSize());
 	}
-
+	else if (fileName == REPO_SELECTION_TREE_IDMAP)
 	{
-		rapidjson::StringBuffer buffer;
-		rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-
-		writer.StartObject();
-
 		writer.Key("idMap");
 		writer.StartObject();
-		for (auto& p : trees.idMap) {
-			writer.Key(p.first.toString());
-			writer.String(p.second.toString());
-		}
-		writer.EndObject();
-
+		auto write = [&](const SelectionTree::Node& node) {
+			writer.Key(node._id.toString());
+			writer.String(node.shared_id.toString());
+		};
+		forEachNode(root, write);
 		writer.EndObject();
-
-		map["idMap.json"] = std::string(buffer.GetString(), buffer.GetSize());
 	}
-
+	else if (fileName == REPO_SELECTION_TREE_IDTOMESHES)
 	{
-		rapidjson::StringBuffer buffer;
-		rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-
-		writer.StartObject();
-
-		for (auto& p : trees.idToMeshes) {
-			writer.Key(p.first.toString());
+		auto write = [&](const SelectionTree::Node& node) {
+			writer.Key(node._id.toString());
 			writer.StartArray();
-			for (const auto& meshId : p.second) {
-				writer.String(meshId.toString());
+			for (auto i = node.meshStart; i < node.meshEnd; i++) {
+				writer.String(trees.meshes[i].toString());
 			}
 			writer.EndArray();
-		}
-
-		writer.EndObject();
-
-		map["idToMeshes.json"] = std::string(buffer.GetString(), buffer.GetSize());
+		};
+		forEachNode(root, write);
 	}
-
-
-	if (trees.modelSettings.hiddenNodes.size()) 
+	else if (fileName == REPO_SELECTION_TREE_MODELPROPERTIES)
 	{
-		rapidjson::StringBuffer buffer;
-		rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-
-		writer.StartObject();
-
 		writer.Key("hiddenNodes");
 		writer.StartArray();
 		for (auto& node : trees.modelSettings.hiddenNodes) {
 			writer.String(node.toString());
 		}
 		writer.EndArray();
-
-		writer.EndObject();
-
-		map["modelProperties.json"] = std::string(buffer.GetString(), buffer.GetSize());
 	}
-
-	return map;
-}
-
-std::map<std::string, std::vector<uint8_t>> SelectionTreeMaker::getSelectionTreeAsBuffer() const
-{
-	auto maps = serialiseSelectionTreesToJson(trees);
-	std::map<std::string, std::vector<uint8_t>> buffer;
-	for (const auto& map : maps)
+	else
 	{
-		const std::string& jsonString = map.second;
-		if (!jsonString.empty())
-		{
-			size_t byteLength = jsonString.size() * sizeof(*jsonString.data());
-			buffer[map.first] = std::vector<uint8_t>();
-			buffer[map.first].resize(byteLength);
-			memcpy(buffer[map.first].data(), jsonString.data(), byteLength);
-		}
-		else
-		{
-			repoError << "Failed to write selection tree into the buffer: JSON string is empty.";
-		}
+		throw repo::lib::RepoException("Unknown selection tree file: " + fileName);
 	}
-	return buffer;
+
+	writer.EndObject();
+	stream.flush();
 }
 
 SelectionTreeMaker::~SelectionTreeMaker()
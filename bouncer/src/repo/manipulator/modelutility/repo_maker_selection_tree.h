@@ -38,7 +38,13 @@ namespace repo{
 					repo::lib::RepoUUID shared_id;
 					std::vector<repo::lib::RepoUUID> meta;
 					std::vector<Node*> children; // Use pointers here because references are not assignable so cant be used in a vector
-					std::vector<repo::lib::RepoUUID> path;
+					Node* parent;
+
+					// The meshes under this node (including itself) are stored contiguously
+					// in SelectionTreesSet::meshes, in the range [meshStart, meshEnd).
+
+					size_t meshStart;
+					size_t meshEnd;
 
 					enum ToggleState {
 						SHOW,
@@ -50,7 +56,10 @@ namespace repo{
 
 					Node() :
 						toggleState(ToggleState::SHOW),
-						type(repo::core::model::NodeType::UNKNOWN)
+						type(repo::core::model::NodeType::UNKNOWN),
+						parent(nullptr),
+						meshStart(0),
+						meshEnd(0)
 					{
 					}
 				};
@@ -58,31 +67,25 @@ namespace repo{
 				Container container;
 				Node* root;
 				std::vector<Node> nodes; // This vector holds the memory containing the actual nodes
-
-				using ChildPath = std::vector<repo::lib::RepoUUID>;
 			};
 
-			using IdToName = std::unordered_map<repo::lib::RepoUUID, std::string, repo::lib::RepoUUIDHasher>;
-
-			using IdToPath = std::unordered_map<repo::lib::RepoUUID, SelectionTree::ChildPath, repo::lib::RepoUUIDHasher>;
-
-			using IdToMeshes = std::unordered_map<repo::lib::RepoUUID, std::vector<repo::lib::RepoUUID>, repo::lib::RepoUUIDHasher>;
-
-			using IdMap = std::unordered_map<repo::lib::RepoUUID, repo::lib::RepoUUID, repo::lib::RepoUUIDHasher>;
-
 			class Settings
 			{
 			public:
 				std::vector<repo::lib::RepoUUID> hiddenNodes;
 			};
 
+			/*
+			* The paths, names and mesh lists written to the json files are not stored
+			* per node, but derived from the tree as they are written. Each node's
+			* path is found by following its parents, and its meshes are a range of
+			* the meshes member, which holds the mesh ids in the order they are left
+			* by a depth first traversal, so all the meshes of a subtree are adjacent.
+			*/
 			struct SelectionTreesSet
 			{
 				SelectionTree fullTree;
-				IdToPath idToPath;
-				IdToMeshes idToMeshes;
-				IdToName idToName;
-				IdMap idMap;
+				std::vector<repo::lib::RepoUUID> meshes;
 				Settings modelSettings;
 			};
 
@@ -99,12 +102,18 @@ namespace repo{
 				~SelectionTreeMaker();
 
 				/**
-				* Construct and return the selection tree as a Property Tree As a buffer
-				* The method will return an empty tree if the scene is null
-				* or the default graph is not loaded.
-				* @return returns the selection tree as a property tree
+				* Get the names of the json files that make up the selection tree.
+				* @return returns the file names, e.g. fulltree.json
+				*/
+				std::vector<std::string> getFileNames() const;
+
+				/**
+				* Serialise one of the selection tree files, as named by getFileNames,
+				* directly to the stream.
+				* @params fileName name of the file to write
+				* @params stream stream to write the json to
 				*/
-				std::map<std::string, std::vector<uint8_t>> getSelectionTreeAsBuffer() const;
+				void writeFile(const std::string& fileName, std::ostream& stream) const;
 
 			private:
 				const repo::core::model::RepoScene *scene;
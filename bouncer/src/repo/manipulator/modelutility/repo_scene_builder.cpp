@@ -29,6 +29,11 @@
 #include <variant>
 #include <semaphore>
 #include <thread>
+#include <mutex>
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+#include <boost/crc.hpp>
 #include "spscqueue/readerwriterqueue.h"
 
 using namespace repo::manipulator::modelutility;
@@ -38,21 +43,28 @@ using namespace repo::lib;
 // 500 Mb
 #define DEFAULT_THRESHOLD 1024*1024*500
 
+// The number of concurrent bulk write contexts used by default
+#define DEFAULT_NUM_WRITERS 4
+
+// The most memory held by the geometry buffers kept for sharing (bytes)
+#define DEFAULT_SHARED_GEOMETRY_MEMORY 1024*1024*250
+
 static const uint32_t MAX_MATERIALNODE_USAGE = 500000;
 
 /*
 * The async worker of RepoSceneBuilder is responsible for the multithreaded
 * writes. It's public API is expected to be called from the same thread as
 * RepoSceneBuilder, where it can exert backpressure by blocking. Internally it
-* maintains a worker that holds a database bulk write context.
-* Destroying the object will block until the bulk write context is finished.
+* maintains a number of writers, each with a worker thread that holds its own
+* database bulk write context (and so its own blob file).
+* Destroying the object will block until all bulk write contexts are finished.
 * AsyncImpl is designed to be cheap to create - to flush it, just destroy it,
 * and make another one if necessary.
 */
 class RepoSceneBuilder::AsyncImpl
 {
 public:
-	AsyncImpl(RepoSceneBuilder* builder);
+	AsyncImpl(RepoSceneBuilder* builder, size_t numWriters);
 
 	~AsyncImpl();
 
@@ -95,7 +107,25 @@ private:
 		size_t size;
 	};
 
-	void push(Consumable consumable);
+	/*
+	* Each writer has its own queue, which only the RepoSceneBuilder thread pushes
+	* to, so they can remain single-producer single-consumer.
+	*
+	* Documents are assigned to writers by their unique Id, and updates by the
+	* unique Id of the document they modify. This means an update always goes
+	* through the same bulk write context as the insert for its document, and
+	* so is executed after it.
+	*/
+	struct Writer
+	{
+		moodycamel::BlockingReaderWriterQueue<Consumable> queue;
+		std::thread thread;
+		std::atomic<size_t> queueSize = 0;
+	};
+
+	Writer& getWriter(const repo::lib::RepoUUID& uniqueId);
+
+	void push(Writer& writer, Consumable consumable);
 
 	struct Consumer
 	{
@@ -105,22 +135,22 @@ private:
 		RepoSceneBuilder::AsyncImpl* impl;
 
 		bool operator() (repo::core::model::RepoNode* n) const;
+		void insertMeshNode(const repo::core::model::MeshNode& n) const;
 		bool operator() (const repo::core::handler::database::query::AddParent* n) const;
 		bool operator() (const  Close& n) const;
 		bool operator() (const  Notify& n) const;
 	};
 
-	/* This will run as a member function */
-	void consumerFunction();
+	/* This will run as a member function, once for each writer */
+	void consumerFunction(Writer* writer);
 
 	RepoSceneBuilder* builder;
 
-	moodycamel::BlockingReaderWriterQueue<Consumable> queue;
-	std::thread consumer;
+	std::vector<std::unique_ptr<Writer>> writers;
 
 	/*
-	* The size of the queue - this is a unitless value that is compared with a
-	* fixed threshold. In practice, currently it represents the estimated memory
+	* The size of all the queues - this is a unitless value that is compared with
+	* a fixed threshold. In practice, currently it represents the estimated memory
 	* usage of each node or update object.
 	*/
 	std::atomic<size_t> queueSize;
@@ -128,15 +158,63 @@ private:
 	/*
 	* When the amount of data buffered exceeds the threshold, the main thread
 	* will attempt to acquire the semaphore to suspend itself until signalled
-	* by the consumer.
+	* by a consumer. More than one consumer may signal before the main thread
+	* wakes, so this is a counting semaphore; any extra signals only cause the
+	* main thread to check the size again.
 	*/
-	std::binary_semaphore block;
+	std::counting_semaphore<> block;
 
 	/*
-	* If the consumer thread throws an exception, this will hold it. By default it
-	* is checked and rethrown in the destructor.
+	* If a consumer thread throws an exception, this will hold the first one. By
+	* default it is checked and rethrown in the destructor.
 	*/
 	std::exception_ptr consumerException;
+	std::mutex consumerExceptionMutex;
+
+	void checkConsumerException();
+
+	/*
+	* Meshes with identical geometry share one range of the blob files. The
+	* combined binary buffer of each mesh is addressed by its size and two
+	* independent hashes, which map to the first copy written and its
+	* serialised DataRef. A match is only reused if the bytes are the same too,
+	* so a collision costs a second copy rather than the wrong geometry. This is
+	* shared between the writers, as a DataRef can point into any blob file.
+	*
+	* The buffers are held until the builder is finished, so once they exceed
+	* sharedGeometryMemory, further geometry is written without being recorded.
+	*/
+	struct GeometryKey
+	{
+		size_t size;
+		size_t hash;
+		uint32_t crc;
+
+		GeometryKey(const std::vector<uint8_t>& buffer);
+
+		bool operator==(const GeometryKey& other) const = default;
+	};
+
+	struct GeometryKeyHasher
+	{
+		size_t operator()(const GeometryKey& key) const
+		{
+			return key.hash;
+		}
+	};
+
+	struct GeometryRef
+	{
+		std::vector<uint8_t> buffer;
+		repo::core::model::RepoBSON ref;
+	};
+
+	std::unordered_map<GeometryKey, GeometryRef, GeometryKeyHasher> geometryRefs;
+	std::mutex geometryRefsMutex;
+	size_t sharedGeometryMemory;
+	size_t geometryRefsMemory;
+	std::atomic<size_t> numSharedGeometry;
+	std::atomic<size_t> sharedGeometryBytes;
 };
 
 struct RepoSceneBuilder::Deleter
@@ -163,7 +241,9 @@ RepoSceneBuilder::RepoSceneBuilder(
 	isMissingTextures(false),
 	offset({}),
 	units(repo::lib::ModelUnits::UNKNOWN),
-	impl(std::make_unique<AsyncImpl>(this))
+	numWriters(DEFAULT_NUM_WRITERS),
+	queueThreshold(DEFAULT_THRESHOLD),
+	impl(std::make_unique<AsyncImpl>(this, DEFAULT_NUM_WRITERS))
 {
 }
 
@@ -245,7 +325,24 @@ void RepoSceneBuilder::commit()
 void RepoSceneBuilder::finalise()
 {
 	commit();
-	impl = std::make_unique<AsyncImpl>(this); // Destroying the AsyncImpl will flush everything to the database
+	impl = std::make_unique<AsyncImpl>(this, numWriters); // Destroying the AsyncImpl will flush everything to the database
+}
+
+void RepoSceneBuilder::setNumWriters(size_t numWriters)
+{
+	this->numWriters = std::max(numWriters, (size_t)1);
+	impl = std::make_unique<AsyncImpl>(this, this->numWriters); // Flushes anything already queued
+}
+
+size_t RepoSceneBuilder::getNumWriters()
+{
+	return numWriters;
+}
+
+void RepoSceneBuilder::setQueueThreshold(size_t threshold)
+{
+	queueThreshold = threshold;
+	impl->threshold = threshold;
 }
 
 repo::lib::RepoVector3D64 RepoSceneBuilder::getWorldOffset()
@@ -398,40 +495,70 @@ void RepoSceneBuilder::createIndexes()
 	handler->createIndex(databaseName, sceneCollection, Ascending({ REPO_NODE_LABEL_SHARED_ID }));	
 }
 
-RepoSceneBuilder::AsyncImpl::AsyncImpl(RepoSceneBuilder* builder):
+RepoSceneBuilder::AsyncImpl::AsyncImpl(RepoSceneBuilder* builder, size_t numWriters):
 	builder(builder),
-	block(0)
-{
-	consumer = std::thread(&RepoSceneBuilder::AsyncImpl::consumerFunction, this);
-	threshold = DEFAULT_THRESHOLD;
+	queueSize(0),
+	block(0),
+	numSharedGeometry(0),
+	sharedGeometryBytes(0)
+{
+	threshold = builder->queueThreshold;
+	sharedGeometryMemory = DEFAULT_SHARED_GEOMETRY_MEMORY;
+	geometryRefsMemory = 0;
+	for (size_t i = 0; i < std::max(numWriters, (size_t)1); i++) {
+		writers.push_back(std::make_unique<Writer>());
+	}
+	for (auto& writer : writers) {
+		writer->thread = std::thread(&RepoSceneBuilder::AsyncImpl::consumerFunction, this, writer.get());
+	}
 }
 
 RepoSceneBuilder::AsyncImpl::~AsyncImpl()
 {
-	push({ Consumables(Close()), 0 });
-	consumer.join();
+	for (auto& writer : writers) {
+		writer->queue.enqueue({ Consumables(Close()), 0 });
+	}
+	for (auto& writer : writers) {
+		writer->thread.join();
+	}
+	if (numSharedGeometry) {
+		repoInfo << "Shared geometry buffers of " << numSharedGeometry << " meshes, saving " << sharedGeometryBytes << " bytes";
+	}
 	if (consumerException) {
 		std::rethrow_exception(consumerException);
 	}
 }
 
+RepoSceneBuilder::AsyncImpl::Writer& RepoSceneBuilder::AsyncImpl::getWriter(const repo::lib::RepoUUID& uniqueId)
+{
+	return *writers[repo::lib::RepoUUIDHasher()(uniqueId) % writers.size()];
+}
+
 void RepoSceneBuilder::AsyncImpl::push(repo::core::handler::database::query::AddParent* u)
 {
-	push({ Consumables(u), 100 }); // Update operations have a fixed approximate cost
+	push(getWriter(u->uniqueId), { Consumables(u), 100 }); // Update operations have a fixed approximate cost
 }
 
 void RepoSceneBuilder::AsyncImpl::push(repo::core::model::RepoNode* node)
 {
-	push({ Consumables(node), node->getSize() });
+	push(getWriter(node->getUniqueID()), { Consumables(node), node->getSize() });
 }
 
-void RepoSceneBuilder::AsyncImpl::push(Consumable consumable)
+void RepoSceneBuilder::AsyncImpl::checkConsumerException()
+{
+	std::scoped_lock lock(consumerExceptionMutex);
+	if (consumerException) {
+		std::rethrow_exception(consumerException);
+	}
+}
+
+void RepoSceneBuilder::AsyncImpl::push(Writer& writer, Consumable consumable)
 {
 	// The block semaphore is used to introduce backpressure by prompting the main
 	// thread (the caller) to suspend.
 
 	// The threads are only loosely synchronised - we don't track memory to the byte,
-	// and there is buffering in the bulk write context as well.
+	// and there is buffering in the bulk write contexts as well.
 	// The use of semaphores means that the order of the acquire() and release()
 	// calls should not matter (if the signal gets to the head of the consumer
 	// before we move onto the next statement).
@@ -439,19 +566,24 @@ void RepoSceneBuilder::AsyncImpl::push(Consumable consumable)
 	// In any case though, to be sure there are no deadlocks we use try_acquire with
 	// a timeout - in the worst case, this method will simply check 'size' again.
 
+	// The signal is sent through the writer with the most outstanding data, as
+	// that is the one the main thread is most likely to be waiting on.
+
 	if (consumable.size)
 	{
 		auto maxQueueSize = std::max((long)threshold - (long)consumable.size, 0l);
 		while (queueSize > maxQueueSize) {
-			queue.enqueue({ Consumables(Notify()), 0 });
+			auto busiest = std::max_element(writers.begin(), writers.end(), [](auto& a, auto& b) {
+				return a->queueSize < b->queueSize;
+			});
+			(*busiest)->queue.enqueue({ Consumables(Notify()), 0 });
 			block.try_acquire_for(std::chrono::seconds(1));
-			if (consumerException) {
-				std::rethrow_exception(consumerException);
-			}
+			checkConsumerException();
 		}
 	}
 	queueSize += consumable.size;
-	queue.enqueue(consumable);
+	writer.queueSize += consumable.size;
+	writer.queue.enqueue(consumable);
 }
 
 RepoSceneBuilder::AsyncImpl::Consumer::Consumer(RepoSceneBuilder::AsyncImpl* impl):
@@ -464,21 +596,74 @@ RepoSceneBuilder::AsyncImpl::Consumer::Consumer(RepoSceneBuilder::AsyncImpl* imp
 
 bool RepoSceneBuilder::AsyncImpl::Consumer::operator() (repo::core::model::RepoNode* n) const
 {
-	// At the moment, profiling shows that this thread is often waiting more than
-	// not, so we perform optimisations in it directly.
-	// If this changes in the future, we will need to move the optimisation calls
-	// somewhere else.
+	// Each writer performs the optimisations for its own nodes, so they run in
+	// parallel with each other, and with the database writes of the other writers.
 
 	auto meshNode = dynamic_cast<repo::core::model::MeshNode*>(n);
 	if (meshNode) {
 		meshNode->removeDuplicateVertices();
+		insertMeshNode(*meshNode);
+	}
+	else {
+		collection->insertDocument(*n);
 	}
 
-	collection->insertDocument(*n);
 	delete n;
 	return true;
 }
 
+void RepoSceneBuilder::AsyncImpl::Consumer::insertMeshNode(const repo::core::model::MeshNode& n) const
+{
+	// Identical geometry is written to the blob files only once, and the nodes
+	// reference the same range. This is done after removeDuplicateVertices, so
+	// that meshes that differ only in their redundant vertices are matched too.
+
+	repo::core::model::RepoBSON bson = n;
+	auto [elements, buffer] = bson.getBinariesAsBuffer();
+	if (!buffer.size()) {
+		collection->insertDocument(bson);
+		return;
+	}
+
+	GeometryKey key(buffer);
+	repo::core::model::RepoBSON ref;
+	{
+		std::scoped_lock lock(impl->geometryRefsMutex);
+		auto it = impl->geometryRefs.find(key);
+		if (it != impl->geometryRefs.end() && it->second.buffer == buffer) {
+			ref = it->second.ref;
+		}
+	}
+
+	if (ref.isEmpty()) {
+		// Two writers may insert the same geometry at the same time; this only
+		// means it is stored twice, which is harmless.
+		ref = collection->insertBinary(buffer);
+		std::scoped_lock lock(impl->geometryRefsMutex);
+		if (impl->geometryRefsMemory + buffer.size() <= impl->sharedGeometryMemory) {
+			if (impl->geometryRefs.try_emplace(key, GeometryRef{ buffer, ref }).second) {
+				impl->geometryRefsMemory += buffer.size();
+			}
+		}
+	}
+	else {
+		impl->numSharedGeometry++;
+		impl->sharedGeometryBytes += buffer.size();
+	}
+
+	bson.replaceBinaryWithReference(ref, elements);
+	collection->insertDocument(bson);
+}
+
+RepoSceneBuilder::AsyncImpl::GeometryKey::GeometryKey(const std::vector<uint8_t>& buffer)
+	:size(buffer.size())
+{
+	hash = std::hash<std::string_view>()(std::string_view((const char*)buffer.data(), buffer.size()));
+	boost::crc_32_type crc32;
+	crc32.process_bytes(buffer.data(), buffer.size());
+	crc = crc32.checksum();
+}
+
 bool RepoSceneBuilder::AsyncImpl::Consumer::operator() (const repo::core::handler::database::query::AddParent* u) const
 {
 	collection->updateDocument(repo::core::handler::database::query::RepoUpdate(*u));
@@ -497,20 +682,24 @@ bool RepoSceneBuilder::AsyncImpl::Consumer::operator() (const Notify& n) const
 	return true;
 }
 
-void RepoSceneBuilder::AsyncImpl::consumerFunction()
+void RepoSceneBuilder::AsyncImpl::consumerFunction(Writer* writer)
 {
 	try {
 		Consumer consumer(this);
 
 		Consumable consumable;
 		do {
-			queue.wait_dequeue(consumable);
+			writer->queue.wait_dequeue(consumable);
+			writer->queueSize -= consumable.size;
 			queueSize -= consumable.size;
 		} while (std::visit(consumer, consumable.object));
 	}
 	catch (...)
 	{
-		consumerException = std::current_exception();
+		std::scoped_lock lock(consumerExceptionMutex);
+		if (!consumerException) {
+			consumerException = std::current_exception();
+		}
 	}
 }
 
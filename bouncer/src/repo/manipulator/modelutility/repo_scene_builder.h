@@ -51,6 +51,10 @@ namespace repo {
 			* database. It should be used instead of the RepoScene factory method in
 			* cases where RepoNodes are expected to consume prohibitive amounts of
 			* memory, such as importers that are expected to handle large models.
+			*
+			* MeshNodes with identical geometry (after duplicate vertices are removed)
+			* have their binaries written only once, and share the range in the blob
+			* files.
 			*/
 			class REPO_API_EXPORT RepoSceneBuilder
 			{
@@ -95,6 +99,20 @@ namespace repo {
 				// Call when no more nodes are expected.
 				void finalise();
 
+				/*
+				* Sets the number of threads that write nodes to the database concurrently.
+				* Each has its own bulk write context and blob file. Anything already
+				* added is flushed before the change takes effect.
+				*/
+				void setNumWriters(size_t numWriters);
+				size_t getNumWriters();
+
+				/*
+				* Sets the approximate amount of data (in bytes) that may be queued for
+				* the writers before addNode blocks to wait for them to catch up.
+				*/
+				void setQueueThreshold(size_t threshold);
+
 				repo::lib::RepoVector3D64 getWorldOffset();
 				void setWorldOffset(const repo::lib::RepoVector3D64& offset);
 
@@ -177,11 +195,15 @@ namespace repo {
 
 				struct Deleter;
 
+				size_t numWriters;
+
+				size_t queueThreshold;
+
 				size_t referenceCounter;
 
 				// This is the multithreaded part of RepoSceneBuilder; it appears to the
-				// outer-part as a concurrent queue. Internally it has a thread that owns a
-				// database bulk write context.
+				// outer-part as a concurrent queue. Internally it has a number of threads
+				// that each own a database bulk write context.
 				class AsyncImpl;
 				std::unique_ptr<AsyncImpl> impl;
 			};
@@ -119,8 +119,10 @@ repo::core::model::RepoScene* SceneManager::fetchScene(
 		scene = new repo::core::model::RepoScene(database, project);
 		if (scene)
 		{
-			if (skeletonFetch)
+			if (skeletonFetch) {
 				scene->skipLoadingExtFiles();
+				scene->setLazyLoading();
+			}
 			if (headRevision)
 				scene->setBranch(uuid);
 			else
@@ -257,6 +259,10 @@ bool SceneManager::generateWebViewBuffers(
 		}
 
 		repo::manipulator::modeloptimizer::MultipartOptimizer mpOpt(handler, exporter.get(), config.splitByFloor);
+		mpOpt.setNumThreads(config.numThreads);
+		if (config.memoryBudget) {
+			mpOpt.setMemoryBudget(config.memoryBudget);
+		}
 		mpOpt.processScene(
 			scene->getDatabaseName(),
 			scene->getProjectName(),
@@ -281,24 +287,27 @@ bool SceneManager::generateAndCommitSelectionTree(
 	if (success = scene && scene->isRevisioned() && handler)
 	{
 		SelectionTreeMaker treeMaker(scene, handler);
-		auto buffer = treeMaker.getSelectionTreeAsBuffer();
+		auto files = treeMaker.getFileNames();
 
-		if (success = buffer.size())
+		if (success = files.size())
 		{
 			std::string databaseName = scene->getDatabaseName();
 			std::string projectName = scene->getProjectName();
 			std::string errMsg;
 			std::string fileNamePrefix = scene->getRevisionID().toString() + "/";
 
-			for (const auto & file : buffer)
+			for (const auto & file : files)
 			{
-				std::string fileName = fileNamePrefix + file.first;
+				std::string fileName = fileNamePrefix + file;
+
+				// The json is streamed directly into the file store, rather than being
+				// serialised to a buffer first.
 
 				if (handler && handler->getFileManager()->uploadFileAndCommit(
 					databaseName,
 					projectName + "." + REPO_COLLECTION_STASH_JSON,
 					fileName,
-					file.second))
+					[&](std::ostream& stream) { treeMaker.writeFile(file, stream); }))
 				{
 					repoInfo << "File (" << fileName << ") added successfully to file storage.";
 				}
@@ -312,7 +321,7 @@ bool SceneManager::generateAndCommitSelectionTree(
 		}
 		else
 		{
-			repoError << "Failed to generate selection tree: JSON file buffer is empty!";
+			repoError << "Failed to generate selection tree: there are no files to write!";
 		}
 	}
 	return success;
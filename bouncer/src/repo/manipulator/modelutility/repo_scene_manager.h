@@ -50,6 +50,8 @@ namespace repo {
 				* @param uuid if headRevision, uuid represents the branch id,
 				*              otherwise the unique id of the revision branch
 				* @param headRevision true if retrieving head revision
+				* @param skeletonFetch load the scene in lazy mode, reading only the
+				*              skeleton of the graph and no geometry (see RepoScene::setLazyLoading)
 				* @return returns a pointer to a repoScene.
 				*/
 				repo::core::model::RepoScene* fetchScene(
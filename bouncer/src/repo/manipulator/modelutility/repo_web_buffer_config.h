@@ -17,6 +17,8 @@
 
 #pragma once
 
+#include <cstddef>
+
 namespace repo {
 	namespace manipulator {
 		namespace modelutility {
@@ -29,8 +31,22 @@ namespace repo {
 				*/
 				bool splitByFloor;
 
+				/*
+				* The number of threads used to build the supermeshes. If zero or less, the
+				* hardware concurrency is used.
+				*/
+				int numThreads;
+
+				/*
+				* The limit on the estimated memory of the clusters being turned into
+				* supermeshes at once, in bytes. If zero, the optimizer's default is used.
+				*/
+				size_t memoryBudget;
+
 				WebBufferConfig():
-					splitByFloor(false)
+					splitByFloor(false),
+					numThreads(0),
+					memoryBudget(0)
 				{
 				}
 			};
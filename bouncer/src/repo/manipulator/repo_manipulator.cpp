@@ -27,9 +27,11 @@
 
 #include <repo_log.h>
 #include "repo/core/handler/repo_database_handler_mongo.h"
+#include "repo/core/handler/repo_database_handler_embedded.h"
 #include "repo/core/handler/fileservice/repo_file_manager.h"
 #include "repo/core/model/bson/repo_bson_factory.h"
 #include "repo/core/model/bson/repo_bson.h"
+#include "repo/core/model/bson/repo_node_mesh.h"
 #include "repo/error_codes.h"
 #include "repo/lib/repo_config.h"
 #include "modelconvertor/import/repo_drawing_import_manager.h"
@@ -38,6 +40,7 @@
 #include "modelutility/repo_scene_manager.h"
 #include "modelutility/spatialpartitioning/repo_spatial_partitioner_rdtree.h"
 #include "modelutility/repo_drawing_manager.h"
+#include "modelutility/repo_clash_detection_config.h"
 #include "modelutility/repo_clash_detection_engine.h"
 #include "modelutility/repo_web_buffer_config.h"
 
@@ -61,14 +64,15 @@ void RepoManipulator::connectAndAuthenticateWithAdmin(
 {
 	repo::core::handler::MongoDatabaseHandler::ConnectionOptions options;
 	options.maxConnections = maxConnections;
-	dbHandler = repo::core::handler::MongoDatabaseHandler::getHandler(
+	auto handler = repo::core::handler::MongoDatabaseHandler::getHandler(
 		address,
 		port,
 		username,
 		password,
 		options
 	);
-	dbHandler->testConnection();
+	handler->testConnection();
+	dbHandler = handler;
 }
 
 void RepoManipulator::connectAndAuthenticateWithAdmin(
@@ -80,13 +84,14 @@ void RepoManipulator::connectAndAuthenticateWithAdmin(
 {
 	repo::core::handler::MongoDatabaseHandler::ConnectionOptions options;
 	options.maxConnections = maxConnections;
-	dbHandler = repo::core::handler::MongoDatabaseHandler::getHandler(
+	auto handler = repo::core::handler::MongoDatabaseHandler::getHandler(
 		connString,
 		username,
 		password,
 		options
 	);
-	dbHandler->testConnection();
+	handler->testConnection();
+	dbHandler = handler;
 }
 
 uint8_t RepoManipulator::commitScene(
@@ -284,9 +289,13 @@ void RepoManipulator::processDrawingRevision(
 void RepoManipulator::performClashDetection(
 	const ClashDetectionConfig& config)
 {
+	// Clashes are written to the results file as they are found, rather than
+	// being held until the end.
+
 	modelutility::ClashDetectionEngine clashEngine(dbHandler);
-	auto results = clashEngine.runClashDetection(config);
-	ClashDetectionEngineUtils::writeJson(results, config);
+	modelutility::ClashDetectionJsonWriter writer(config.resultsFile);
+	auto results = clashEngine.runClashDetection(config, &writer);
+	writer.finish(results);
 }
 
 bool RepoManipulator::init(
@@ -295,13 +304,21 @@ bool RepoManipulator::init(
 	const int& nDbConnections
 ) {
 	auto dbConf = config.getDatabaseConfig();
-	if (dbConf.connString.empty()) {
+	if (dbConf.embedded) {
+		repoInfo << "Using the embedded database in " << dbConf.path << " instead of a database server";
+		dbHandler = repo::core::handler::EmbeddedDatabaseHandler::getHandler(dbConf.path);
+	}
+	else if (dbConf.connString.empty()) {
 		connectAndAuthenticateWithAdmin(dbConf.addr, dbConf.port, nDbConnections, dbConf.username, dbConf.password);
 	}
 	else {
 		connectAndAuthenticateWithAdmin(dbConf.connString, nDbConnections, dbConf.username, dbConf.password);
 	}
 	dbHandler->setFileManager(std::make_shared<repo::core::handler::fileservice::FileManager>(config, dbHandler));
+	if (config.getLegacyFaces()) {
+		repoInfo << "Writing mesh faces in the legacy count-prefixed layout";
+	}
+	repo::core::model::MeshNode::setLegacyFaces(config.getLegacyFaces());
 	return true;
 }
 
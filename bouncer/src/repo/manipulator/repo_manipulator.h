@@ -36,7 +36,7 @@
 namespace repo {
 	namespace core {
 	namespace handler {
-		class MongoDatabaseHandler;
+		class AbstractDatabaseHandler;
 	namespace fileservice {
 		class FileManager;
 	}
@@ -275,7 +275,7 @@ namespace repo {
 				const std::string &password
 			);
 
-			std::shared_ptr<repo::core::handler::MongoDatabaseHandler> dbHandler;
+			std::shared_ptr<repo::core::handler::AbstractDatabaseHandler> dbHandler;
 		};
 	}
 }
@@ -164,6 +164,8 @@ namespace repo {
 		* @param uuid if headRevision, uuid represents the branch id,
 		*              otherwise the unique id of the revision branch
 		* @param headRevision true if retrieving head revision
+		* @param skeletonFetch load only the skeleton of the graph, with the
+		*              geometry read on demand (see RepoScene::setLazyLoading)
 		* @return returns a pointer to a repoScene.
 		*/
 		repo::core::model::RepoScene* fetchScene(
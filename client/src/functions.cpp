@@ -178,7 +178,9 @@ bool _generateStash(
 	const bool                   isBranch,
 	const std::string& revID) {
 	repoLog("Generating stash of type " + type + " for " + dbName + "." + project + " rev: " + revID + (isBranch ? " (branch ID)" : ""));
-	auto scene = controller->fetchScene(token, dbName, project, revID, isBranch, type == "tree");
+	// Neither stash type reads the geometry through the scene (both read the
+	// collections directly), so only the skeleton of the graph is loaded.
+	auto scene = controller->fetchScene(token, dbName, project, revID, isBranch, true);
 	bool  success = false;
 	if (scene) {
 		if (type == "repo")
@@ -337,6 +339,7 @@ int32_t importFileAndCommit(
 				config.revisionId = repo::lib::RepoUUID(revIdStr);
 			}
 			config.numThreads = jsonTree.get<int>("numThreads", config.numThreads);
+			config.numWriters = jsonTree.get<int>("numWriters", config.numWriters);
 
 			if (config.databaseName.empty() || config.projectName.empty() || fileLoc.empty())
 			{
@@ -379,6 +382,7 @@ int32_t importFileAndCommit(
 
 		repo::manipulator::modelutility::WebBufferConfig webBufferConfig;
 		webBufferConfig.splitByFloor = config.splitByFloor;
+		webBufferConfig.numThreads = config.numThreads;
 
 		err = controller->commitScene(token, graph, owner, tag, desc, config.revisionId, webBufferConfig);
 
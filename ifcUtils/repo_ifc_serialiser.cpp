@@ -1009,11 +1009,15 @@ void IfcSerialiser::import(const IfcGeom::TriangulationElement* triangulation)
 		const double x = *(it++);
 		const double y = *(it++);
 		const double z = *(it++);
-		repo::lib::RepoVector3D64 v = { x, y, z };
-		vertices64.push_back(v);
+		vertices64.push_back({ x, y, z });
+	}
 
-		auto vOrg = orgMat * v;
-		bounds.encapsulate(vOrg);
+	{
+		std::vector<repo::lib::RepoVector3D64> verticesOrg(vertices64.size());
+		orgMat.transformPoints(vertices64, verticesOrg);
+		for (auto& v : verticesOrg) {
+			bounds.encapsulate(v);
+		}
 	}
 
 	std::vector<repo::lib::RepoVector3D> normals;
@@ -1066,7 +1070,7 @@ void IfcSerialiser::import(const IfcGeom::TriangulationElement* triangulation)
 
 	auto parentId = getParentId(triangulation, !isIfcSpace, newSpaceMat);
 	
-	std::vector<repo::lib::RepoVector3D> vertices;
+	std::vector<repo::lib::RepoVector3D> vertices(vertices64.size());
 
 	// Calculate matrix to transform the vertices from their original local space
 	// into a new local space that takes the transforms of their parents in the 
@@ -1075,12 +1079,7 @@ void IfcSerialiser::import(const IfcGeom::TriangulationElement* triangulation)
 	auto fullCorrMat = parentMat.inverse() * orgMat;
 
 	// Apply corrective to vertices
-	for (int i = 0; i < vertices64.size(); i++)
-	{
-		auto v = vertices64[i];
-		v = fullCorrMat * v;
-		vertices.push_back(v);
-	}
+	fullCorrMat.transformPoints(vertices64, vertices);
 
 	// Apply corrective to normals
 	repo::core::model::MeshNode::transformNormals(normals, fullCorrMat);
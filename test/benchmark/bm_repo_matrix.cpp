@@ -0,0 +1,67 @@
+/**
+*  Copyright (C) 2025 3D Repo Ltd
+*
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU Affero General Public License as
+*  published by the Free Software Foundation, either version 3 of the
+*  License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Affero General Public License for more details.
+*
+*  You should have received a copy of the GNU Affero General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include <random>
+#include <chrono>
+#include <iostream>
+
+#include <repo/lib/datastructure/repo_matrix.h>
+
+using namespace repo::lib;
+
+TEST(MatrixBenchmark, TransformPoints)
+{
+	// Times the batch point transform against the single vector operator, over
+	// a mesh of one million vertices.
+
+	auto m = RepoMatrix::translate(RepoVector3D64(1000, -20, 3.5)) *
+		RepoMatrix::scale(RepoVector3D64(0.1, 2, 30)) *
+		RepoMatrix::rotationX(0.2) *
+		RepoMatrix::rotationY(0.4) *
+		RepoMatrix::rotationZ(0.7);
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<double> distribution(-1000, 1000);
+	std::vector<RepoVector3D> vectors;
+	for (size_t i = 0; i < 1000000; i++) {
+		vectors.push_back(RepoVector3D(distribution(random), distribution(random), distribution(random)));
+	}
+
+	std::vector<RepoVector3D64> out(vectors.size());
+
+	auto measure = [&](const std::string& name, auto func) {
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < 10; i++) {
+			func();
+		}
+		auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		auto rate = (vectors.size() * 10) / seconds;
+		RecordProperty(name, std::to_string(rate));
+		std::cout << name << ": " << rate << std::endl;
+	};
+
+	measure("SingleVerticesPerSecond", [&]() {
+		for (size_t i = 0; i < vectors.size(); i++) {
+			out[i] = m * RepoVector3D64(vectors[i]);
+		}
+	});
+
+	measure("BatchVerticesPerSecond", [&]() {
+		m.transformPoints(vectors, out);
+	});
+}
\ No newline at end of file
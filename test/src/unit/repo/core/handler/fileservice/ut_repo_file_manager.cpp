@@ -89,6 +89,38 @@ TEST(FileManager, UploadFileAndCommitUUIDId)
 	EXPECT_EQ(expected, actual);
 }
 
+TEST(FileManager, UploadFileAndCommitStream)
+{
+	// Test that files can be written directly into the store by a callback,
+	// both with and without compression.
+
+	auto handler = getHandler();
+	auto manager = handler->getFileManager();
+	ASSERT_TRUE(manager);
+	auto db = "testFileManager";
+	std::string col = "fileUpload";
+
+	std::string content = "Test File Contents 3";
+	std::vector<uint8_t> expected;
+	for (int i = 0; i < 1000; i++) {
+		expected.insert(expected.end(), content.begin(), content.end());
+	}
+
+	auto writer = [&](std::ostream& stream) {
+		stream.write((const char*)expected.data(), expected.size());
+	};
+
+	auto id = repo::lib::RepoUUID().createUUID().toString();
+	EXPECT_TRUE(manager->uploadFileAndCommit(db, col, id, writer));
+	EXPECT_EQ(expected, manager->getFile(db, col, id));
+	EXPECT_EQ(expected.size(), manager->getFileRef(db, col, id).getFileSize());
+
+	auto compressedId = repo::lib::RepoUUID().createUUID().toString();
+	EXPECT_TRUE(manager->uploadFileAndCommit(db, col, compressedId, writer, {}, FileManager::Encoding::Gzip));
+	EXPECT_EQ(expected, manager->getFile(db, col, compressedId, FileManager::Encoding::Gzip));
+	EXPECT_LT(manager->getFileRef(db, col, compressedId).getFileSize(), expected.size());
+}
+
 TEST(FileManager, deleteFileAndRef)
 {
 	auto handler = getHandler();
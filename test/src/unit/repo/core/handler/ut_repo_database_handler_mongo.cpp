@@ -16,10 +16,12 @@
 */
 
 #include <repo/core/handler/repo_database_handler_mongo.h>
+#include <repo/core/handler/repo_database_handler_embedded.h>
 #include <repo/core/handler/database/repo_query.h>
 #include <repo/core/model/bson/repo_bson.h>
 #include <repo/core/model/bson/repo_bson_element.h>
 #include <repo/core/model/bson/repo_node.h>
+#include <repo/core/model/bson/repo_node_mesh.h>
 #include <repo/core/model/bson/repo_bson_builder.h>
 #include <repo/core/handler/fileservice/repo_blob_files_handler.h>
 
@@ -34,6 +36,9 @@
 #include <mongocxx/exception/operation_exception.hpp>
 
 #include <thread>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
 
 using namespace repo::core::handler;
 using namespace testing;
@@ -166,6 +171,97 @@ TEST(MongoDatabaseHandlerTest, GetHandler)
 	}
 }
 
+/*
+* The remaining tests run against both the MongoDatabaseHandler and the
+* EmbeddedDatabaseHandler. The embedded database starts empty, so the first
+* test to use it restores it from the same dump as the MongoDB instance, in a
+* temporary directory that is removed at the end of the suite.
+*/
+
+enum class DatabaseBackend
+{
+	Mongo,
+	Embedded
+};
+
+class DatabaseHandlerTest : public TestWithParam<DatabaseBackend>
+{
+public:
+	static void TearDownTestSuite()
+	{
+		if (embedded) {
+			embedded.reset();
+			std::filesystem::remove_all(directory);
+		}
+	}
+
+protected:
+	std::shared_ptr<AbstractDatabaseHandler> getHandler()
+	{
+		if (GetParam() == DatabaseBackend::Mongo) {
+			return ::getHandler();
+		}
+
+		if (!embedded) {
+			directory = std::filesystem::temp_directory_path() / ("embeddedDatabase" + repo::lib::RepoUUID::createUUID().toString());
+			embedded = getEmbeddedHandler(directory.string());
+			for (auto& database : { REPO_GTEST_DBNAME1, REPO_GTEST_DBNAME2, REPO_GTEST_DBNAME4, REPO_GTEST_DROPCOL_TESTCASE.first })
+			{
+				restoreDatabase(database);
+			}
+		}
+		return embedded;
+	}
+
+private:
+	inline static std::filesystem::path directory;
+	inline static std::shared_ptr<EmbeddedDatabaseHandler> embedded;
+
+	/*
+	* Copies a database from the mongodump used to restore the test instance. Each
+	* collection is a .bson file holding the documents back to back, each prefixed
+	* by its length.
+	*/
+	static void restoreDatabase(const std::string& database)
+	{
+		auto dump = std::filesystem::path(getDataPath("../database/dump")) / database;
+		if (!std::filesystem::is_directory(dump)) {
+			throw repo::lib::RepoException("Cannot find the dump of " + database + " at " + dump.string());
+		}
+
+		for (auto& entry : std::filesystem::directory_iterator(dump))
+		{
+			if (entry.path().extension() != ".bson") {
+				continue;
+			}
+
+			std::ifstream file(entry.path(), std::ios::binary);
+			std::vector<repo::core::model::RepoBSON> documents;
+			int32_t length;
+			while (file.read((char*)&length, sizeof(length)))
+			{
+				std::vector<uint8_t> data(length);
+				memcpy(data.data(), &length, sizeof(length));
+				file.read((char*)data.data() + sizeof(length), length - sizeof(length));
+				documents.push_back(repo::core::model::RepoBSON(bsoncxx::document::view(data.data(), data.size())));
+			}
+
+			if (documents.size()) {
+				embedded->insertManyDocuments(database, entry.path().stem().string(), documents);
+			}
+		}
+	}
+};
+
+INSTANTIATE_TEST_SUITE_P(
+	Backends,
+	DatabaseHandlerTest,
+	Values(DatabaseBackend::Mongo, DatabaseBackend::Embedded),
+	[](const TestParamInfo<DatabaseBackend>& info) {
+		return std::string(info.param == DatabaseBackend::Mongo ? "Mongo" : "Embedded");
+	}
+);
+
 // Equality operator for use by GetAllFromCollectionTailable
 
 bool operator== (const repo::core::model::RepoBSON& a, const  GoldenDocument& b)
@@ -209,7 +305,7 @@ MATCHER_P(GetAllFromCollectionTailable_CounterIsDecreasing, start, "")
 }
 
 void populateBinaryData(
-	MongoDatabaseHandler* handler,
+	AbstractDatabaseHandler* handler,
 	std::string db,
 	std::string col,
 	std::vector<repo::core::model::RepoBSON>& bsons
@@ -226,7 +322,7 @@ void populateBinaryData(
 }
 
 void populateBinaryData(
-	MongoDatabaseHandler* handler,
+	AbstractDatabaseHandler* handler,
 	std::string db,
 	std::string col,
 	repo::core::model::RepoBSON& bson
@@ -240,7 +336,7 @@ void populateBinaryData(
 	}
 }
 
-TEST(MongoDatabaseHandlerTest, GetAllFromCollectionTailable)
+TEST_P(DatabaseHandlerTest, GetAllFromCollectionTailable)
 {
 	auto handler = getHandler();
 	ASSERT_TRUE(handler);
@@ -382,7 +478,7 @@ TEST(MongoDatabaseHandlerTest, GetAllFromCollectionTailable)
 	}
 }
 
-TEST(MongoDatabaseHandlerTest, GetCollections)
+TEST_P(DatabaseHandlerTest, GetCollections)
 {
 	auto handler = getHandler();
 	ASSERT_TRUE(handler);
@@ -404,7 +500,7 @@ TEST(MongoDatabaseHandlerTest, GetCollections)
 	EXPECT_THAT(handler->getCollections("blahblah"), IsEmpty());
 }
 
-TEST(MongoDatabaseHandlerTest, DropCollection)
+TEST_P(DatabaseHandlerTest, DropCollection)
 {
 	auto handler = getHandler();
 
@@ -430,7 +526,7 @@ MATCHER_P(DropDocument_UnorderedNamesAre, names, "")
 	return ExplainMatchResult(UnorderedElementsAreArray(names), names, result_listener);
 }
 
-TEST(MongoDatabaseHandlerTest, DropDocument)
+TEST_P(DatabaseHandlerTest, DropDocument)
 {
 	auto handler = getHandler();
 
@@ -499,7 +595,7 @@ TEST(MongoDatabaseHandlerTest, DropDocument)
 	}
 }
 
-TEST(MongoDatabaseHandlerTest, InsertDocument)
+TEST_P(DatabaseHandlerTest, InsertDocument)
 {
 	auto handler = getHandler();
 
@@ -519,6 +615,10 @@ TEST(MongoDatabaseHandlerTest, InsertDocument)
 
 	EXPECT_THAT(handler->findOneByUniqueID(database, collection, id), Eq(bson));
 
+	// Documents must have unique ids
+
+	EXPECT_THROW(handler->insertDocument(database, collection, bson), std::exception);
+
 	// Invalid names will result in an exception
 	EXPECT_THROW(handler->insertDocument("", collection, repo::core::model::RepoBSON()), std::exception);
 	EXPECT_THROW(handler->insertDocument(database, "", repo::core::model::RepoBSON()), std::exception);
@@ -528,7 +628,7 @@ TEST(MongoDatabaseHandlerTest, InsertDocument)
 // A number of these documents have flags manually set which uniquely identify them
 // and ensure that there are no false positives.
 
-TEST(MongoDatabaseHandlerTest, FindAllByCriteria)
+TEST_P(DatabaseHandlerTest, FindAllByCriteria)
 {
 	auto handler = getHandler();
 	ASSERT_TRUE(handler);
@@ -546,12 +646,159 @@ TEST(MongoDatabaseHandlerTest, FindAllByCriteria)
 	EXPECT_THAT(handler->findAllByCriteria(REPO_GTEST_DBNAME1, "", search), IsEmpty());
 }
 
+TEST_P(DatabaseHandlerTest, FindAllByCriteriaProjection)
+{
+	auto handler = getHandler();
+	ASSERT_TRUE(handler);
+
+	using namespace repo::core::handler::database;
+
+	auto collection = REPO_GTEST_DBNAME1_PROJ + ".scene";
+	query::Eq search("type", std::string("mesh"));
+
+	query::RepoProjectionBuilder inclusion;
+	inclusion.includeField(REPO_NODE_LABEL_SHARED_ID);
+
+	auto results = handler->findAllByCriteria(REPO_GTEST_DBNAME1, collection, search, inclusion);
+	ASSERT_EQ(4, results.size());
+	for (auto& r : results) {
+		EXPECT_THAT(r.getFieldNames(), UnorderedElementsAre(REPO_NODE_LABEL_ID, REPO_NODE_LABEL_SHARED_ID));
+	}
+
+	query::RepoProjectionBuilder exclusion;
+	exclusion.excludeField(REPO_NODE_LABEL_PARENTS);
+
+	results = handler->findAllByCriteria(REPO_GTEST_DBNAME1, collection, search, exclusion);
+	ASSERT_EQ(4, results.size());
+	for (auto& r : results) {
+		EXPECT_FALSE(r.hasField(REPO_NODE_LABEL_PARENTS));
+		EXPECT_TRUE(r.hasField(REPO_NODE_LABEL_TYPE));
+	}
+
+	// The cursor should honour the projection too
+
+	auto cursor = handler->findCursorByCriteria(REPO_GTEST_DBNAME1, collection, search, inclusion);
+	size_t count = 0;
+	for (auto bson : *cursor) {
+		EXPECT_THAT(bson.getFieldNames(), UnorderedElementsAre(REPO_NODE_LABEL_ID, REPO_NODE_LABEL_SHARED_ID));
+		count++;
+	}
+	EXPECT_EQ(4, count);
+}
+
+TEST_P(DatabaseHandlerTest, FindAllByCriteriaOptions)
+{
+	auto handler = getHandler();
+	ASSERT_TRUE(handler);
+
+	using namespace repo::core::handler::database;
+
+	auto collection = REPO_GTEST_DBNAME1_PROJ + ".scene";
+	query::Eq search("type", std::string("mesh"));
+
+	query::RepoProjectionBuilder projection;
+	projection.includeField(REPO_NODE_LABEL_ID);
+
+	auto getIds = [](const std::vector<repo::core::model::RepoBSON>& results) {
+		std::vector<repo::lib::RepoUUID> ids;
+		for (auto& r : results) {
+			ids.push_back(r.getUUIDField(REPO_NODE_LABEL_ID));
+		}
+		return ids;
+	};
+
+	FindOptions ascending;
+	ascending.sortField = REPO_NODE_LABEL_ID;
+	ascending.sortOrder = 1;
+
+	FindOptions descending = ascending;
+	descending.sortOrder = -1;
+
+	auto a = getIds(handler->findAllByCriteria(REPO_GTEST_DBNAME1, collection, search, projection, ascending));
+	auto d = getIds(handler->findAllByCriteria(REPO_GTEST_DBNAME1, collection, search, projection, descending));
+	ASSERT_EQ(4, a.size());
+	std::reverse(d.begin(), d.end());
+	EXPECT_THAT(a, ElementsAreArray(d));
+
+	// The limit should apply after the sort
+
+	ascending.limit = 2;
+	auto l = getIds(handler->findAllByCriteria(REPO_GTEST_DBNAME1, collection, search, projection, ascending));
+	EXPECT_THAT(l, ElementsAre(a[0], a[1]));
+
+	// The batch size should not change the results of a cursor, only how many
+	// documents are read from the server at a time
+
+	FindOptions batched = ascending;
+	batched.limit = 0;
+	batched.batchSize = 1;
+	auto cursor = handler->findCursorByCriteria(REPO_GTEST_DBNAME1, collection, search, projection, batched);
+	std::vector<repo::lib::RepoUUID> c;
+	for (auto bson : *cursor) {
+		c.push_back(bson.getUUIDField(REPO_NODE_LABEL_ID));
+	}
+	EXPECT_THAT(c, ElementsAreArray(a));
+}
+
+/*
+* Reports the size of the documents returned for the queries made by the
+* selection tree and the supermeshing of the MultipartOptimizer, with and
+* without their projections.
+*/
+TEST_P(DatabaseHandlerTest, ProjectionBytesTransferred)
+{
+	auto handler = getHandler();
+	ASSERT_TRUE(handler);
+
+	using namespace repo::core::handler::database;
+
+	auto collection = REPO_GTEST_DBNAME1_PROJ + ".scene";
+
+	auto bytes = [&](const query::RepoQuery& filter, const query::RepoProjectionBuilder& projection) {
+		size_t total = 0;
+		for (auto bson : *handler->findCursorByCriteria(REPO_GTEST_DBNAME1, collection, filter, projection)) {
+			total += bson.objsize();
+		}
+		return total;
+	};
+
+	query::RepoProjectionBuilder selectionTree;
+	selectionTree.includeField(REPO_NODE_LABEL_ID);
+	selectionTree.includeField(REPO_NODE_LABEL_SHARED_ID);
+	selectionTree.includeField(REPO_NODE_LABEL_PARENTS);
+	selectionTree.includeField(REPO_NODE_LABEL_TYPE);
+	selectionTree.includeField(REPO_NODE_LABEL_NAME);
+
+	query::RepoProjectionBuilder supermeshing;
+	supermeshing.includeField(REPO_NODE_LABEL_ID);
+	supermeshing.includeField(REPO_NODE_LABEL_SHARED_ID);
+	supermeshing.includeField(REPO_NODE_MESH_LABEL_VERTICES_COUNT);
+	supermeshing.includeField(REPO_NODE_MESH_LABEL_FACES_COUNT);
+	supermeshing.includeField(REPO_NODE_MESH_LABEL_UV_CHANNELS_COUNT);
+	supermeshing.includeField(REPO_NODE_MESH_LABEL_PRIMITIVE);
+	supermeshing.includeField(REPO_LABEL_BINARY_REFERENCE);
+
+	query::Eq all("type", std::vector<std::string>({ "transformation", "mesh", "metadata" }));
+	query::Eq meshes("type", std::string("mesh"));
+
+	auto treeFull = bytes(all, {});
+	auto treeProjected = bytes(all, selectionTree);
+	auto meshFull = bytes(meshes, {});
+	auto meshProjected = bytes(meshes, supermeshing);
+
+	RecordProperty("SelectionTreeBytes", std::to_string(treeProjected) + " of " + std::to_string(treeFull));
+	RecordProperty("SupermeshingBytes", std::to_string(meshProjected) + " of " + std::to_string(meshFull));
+
+	EXPECT_LT(treeProjected, treeFull);
+	EXPECT_LT(meshProjected, meshFull);
+}
+
 // The implementation of this is defined in repo_database_handler_mongo.cpp.
 // It is not intended to be used outside that module, but this being that
 // modules unit test is a special case.
 repo::core::model::RepoBSON REPO_API_EXPORT makeQueryFilterDocument(const repo::core::handler::database::query::RepoQuery& query);
 
-TEST(MongoDatabaseHandlerTest, FindOneByCriteria)
+TEST_P(DatabaseHandlerTest, FindOneByCriteria)
 {
 	auto handler = getHandler();
 	auto db = REPO_GTEST_DBNAME4;
@@ -680,7 +927,7 @@ TEST(MongoDatabaseHandlerTest, FindOneByCriteria)
 	}
 }
 
-TEST(MongoDatabaseHandlerTest, MetadataQueries)
+TEST_P(DatabaseHandlerTest, MetadataQueries)
 {
 	// Tests that the ArrayContains query can be used for its intended purpose
 	// of working with metadata.
@@ -711,7 +958,7 @@ TEST(MongoDatabaseHandlerTest, MetadataQueries)
 	}
 }
 
-TEST(MongoDatabaseHandlerTest, FindOneByUniqueID)
+TEST_P(DatabaseHandlerTest, FindOneByUniqueID)
 {
 	auto handler = getHandler();
 	auto db = REPO_GTEST_DBNAME4;
@@ -746,7 +993,7 @@ TEST(MongoDatabaseHandlerTest, FindOneByUniqueID)
 	}
 }
 
-TEST(MongoDatabaseHandlerTest, FindOneBySharedID)
+TEST_P(DatabaseHandlerTest, FindOneBySharedID)
 {
 	auto handler = getHandler();
 	auto db = REPO_GTEST_DBNAME4;
@@ -773,7 +1020,7 @@ TEST(MongoDatabaseHandlerTest, FindOneBySharedID)
 	}
 }
 
-TEST(MongoDatabaseHandlerTest, UpsertDocument)
+TEST_P(DatabaseHandlerTest, UpsertDocument)
 {
 	auto handler = getHandler();
 
@@ -845,7 +1092,7 @@ TEST(MongoDatabaseHandlerTest, UpsertDocument)
 	EXPECT_THAT(documents, UnorderedElementsAre(update, doc1, doc2));
 }
 
-TEST(MongoDatabaseHandlerTest, UpsertDocumentBinary)
+TEST_P(DatabaseHandlerTest, UpsertDocumentBinary)
 {
 	// Upserting is not supported for BSONS with bin mappings
 
@@ -859,7 +1106,7 @@ TEST(MongoDatabaseHandlerTest, UpsertDocumentBinary)
 	repo::lib::RepoException);
 }
 
-TEST(MongoDatabaseHandlerTest, InsertDocumentBinary)
+TEST_P(DatabaseHandlerTest, InsertDocumentBinary)
 {
 	// Inserting is not supported for BSONS with bin mappings
 
@@ -915,7 +1162,7 @@ MATCHER(InsertManyDocumentsBinaryBSONMatcher, "") {
 	return true;
 }
 
-TEST(MongoDatabaseHandlerTest, InsertManyDocumentsBinary)
+TEST_P(DatabaseHandlerTest, InsertManyDocumentsBinary)
 {
 	// InsertManyDocuments is a special method that should batch multiple binary
 	// buffers into a single backing store
@@ -971,7 +1218,7 @@ TEST(MongoDatabaseHandlerTest, InsertManyDocumentsBinary)
 	EXPECT_THAT(actual, Pointwise(InsertManyDocumentsBinaryBSONMatcher(), documents));
 }
 
-TEST(MongoDatabaseHandlerTest, InsertManyDocumentsMetadata)
+TEST_P(DatabaseHandlerTest, InsertManyDocumentsMetadata)
 {
 	// The binary blobs created may have metadata attached. This metadata is
 	// added as first-part members to the ref node.
@@ -1057,7 +1304,7 @@ bool checkBinaryAgainstUUID(repo::lib::RepoUUID id, std::vector<uint8_t>& bin, s
 }
 
 void checkDocument(
-	MongoDatabaseHandler* handler,
+	AbstractDatabaseHandler* handler,
 	std::string database,
 	std::string collection,
 	int binarySampleCount,
@@ -1144,7 +1391,7 @@ repo::core::model::RepoBSON generateSample(bool addBinary, int binarySampleCount
 }
 
 void checkThreadGetAllFromCollectionTailable(
-	MongoDatabaseHandler* handler,
+	AbstractDatabaseHandler* handler,
 	std::string database,
 	std::string collection,
 	int binarySampleCount,
@@ -1170,7 +1417,7 @@ void checkThreadGetAllFromCollectionTailable(
 }
 
 void checkThreadFindAllByCriteria(
-	MongoDatabaseHandler* handler,
+	AbstractDatabaseHandler* handler,
 	std::string database,
 	std::string collection,
 	int binarySampleCount,
@@ -1210,7 +1457,7 @@ void checkThreadFindAllByCriteria(
 }
 
 void checkThreadFindAllByCriteriaWithProjection(
-	MongoDatabaseHandler* handler,
+	AbstractDatabaseHandler* handler,
 	std::string database,
 	std::string collection,
 	int binarySampleCount,
@@ -1254,7 +1501,7 @@ void checkThreadFindAllByCriteriaWithProjection(
 }
 
 void checkThreadFindCursorByCriteria(
-	MongoDatabaseHandler* handler,
+	AbstractDatabaseHandler* handler,
 	std::string database,
 	std::string collection,
 	int binarySampleCount,
@@ -1294,7 +1541,7 @@ void checkThreadFindCursorByCriteria(
 }
 
 void checkThreadFindCursorByCriteriaWithProjection(
-	MongoDatabaseHandler* handler,
+	AbstractDatabaseHandler* handler,
 	std::string database,
 	std::string collection,
 	int binarySampleCount,
@@ -1344,7 +1591,7 @@ void checkThreadFindCursorByCriteriaWithProjection(
 }
 
 void checkThreadFindOneByCriteria(
-	MongoDatabaseHandler* handler,
+	AbstractDatabaseHandler* handler,
 	std::string database,
 	std::string collection,
 	int binarySampleCount,
@@ -1384,7 +1631,7 @@ void checkThreadFindOneByCriteria(
 }
 
 void checkThreadFindOneBySharedId(
-	MongoDatabaseHandler* handler,
+	AbstractDatabaseHandler* handler,
 	std::string database,
 	std::string collection,
 	int binarySampleCount,
@@ -1425,7 +1672,7 @@ void checkThreadFindOneBySharedId(
 }
 
 void checkThreadFindOneByUniqueId(
-	MongoDatabaseHandler* handler,
+	AbstractDatabaseHandler* handler,
 	std::string database,
 	std::string collection,
 	int binarySampleCount,
@@ -1464,7 +1711,7 @@ void checkThreadFindOneByUniqueId(
 }
 
 void checkThreadFindOneByUniqueIdString(
-	MongoDatabaseHandler* handler,
+	AbstractDatabaseHandler* handler,
 	std::string database,
 	std::string collection,
 	int binarySampleCount,
@@ -1498,7 +1745,7 @@ void checkThreadFindOneByUniqueIdString(
 }
 
 void checkThreadGetCollection(
-	MongoDatabaseHandler* handler,
+	AbstractDatabaseHandler* handler,
 	std::string database,
 	std::string collection,
 	int binarySampleCount,
@@ -1529,7 +1776,7 @@ void checkThreadGetCollection(
 }
 
 void writeThreadInsertDocument(
-	MongoDatabaseHandler* handler,
+	AbstractDatabaseHandler* handler,
 	std::string database,
 	std::string collection,
 	int binarySampleCount,
@@ -1545,7 +1792,7 @@ void writeThreadInsertDocument(
 }
 
 void writeThreadInsertManyDocuments(
-	MongoDatabaseHandler* handler,
+	AbstractDatabaseHandler* handler,
 	std::string database,
 	std::string collection,
 	int binarySampleCount,
@@ -1573,7 +1820,7 @@ void writeThreadInsertManyDocuments(
 }
 
 void writeThreadUpsertDocument(
-	MongoDatabaseHandler* handler,
+	AbstractDatabaseHandler* handler,
 	std::string database,
 	std::string collection,
 	int binarySampleCount,
@@ -1630,7 +1877,7 @@ void writeThreadUpsertDocument(
 }
 
 void writeThreadBulkWriteContext(
-	MongoDatabaseHandler* handler,
+	AbstractDatabaseHandler* handler,
 	std::string database,
 	std::string collection,
 	int binarySampleCount,
@@ -1681,7 +1928,7 @@ void writeThreadBulkWriteContext(
 }
 
 void writeThreadCreateIndex(
-	MongoDatabaseHandler* handler,
+	AbstractDatabaseHandler* handler,
 	std::string database,
 	std::string collection,
 	int binarySampleCount,
@@ -1696,7 +1943,7 @@ void writeThreadCreateIndex(
 }
 
 void dropThreadDropDocument(
-	MongoDatabaseHandler* handler,
+	AbstractDatabaseHandler* handler,
 	std::string database,
 	std::string collection,
 	int binarySampleCount,
@@ -1726,7 +1973,7 @@ void dropThreadDropDocument(
 	}
 }
 
-TEST(MongoDatabaseHandlerTest, SoakTestWriteVsWrite)
+TEST_P(DatabaseHandlerTest, SoakTestWriteVsWrite)
 {
 	std::string database = REPO_GTEST_DBNAME3;
 	std::string collection = "mtTestCollectionWvsW";
@@ -1735,7 +1982,7 @@ TEST(MongoDatabaseHandlerTest, SoakTestWriteVsWrite)
 	int noCases = 2500; // per thread. Scaled to keep runtime in the minutes
 
 	// Typedef for the function pointers
-	typedef void (*fp)(MongoDatabaseHandler*, std::string, std::string, int, int);
+	typedef void (*fp)(AbstractDatabaseHandler*, std::string, std::string, int, int);
 
 	// Create array of function pointers
 	std::pair<std::string, fp> writeFunctions[] =
@@ -1783,7 +2030,7 @@ TEST(MongoDatabaseHandlerTest, SoakTestWriteVsWrite)
 	}
 }
 
-TEST(MongoDatabaseHandlerTest, SoakTestReadVsRead)
+TEST_P(DatabaseHandlerTest, SoakTestReadVsRead)
 {
 	std::string database = REPO_GTEST_DBNAME3;
 	std::string collection = "mtTestCollectionRvsR";
@@ -1792,7 +2039,7 @@ TEST(MongoDatabaseHandlerTest, SoakTestReadVsRead)
 	int noCases = 300; // per thread. Scaled to keep the runtime in minutes.
 
 	// Typedef for the function pointers
-	typedef void (*fp)(MongoDatabaseHandler*, std::string, std::string, int, int);
+	typedef void (*fp)(AbstractDatabaseHandler*, std::string, std::string, int, int);
 
 	// Create array of function pointers
 	std::pair<std::string, fp> checkFunctions[] =
@@ -1855,7 +2102,7 @@ TEST(MongoDatabaseHandlerTest, SoakTestReadVsRead)
 	}
 }
 
-TEST(MongoDatabaseHandlerTest, SoakTestReadVsWrite)
+TEST_P(DatabaseHandlerTest, SoakTestReadVsWrite)
 {
 	std::string database = REPO_GTEST_DBNAME3;
 	std::string collection = "mtTestCollectionRvsW";
@@ -1865,7 +2112,7 @@ TEST(MongoDatabaseHandlerTest, SoakTestReadVsWrite)
 	int noCasesCheck = 300; // per thread
 
 	// Typedef for the function pointers
-	typedef void (*fp)(MongoDatabaseHandler*, std::string, std::string, int, int);
+	typedef void (*fp)(AbstractDatabaseHandler*, std::string, std::string, int, int);
 
 	// Create array of function pointers
 	std::pair<std::string, fp> writeFunctions[] =
@@ -1927,7 +2174,7 @@ TEST(MongoDatabaseHandlerTest, SoakTestReadVsWrite)
 	}
 }
 
-TEST(MongoDatabaseHandlerTest, SoakTestDropVsRead)
+TEST_P(DatabaseHandlerTest, SoakTestDropVsRead)
 {
 	std::string database = REPO_GTEST_DBNAME3;
 	std::string collection = "mtTestCollectionDvsR";
@@ -1937,7 +2184,7 @@ TEST(MongoDatabaseHandlerTest, SoakTestDropVsRead)
 	int noCasesCheck = 500; // per thread. Scaled to keep the runtime in minutes.
 
 	// Typedef for the function pointers
-	typedef void (*fp)(MongoDatabaseHandler*, std::string, std::string, int, int);
+	typedef void (*fp)(AbstractDatabaseHandler*, std::string, std::string, int, int);
 
 	// Create array of function pointers
 	std::pair<std::string, fp> checkFunctions[] =
@@ -1994,7 +2241,7 @@ TEST(MongoDatabaseHandlerTest, SoakTestDropVsRead)
 	}
 }
 
-TEST(MongoDatabaseHandlerTest, SoakTestReadVsWriteVsDrop)
+TEST_P(DatabaseHandlerTest, SoakTestReadVsWriteVsDrop)
 {
 	std::string database = REPO_GTEST_DBNAME3;
 	std::string collection = "mtTestCollectionRvsWvsD";
@@ -2005,7 +2252,7 @@ TEST(MongoDatabaseHandlerTest, SoakTestReadVsWriteVsDrop)
 	int noCasesDrop = 7500; // per thread. Scaled to keep the runtime in minutes.
 
 	// Typedef for the function pointers
-	typedef void (*fp)(MongoDatabaseHandler*, std::string, std::string, int, int);
+	typedef void (*fp)(AbstractDatabaseHandler*, std::string, std::string, int, int);
 
 	// Create array of function pointers
 	std::pair<int, fp> functions[] =
@@ -2052,4 +2299,104 @@ TEST(MongoDatabaseHandlerTest, SoakTestReadVsWriteVsDrop)
 	// Wait for all threads to complete
 	for (auto& t : threads)
 		t.join();
+}
+
+/*
+* The embedded database stores each collection as a log of writes with an index
+* beside it. These tests cover behaviours that only exist for it, so create
+* their own databases in a temporary directory that is removed afterwards.
+*/
+
+namespace {
+	struct TemporaryDirectory
+	{
+		std::filesystem::path path;
+
+		TemporaryDirectory()
+			:path(std::filesystem::temp_directory_path() / ("embeddedDatabase" + repo::lib::RepoUUID::createUUID().toString()))
+		{
+		}
+
+		~TemporaryDirectory()
+		{
+			std::filesystem::remove_all(path);
+		}
+	};
+
+	repo::core::model::RepoBSON makeNode(int value)
+	{
+		repo::core::model::RepoBSONBuilder builder;
+		builder.append(REPO_LABEL_ID, repo::lib::RepoUUID::createUUID());
+		builder.append(REPO_NODE_LABEL_SHARED_ID, repo::lib::RepoUUID::createUUID());
+		builder.append("type", "mesh");
+		builder.append("value", value);
+		return builder.obj();
+	}
+}
+
+TEST(EmbeddedDatabaseHandlerTest, Persistence)
+{
+	TemporaryDirectory directory;
+
+	std::string database = "sandbox";
+	std::string collection = "project.scene";
+
+	std::vector<repo::core::model::RepoBSON> documents;
+	for (int i = 0; i < 100; i++) {
+		documents.push_back(makeNode(i));
+	}
+
+	{
+		auto handler = getEmbeddedHandler(directory.path.string());
+		handler->insertManyDocuments(database, collection, { documents.begin(), documents.begin() + 50 });
+
+		// Writes after the index was last saved are replayed from the log
+
+		for (auto i = 50; i < 100; i++) {
+			handler->insertDocument(database, collection, documents[i]);
+		}
+		handler->dropDocument(documents[0], database, collection);
+	}
+
+	std::vector<repo::core::model::RepoBSON> expected(documents.begin() + 1, documents.end());
+
+	{
+		auto handler = getEmbeddedHandler(directory.path.string());
+		EXPECT_THAT(handler->getAllFromCollectionTailable(database, collection), ElementsAreArray(expected));
+		EXPECT_THAT(handler->findOneBySharedID(database, collection, documents[75].getUUIDField(REPO_NODE_LABEL_SHARED_ID), ""), Eq(documents[75]));
+	}
+
+	// An incomplete record at the end of the log is discarded, and a missing
+	// index is rebuilt
+
+	auto path = directory.path / database / collection;
+	{
+		std::ofstream log(path.string() + ".log", std::ios::binary | std::ios::app);
+		log.write("W\x40\x00\x00\x00", 5);
+	}
+	std::filesystem::remove(path.string() + ".idx");
+
+	{
+		auto handler = getEmbeddedHandler(directory.path.string());
+		EXPECT_THAT(handler->getAllFromCollectionTailable(database, collection), ElementsAreArray(expected));
+		EXPECT_THAT(handler->findOneByUniqueID(database, collection, documents[0].getUUIDField(REPO_LABEL_ID)).isEmpty(), IsTrue());
+
+		handler->insertDocument(database, collection, documents[0]);
+		EXPECT_THAT(handler->findOneByUniqueID(database, collection, documents[0].getUUIDField(REPO_LABEL_ID)), Eq(documents[0]));
+	}
+}
+
+TEST(EmbeddedDatabaseHandlerTest, InvalidNames)
+{
+	TemporaryDirectory directory;
+	auto handler = getEmbeddedHandler(directory.path.string());
+
+	// Database and collection names become paths, so must not be able to leave
+	// the root directory
+
+	auto bson = makeNode(0);
+	EXPECT_THROW(handler->insertDocument("../sandbox", "collection", bson), std::exception);
+	EXPECT_THROW(handler->insertDocument("sandbox", "../collection", bson), std::exception);
+	EXPECT_THROW(handler->insertDocument("..", "collection", bson), std::exception);
+	EXPECT_THROW(handler->getCollections("../sandbox"), std::exception);
 }
\ No newline at end of file
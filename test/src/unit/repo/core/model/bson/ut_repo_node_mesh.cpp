@@ -123,23 +123,34 @@ TEST(MeshNodeTest, Serialise)
 	((RepoBSON)node).getBinaryFieldAsVector(REPO_NODE_MESH_LABEL_VERTICES, vertices);
 	EXPECT_THAT(vertices, ElementsAreArray(node.getVertices()));
 
+	// Lines and triangles are written with a fixed stride. Whether the indices
+	// are 16 or 32 bit depends on the range of rand(), so the faces are checked
+	// by decoding them.
+
+	auto readFaces = [](const RepoBSON& bson) {
+		std::vector<repo::lib::repo_face_t> faces;
+		auto& binary = bson.getBinary(REPO_NODE_MESH_LABEL_FACES);
+		EXPECT_TRUE(MeshNode::deserialiseFaces(
+			binary.data(),
+			binary.size(),
+			bson.getIntField(REPO_NODE_MESH_LABEL_FACES_ENCODING),
+			(MeshNode::Primitive)bson.getIntField(REPO_NODE_MESH_LABEL_PRIMITIVE),
+			bson.getIntField(REPO_NODE_MESH_LABEL_FACES_COUNT),
+			faces));
+		return faces;
+	};
+
 	node.setFaces(makeFaces(MeshNode::Primitive::LINES));
 	EXPECT_THAT(((RepoBSON)node).getIntField(REPO_NODE_MESH_LABEL_FACES_COUNT), Eq(node.getNumFaces()));
 	EXPECT_THAT(((RepoBSON)node).getIntField(REPO_NODE_MESH_LABEL_PRIMITIVE), Eq((int)node.getPrimitive()));
-	std::vector<uint32_t> faces;
-	((RepoBSON)node).getBinaryFieldAsVector(REPO_NODE_MESH_LABEL_FACES, faces);
-	EXPECT_THAT(faces[0], Eq((int)node.getPrimitive()));
-	EXPECT_THAT(faces[1], Eq(node.getFaces()[0][0]));
-	EXPECT_THAT(faces[2], Eq(node.getFaces()[0][1]));
+	EXPECT_THAT(((RepoBSON)node).getIntField(REPO_NODE_MESH_LABEL_FACES_ENCODING) & MeshNode::FaceEncoding::FIXED_STRIDE, Ne(0));
+	EXPECT_THAT(readFaces((RepoBSON)node), ElementsAreArray(node.getFaces()));
 
 	node.setFaces(makeFaces(MeshNode::Primitive::TRIANGLES));
 	EXPECT_THAT(((RepoBSON)node).getIntField(REPO_NODE_MESH_LABEL_FACES_COUNT), Eq(node.getNumFaces()));
 	EXPECT_THAT(((RepoBSON)node).getIntField(REPO_NODE_MESH_LABEL_PRIMITIVE), Eq((int)node.getPrimitive()));
-	((RepoBSON)node).getBinaryFieldAsVector(REPO_NODE_MESH_LABEL_FACES, faces);
-	EXPECT_THAT(faces[0], Eq((int)node.getPrimitive()));
-	EXPECT_THAT(faces[1], Eq(node.getFaces()[0][0]));
-	EXPECT_THAT(faces[2], Eq(node.getFaces()[0][1]));
-	EXPECT_THAT(faces[3], Eq(node.getFaces()[0][2]));
+	EXPECT_THAT(((RepoBSON)node).getIntField(REPO_NODE_MESH_LABEL_FACES_ENCODING) & MeshNode::FaceEncoding::FIXED_STRIDE, Ne(0));
+	EXPECT_THAT(readFaces((RepoBSON)node), ElementsAreArray(node.getFaces()));
 
 	node.setNormals(makeNormals(100));
 	std::vector<repo::lib::RepoVector3D> normals;
@@ -187,6 +198,79 @@ TEST(MeshNodeTest, Serialise)
 	EXPECT_FALSE(((RepoBSON)nodeNoUv).getObjectField(REPO_FILTER_OBJECT_NAME).hasField(REPO_FILTER_PROP_TEXTURE_ID));
 }
 
+TEST(MeshNodeTest, FaceEncodings)
+{
+	// Meshes of only lines or only triangles should be written with a fixed
+	// stride, using 16 bit indices when they all fit, and anything else in the
+	// count prefixed layout. All should read back as the same faces.
+
+	auto makeIndexedFaces = [](MeshNode::Primitive primitive, uint32_t maxIndex) {
+		std::vector<repo::lib::repo_face_t> faces;
+		for (uint32_t i = 0; i < 100; i++) {
+			repo::lib::repo_face_t face;
+			for (int j = 0; j < (int)primitive; j++) {
+				face.push_back((i * 3 + j) % maxIndex);
+			}
+			faces.push_back(face);
+		}
+		faces.back()[0] = maxIndex;
+		return faces;
+	};
+
+	auto roundTrip = [](const std::vector<repo::lib::repo_face_t>& faces, int32_t expectedEncoding, size_t expectedBytes) {
+		MeshNode node;
+		node.setFaces(faces);
+		auto bson = (RepoBSON)node;
+		if (expectedEncoding == MeshNode::FaceEncoding::LEGACY) {
+			EXPECT_THAT(bson.hasField(REPO_NODE_MESH_LABEL_FACES_ENCODING), IsFalse());
+		}
+		else {
+			EXPECT_THAT(bson.getIntField(REPO_NODE_MESH_LABEL_FACES_ENCODING), Eq(expectedEncoding));
+		}
+		EXPECT_THAT(bson.getBinary(REPO_NODE_MESH_LABEL_FACES).size(), Eq(expectedBytes));
+		EXPECT_THAT(MeshNode(bson).getFaces(), ElementsAreArray(faces));
+	};
+
+	auto fixed16 = MeshNode::FaceEncoding::FIXED_STRIDE | MeshNode::FaceEncoding::INDEX_16;
+	auto fixed32 = MeshNode::FaceEncoding::FIXED_STRIDE;
+
+	roundTrip(makeIndexedFaces(MeshNode::Primitive::TRIANGLES, 65535), fixed16, 100 * 3 * sizeof(uint16_t));
+	roundTrip(makeIndexedFaces(MeshNode::Primitive::TRIANGLES, 65536), fixed32, 100 * 3 * sizeof(uint32_t));
+	roundTrip(makeIndexedFaces(MeshNode::Primitive::LINES, 1000), fixed16, 100 * 2 * sizeof(uint16_t));
+	roundTrip(makeIndexedFaces(MeshNode::Primitive::LINES, 100000), fixed32, 100 * 2 * sizeof(uint32_t));
+
+	auto mixed = makeIndexedFaces(MeshNode::Primitive::TRIANGLES, 1000);
+	mixed[10].resize(2);
+	roundTrip(mixed, MeshNode::FaceEncoding::LEGACY, (100 * 4 - 1) * sizeof(uint32_t));
+
+	// Truncated buffers should return the faces that could be read, in either
+	// layout.
+
+	std::vector<uint16_t> indices16 = { 0, 1, 2, 3, 4, 5, 6 };
+	std::vector<repo::lib::repo_face_t> faces;
+	EXPECT_FALSE(MeshNode::deserialiseFaces((const uint8_t*)indices16.data(), indices16.size() * sizeof(uint16_t), fixed16, MeshNode::Primitive::TRIANGLES, 3, faces));
+	EXPECT_THAT(faces, ElementsAre(repo::lib::repo_face_t({ 0, 1, 2 }), repo::lib::repo_face_t({ 3, 4, 5 })));
+
+	std::vector<uint32_t> legacy = { 3, 0, 1, 2, 2, 3, 4, 3, 5 };
+	faces.clear();
+	EXPECT_FALSE(MeshNode::deserialiseFaces((const uint8_t*)legacy.data(), legacy.size() * sizeof(uint32_t), MeshNode::FaceEncoding::LEGACY, MeshNode::Primitive::TRIANGLES, 3, faces));
+	EXPECT_THAT(faces, ElementsAre(repo::lib::repo_face_t({ 0, 1, 2 }), repo::lib::repo_face_t({ 3, 4 })));
+
+	// The fixed stride layouts are only defined for lines and triangles
+
+	faces.clear();
+	EXPECT_FALSE(MeshNode::deserialiseFaces((const uint8_t*)indices16.data(), indices16.size() * sizeof(uint16_t), fixed16, MeshNode::Primitive::QUADS, 1, faces));
+
+	// When the legacy layout is asked for, every mesh should be written count
+	// prefixed, so older readers can still load it
+
+	EXPECT_FALSE(MeshNode::getLegacyFaces());
+	MeshNode::setLegacyFaces(true);
+	roundTrip(makeIndexedFaces(MeshNode::Primitive::TRIANGLES, 65535), MeshNode::FaceEncoding::LEGACY, 100 * 4 * sizeof(uint32_t));
+	roundTrip(makeIndexedFaces(MeshNode::Primitive::LINES, 100000), MeshNode::FaceEncoding::LEGACY, 100 * 3 * sizeof(uint32_t));
+	MeshNode::setLegacyFaces(false);
+}
+
 TEST(MeshNodeTest, TypeTest)
 {
 	MeshNode node;
@@ -227,4 +227,47 @@ TEST(StreamingMeshNodeTest, BakeMeshData) {
 	// Check the transformed data
 	EXPECT_THAT(node.getLoadedVertices(), ElementsAreArray(transformedVertices));
 	EXPECT_THAT(node.getLoadedNormals(), ElementsAreArray(transformedNormals));
+}
+
+TEST(StreamingMeshNodeTest, BakeMeshDataFromView) {
+	// Loading from a view into a buffer should give the same results as loading
+	// from a vector, including when the arrays are not aligned, as they may not
+	// be in a memory mapped blob file.
+
+	auto meshData = mesh_data(true, true, 2, 3, true, 2, 100, "");
+	auto bson = meshNodeTestBSONFactory(meshData);
+
+	auto m = repo::lib::RepoMatrix::translate(repo::lib::RepoVector3D(10, 0, 0))
+		* repo::lib::RepoMatrix::rotationX(0.12f)
+		* repo::lib::RepoMatrix::rotationY(0.8f)
+		* repo::lib::RepoMatrix::rotationZ(1.02f);
+
+	auto data = bson.getBinariesAsBuffer();
+	auto fakeRef = repo::core::handler::fileservice::DataRef("file", 0, data.second.size());
+	bson.replaceBinaryWithReference(fakeRef.serialise(), data.first);
+
+	StreamingMeshNode expected = StreamingMeshNode(bson);
+	expected.loadSupermeshingData(bson, data.second, false);
+	expected.bakeLoadedMeshes(m);
+
+	std::vector<uint8_t> unaligned(data.second.size() + 1);
+	memcpy(unaligned.data() + 1, data.second.data(), data.second.size());
+
+	StreamingMeshNode node = StreamingMeshNode(bson);
+	node.loadSupermeshingData(bson, unaligned.data() + 1, data.second.size(), false);
+
+	EXPECT_EQ(node.getUniqueId(), meshData.uniqueId);
+	EXPECT_EQ(node.getNumLoadedVertices(), meshData.vertices.size());
+	EXPECT_THAT(node.getLoadedFaces(), ElementsAreArray(meshData.faces));
+	EXPECT_THAT(node.getLoadedUVChannelsSeparated(), ElementsAreArray(meshData.uvChannels));
+
+	node.bakeLoadedMeshes(m);
+
+	EXPECT_THAT(node.getLoadedVertices(), ElementsAreArray(expected.getLoadedVertices()));
+	EXPECT_THAT(node.getLoadedNormals(), ElementsAreArray(expected.getLoadedNormals()));
+
+	// References outside the buffer should be rejected
+
+	StreamingMeshNode truncated = StreamingMeshNode(bson);
+	EXPECT_REPO_EXCEPTION(truncated.loadSupermeshingData(bson, data.second.data(), data.second.size() / 2, false));
 }
\ No newline at end of file
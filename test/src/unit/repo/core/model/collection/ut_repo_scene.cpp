@@ -557,6 +557,75 @@ TEST(RepoSceneTest, loadScene)
 	errMsg.clear();
 }
 
+TEST(RepoSceneTest, loadSceneLazy)
+{
+	auto handler = getHandler();
+	std::string errMsg;
+
+	RepoScene full(REPO_GTEST_DBNAME1, REPO_GTEST_DBNAME1_PROJ);
+	EXPECT_TRUE(full.loadScene(handler.get(), errMsg));
+
+	RepoScene lazy(REPO_GTEST_DBNAME1, REPO_GTEST_DBNAME1_PROJ);
+	lazy.setLazyLoading();
+	EXPECT_TRUE(lazy.isLazy());
+	EXPECT_TRUE(lazy.loadScene(handler.get(), errMsg));
+	EXPECT_TRUE(errMsg.empty());
+
+	// The skeleton should have the same graph as the fully loaded scene, but
+	// none of the geometry until it is requested.
+
+	EXPECT_EQ(lazy.getItemsInCurrentGraph(defaultG), full.getItemsInCurrentGraph(defaultG));
+
+	auto meshes = full.getAllMeshes(defaultG);
+	ASSERT_THAT(meshes.size(), Gt(0));
+	EXPECT_EQ(lazy.getAllMeshes(defaultG).size(), meshes.size());
+
+	for (auto& m : meshes) {
+		auto expected = dynamic_cast<MeshNode*>(m);
+		auto node = dynamic_cast<MeshNode*>(lazy.getNodeByUniqueID(defaultG, m->getUniqueID()));
+		ASSERT_TRUE(node);
+		EXPECT_EQ(node->getName(), expected->getName());
+		EXPECT_EQ(node->getParentIDs(), expected->getParentIDs());
+		EXPECT_EQ(node->getBoundingBox(), expected->getBoundingBox());
+		EXPECT_EQ(node->getNumVertices(), 0);
+
+		lazy.loadGeometry(node);
+		EXPECT_EQ(node->getVertices(), expected->getVertices());
+		EXPECT_EQ(node->getNormals(), expected->getNormals());
+		EXPECT_EQ(node->getFaces(), expected->getFaces());
+
+		lazy.unloadGeometry(node);
+		EXPECT_EQ(node->getNumVertices(), 0);
+		EXPECT_EQ(node->getNumFaces(), 0);
+		EXPECT_EQ(node->getBoundingBox(), expected->getBoundingBox());
+	}
+
+	// Fully loaded scenes cannot retrieve their geometry again, so should not
+	// release it
+
+	auto m = dynamic_cast<MeshNode*>(*meshes.begin());
+	auto numVertices = m->getNumVertices();
+	full.unloadGeometry(m);
+	EXPECT_EQ(m->getNumVertices(), numVertices);
+
+	// The loader can be replaced, e.g. to read from a different source
+
+	RepoScene custom(REPO_GTEST_DBNAME1, REPO_GTEST_DBNAME1_PROJ);
+	custom.setLazyLoading();
+	size_t calls = 0;
+	custom.setGeometryLoader([&](const MeshNode& node) {
+		calls++;
+		return *dynamic_cast<MeshNode*>(full.getNodeByUniqueID(defaultG, node.getUniqueID()));
+	});
+	EXPECT_TRUE(custom.loadScene(handler.get(), errMsg));
+
+	auto node = dynamic_cast<MeshNode*>(custom.getNodeByUniqueID(defaultG, m->getUniqueID()));
+	custom.loadGeometry(node);
+	custom.loadGeometry(node); // Already loaded, so should not call the loader again
+	EXPECT_EQ(calls, 1);
+	EXPECT_EQ(node->getVertices(), m->getVertices());
+}
+
 TEST(RepoSceneTest, loadStash)
 {
 	auto handler = getHandler();
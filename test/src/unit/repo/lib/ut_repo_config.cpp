@@ -19,6 +19,8 @@
 #include <repo/lib/repo_config.h>
 #include <repo/lib/repo_exception.h>
 #include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
 
 #include "../../repo_test_database_info.h"
 
@@ -133,4 +135,69 @@ TEST(RepoConfigTest, validationTestFS)
 
 	config.configureFS(dummy, -1);
 	EXPECT_FALSE(config.validate());
+}
+
+TEST(RepoConfigTest, validationTestEmbedded)
+{
+	std::string dummy = "dummy";
+
+	// The embedded database does not need any server details, but must be
+	// configured explicitly
+
+	RepoConfig config("", "", "");
+	EXPECT_FALSE(config.validate());
+	EXPECT_FALSE(config.getDatabaseConfig().embedded);
+
+	config.configureEmbeddedDatabase(dummy);
+	EXPECT_TRUE(config.validate());
+	EXPECT_TRUE(config.getDatabaseConfig().embedded);
+	EXPECT_EQ(config.getDatabaseConfig().path, dummy);
+
+	config.configureEmbeddedDatabase("");
+	EXPECT_FALSE(config.validate());
+}
+
+TEST(RepoConfigTest, EmbeddedFromFile)
+{
+	auto path = std::filesystem::temp_directory_path() / ("config" + RepoUUID::createUUID().toString() + ".json");
+	auto fromJson = [&](const std::string& json) {
+		std::ofstream(path) << json;
+		return RepoConfig::fromFile(path.string());
+	};
+
+	auto config = fromJson(R"({ "db": { "engine": "embedded", "path": "databases" } })");
+	EXPECT_TRUE(config.getDatabaseConfig().embedded);
+	EXPECT_EQ(config.getDatabaseConfig().path, "databases");
+
+	config = fromJson(R"({ "db": { "engine": "mongo", "dbhost": "localhost", "dbport": 27017 } })");
+	EXPECT_FALSE(config.getDatabaseConfig().embedded);
+
+	// A path alone does not select the embedded database, so a config with both
+	// server details and a path cannot silently stop using the server
+
+	EXPECT_THROW(fromJson(R"({ "db": { "dbhost": "localhost", "dbport": 27017, "path": "databases" } })"), RepoException);
+	EXPECT_THROW(fromJson(R"({ "db": { "engine": "embedded" } })"), RepoException);
+	EXPECT_THROW(fromJson(R"({ "db": { "engine": "sqlite", "path": "databases" } })"), RepoException);
+
+	std::filesystem::remove(path);
+}
+
+TEST(RepoConfigTest, LegacyFacesFromFile)
+{
+	auto path = std::filesystem::temp_directory_path() / ("config" + RepoUUID::createUUID().toString() + ".json");
+	auto fromJson = [&](const std::string& json) {
+		std::ofstream(path) << json;
+		return RepoConfig::fromFile(path.string());
+	};
+
+	auto config = fromJson(R"({ "db": { "dbhost": "localhost", "dbport": 27017 } })");
+	EXPECT_FALSE(config.getLegacyFaces());
+
+	config = fromJson(R"({ "db": { "dbhost": "localhost", "dbport": 27017 }, "legacyFaces": true })");
+	EXPECT_TRUE(config.getLegacyFaces());
+
+	config.configureLegacyFaces(false);
+	EXPECT_FALSE(config.getLegacyFaces());
+
+	std::filesystem::remove(path);
 }
\ No newline at end of file
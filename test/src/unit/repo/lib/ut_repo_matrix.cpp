@@ -16,7 +16,9 @@
 */
 
 #include <cstdlib>
+#include <random>
 #include <repo/lib/datastructure/repo_matrix.h>
+#include <repo/lib/repo_exception.h>
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest-matchers.h>
@@ -480,4 +482,113 @@ TEST(RepoMatrixTest, AxisAngleRotation)
 	EXPECT_THAT(repo::lib::RepoMatrix::rotation(x, RAD(90)) * y, VectorNear(z));
 	EXPECT_THAT(repo::lib::RepoMatrix::rotation(x, RAD(90)) * x, VectorNear(x));
 	EXPECT_THAT(repo::lib::RepoMatrix::rotation(x, RAD(90)) * xy, VectorNear(xz));
+}
+
+static RepoMatrix makeTransform()
+{
+	return RepoMatrix::translate(RepoVector3D64(1000, -20, 3.5)) *
+		RepoMatrix::scale(RepoVector3D64(0.1, 2, 30)) *
+		RepoMatrix::rotationX(RAD(13)) *
+		RepoMatrix::rotationY(RAD(27)) *
+		RepoMatrix::rotationZ(RAD(41));
+}
+
+template<typename V>
+static std::vector<V> makeVectors(size_t count)
+{
+	std::mt19937 random(1);
+	std::uniform_real_distribution<double> distribution(-1000, 1000);
+	std::vector<V> vectors;
+	for (size_t i = 0; i < count; i++) {
+		vectors.push_back(V(distribution(random), distribution(random), distribution(random)));
+	}
+	return vectors;
+}
+
+TEST(RepoMatrixTest, TransformPoints)
+{
+	// The batch transforms should give the same results as the single vector
+	// versions, for all combinations of precision, and when transforming in place.
+	// An odd count makes sure any remainder is handled.
+
+	auto m = makeTransform();
+	auto vectors = makeVectors<RepoVector3D64>(1001);
+	auto vectors32 = makeVectors<RepoVector3D>(1001);
+
+	{
+		std::vector<RepoVector3D64> out(vectors.size());
+		m.transformPoints(vectors, out);
+		for (size_t i = 0; i < vectors.size(); i++) {
+			EXPECT_THAT(out[i], VectorNear(m * vectors[i], 1e-9));
+		}
+
+		auto inPlace = vectors;
+		m.transformPoints(inPlace, inPlace);
+		EXPECT_THAT(inPlace, Eq(out));
+	}
+
+	{
+		std::vector<RepoVector3D> out(vectors.size());
+		m.transformPoints(vectors, out);
+		for (size_t i = 0; i < vectors.size(); i++) {
+			EXPECT_THAT(out[i], VectorNear(RepoVector3D(m * vectors[i]), 1e-3));
+		}
+	}
+
+	{
+		std::vector<RepoVector3D64> out(vectors32.size());
+		m.transformPoints(vectors32, out);
+		for (size_t i = 0; i < vectors32.size(); i++) {
+			EXPECT_THAT(out[i], VectorNear(m * RepoVector3D64(vectors32[i]), 1e-9));
+		}
+	}
+
+	{
+		std::vector<RepoVector3D> out(vectors32.size());
+		m.transformPoints(vectors32, out);
+		for (size_t i = 0; i < vectors32.size(); i++) {
+			EXPECT_THAT(out[i], VectorNear(m * vectors32[i], 1e-3));
+		}
+
+		auto inPlace = vectors32;
+		m.transformPoints(inPlace, inPlace);
+		EXPECT_THAT(inPlace, Eq(out));
+	}
+
+	// The output must be large enough to hold the results
+
+	std::vector<RepoVector3D64> small(10);
+	EXPECT_THROW(m.transformPoints(vectors, small), repo::lib::RepoException);
+
+	// Empty arrays are allowed
+
+	std::vector<RepoVector3D64> empty;
+	EXPECT_NO_THROW(m.transformPoints(empty, empty));
+}
+
+TEST(RepoMatrixTest, TransformDirections)
+{
+	auto m = makeTransform();
+
+	{
+		auto vectors = makeVectors<RepoVector3D64>(1001);
+		std::vector<RepoVector3D64> out(vectors.size());
+		m.transformDirections(vectors, out);
+		for (size_t i = 0; i < vectors.size(); i++) {
+			EXPECT_THAT(out[i], VectorNear(m.transformDirection(vectors[i]), 1e-9));
+		}
+		m.transformDirections(vectors, vectors);
+		EXPECT_THAT(vectors, Eq(out));
+	}
+
+	{
+		auto vectors = makeVectors<RepoVector3D>(1001);
+		std::vector<RepoVector3D> out(vectors.size());
+		m.transformDirections(vectors, out);
+		for (size_t i = 0; i < vectors.size(); i++) {
+			EXPECT_THAT(out[i], VectorNear(m.transformDirection(vectors[i]), 1e-3));
+		}
+		m.transformDirections(vectors, vectors);
+		EXPECT_THAT(vectors, Eq(out));
+	}
 }
\ No newline at end of file
@@ -824,4 +824,110 @@ TEST(MultipartOptimizer, TestBranchGroupings)
 	EXPECT_THAT(supermeshMap["branchGroup2"].size(), testing::Eq(3)); // 1 meshnode, 2x "a" and 1 "c"
 	EXPECT_THAT(supermeshMap["branchGroup3"].size(), testing::Eq(1)); // 2 combined meshnodes
 	EXPECT_THAT(supermeshMap["branchGroup4"].size(), testing::Eq(3)); // 4 combined meshnodes, 2 "a" and 1 "b"
+}
+
+TEST(MultipartOptimizer, TestParallelDeterminism)
+{
+	// Processing the clusters concurrently, with or without a restrictive memory
+	// budget, should give exactly the same supermeshes in the same order as
+	// processing them one at a time.
+
+	auto handler = getHandler();
+	std::string database = DBMULTIPARTOPTIMIZERTEST;
+	std::string projectName = "TestParallelDeterminism";
+	auto revId = repo::lib::RepoUUID::createUUID();
+
+	auto sceneBuilder = repo::manipulator::modelutility::RepoSceneBuilder(handler, database, projectName, revId);
+
+	auto rootNode = repo::core::model::RepoBSONFactory::makeTransformationNode({}, "rootNode", {});
+	sceneBuilder.addNode(rootNode);
+	auto rootNodeId = rootNode.getSharedID();
+
+	// Each grouping is supermeshed separately, so will become at least one
+	// cluster each.
+
+	for (int i = 0; i < 20; i++) {
+		auto grouping = std::to_string(i % 10);
+		sceneBuilder.addNode(createRandomMesh(1000 + i * 100, false, i % 2 ? 2 : 3, grouping, { rootNodeId }));
+	}
+
+	sceneBuilder.finalise();
+
+	auto run = [&](int numThreads, size_t budget) {
+		auto exporter = std::make_unique<TestModelExport>(handler.get(), database, projectName, revId, std::vector<double>({ 0, 0, 0 }));
+		MultipartOptimizer opt(handler.get(), exporter.get());
+		opt.setNumThreads(numThreads);
+		if (budget) {
+			opt.setMemoryBudget(budget);
+		}
+		opt.processScene(database, projectName, revId);
+
+		EXPECT_TRUE(exporter->isFinalised());
+		EXPECT_TRUE(compareMeshes(database, projectName, revId, exporter.get()));
+
+		std::vector<std::vector<repo::lib::RepoUUID>> order;
+		for (auto& supermesh : exporter->getSupermeshes()) {
+			std::vector<repo::lib::RepoUUID> ids;
+			for (auto& mapping : supermesh.getMeshMapping()) {
+				ids.push_back(mapping.mesh_id);
+			}
+			order.push_back(ids);
+		}
+		return order;
+	};
+
+	auto expected = run(1, 0);
+	EXPECT_GE(expected.size(), 10);
+
+	EXPECT_EQ(run(8, 0), expected);
+	EXPECT_EQ(run(8, 1), expected); // Smaller than any one cluster
+	EXPECT_EQ(run(8, 1000 * REPO_MP_BYTES_PER_VERTEX * 3), expected);
+}
+
+TEST(MultipartOptimizer, TestSharedGeometry)
+{
+	// Nodes that share a blob range (see RepoSceneBuilder.SharedGeometry) should
+	// each still appear in the stash.
+
+	auto handler = getHandler();
+	std::string database = DBMULTIPARTOPTIMIZERTEST;
+	std::string projectName = "TestSharedGeometry";
+	auto revId = repo::lib::RepoUUID::createUUID();
+
+	auto sceneBuilder = repo::manipulator::modelutility::RepoSceneBuilder(handler, database, projectName, revId);
+
+	auto rootNode = repo::core::model::RepoBSONFactory::makeTransformationNode({}, "rootNode", {});
+	sceneBuilder.addNode(rootNode);
+	auto rootNodeId = rootNode.getSharedID();
+
+	auto instance = createRandomMesh(100, false, 3, "", { rootNodeId });
+	auto nInstances = 10;
+
+	for (int i = 0; i < nInstances; ++i) {
+		auto node = std::make_unique<repo::core::model::MeshNode>(*instance);
+		node->setUniqueID(repo::lib::RepoUUID::createUUID());
+		node->setSharedID(repo::lib::RepoUUID::createUUID());
+		sceneBuilder.addNode(std::move(node));
+	}
+
+	sceneBuilder.addNode(createRandomMesh(100, false, 3, "", { rootNodeId }));
+
+	sceneBuilder.finalise();
+
+	auto mockExporter = std::make_unique<TestModelExport>(handler.get(), database, projectName, revId, std::vector<double>({ 0, 0, 0 }));
+
+	MultipartOptimizer opt(handler.get(), mockExporter.get());
+	opt.processScene(
+		database,
+		projectName,
+		revId
+	);
+
+	EXPECT_TRUE(mockExporter->isFinalised());
+
+	EXPECT_TRUE(compareMeshes(
+		database,
+		projectName,
+		revId,
+		mockExporter.get()));
 }
\ No newline at end of file
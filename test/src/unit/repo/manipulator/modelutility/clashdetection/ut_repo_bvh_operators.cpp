@@ -19,8 +19,13 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest-matchers.h>
+#include <numeric>
+#include <algorithm>
 
 #include <repo/manipulator/modelutility/clashdetection/bvh_operators.h>
+#include <repo/manipulator/modelutility/clashdetection/bvh_wide.h>
+#include <repo/manipulator/modeloptimizer/bvh/sweep_sah_builder.hpp>
+#include <repo/manipulator/modeloptimizer/bvh/node_intersectors.hpp>
 #include <repo/manipulator/modelutility/clashdetection/geometry_tests.h>
 
 #include "../../../../repo_test_utils.h"
@@ -148,4 +153,201 @@ TEST(Bvh, Contacts)
 
 		EXPECT_THAT(bvh::predicates::contacts(a, a), IsTrue());
 	}
+}
+
+namespace {
+	/*
+	* Builds a binary Bvh over a set of random boxes. The offset moves them well
+	* away from the origin, as the wide layout must not lose precision when the
+	* geometry is far from it.
+	*/
+	Bvh createRandomBvh(RepoRandomGenerator& random, size_t count, double scale, double offset)
+	{
+		auto bounds = std::vector<bvh::BoundingBox<double>>();
+		auto centers = std::vector<bvh::Vector3<double>>();
+		for (size_t i = 0; i < count; i++) {
+			auto min = random.vector(repo::lib::RepoRange(0, 100 * scale));
+			auto size = random.number(repo::lib::RepoRange(0.1 * scale, 3 * scale));
+			bounds.push_back(bvh::BoundingBox<double>(
+				bvh::Vector3<double>(min.x + offset, min.y, min.z),
+				bvh::Vector3<double>(min.x + offset + size, min.y + size, min.z + size)
+			));
+			centers.push_back(bounds.back().center());
+		}
+
+		auto globalBounds = bvh::compute_bounding_boxes_union(bounds.data(), bounds.size());
+
+		Bvh bvh;
+		bvh::SweepSahBuilder<Bvh> builder(bvh);
+		builder.max_leaf_size = 1;
+		builder.build(globalBounds, bounds.data(), centers.data(), bounds.size());
+		return bvh;
+	}
+
+	using Pairs = std::vector<std::pair<size_t, size_t>>;
+
+	struct IntersectQuery : public bvh::IntersectQuery {
+		Pairs results;
+		bool intersect(size_t a, size_t b) override {
+			results.push_back({ std::min(a, b), std::max(a, b) });
+			return false;
+		}
+	};
+
+	struct DistanceQuery : public bvh::DistanceQuery {
+		Pairs results;
+		bool intersect(size_t a, size_t b) override {
+			results.push_back({ std::min(a, b), std::max(a, b) });
+			return false;
+		}
+	};
+
+	Pairs sorted(Pairs pairs)
+	{
+		std::sort(pairs.begin(), pairs.end());
+		return pairs;
+	}
+
+	/*
+	* The wide tests are conservative, so must find every pair the binary tree
+	* does, and only a handful more.
+	*/
+	void expectSuperset(const Pairs& wide, const Pairs& binary)
+	{
+		auto w = sorted(wide);
+		auto b = sorted(binary);
+		EXPECT_THAT(std::includes(w.begin(), w.end(), b.begin(), b.end()), IsTrue());
+		EXPECT_THAT(w.size() - b.size(), Le(b.size() / 100 + 1));
+	}
+
+	template<size_t N>
+	void testWideTraversal(RepoRandomGenerator& random, size_t count, double scale, double offset)
+	{
+		auto a = createRandomBvh(random, count, scale, offset);
+		auto b = createRandomBvh(random, count, scale, offset);
+
+		bvh::WideBvh<N> wa, wb;
+		bvh::builders::collapse(a, wa);
+		bvh::builders::collapse(b, wb);
+
+		{
+			IntersectQuery binary, wide;
+			binary(a, b);
+			wide(wa, wb);
+			expectSuperset(wide.results, binary.results);
+		}
+
+		{
+			IntersectQuery binary, wide;
+			binary(a);
+			wide(wa);
+			expectSuperset(wide.results, binary.results);
+		}
+
+		{
+			DistanceQuery binary, wide;
+			binary.d = scale;
+			wide.d = scale;
+			binary(a, b);
+			wide(wa, wb);
+			expectSuperset(wide.results, binary.results);
+		}
+
+		{
+			DistanceQuery binary, wide;
+			binary.d = scale;
+			wide.d = scale;
+			binary(a);
+			wide(wa);
+			expectSuperset(wide.results, binary.results);
+		}
+
+		// Rays should reach every leaf whose exact bounds they hit
+
+		for (int i = 0; i < 100; i++) {
+			auto o = random.vector(repo::lib::RepoRange(0, 100 * scale));
+			auto d = random.direction();
+			bvh::Vector3<double> origin(o.x + offset, o.y, o.z);
+			bvh::Vector3<double> direction(d.x, d.y, d.z);
+
+			std::vector<size_t> hits;
+			bvh::wide::traverse(wa, bvh::wide::Ray(wa, origin, direction), [&](size_t primitive) {
+				hits.push_back(primitive);
+				return false;
+			});
+			std::sort(hits.begin(), hits.end());
+
+			bvh::Ray<double> ray(origin, direction);
+			bvh::RobustNodeIntersector<Bvh> intersector(ray);
+			for (size_t n = 0; n < a.node_count; n++) {
+				auto& node = a.nodes[n];
+				auto [entry, exit] = intersector.intersect(node, ray);
+				if (node.is_leaf() && entry <= exit) {
+					auto primitive = a.primitive_indices[node.first_child_or_primitive];
+					EXPECT_THAT(std::binary_search(hits.begin(), hits.end(), primitive), IsTrue());
+				}
+			}
+		}
+	}
+}
+
+TEST(Bvh, WideTraversal)
+{
+	RepoRandomGenerator random;
+
+	for (auto count : { 1, 2, 5, 9, 100, 5000 }) {
+		testWideTraversal<4>(random, count, 1, 0);
+		testWideTraversal<8>(random, count, 1, 0);
+		testWideTraversal<4>(random, count, 0.001, 1e5);
+		testWideTraversal<8>(random, count, 0.001, 1e5);
+	}
+}
+
+TEST(Bvh, WideCollapse)
+{
+	RepoRandomGenerator random;
+
+	auto binary = createRandomBvh(random, 1000, 1, 1e5);
+
+	bvh::WideBvh8 wide;
+	bvh::builders::collapse(binary, wide);
+
+	// Every primitive should appear in exactly one leaf lane, and all the node
+	// bounds should enclose the exact bounds of the primitives beneath them.
+
+	std::vector<size_t> primitives;
+	for (auto& node : wide.nodes) {
+		for (size_t i = 0; i < 8; i++) {
+			for (size_t p = 0; p < node.count[i]; p++) {
+				primitives.push_back(wide.primitive_indices[node.first[i] + p]);
+			}
+		}
+	}
+	std::sort(primitives.begin(), primitives.end());
+	std::vector<size_t> expected(1000);
+	std::iota(expected.begin(), expected.end(), 0);
+	EXPECT_THAT(primitives, Eq(expected));
+
+	for (size_t n = 0; n < binary.node_count; n++) {
+		auto& node = binary.nodes[n];
+		if (!node.is_leaf()) {
+			continue;
+		}
+		bool found = false;
+		for (auto& w : wide.nodes) {
+			for (size_t i = 0; i < 8; i++) {
+				if (w.count[i] && w.first[i] == node.first_child_or_primitive) {
+					found = true;
+					for (int k = 0; k < 3; k++) {
+						EXPECT_THAT((double)w.min[k][i], Le(node.bounds[k * 2] - wide.origin[k]));
+						EXPECT_THAT((double)w.max[k][i], Ge(node.bounds[k * 2 + 1] - wide.origin[k]));
+					}
+				}
+			}
+		}
+		EXPECT_THAT(found, IsTrue());
+	}
+
+	EXPECT_THAT(wide.bounds.min[0], Eq(binary.nodes[0].bounds[0]));
+	EXPECT_THAT(wide.bounds.max[2], Eq(binary.nodes[0].bounds[5]));
 }
\ No newline at end of file
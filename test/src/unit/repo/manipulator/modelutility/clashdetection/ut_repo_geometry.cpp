@@ -20,6 +20,7 @@
 #include <gtest/gtest-matchers.h>
 
 #include <repo/manipulator/modelutility/clashdetection/geometry_tests.h>
+#include <repo/manipulator/modelutility/clashdetection/geometry_tests_batch.h>
 
 #include <repo/manipulator/modelutility/clashdetection/predicates.h>
 
@@ -1119,4 +1120,58 @@ TEST(Geometry, RayTriangleIntersects)
 			}
 		}
 	}
+}
+
+TEST(Geometry, TriangleSeparation)
+{
+	// The separation test returns a lower bound on the distance between two
+	// triangles, so must never exceed the distance found by closestPoints (less
+	// rounding error). The batched version must return exactly the same bounds
+	// as the single pair version, whichever instruction set it uses.
+
+	CellDistribution space;
+	ClashGenerator clashGenerator;
+
+	std::vector<double> distances = { 0, 1, 2, 100 };
+	for (auto d : distances) {
+		clashGenerator.distance = d;
+
+		geometry::TriangleBatch batchA;
+		geometry::TriangleBatch batchB;
+		std::vector<double> expected;
+
+		// An odd number, so the batch has a remainder that doesn't fill a vector
+
+		for (int i = 0; i < 100001; ++i) {
+			auto p = clashGenerator.createTrianglesTransformed(space.sample());
+			auto [a, b] = ClashGenerator::applyTransforms(p);
+
+			auto s = geometry::separation(a, b);
+			auto line = geometry::closestPoints(a, b);
+
+			EXPECT_THAT(s, Ge(0));
+			EXPECT_THAT(s, Le(line.magnitude() + geometry::contactThreshold(a, b)));
+
+			batchA.push_back(a);
+			batchB.push_back(b);
+			expected.push_back(s);
+		}
+
+		std::vector<double> results(batchA.size());
+		geometry::separation(batchA, batchB, results.data());
+		EXPECT_THAT(results, ElementsAreArray(expected));
+	}
+
+	// Triangles that are clearly apart should be separated by the bounds and
+	// plane tests.
+
+	repo::lib::RepoTriangle a(
+		repo::lib::RepoVector3D64(0, 0, 0),
+		repo::lib::RepoVector3D64(1, 0, 0),
+		repo::lib::RepoVector3D64(0, 1, 0)
+	);
+
+	EXPECT_THAT(geometry::separation(a, a + repo::lib::RepoVector3D64(10, 0, 0)), DoubleNear(9, 1e-9));
+	EXPECT_THAT(geometry::separation(a, a + repo::lib::RepoVector3D64(0, 0, 10)), DoubleNear(10, 1e-9));
+	EXPECT_THAT(geometry::separation(a, a + repo::lib::RepoVector3D64(0.5, 0.5, 0)), Eq(0));
 }
\ No newline at end of file
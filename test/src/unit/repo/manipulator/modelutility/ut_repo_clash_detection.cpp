@@ -21,6 +21,7 @@
 #include <numeric>
 #include <numbers>
 #include <random>
+#include <chrono>
 #include <exception>
 #include <repo_log.h>
 
@@ -53,6 +54,9 @@
 #include <repo/manipulator/modelutility/clashdetection/clash_exceptions.h>
 #include <repo/manipulator/modelutility/clashdetection/repo_deformdepth.h>
 #include <repo/manipulator/modelutility/clashdetection/clash_node_cache.h>
+#include <repo/manipulator/modelutility/clashdetection/clash_task_pool.h>
+#include <repo/manipulator/modelutility/clashdetection/clash_prefetcher.h>
+#include <repo/manipulator/modelutility/clashdetection/clash_broadphase.h>
 
 #include <repo/manipulator/modeloptimizer/bvh/bvh.hpp>
 #include <repo/manipulator/modeloptimizer/bvh/sweep_sah_builder.hpp>
@@ -496,6 +500,213 @@ TEST(Clash, Scheduler)
 	clash::ClashScheduler::schedule(broadphaseResults);
 
 	EXPECT_THAT(broadphaseResults, UnorderedElementsAreArray(copy));
+
+	// The result should be the same regardless of the number of threads
+
+	for (int threads : { 0, 4 }) {
+		auto threaded = copy;
+		clash::ClashScheduler::schedule(threaded, threads);
+		EXPECT_THAT(threaded, ElementsAreArray(broadphaseResults));
+	}
+}
+
+TEST(Clash, SchedulerComponents)
+{
+	// The scheduler should place each connected component of the graph
+	// contiguously, and when asked, return where each one starts, so that they
+	// can be processed independently.
+
+	// This graph is made of chains of random lengths, some with branches, so
+	// the number of components is known.
+
+	std::vector<std::pair<std::uintptr_t, std::uintptr_t>> broadphaseResults;
+
+	RepoRandomGenerator random;
+
+	std::uintptr_t node = 0;
+	size_t numComponents = 100;
+	for (size_t c = 0; c < numComponents; c++) {
+		auto start = node;
+		auto length = random.number(1, 50);
+		for (auto i = 0; i < length; i++) {
+			broadphaseResults.push_back({ node, node + 1 });
+			node++;
+		}
+		if (random.boolean()) {
+			broadphaseResults.push_back({ start, node });
+		}
+		node++;
+	}
+
+	std::shuffle(broadphaseResults.begin(), broadphaseResults.end(), std::mt19937(1));
+
+	auto copy = broadphaseResults;
+
+	std::vector<size_t> components;
+	clash::ClashScheduler::schedule(broadphaseResults, 4, &components);
+
+	EXPECT_THAT(broadphaseResults, UnorderedElementsAreArray(copy));
+	EXPECT_THAT(components.size(), Eq(numComponents));
+	EXPECT_THAT(components[0], Eq(0));
+
+	std::unordered_map<std::uintptr_t, size_t> nodeComponent;
+	for (size_t c = 0; c < components.size(); c++) {
+		auto end = c + 1 < components.size() ? components[c + 1] : broadphaseResults.size();
+		EXPECT_THAT(end, Gt(components[c]));
+		for (auto i = components[c]; i < end; i++) {
+			for (auto n : { broadphaseResults[i].first, broadphaseResults[i].second }) {
+				auto [it, inserted] = nodeComponent.insert({ n, c });
+				EXPECT_THAT(it->second, Eq(c));
+			}
+		}
+	}
+}
+
+TEST(Clash, SchedulerLargeGraph)
+{
+	// A large graph, where each node overlaps a few of its neighbours, as meshes
+	// laid out in a building would, and the neighbours are grouped into blocks
+	// that do not overlap each other, so the components are known. The scheduler
+	// should keep all the pairs, place each block contiguously, and give the same
+	// order regardless of the number of threads.
+	// The time this takes is measured by the scheduler benchmark instead.
+
+	std::vector<std::pair<std::uintptr_t, std::uintptr_t>> broadphaseResults;
+
+	std::mt19937_64 random(1);
+	size_t numBlocks = 500;
+	size_t blockSize = 200;
+	for (size_t block = 0; block < numBlocks; block++) {
+		auto first = block * blockSize;
+		for (size_t i = 0; i < blockSize - 1; i++) {
+			broadphaseResults.push_back({ first + i, first + i + 1 }); // Ensures the block is connected
+		}
+		for (size_t i = 0; i < blockSize * 2; i++) {
+			auto a = random() % blockSize;
+			auto b = (a + 1 + random() % 8) % blockSize;
+			broadphaseResults.push_back({ first + a, first + b });
+		}
+	}
+
+	std::shuffle(broadphaseResults.begin(), broadphaseResults.end(), std::mt19937(1));
+
+	auto copy = broadphaseResults;
+
+	std::vector<size_t> components;
+	clash::ClashScheduler::schedule(broadphaseResults, 1, &components);
+
+	auto sorted = broadphaseResults;
+	auto expected = copy;
+	std::sort(sorted.begin(), sorted.end());
+	std::sort(expected.begin(), expected.end());
+	EXPECT_THAT(sorted, Eq(expected));
+	ASSERT_THAT(components.size(), Eq(numBlocks));
+
+	std::set<size_t> blocks;
+	for (size_t c = 0; c < components.size(); c++) {
+		auto end = c + 1 < components.size() ? components[c + 1] : broadphaseResults.size();
+		auto block = broadphaseResults[components[c]].first / blockSize;
+		EXPECT_THAT(end - components[c], Eq(blockSize * 3 - 1));
+		for (auto i = components[c]; i < end; i++) {
+			EXPECT_THAT(broadphaseResults[i].first / blockSize, Eq(block));
+			EXPECT_THAT(broadphaseResults[i].second / blockSize, Eq(block));
+		}
+		blocks.insert(block);
+	}
+	EXPECT_THAT(blocks.size(), Eq(numBlocks));
+
+	for (int threads : { 0, 4 }) {
+		auto threaded = copy;
+		clash::ClashScheduler::schedule(threaded, threads);
+		EXPECT_THAT(threaded, Eq(broadphaseResults));
+	}
+}
+
+TEST(Clash, TaskPool)
+{
+	// The TaskPool should run every task exactly once, regardless of how they are
+	// distributed between the workers, and report this in its statistics.
+
+	using namespace repo::manipulator::modelutility::clash;
+
+	{
+		TaskPool<size_t> pool(4);
+		EXPECT_THAT(pool.numThreads(), Eq(4));
+
+		std::vector<size_t> tasks(1000);
+		std::iota(tasks.begin(), tasks.end(), 0);
+		pool.push(tasks);
+
+		std::mutex mutex;
+		std::vector<size_t> completed;
+
+		// The first parcel is much more expensive than the others, so the other
+		// workers should have to steal from it.
+
+		pool.run([&](size_t& task) {
+			if (task < 10) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+			std::scoped_lock lock(mutex);
+			completed.push_back(task);
+		});
+
+		std::vector<size_t> expected(1000);
+		std::iota(expected.begin(), expected.end(), 0);
+		EXPECT_THAT(completed, UnorderedElementsAreArray(expected));
+
+		auto statistics = pool.getStatistics();
+		EXPECT_THAT(statistics.size(), Eq(4));
+
+		size_t tasksRun = 0;
+		size_t steals = 0;
+		for (auto& s : statistics) {
+			tasksRun += s.tasks;
+			steals += s.steals;
+			EXPECT_THAT(s.busy, Ge(0));
+			EXPECT_THAT(s.idle, Ge(0));
+		}
+		EXPECT_THAT(tasksRun, Eq(1000));
+		EXPECT_THAT(steals, Gt(0));
+	}
+
+	{
+		// Fewer tasks than workers, and no tasks at all, should both complete
+
+		TaskPool<size_t> pool(8);
+		std::vector<size_t> tasks = { 1 };
+		pool.push(tasks);
+		std::atomic<size_t> count = 0;
+		pool.run([&](size_t&) { count++; });
+		EXPECT_THAT(count, Eq(1));
+
+		TaskPool<size_t> empty(8);
+		std::vector<size_t> none;
+		empty.push(none);
+		empty.run([&](size_t&) { count++; });
+		EXPECT_THAT(count, Eq(1));
+	}
+
+	{
+		// Exceptions thrown by tasks should be rethrown on the calling thread
+
+		TaskPool<size_t> pool(3);
+		std::vector<size_t> tasks(100);
+		std::iota(tasks.begin(), tasks.end(), 0);
+		pool.push(tasks);
+
+		EXPECT_THROW({
+			pool.run([&](size_t& task) {
+				if (task == 50) {
+					throw DegenerateTestException(
+						repo::lib::RepoUUID::createUUID(),
+						repo::lib::RepoUUID::createUUID(),
+						"Task failed"
+					);
+				}
+			});
+		}, DegenerateTestException);
+	}
 }
 
 /*
@@ -1677,6 +1888,109 @@ TEST(Clash, BvhTraversal)
 	));
 }
 
+TEST(Clash, BvhParallelTraversal)
+{
+	// Checks that the Tasks from splitting a traversal find the same pairs as the
+	// full traversal, and that the ParallelBroadphase and sortUnique merge them
+	// correctly.
+
+	using namespace repo::manipulator::modelutility::clash;
+
+	RepoRandomGenerator random;
+
+	auto makeBvh = [&](size_t count) {
+		auto bounds = std::vector<bvh::BoundingBox<double>>();
+		auto centers = std::vector<bvh::Vector3<double>>();
+		for (size_t i = 0; i < count; i++) {
+			auto min = random.vector(repo::lib::RepoRange(0, 100));
+			auto size = random.number(repo::lib::RepoRange(0.1, 3));
+			bounds.push_back(bvh::BoundingBox<double>(
+				bvh::Vector3<double>(min.x, min.y, min.z),
+				bvh::Vector3<double>(min.x + size, min.y + size, min.z + size)
+			));
+			centers.push_back(bounds.back().center());
+		}
+
+		auto globalBounds = bvh::compute_bounding_boxes_union(bounds.data(), bounds.size());
+
+		bvh::Bvh<double> bvh;
+		bvh::SweepSahBuilder<bvh::Bvh<double>> builder(bvh);
+		builder.max_leaf_size = 1;
+		builder.build(globalBounds, bounds.data(), centers.data(), bounds.size());
+		return bvh;
+	};
+
+	using Pair = std::pair<size_t, size_t>;
+
+	struct IntersectQuery : public bvh::IntersectQuery {
+		BroadphaseResults results;
+
+		bool intersect(size_t a, size_t b) override {
+			results.push_back({ a, b });
+			return false;
+		}
+	};
+
+	auto ordered = [](std::vector<Pair> pairs, bool symmetric) {
+		if (symmetric) {
+			for (auto& [a, b] : pairs) {
+				if (b < a) {
+					std::swap(a, b);
+				}
+			}
+		}
+		std::sort(pairs.begin(), pairs.end());
+		return pairs;
+	};
+
+	for (auto count : { 1, 2, 3, 50, 5000 }) {
+		auto a = makeBvh(count);
+		auto b = makeBvh(count);
+
+		IntersectQuery inter;
+		inter(a, b);
+		auto expectedInter = ordered(inter.results, false);
+
+		IntersectQuery intra;
+		intra(a);
+		auto expectedIntra = ordered(intra.results, true);
+
+		// Run the Tasks one at a time
+
+		IntersectQuery tasks;
+		for (auto& task : tasks.split(a, b, 16)) {
+			tasks(a, b, task);
+		}
+		EXPECT_THAT(ordered(tasks.results, false), Eq(expectedInter));
+
+		tasks.results.clear();
+		for (auto& task : tasks.split(a, 16)) {
+			tasks(a, a, task);
+		}
+		EXPECT_THAT(ordered(tasks.results, true), Eq(expectedIntra));
+
+		// And concurrently. Adding the intra traversal twice ensures sortUnique has
+		// duplicates to remove.
+
+		ParallelBroadphase<IntersectQuery, Pair> broadphase(
+			[]() { return IntersectQuery(); },
+			4
+		);
+
+		broadphase.add(a, b, [](size_t a, size_t b, std::vector<Pair>& results) {
+			results.push_back({ a, b });
+		});
+		EXPECT_THAT(sortUnique(broadphase.run(), 4), Eq(expectedInter));
+
+		auto symmetric = [](size_t a, size_t b, std::vector<Pair>& results) {
+			results.push_back({ std::min(a, b), std::max(a, b) });
+		};
+		broadphase.add(a, symmetric);
+		broadphase.add(a, symmetric);
+		EXPECT_THAT(sortUnique(broadphase.run(), 4), Eq(expectedIntra));
+	}
+}
+
 TEST(Clash, RepoDeformDepthDb)
 {
 	// Tests the penetration depth estimation (DeformDepth) of the geometry utils
@@ -1837,6 +2151,58 @@ TEST(Clash, RepoDeformDepthDegenerateGeometry)
 	}
 }
 
+TEST(Clash, RepoDeformDepthParallel)
+{
+	// DeformDepth can split its search between threads for large pairs. This
+	// should never change the result, whichever stage of the search resolves
+	// (or fails to resolve) the clash.
+
+	using repo::lib::RepoMatrix;
+	using repo::lib::RepoVector3D64;
+
+	// Each MeshNode becomes its own face group, so the tests cover multiple
+	// group pairs as well as splitting the traversals within the groups.
+
+	auto build = [](geometry::RepoDeformDepth::Mesh& mesh, std::vector<repo::core::model::MeshNode> nodes) {
+		for (auto& node : nodes) {
+			auto start = mesh.faces.size();
+			auto offset = mesh.vertices.size();
+			for (const auto& v : node.getVertices()) {
+				mesh.vertices.push_back(v);
+			}
+			for (const auto& f : node.getFaces()) {
+				mesh.faces.push_back(repo::lib::repo_face_t({
+					f[0] + offset,
+					f[1] + offset,
+					f[2] + offset
+				}));
+			}
+			mesh.addFaceRange(start, mesh.faces.size());
+		}
+		mesh.initialise();
+	};
+
+	for (auto x : { 0.0, 0.3, 0.45, 0.55, 0.95, 1.2 }) {
+		for (auto tolerance : { 0.0, 0.05, 0.2, 0.6 }) {
+			auto sphere1 = repo::test::utils::mesh::makeUnitSphere();
+			auto sphere2 = repo::test::utils::mesh::makeUnitSphere();
+			sphere1.applyTransformation(RepoMatrix::translate(RepoVector3D64(x, 0, 0)));
+			sphere2.applyTransformation(RepoMatrix::translate(RepoVector3D64(x, 0, 1.5)));
+
+			geometry::RepoDeformDepth::Mesh a;
+			build(a, { sphere1, sphere2 });
+
+			geometry::RepoDeformDepth::Mesh b;
+			build(b, { repo::test::utils::mesh::makeUnitSphere() });
+
+			geometry::RepoDeformDepth serial(a, b, tolerance, 1);
+			geometry::RepoDeformDepth parallel(a, b, tolerance, 4);
+
+			EXPECT_THAT(parallel.getPenetrationDepth(), Eq(serial.getPenetrationDepth()));
+		}
+	}
+}
+
 TEST(Clash, DeformDepthIsIdempotent)
 {
 	// Test that clashing the same meshes multiple times does not change the result.
@@ -1945,130 +2311,615 @@ TEST(Clash, HardE2E)
 	}
 }
 
-TEST(Clash, HardTolerance) 
+/*
+* Maps the clashes by the ids of their Composite Objects to their fingerprints,
+* so the results of runs with different settings can be compared.
+*/
+using ClashMap = std::map<std::pair<std::string, std::string>, size_t>;
+
+static ClashMap toMap(const std::vector<ClashDetectionResult>& clashes)
 {
-	// Tolerance in hard mode means to accept clashes that can be resolved by
-	// a translation less than the tolerance...
+	ClashMap map;
+	for (auto& c : clashes) {
+		map[{c.idA, c.idB}] = c.fingerprint;
+	}
+	return map;
+}
 
-	auto cube = repo::test::utils::mesh::makeUnitCube();
-	auto cone = repo::test::utils::mesh::makeUnitCone();
+static ClashMap toMap(const ClashDetectionReport& report)
+{
+	return toMap(report.clashes);
+}
 
-	// This line moves the cone so that it overlaps the box by 0.1 units.
+// The number of narrowphase tests actually run by the workers
 
-	auto t = repo::lib::RepoMatrix::translate(repo::lib::RepoVector3D64(0, 0, 0.9));
+static size_t countTasks(const ClashDetectionReport& report)
+{
+	size_t count = 0;
+	for (auto& t : report.statistics.narrowphaseThreads) {
+		count += t.tasks;
+	}
+	return count;
+}
 
-	// Validate the test data...
-	{
-		auto a = ClashGenerator::triangles(cube);
-		auto b = ClashGenerator::triangles(cone);
-		ClashGenerator::applyTransforms(b, t);
-		EXPECT_THAT(intersects(a, b), IsTrue());
+static std::unique_ptr<clash::Pipeline> createPipeline(
+	std::shared_ptr<repo::core::handler::AbstractDatabaseHandler> handler,
+	const ClashDetectionConfig& config)
+{
+	if (config.type == ClashDetectionType::Hard) {
+		return std::make_unique<clash::Hard>(handler, config);
+	}
+	else {
+		return std::make_unique<clash::Clearance>(handler, config);
 	}
+}
 
+/*
+* A scene of generated Composite Object pairs, one from each of set A & B, for
+* tests that compare the results of the pipelines under different settings.
+* Hard soups are spread so that some pairs are apart, and the transformed
+* triangles give pairs that only clash within a Clearance tolerance.
+*/
+struct GeneratedClashScene
+{
+	std::shared_ptr<MockDatabase> db;
 	ClashDetectionConfigHelper config;
-	config.type = ClashDetectionType::Hard;
-	MockClashScene scene(config.getRevision());
 
-	TransformMeshes problem = { { cube, {} }, { cone, t } };
-	scene.add(problem, config);
+	GeneratedClashScene(int numHardSoups, int numTriangles):
+		db(std::make_shared<MockDatabase>())
+	{
+		ClashGenerator clashGenerator;
+		CellDistribution space;
+		MockClashScene scene(config.getRevision());
 
-	auto db = std::make_shared<MockDatabase>();
-	db->setDocuments(scene.bsons);
+		clashGenerator.distance = { 0.1, 4 };
+		for (int j = 0; j < numHardSoups; j++) {
+			scene.add(clashGenerator.createHardSoup(space.sample()), config);
+		}
+
+		clashGenerator.distance = 0.5;
+		for (int j = 0; j < numTriangles; j++) {
+			scene.add(clashGenerator.createTrianglesTransformed(space.sample()), config);
+		}
+
+		db->setDocuments(scene.bsons);
+	}
 
+	std::unique_ptr<clash::Pipeline> createPipeline() const
 	{
-		config.tolerance = 0.0;
-		clash::Hard pipeline(db, config);
-		auto results = pipeline.runPipeline();
-		EXPECT_THAT(results.clashes.size(), Eq(1));
+		return ::createPipeline(db, config);
 	}
 
+	ClashDetectionReport run() const
 	{
-		config.tolerance = 0.2;
-		clash::Hard pipeline(db, config);
-		auto results = pipeline.runPipeline();
-		EXPECT_THAT(results.clashes.size(), Eq(0));
+		return createPipeline()->runPipeline();
 	}
-}
+};
 
-TEST(Clash, NodeCache)
+TEST(Clash, Prefetch)
 {
-	static size_t nodeCount = 0;
+	// The prefetch stage should only change when meshes are loaded, never the
+	// results, regardless of the budget or number of threads.
 
-	struct Node {
+	GeneratedClashScene generated(50, 50);
+	auto& config = generated.config;
 
-		size_t i;
+	for (auto type : { ClashDetectionType::Hard, ClashDetectionType::Clearance }) {
+		config.type = type;
+		config.tolerance = 1.0;
 
-		Node() {
-			nodeCount++;
-		}
+		config.numPrefetchThreads = 0;
+		auto expected = generated.run();
 
-		~Node() {
-			nodeCount--;
+		EXPECT_THAT(expected.clashes.size(), Gt(0));
+
+		for (size_t budget : { (size_t)1, (size_t)1024 * 1024 * 1024 }) {
+			for (int threads : { 1, 4 }) {
+				config.prefetchMemory = budget;
+				config.numPrefetchThreads = threads;
+				EXPECT_THAT(toMap(generated.run()), Eq(toMap(expected)));
+			}
 		}
-	};
+	}
+}
 
-	// Cache expects to be keyed by objects (specifically, their addresses)
+TEST(Clash, SceneGraphThreads)
+{
+	// The scene graphs of all sets are loaded together, one container at a
+	// time on each thread. The results should not depend on the number of
+	// threads, and identical containers should only be loaded once, however
+	// they are referenced.
+
+	GeneratedClashScene generated(50, 0);
+	auto& config = generated.config;
+
+	auto copy = std::make_unique<repo::lib::Container>(*config.containers[0]);
+	for (size_t i = 0; i < config.setB.size(); i += 2) {
+		for (auto& mesh : config.setB[i].meshes) {
+			mesh.container = copy.get();
+		}
+	}
+	config.containers.push_back(std::move(copy));
 
-	struct K {
-		size_t i;
-	};
+	config.type = ClashDetectionType::Hard;
+	config.tolerance = 1.0;
 
-	std::vector<K> keys;
+	config.numThreads = 1;
+	auto expected = generated.run();
+	EXPECT_THAT(expected.clashes.size(), Gt(0));
+	EXPECT_THAT(expected.statistics.sceneGraph.containers, Eq(1));
 
-	for (size_t i = 0; i < 10; i++) {
-		keys.push_back(K{i});
+	for (int threads : { 0, 4 }) {
+		config.numThreads = threads;
+		auto results = generated.run();
+		EXPECT_THAT(toMap(results), Eq(toMap(expected)));
+		EXPECT_THAT(results.statistics.sceneGraph.containers, Eq(1));
 	}
+}
 
-	struct Cache : public repo::manipulator::modelutility::clash::ResourceCache<K, Node>
-	{
-		void initialise(const K& key, Node* node) const override {
-			node->i = key.i;
+TEST(Clash, Incremental)
+{
+	// An incremental run should return the same results as a full run, but only
+	// test the pairs where one or both Composite Objects have changed.
+
+	GeneratedClashScene generated(50, 50);
+	auto& config = generated.config;
+
+	auto run = [&](const ClashDetectionReport* previous) {
+		auto pipeline = generated.createPipeline();
+		if (previous) {
+			pipeline->setPreviousReport(*previous);
 		}
+		return pipeline->runPipeline();
 	};
 
-	EXPECT_THROW({
-		{
-			Cache cache;
-			std::vector<Cache::Record*> records;
-			for(auto& key : keys) {
-				records.push_back(cache.get(key));
-			}
+	for (auto type : { ClashDetectionType::Hard, ClashDetectionType::Clearance }) {
+		config.type = type;
+		config.tolerance = 1.0;
+		config.previousRevisions.clear();
 
-			EXPECT_THAT(nodeCount, Eq(keys.size()));
-		} // The expected exception will be thrown on exiting this inner scope, when cache is destroyed
-	}, std::runtime_error);
+		auto full = run(nullptr);
+		EXPECT_THAT(full.clashes.size(), Gt(0));
+		EXPECT_THAT(full.statistics.reusedPairs, Eq(0));
 
-	nodeCount = 0;
+		// The previous report should survive being written out and read back in
 
-	{
-		// Cache is cleaned up properly, but without using auto collection
+		std::stringstream stream;
+		ClashDetectionEngineUtils::writeJson(full, stream);
+		ClashDetectionReport previous;
+		EXPECT_TRUE(ClashDetectionEngineUtils::readJson(stream, previous));
+		EXPECT_THAT(previous.settings, Eq(full.settings));
+		EXPECT_THAT(previous.composites, Eq(full.composites));
 
-		Cache cache;
-		std::vector<Cache::Record*> records;
-		for (auto& key : keys) {
-			records.push_back(cache.get(key));
-		}
+		// Nothing has changed, so nothing should be tested
 
-		EXPECT_THAT(nodeCount, Eq(keys.size()));
+		auto incremental = run(&previous);
+		EXPECT_THAT(toMap(incremental), Eq(toMap(full)));
+		EXPECT_THAT(incremental.statistics.reusedPairs, Gt(0));
+		EXPECT_THAT(countTasks(incremental), Eq(0));
 
-		for (auto& key : keys) {
-			cache.release(key);
-		}
+		// Changing the tolerance invalidates all previous results
 
-		EXPECT_THAT(nodeCount, Eq(0));
-	}
+		config.tolerance = 0.5;
+		auto tolerance = run(&previous);
+		EXPECT_THAT(toMap(tolerance), Eq(toMap(run(nullptr))));
+		EXPECT_THAT(tolerance.statistics.reusedPairs, Eq(0));
+		config.tolerance = 1.0;
 
-	{
-		// Getting a record a second time returns the same pointer
+		// As does a change in revision of the container
 
-		Cache cache;
-		std::vector<Cache::Record*> records;
-		for (auto& key : keys) {
-			records.push_back(cache.get(key));
-		}
+		config.previousRevisions[config.containers[0].get()] = repo::lib::RepoUUID::createUUID();
+		EXPECT_THAT(run(&previous).statistics.reusedPairs, Eq(0));
+		config.previousRevisions[config.containers[0].get()] = config.getRevision();
+		EXPECT_THAT(run(&previous).statistics.reusedPairs, Gt(0));
 
-		for (size_t itr = 0; itr < 3; itr++) {
-			for (size_t i = 0; i < keys.size(); i++) {
+		// Swapping the meshes between two objects changes both, so any pairs they
+		// are part of should be tested again, and the rest reused.
+
+		std::swap(config.setA[0].meshes, config.setA[1].meshes);
+
+		auto expected = run(nullptr);
+		auto changed = run(&previous);
+		EXPECT_THAT(toMap(changed), Eq(toMap(expected)));
+		EXPECT_THAT(changed.statistics.reusedPairs, Gt(0));
+		EXPECT_THAT(changed.statistics.reusedPairs, Lt(incremental.statistics.reusedPairs));
+		EXPECT_THAT(countTasks(changed), Gt(0));
+
+		std::swap(config.setA[0].meshes, config.setA[1].meshes);
+	}
+}
+
+TEST(Clash, IncrementalMalformedPrevious)
+{
+	// Previous results that are malformed, or written by an older version,
+	// should be rejected without changing the report, and the engine should
+	// fall back to testing all pairs.
+
+	auto read = [](const std::string& json) {
+		std::stringstream stream(json);
+		ClashDetectionReport report;
+		auto success = ClashDetectionEngineUtils::readJson(stream, report);
+		EXPECT_THAT(report.clashes.size(), Eq(success ? 1 : 0));
+		EXPECT_THAT(report.composites.size(), Eq(success ? 1 : 0));
+		return success;
+	};
+
+	auto makeJson = [](const std::string& composite, const std::string& clash) {
+		return "{\"settings\":\"1\",\"composites\":{\"c\":" + composite + "},\"clashes\":[" + clash + "]}";
+	};
+
+	const std::string composite = "\"2\"";
+	const std::string clash = "{\"a\":\"x\",\"b\":\"y\",\"positions\":[[0,1,2]],\"fingerprint\":\"3\"}";
+
+	EXPECT_TRUE(read(makeJson(composite, clash)));
+
+	EXPECT_FALSE(read("{\"clashes\":[]}"));
+	EXPECT_FALSE(read("{\"settings\":\"x\",\"composites\":{},\"clashes\":[]}"));
+	EXPECT_FALSE(read(makeJson("2", clash)));
+	EXPECT_FALSE(read(makeJson(composite, "1")));
+	EXPECT_FALSE(read(makeJson(composite, "{\"b\":\"y\",\"positions\":[],\"fingerprint\":\"3\"}")));
+	EXPECT_FALSE(read(makeJson(composite, "{\"a\":1,\"b\":\"y\",\"positions\":[],\"fingerprint\":\"3\"}")));
+	EXPECT_FALSE(read(makeJson(composite, "{\"a\":\"x\",\"b\":\"y\",\"positions\":{},\"fingerprint\":\"3\"}")));
+	EXPECT_FALSE(read(makeJson(composite, "{\"a\":\"x\",\"b\":\"y\",\"positions\":[[0,1]],\"fingerprint\":\"3\"}")));
+	EXPECT_FALSE(read(makeJson(composite, "{\"a\":\"x\",\"b\":\"y\",\"positions\":[[0,\"1\",2]],\"fingerprint\":\"3\"}")));
+	EXPECT_FALSE(read(makeJson(composite, "{\"a\":\"x\",\"b\":\"y\",\"positions\":[],\"fingerprint\":3}")));
+	EXPECT_FALSE(read(makeJson(composite, "{\"a\":\"x\",\"b\":\"y\",\"positions\":[],\"fingerprint\":\"z\"}")));
+
+	GeneratedClashScene generated(50, 0);
+	auto& config = generated.config;
+	config.type = ClashDetectionType::Hard;
+	config.tolerance = 1.0;
+
+	config.previousResultsFile = getDataPath("clash/tmp_malformed_previous.json");
+	{
+		std::ofstream file(config.previousResultsFile);
+		file << makeJson(composite, "{\"a\":1}");
+	}
+
+	ClashDetectionEngine engine(generated.db);
+	auto results = engine.runClashDetection(config);
+	EXPECT_THAT(results.errors.size(), Eq(0));
+	EXPECT_THAT(results.statistics.reusedPairs, Eq(0));
+	EXPECT_THAT(toMap(results), Eq(toMap(generated.run())));
+}
+
+TEST(Clash, StreamingResults)
+{
+	// When a sink is given, clashes should be passed to it as they are finalised
+	// instead of being held in the report, and the streamed file should read
+	// back as the same results.
+
+	GeneratedClashScene generated(50, 50);
+	auto& config = generated.config;
+
+	auto run = [&](ClashResultsSink* sink) {
+		auto pipeline = generated.createPipeline();
+		pipeline->setSink(sink);
+		return pipeline->runPipeline();
+	};
+
+	struct Collector : public ClashResultsSink
+	{
+		std::mutex mutex;
+		std::vector<ClashDetectionResult> clashes;
+
+		void write(const ClashDetectionResult& result) override {
+			std::scoped_lock lock(mutex);
+			clashes.push_back(result);
+		}
+	};
+
+	auto filename = getDataPath("clash/tmp_results_stream.json");
+
+	for (auto type : { ClashDetectionType::Hard, ClashDetectionType::Clearance }) {
+		config.type = type;
+		config.tolerance = 1.0;
+
+		auto expected = run(nullptr);
+		EXPECT_THAT(expected.clashes.size(), Gt(0));
+
+		Collector collector;
+		auto streamed = run(&collector);
+		EXPECT_THAT(streamed.clashes.size(), Eq(0));
+		EXPECT_THAT(collector.clashes.size(), Eq(expected.clashes.size()));
+		EXPECT_THAT(toMap(collector.clashes), Eq(toMap(expected.clashes)));
+
+		{
+			ClashDetectionJsonWriter writer(filename);
+			auto report = run(&writer);
+			writer.finish(report);
+		}
+
+		ClashDetectionReport read;
+		EXPECT_TRUE(ClashDetectionEngineUtils::readJson(filename, read));
+		EXPECT_THAT(toMap(read.clashes), Eq(toMap(expected.clashes)));
+	}
+
+	// A writer that is finished without any clashes should still produce a
+	// valid, empty, report.
+
+	{
+		ClashDetectionJsonWriter writer(filename);
+		writer.finish(ClashDetectionReport());
+	}
+
+	ClashDetectionReport empty;
+	EXPECT_TRUE(ClashDetectionEngineUtils::readJson(filename, empty));
+	EXPECT_THAT(empty.clashes.size(), Eq(0));
+
+	// If the run fails, the clashes already streamed are discarded and the file
+	// holds only the errors (as with writeJson, the clashes array is empty).
+
+	{
+		ClashDetectionJsonWriter writer(filename);
+		ClashDetectionResult result;
+		result.idA = repo::lib::RepoUUID::createUUID().toString();
+		result.idB = repo::lib::RepoUUID::createUUID().toString();
+		writer.write(result);
+
+		ClashDetectionReport report;
+		report.errors.push_back(
+			std::make_shared<clash::DegenerateTestException>(
+				repo::lib::RepoUUID::createUUID(),
+				repo::lib::RepoUUID::createUUID(),
+				"Degenerate Test Reason"
+			)
+		);
+		writer.finish(report);
+	}
+
+	std::ifstream file(filename);
+	std::stringstream buffer;
+	buffer << file.rdbuf();
+
+	rapidjson::Document document;
+	document.Parse(buffer.str().c_str());
+	EXPECT_FALSE(document.HasParseError());
+	EXPECT_TRUE(document.HasMember("errors"));
+	EXPECT_TRUE(document["clashes"].IsArray());
+	EXPECT_THAT(document["clashes"].Size(), Eq(0));
+}
+
+TEST(Clash, StageStatistics)
+{
+	// Each run should report how long each stage took, how many pairs passed
+	// between them, and how much geometry was loaded. While running, progress
+	// should be reported periodically to the progress sink, finishing with a
+	// complete report.
+
+	GeneratedClashScene generated(50, 0);
+	auto& config = generated.config;
+
+	struct Recorder : public ClashProgressSink
+	{
+		std::mutex mutex;
+		std::vector<ClashDetectionProgress> reports;
+
+		void progress(const ClashDetectionProgress& progress) override {
+			std::scoped_lock lock(mutex);
+			reports.push_back(progress);
+		}
+	};
+
+	config.progressInterval = 0.001;
+
+	for (auto type : { ClashDetectionType::Hard, ClashDetectionType::Clearance }) {
+		config.type = type;
+		config.tolerance = 1.0;
+
+		auto pipeline = generated.createPipeline();
+
+		Recorder recorder;
+		pipeline->setProgressSink(&recorder);
+		auto report = pipeline->runPipeline();
+		auto& statistics = report.statistics;
+
+		EXPECT_THAT(report.clashes.size(), Gt(0));
+
+		using Stage = ClashDetectionStatistics::Stage;
+		for (auto stage : std::initializer_list<const Stage*>{ &statistics.sceneGraph, &statistics.validation, &statistics.broadphase, &statistics.scheduling, &statistics.narrowphase }) {
+			EXPECT_THAT(stage->time, Ge(0));
+			EXPECT_THAT(stage->cpu, Ge(0));
+		}
+		EXPECT_THAT(statistics.narrowphase.time, Gt(0));
+
+		auto tasks = countTasks(report);
+
+		EXPECT_THAT(statistics.pairs.broadphase, Ge(statistics.pairs.narrowphase));
+		EXPECT_THAT(statistics.pairs.narrowphase, Eq(tasks));
+		EXPECT_THAT(statistics.pairs.clashes, Eq(report.clashes.size()));
+
+		EXPECT_THAT(statistics.geometry.meshes, Gt(0));
+		EXPECT_THAT(statistics.geometry.bytes, Gt(0));
+		EXPECT_THAT(statistics.peakMemory, Gt(0));
+
+		ASSERT_THAT(recorder.reports.size(), Gt(0));
+		auto& last = recorder.reports.back();
+		EXPECT_THAT(last.stage, Eq("complete"));
+		EXPECT_THAT(last.completed, Eq(tasks));
+		EXPECT_THAT(last.total, Eq(tasks));
+
+		// Progress reports should also be readable as json, since this is how
+		// they appear in the log by default.
+
+		rapidjson::Document document;
+		document.Parse(ClashDetectionEngineUtils::toJson(last).c_str());
+		EXPECT_FALSE(document.HasParseError());
+		EXPECT_TRUE(document.HasMember("stage"));
+	}
+}
+
+TEST(Clash, MeshStore)
+{
+	// When the mesh store is enabled, the structures built for each mesh should
+	// be written to the file store, and read back by later runs, which should
+	// give the same results as building them again.
+
+	auto handler = getHandler();
+	ClashDetectionDatabaseHelper helper(handler);
+
+	auto c = helper.getContainerByName("cubes_self");
+
+	auto set = {
+		helper.createCompositeObject(c.get(), "Cube1"),
+		helper.createCompositeObject(c.get(), "Cube2"),
+		helper.createCompositeObject(c.get(), "Cube3"),
+		helper.createCompositeObject(c.get(), "Cube4"),
+		helper.createCompositeObject(c.get(), "Cube5"),
+		helper.createCompositeObject(c.get(), "Cube6"),
+		helper.createCompositeObject(c.get(), "Cube7")
+	};
+
+	ClashDetectionConfig config;
+	config.setA.insert(config.setA.end(), set.begin(), set.end());
+	config.selfIntersectsA = true;
+	config.tolerance = 1;
+	config.type = ClashDetectionType::Clearance;
+
+	auto expected = clash::Clearance(handler, config).runPipeline();
+	EXPECT_THAT(expected.statistics.meshStore.hits + expected.statistics.meshStore.misses, Eq(0));
+
+	config.meshStore = true;
+
+	// The records may already exist from a previous execution of this test, so
+	// the first run may have any combination of hits and misses, but the second
+	// must read everything from the store.
+
+	auto first = clash::Clearance(handler, config).runPipeline();
+	auto meshes = first.statistics.meshStore.hits + first.statistics.meshStore.misses;
+	EXPECT_THAT(meshes, Gt(0));
+	EXPECT_THAT(toMap(first), Eq(toMap(expected)));
+
+	auto second = clash::Clearance(handler, config).runPipeline();
+	EXPECT_THAT(second.statistics.meshStore.hits, Eq(meshes));
+	EXPECT_THAT(second.statistics.meshStore.misses, Eq(0));
+	EXPECT_THAT(toMap(second), Eq(toMap(expected)));
+}
+
+TEST(Clash, HardTolerance) 
+{
+	// Tolerance in hard mode means to accept clashes that can be resolved by
+	// a translation less than the tolerance...
+
+	auto cube = repo::test::utils::mesh::makeUnitCube();
+	auto cone = repo::test::utils::mesh::makeUnitCone();
+
+	// This line moves the cone so that it overlaps the box by 0.1 units.
+
+	auto t = repo::lib::RepoMatrix::translate(repo::lib::RepoVector3D64(0, 0, 0.9));
+
+	// Validate the test data...
+	{
+		auto a = ClashGenerator::triangles(cube);
+		auto b = ClashGenerator::triangles(cone);
+		ClashGenerator::applyTransforms(b, t);
+		EXPECT_THAT(intersects(a, b), IsTrue());
+	}
+
+	ClashDetectionConfigHelper config;
+	config.type = ClashDetectionType::Hard;
+	MockClashScene scene(config.getRevision());
+
+	TransformMeshes problem = { { cube, {} }, { cone, t } };
+	scene.add(problem, config);
+
+	auto db = std::make_shared<MockDatabase>();
+	db->setDocuments(scene.bsons);
+
+	{
+		config.tolerance = 0.0;
+		clash::Hard pipeline(db, config);
+		auto results = pipeline.runPipeline();
+		EXPECT_THAT(results.clashes.size(), Eq(1));
+	}
+
+	{
+		config.tolerance = 0.2;
+		clash::Hard pipeline(db, config);
+		auto results = pipeline.runPipeline();
+		EXPECT_THAT(results.clashes.size(), Eq(0));
+	}
+}
+
+TEST(Clash, NodeCache)
+{
+	static size_t nodeCount = 0;
+
+	struct Node {
+
+		size_t i;
+
+		Node() {
+			nodeCount++;
+		}
+
+		~Node() {
+			nodeCount--;
+		}
+	};
+
+	// Cache expects to be keyed by objects (specifically, their addresses)
+
+	struct K {
+		size_t i;
+	};
+
+	std::vector<K> keys;
+
+	for (size_t i = 0; i < 10; i++) {
+		keys.push_back(K{i});
+	}
+
+	struct Cache : public repo::manipulator::modelutility::clash::ResourceCache<K, Node>
+	{
+		void initialise(const K& key, Node* node) const override {
+			node->i = key.i;
+		}
+	};
+
+	EXPECT_THROW({
+		{
+			Cache cache;
+			std::vector<Cache::Record*> records;
+			for(auto& key : keys) {
+				records.push_back(cache.get(key));
+			}
+
+			EXPECT_THAT(nodeCount, Eq(keys.size()));
+		} // The expected exception will be thrown on exiting this inner scope, when cache is destroyed
+	}, std::runtime_error);
+
+	nodeCount = 0;
+
+	{
+		// Cache is cleaned up properly, but without using auto collection
+
+		Cache cache;
+		std::vector<Cache::Record*> records;
+		for (auto& key : keys) {
+			records.push_back(cache.get(key));
+		}
+
+		EXPECT_THAT(nodeCount, Eq(keys.size()));
+
+		for (auto& key : keys) {
+			cache.release(key);
+		}
+
+		EXPECT_THAT(nodeCount, Eq(0));
+	}
+
+	{
+		// Getting a record a second time returns the same pointer
+
+		Cache cache;
+		std::vector<Cache::Record*> records;
+		for (auto& key : keys) {
+			records.push_back(cache.get(key));
+		}
+
+		for (size_t itr = 0; itr < 3; itr++) {
+			for (size_t i = 0; i < keys.size(); i++) {
 				auto record = cache.get(keys[i]);
 				EXPECT_THAT(record, Eq(records[i]));
 			}
@@ -2204,6 +3055,384 @@ TEST(Clash, NodeCache)
 	}
 }
 
+TEST(Clash, ResidencyManager)
+{
+	// The ResidencyManager should keep the memory of the unleased nodes within
+	// the budget, reloading nodes when they are acquired after being evicted.
+
+	using namespace repo::manipulator::modelutility::clash;
+
+	static size_t nodeCount = 0;
+
+	struct Node {
+		size_t i;
+		std::vector<uint8_t> data;
+		std::shared_mutex mutex;
+		size_t loads = 0;
+
+		Node() {
+			nodeCount++;
+		}
+
+		~Node() {
+			nodeCount--;
+		}
+
+		bool isInitialised() {
+			return data.size();
+		}
+
+		void initialise(size_t size) {
+			data.resize(size);
+			loads++;
+		}
+
+		void unload() {
+			data = {};
+		}
+
+		size_t getMemoryUsage() const {
+			return data.size();
+		}
+	};
+
+	struct K {
+		size_t i;
+	};
+
+	struct Cache : public ResourceCache<K, Node>
+	{
+		void initialise(const K& key, Node* node) const override {
+			node->i = key.i;
+		}
+	};
+
+	std::vector<K> keys;
+	for (size_t i = 0; i < 10; i++) {
+		keys.push_back(K{ i });
+	}
+
+	{
+		// With a budget of two nodes, acquiring all nodes in turn should keep at
+		// most two resident at a time
+
+		auto residency = std::make_shared<ResidencyManager<Node>>(200);
+
+		Cache cache;
+		cache.setResidencyManager(residency);
+
+		std::vector<Cache::Entry> entries;
+		for (auto& key : keys) {
+			entries.push_back(cache.get(key)->getReference());
+		}
+		cache.finalise();
+
+		for (auto& e : entries) {
+			auto lease = residency->acquire(e.get(), 100);
+			EXPECT_THAT(e->isInitialised(), IsTrue());
+			EXPECT_THAT(residency->getMemoryUsage(), Le(200));
+		}
+
+		auto statistics = residency->getStatistics();
+		EXPECT_THAT(statistics.misses, Eq(keys.size()));
+		EXPECT_THAT(statistics.hits, Eq(0));
+		EXPECT_THAT(statistics.reloads, Eq(0));
+		EXPECT_THAT(statistics.evictions, Eq(keys.size() - 2));
+		EXPECT_THAT(statistics.peakMemory, Le(300));
+
+		// The first node was evicted, so should be loaded again, whereas the last
+		// one is still resident.
+
+		EXPECT_THAT(entries[0]->isInitialised(), IsFalse());
+		{
+			auto lease = residency->acquire(entries[0].get(), 100);
+			EXPECT_THAT(entries[0]->loads, Eq(2));
+		}
+		{
+			auto lease = residency->acquire(entries.back().get(), 100);
+			EXPECT_THAT(entries.back()->loads, Eq(1));
+		}
+
+		statistics = residency->getStatistics();
+		EXPECT_THAT(statistics.reloads, Eq(1));
+		EXPECT_THAT(statistics.hits, Eq(1));
+
+		// Destroying resident nodes should release their memory from the budget
+
+		entries.clear();
+		EXPECT_THAT(nodeCount, Eq(0));
+		EXPECT_THAT(residency->getMemoryUsage(), Eq(0));
+	}
+
+	{
+		// Leased nodes should never be evicted, even if the budget is exceeded
+
+		auto residency = std::make_shared<ResidencyManager<Node>>(100);
+
+		Cache cache;
+		cache.setResidencyManager(residency);
+
+		std::vector<Cache::Entry> entries;
+		for (auto& key : keys) {
+			entries.push_back(cache.get(key)->getReference());
+		}
+		cache.finalise();
+
+		{
+			std::vector<ResidencyManager<Node>::Lease> leases;
+			for (auto& e : entries) {
+				leases.push_back(residency->acquire(e.get(), 100));
+			}
+
+			for (auto& e : entries) {
+				EXPECT_THAT(e->isInitialised(), IsTrue());
+			}
+			EXPECT_THAT(residency->getMemoryUsage(), Eq(100 * keys.size()));
+		}
+
+		EXPECT_THAT(residency->getMemoryUsage(), Le(100));
+	}
+
+	{
+		// A budget of zero never evicts
+
+		auto residency = std::make_shared<ResidencyManager<Node>>(0);
+
+		Cache cache;
+		cache.setResidencyManager(residency);
+
+		std::vector<Cache::Entry> entries;
+		for (auto& key : keys) {
+			entries.push_back(cache.get(key)->getReference());
+		}
+		cache.finalise();
+
+		for (auto& e : entries) {
+			auto lease = residency->acquire(e.get(), 100);
+		}
+
+		EXPECT_THAT(residency->getStatistics().evictions, Eq(0));
+		EXPECT_THAT(residency->getMemoryUsage(), Eq(100 * keys.size()));
+	}
+}
+
+TEST(Clash, PrefetchResidency)
+{
+	// Entries loaded by the Prefetcher should stay resident until a worker has
+	// consumed them, even when the ResidencyManager's budget is much smaller than
+	// that of the Prefetcher.
+
+	using namespace repo::manipulator::modelutility::clash;
+
+	struct Node {
+		std::vector<uint8_t> data;
+		std::shared_mutex mutex;
+		size_t loads = 0;
+
+		bool isInitialised() {
+			return data.size();
+		}
+
+		void initialise(size_t size) {
+			data.resize(size);
+			loads++;
+		}
+
+		void unload() {
+			data = {};
+		}
+
+		size_t getMemoryUsage() const {
+			return data.size();
+		}
+	};
+
+	struct K {
+		size_t i;
+	};
+
+	struct Cache : public ResourceCache<K, Node>
+	{
+		void initialise(const K& key, Node* node) const override {
+		}
+	};
+
+	using Residency = ResidencyManager<Node>;
+	using Test = std::pair<Cache::Entry, Cache::Entry>;
+
+	std::vector<K> keys;
+	for (size_t i = 0; i < 20; i++) {
+		keys.push_back(K{ i });
+	}
+
+	{
+		// With a budget of one node, the prefetched entries should not be evicted
+		// until they are consumed, so none are loaded twice.
+
+		auto residency = std::make_shared<Residency>(100);
+
+		Cache cache;
+		cache.setResidencyManager(residency);
+
+		std::vector<Cache::Entry> entries;
+		for (auto& key : keys) {
+			entries.push_back(cache.get(key)->getReference());
+		}
+		cache.finalise();
+
+		std::vector<Test> tests;
+		for (size_t i = 0; i < entries.size(); i += 2) {
+			tests.push_back({ entries[i], entries[i + 1] });
+		}
+
+		Prefetcher<Node, Residency::Lease> prefetcher([&](Node* node) {
+				return residency->acquire(node, 100);
+			},
+			1024 * 1024,
+			2
+		);
+		prefetcher.start(tests, 1);
+
+		while (residency->getMemoryUsage() < 100 * entries.size()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		EXPECT_THAT(residency->getStatistics().evictions, Eq(0));
+
+		for (auto& [a, b] : tests) {
+			auto leaseA = residency->acquire(a.get(), 100);
+			auto leaseB = residency->acquire(b.get(), 100);
+			prefetcher.consume(a.get());
+			prefetcher.consume(b.get());
+			EXPECT_THAT(a->loads, Eq(1));
+			EXPECT_THAT(b->loads, Eq(1));
+		}
+
+		prefetcher.stop();
+
+		auto statistics = residency->getStatistics();
+		EXPECT_THAT(statistics.misses, Eq(entries.size()));
+		EXPECT_THAT(statistics.hits, Eq(entries.size()));
+		EXPECT_THAT(statistics.reloads, Eq(0));
+		EXPECT_THAT(residency->getMemoryUsage(), Le(100));
+	}
+
+	{
+		// When the prefetch threads and workers run concurrently, with entries
+		// shared between tests, the entries should always be loaded when a worker
+		// uses them, and none should be left leased once the prefetcher stops.
+
+		auto residency = std::make_shared<Residency>(100);
+
+		Cache cache;
+		cache.setResidencyManager(residency);
+
+		std::vector<Cache::Entry> entries;
+		for (auto& key : keys) {
+			entries.push_back(cache.get(key)->getReference());
+		}
+		cache.finalise();
+
+		std::vector<Test> tests;
+		for (size_t j = 0; j < 10; j++) {
+			for (size_t i = 0; i < entries.size(); i++) {
+				tests.push_back({ entries[i], entries[(i + j + 1) % entries.size()] });
+			}
+		}
+
+		TaskPool<Test> pool(4);
+
+		Prefetcher<Node, Residency::Lease> prefetcher([&](Node* node) {
+				return residency->acquire(node, 100);
+			},
+			300,
+			2
+		);
+		prefetcher.start(tests, pool.numThreads());
+
+		pool.push(tests);
+
+		std::atomic<size_t> unloaded = 0;
+		pool.run([&](Test& test) {
+			auto& [a, b] = test;
+			auto leaseA = residency->acquire(a.get(), 100);
+			auto leaseB = residency->acquire(b.get(), 100);
+			prefetcher.consume(a.get());
+			prefetcher.consume(b.get());
+
+			std::shared_lock lockA(a->mutex);
+			std::shared_lock lockB(b->mutex);
+			if (!a->isInitialised() || !b->isInitialised()) {
+				unloaded++;
+			}
+		});
+
+		prefetcher.stop();
+
+		EXPECT_THAT(unloaded, Eq(0));
+		EXPECT_THAT(residency->getMemoryUsage(), Le(100));
+	}
+}
+
+TEST(Clash, CacheMemory)
+{
+	// Evicting meshes from the cache should not change the results, only how many
+	// times the meshes are loaded.
+
+	auto db = std::make_shared<MockDatabase>();
+
+	ClashGenerator clashGenerator;
+	CellDistribution space;
+
+	ClashDetectionConfigHelper config;
+	MockClashScene scene(config.getRevision());
+
+	// Composites that share meshes with many others, so they are needed by many
+	// tests, and will be evicted between them if the budget is small.
+
+	clashGenerator.distance = 0.5;
+	for (int j = 0; j < 20; j++) {
+		auto bounds = space.sample();
+		auto [a, b] = scene.add(clashGenerator.createTrianglesTransformed(bounds));
+		auto [c, d] = scene.add(clashGenerator.createTrianglesTransformed(bounds));
+		config.addCompositeObjects({ a, c }, { b, d });
+	}
+
+	db->setDocuments(scene.bsons);
+
+	for (auto type : { ClashDetectionType::Hard, ClashDetectionType::Clearance }) {
+		config.type = type;
+		config.tolerance = 1.0;
+
+		config.cacheMemory = 0;
+		auto expected = createPipeline(db, config)->runPipeline();
+
+		EXPECT_THAT(expected.statistics.cache.evictions, Eq(0));
+		EXPECT_THAT(expected.statistics.cache.reloads, Eq(0));
+
+		// Prefetched meshes are held until a worker uses them, regardless of the
+		// budget, so the peak is only compared without the prefetch stage.
+
+		config.cacheMemory = 1;
+		config.numThreads = 1;
+		config.numPrefetchThreads = 0;
+		auto results = createPipeline(db, config)->runPipeline();
+
+		EXPECT_THAT(toMap(results), Eq(toMap(expected)));
+		EXPECT_THAT(results.statistics.cache.evictions, Gt(0));
+		EXPECT_THAT(results.statistics.cache.peakMemory, Le(expected.statistics.cache.peakMemory));
+
+		config.numPrefetchThreads = 2;
+		results = createPipeline(db, config)->runPipeline();
+
+		EXPECT_THAT(toMap(results), Eq(toMap(expected)));
+		EXPECT_THAT(results.statistics.cache.evictions, Gt(0));
+
+		config.numThreads = 0;
+		config.cacheMemory = 0;
+	}
+}
+
 TEST(Clash, ClashExceptionsAreCaught)
 {
 	// Clash exceptions should be added to the report and the process should
@@ -2259,6 +3488,27 @@ TEST(Clash, ResultsSerialisation)
 		report.clashes.push_back(result);
 	}
 
+	for (int i = 0; i < 2; i++) {
+		repo::manipulator::modelutility::clash::WorkerStatistics thread;
+		thread.tasks = 10 + i;
+		thread.steals = i;
+		thread.busy = 1.5;
+		thread.idle = 0.25;
+		report.statistics.narrowphaseThreads.push_back(thread);
+	}
+
+	report.statistics.cache.hits = 100;
+	report.statistics.cache.misses = 20;
+	report.statistics.cache.reloads = 5;
+	report.statistics.cache.evictions = 6;
+	report.statistics.cache.peakMemory = 1024 * 1024;
+
+	report.statistics.sceneGraph.containers = 40;
+	report.statistics.sceneGraph.time = 2.5;
+
+	report.statistics.meshStore.hits = 30;
+	report.statistics.meshStore.misses = 7;
+
 	ClashDetectionEngineUtils::writeJson(report, config);
 
 	repo::lib::Container container;
@@ -2342,6 +3592,33 @@ TEST(Clash, ResultsSerialisation)
 				EXPECT_THAT(jsonPos[2].GetDouble(), DoubleNear(pos.z, FLT_EPSILON));
 			}
 		}
+
+		EXPECT_TRUE(doc.HasMember("statistics"));
+		const auto& threads = doc["statistics"]["narrowphaseThreads"];
+		EXPECT_TRUE(threads.IsArray());
+		EXPECT_EQ(threads.Size(), report.statistics.narrowphaseThreads.size());
+		for (size_t i = 0; i < report.statistics.narrowphaseThreads.size(); ++i) {
+			const auto& thread = report.statistics.narrowphaseThreads[i];
+			EXPECT_EQ(threads[i]["tasks"].GetUint64(), thread.tasks);
+			EXPECT_EQ(threads[i]["steals"].GetUint64(), thread.steals);
+			EXPECT_THAT(threads[i]["busy"].GetDouble(), DoubleEq(thread.busy));
+			EXPECT_THAT(threads[i]["idle"].GetDouble(), DoubleEq(thread.idle));
+		}
+
+		const auto& cache = doc["statistics"]["cache"];
+		EXPECT_EQ(cache["hits"].GetUint64(), report.statistics.cache.hits);
+		EXPECT_EQ(cache["misses"].GetUint64(), report.statistics.cache.misses);
+		EXPECT_EQ(cache["reloads"].GetUint64(), report.statistics.cache.reloads);
+		EXPECT_EQ(cache["evictions"].GetUint64(), report.statistics.cache.evictions);
+		EXPECT_EQ(cache["peakMemory"].GetUint64(), report.statistics.cache.peakMemory);
+
+		const auto& sceneGraph = doc["statistics"]["sceneGraph"];
+		EXPECT_EQ(sceneGraph["containers"].GetUint64(), report.statistics.sceneGraph.containers);
+		EXPECT_THAT(sceneGraph["time"].GetDouble(), DoubleEq(report.statistics.sceneGraph.time));
+
+		const auto& meshStore = doc["statistics"]["meshStore"];
+		EXPECT_EQ(meshStore["hits"].GetUint64(), report.statistics.meshStore.hits);
+		EXPECT_EQ(meshStore["misses"].GetUint64(), report.statistics.meshStore.misses);
 	}
 	{
 		rapidjson::Document doc;
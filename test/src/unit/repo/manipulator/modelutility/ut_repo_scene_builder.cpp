@@ -0,0 +1,399 @@
+/**
+*  Copyright (C) 2025 3D Repo Ltd
+*
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU Affero General Public License as
+*  published by the Free Software Foundation, either version 3 of the
+*  License, or (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Affero General Public License for more details.
+*
+*  You should have received a copy of the GNU Affero General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include <map>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <repo/core/model/bson/repo_bson.h>
+#include <repo/core/model/bson/repo_bson_builder.h>
+#include <repo/core/model/bson/repo_bson_factory.h>
+#include <repo/core/model/bson/repo_node_mesh.h>
+#include <repo/core/handler/database/repo_query.h>
+#include <repo/manipulator/modelutility/repo_scene_builder.h>
+#include <test/src/unit/repo_test_mesh_utils.h>
+#include <test/src/unit/repo_test_database_info.h>
+#include <test/src/unit/repo_test_mock_database.h>
+
+using namespace repo::test::utils::mesh;
+using namespace repo::manipulator::modelutility;
+using namespace repo::core::model;
+
+#define DBSCENEBUILDERTEST "sceneBuilderTest"
+
+/*
+* Reads back the MeshNodes of a project, with their geometry, by unique id,
+* along with the serialised reference to their range of the blob files.
+*/
+static std::map<repo::lib::RepoUUID, std::pair<MeshNode, std::string>> getMeshNodes(
+	std::shared_ptr<repo::core::handler::AbstractDatabaseHandler> handler,
+	std::string database,
+	std::string projectName)
+{
+	auto bsons = handler->findAllByCriteria(
+		database,
+		projectName + "." + REPO_COLLECTION_SCENE,
+		repo::core::handler::database::query::Eq(REPO_NODE_LABEL_TYPE, REPO_NODE_TYPE_MESH),
+		true
+	);
+
+	std::map<repo::lib::RepoUUID, std::pair<MeshNode, std::string>> nodes;
+	for (auto& bson : bsons) {
+		MeshNode node(bson);
+		nodes.emplace(node.getUniqueID(), std::make_pair(node, bson.getBinaryReference().toString()));
+	}
+	return nodes;
+}
+
+static bool sameGeometry(const MeshNode& a, const MeshNode& b)
+{
+	return a.getVertices() == b.getVertices() && a.getFaces() == b.getFaces();
+}
+
+TEST(RepoSceneBuilder, SharedGeometry)
+{
+	// Identical geometry should be stored only once, with all the nodes
+	// referencing the same blob range. Geometry that is the same size but has
+	// different content should get its own range, and every node should read
+	// back the geometry it was given.
+
+	auto handler = getHandler();
+	std::string database = DBSCENEBUILDERTEST;
+	std::string projectName = "SharedGeometry";
+	auto revId = repo::lib::RepoUUID::createUUID();
+
+	std::map<repo::lib::RepoUUID, MeshNode> expected;
+
+	{
+		RepoSceneBuilder sceneBuilder(handler, database, projectName, revId);
+
+		auto rootNode = RepoBSONFactory::makeTransformationNode({}, "rootNode", {});
+		sceneBuilder.addNode(rootNode);
+		auto rootNodeId = rootNode.getSharedID();
+
+		auto add = [&](const MeshNode& mesh) {
+			auto node = std::make_unique<MeshNode>(mesh);
+			node->setUniqueID(repo::lib::RepoUUID::createUUID());
+			node->setSharedID(repo::lib::RepoUUID::createUUID());
+			node->removeDuplicateVertices();
+			expected.emplace(node->getUniqueID(), *node);
+			sceneBuilder.addNode(std::move(node));
+		};
+
+		auto instance = createRandomMesh(100, false, 3, "", { rootNodeId });
+		for (int i = 0; i < 10; ++i) {
+			add(*instance);
+		}
+
+		auto moved = *instance;
+		auto vertices = moved.getVertices();
+		vertices[0].x += 1;
+		moved.setVertices(vertices);
+		add(moved);
+		add(moved);
+
+		add(*createRandomMesh(100, false, 3, "", { rootNodeId }));
+
+		sceneBuilder.finalise();
+	}
+
+	auto nodes = getMeshNodes(handler, database, projectName);
+	ASSERT_EQ(nodes.size(), expected.size());
+
+	std::set<std::string> refs;
+	for (auto& [id, node] : nodes) {
+		refs.insert(node.second);
+		ASSERT_TRUE(expected.count(id));
+		EXPECT_TRUE(sameGeometry(node.first, expected.at(id)));
+	}
+	EXPECT_EQ(refs.size(), 3);
+}
+
+/*
+* A MockDatabase that records what each bulk write context receives, in order.
+* The contexts can be closed, which stalls the writers on their next write
+* until they are opened again.
+*/
+struct RecordingDatabase : public testing::MockDatabase
+{
+	struct Operation
+	{
+		repo::lib::RepoUUID uniqueId;
+		bool update;
+		RepoBSON document;
+	};
+
+	struct Context
+	{
+		std::string database;
+		std::string collection;
+		std::vector<Operation> operations;
+		std::vector<std::vector<uint8_t>> binaries;
+	};
+
+	std::vector<std::shared_ptr<Context>> contexts;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool open = true;
+
+	void setOpen(bool open)
+	{
+		std::unique_lock lock(mutex);
+		this->open = open;
+		condition.notify_all();
+	}
+
+	class WriteContext : public repo::core::handler::database::BulkWriteContext
+	{
+	public:
+		WriteContext(RecordingDatabase* db, std::shared_ptr<Context> context, int index) :
+			db(db),
+			context(context),
+			index(index)
+		{
+		}
+
+		void insertDocument(RepoBSON obj) override
+		{
+			auto lock = wait();
+			context->operations.push_back({ obj.getUUIDField(REPO_NODE_LABEL_ID), false, obj });
+		}
+
+		RepoBSON insertBinary(const std::vector<uint8_t>& data) override
+		{
+			auto lock = wait();
+			RepoBSONBuilder builder;
+			builder.append("context", index);
+			builder.append("offset", (int)context->binaries.size());
+			context->binaries.push_back(data);
+			return builder.obj();
+		}
+
+		void updateDocument(const repo::core::handler::database::query::RepoUpdate& obj) override
+		{
+			auto lock = wait();
+			auto& update = std::get<repo::core::handler::database::query::AddParent>(obj);
+			context->operations.push_back({ update.uniqueId, true, {} });
+		}
+
+		void flush() override
+		{
+		}
+
+	private:
+		RecordingDatabase* db;
+		std::shared_ptr<Context> context;
+		int index;
+
+		std::unique_lock<std::mutex> wait()
+		{
+			std::unique_lock lock(db->mutex);
+			db->condition.wait(lock, [&]() { return db->open; });
+			return lock;
+		}
+	};
+
+	std::unique_ptr<repo::core::handler::database::BulkWriteContext> getBulkWriteContext(
+		const std::string& database,
+		const std::string& collection) override
+	{
+		std::unique_lock lock(mutex);
+		auto context = std::make_shared<Context>();
+		context->database = database;
+		context->collection = collection;
+		contexts.push_back(context);
+		return std::make_unique<WriteContext>(this, context, (int)contexts.size() - 1);
+	}
+
+	// The contexts that received anything. Each AsyncImpl creates one context
+	// per writer, including the ones that are replaced before being used.
+	std::vector<std::shared_ptr<Context>> getUsedContexts()
+	{
+		std::unique_lock lock(mutex);
+		std::vector<std::shared_ptr<Context>> used;
+		for (auto& c : contexts) {
+			if (c->operations.size()) {
+				used.push_back(c);
+			}
+		}
+		return used;
+	}
+};
+
+TEST(RepoSceneBuilder, MultipleWriters)
+{
+	// Each writer should receive the nodes whose unique ids hash to it, in the
+	// order they were added, with the updates to a node following its insert
+	// in the same context. Each mesh's blob reference should locate its
+	// geometry in the blob file of the context the mesh was written to.
+	// This uses the default number of writers, which imports also use unless
+	// configured otherwise.
+
+	auto handler = std::make_shared<RecordingDatabase>();
+	std::string database = DBSCENEBUILDERTEST;
+	std::string projectName = "MultipleWriters";
+	size_t numWriters = 4;
+
+	std::vector<repo::lib::RepoUUID> added;
+	std::map<repo::lib::RepoUUID, std::vector<uint8_t>> buffers;
+	std::set<repo::lib::RepoUUID> updated;
+
+	{
+		RepoSceneBuilder sceneBuilder(handler, database, projectName, repo::lib::RepoUUID::createUUID());
+		EXPECT_EQ(sceneBuilder.getNumWriters(), numWriters);
+
+		auto root = RepoBSONFactory::makeTransformationNode({}, "rootNode", {});
+		auto rootId = root.getSharedID();
+		added.push_back(root.getUniqueID());
+		sceneBuilder.addNode(std::make_unique<TransformationNode>(root));
+
+		for (int i = 0; i < 200; i++) {
+			auto node = std::make_unique<TransformationNode>(RepoBSONFactory::makeTransformationNode({}, "node", { rootId }));
+			added.push_back(node->getUniqueID());
+			if (i % 3 == 0) {
+				sceneBuilder.addParent(node->getUniqueID(), rootId);
+				updated.insert(node->getUniqueID());
+			}
+			sceneBuilder.addNode(std::move(node));
+		}
+
+		for (int i = 0; i < 50; i++) {
+			auto node = createRandomMesh(100, false, 3, "", { rootId });
+			node->setUniqueID(repo::lib::RepoUUID::createUUID());
+
+			MeshNode copy = *node;
+			copy.removeDuplicateVertices();
+			RepoBSON bson = copy;
+			buffers[node->getUniqueID()] = bson.getBinariesAsBuffer().second;
+
+			added.push_back(node->getUniqueID());
+			sceneBuilder.addNode(std::move(node));
+		}
+
+		sceneBuilder.finalise();
+	}
+
+	auto contexts = handler->getUsedContexts();
+	ASSERT_EQ(contexts.size(), numWriters);
+
+	std::map<repo::lib::RepoUUID, size_t> order;
+	for (size_t i = 0; i < added.size(); i++) {
+		order[added[i]] = i;
+	}
+
+	std::set<size_t> routes;
+	std::map<repo::lib::RepoUUID, size_t> inserts;
+	for (auto& context : contexts) {
+		EXPECT_EQ(context->database, database);
+		EXPECT_EQ(context->collection, projectName + "." + REPO_COLLECTION_SCENE);
+
+		auto route = repo::lib::RepoUUIDHasher()(context->operations[0].uniqueId) % numWriters;
+		EXPECT_FALSE(routes.count(route));
+		routes.insert(route);
+
+		std::set<repo::lib::RepoUUID> inserted;
+		size_t previous = 0;
+		for (auto& op : context->operations) {
+			EXPECT_EQ(repo::lib::RepoUUIDHasher()(op.uniqueId) % numWriters, route);
+
+			// Besides the nodes given parents above, the builder adds parents to the
+			// material nodes it creates and shares between the meshes.
+
+			if (op.update) {
+				EXPECT_TRUE(inserted.count(op.uniqueId));
+				EXPECT_TRUE(updated.count(op.uniqueId) || !order.count(op.uniqueId));
+				continue;
+			}
+
+			inserted.insert(op.uniqueId);
+			inserts[op.uniqueId]++;
+
+			if (order.count(op.uniqueId)) {
+				EXPECT_GE(order[op.uniqueId], previous);
+				previous = order[op.uniqueId];
+			}
+
+			if (buffers.count(op.uniqueId)) {
+				auto ref = op.document.getBinaryReference();
+				ASSERT_EQ(&*handler->contexts[ref.getIntField("context")], &*context);
+				EXPECT_EQ(context->binaries[ref.getIntField("offset")], buffers[op.uniqueId]);
+			}
+		}
+	}
+
+	for (auto& id : added) {
+		EXPECT_EQ(inserts[id], 1);
+	}
+}
+
+TEST(RepoSceneBuilder, Backpressure)
+{
+	// When the writers cannot keep up, addNode should block once the queues
+	// hold more than the threshold, and resume once the writers drain them.
+
+	auto handler = std::make_shared<RecordingDatabase>();
+	size_t numWriters = 2;
+	size_t numNodes = 100;
+
+	auto node = RepoBSONFactory::makeTransformationNode({}, "node", {});
+	auto nodeSize = node.getSize();
+	size_t queueLength = 10;
+
+	RepoSceneBuilder sceneBuilder(handler, DBSCENEBUILDERTEST, "Backpressure", repo::lib::RepoUUID::createUUID());
+	sceneBuilder.setNumWriters(numWriters);
+	sceneBuilder.setQueueThreshold(nodeSize * queueLength);
+
+	handler->setOpen(false);
+
+	std::atomic<size_t> added = 0;
+	std::thread producer([&]() {
+		for (size_t i = 0; i < numNodes; i++) {
+			auto n = std::make_unique<TransformationNode>(node);
+			n->setUniqueID(repo::lib::RepoUUID::createUUID());
+			sceneBuilder.addNode(std::move(n));
+			added++;
+		}
+	});
+
+	// Wait for the producer to stall. Each writer holds at most one node while
+	// it is blocked, and the queues at most the threshold.
+
+	size_t stalled = 0;
+	do {
+		stalled = added;
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	} while (stalled != added);
+
+	EXPECT_LT(stalled, numNodes);
+	EXPECT_LE(stalled, queueLength + numWriters + 1);
+
+	handler->setOpen(true);
+	producer.join();
+	EXPECT_EQ(added, numNodes);
+
+	sceneBuilder.finalise();
+
+	size_t inserted = 0;
+	for (auto& context : handler->getUsedContexts()) {
+		inserted += context->operations.size();
+	}
+	EXPECT_EQ(inserted, numNodes);
+}
\ No newline at end of file
@@ -97,6 +97,7 @@ std::set<repo::lib::RepoUUID> ClashDetectionDatabaseHelper::getUniqueIdsByName(
 	repo::core::handler::database::query::RepoProjectionBuilder projection;
 	projection.includeField(REPO_NODE_LABEL_ID);
 	projection.includeField(REPO_NODE_LABEL_SHARED_ID);
+	projection.includeField(REPO_NODE_LABEL_TYPE); // Used by getChildMeshNodes
 
 	auto cursor = handler->findCursorByCriteria(
 		container->teamspace,
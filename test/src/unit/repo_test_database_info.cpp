@@ -40,6 +40,16 @@ std::shared_ptr<repo::core::handler::MongoDatabaseHandler> getHandler()
 	return handler;
 }
 
+std::shared_ptr<repo::core::handler::EmbeddedDatabaseHandler> getEmbeddedHandler(const std::string& directory)
+{
+	auto handler = repo::core::handler::EmbeddedDatabaseHandler::getHandler(directory);
+
+	auto config = repo::lib::RepoConfig::fromFile(getDataPath("config/withFS.json"));
+	config.configureFS(getDataPath("fileShare"));
+	handler->setFileManager(std::make_shared<repo::core::handler::fileservice::FileManager>(config, handler));
+	return handler;
+}
+
 std::string getClientExePath()
 {
 	char* pathChr = getenv("REPO_CLIENT_PATH");
@@ -17,6 +17,7 @@
 
 #pragma once
 #include <repo/core/handler/repo_database_handler_mongo.h>
+#include <repo/core/handler/repo_database_handler_embedded.h>
 #include <repo/core/handler/fileservice/repo_file_manager.h>
 #include <repo/lib/datastructure/repo_vector.h>
 #include <repo/lib/datastructure/repo_bounds.h>
@@ -151,6 +152,12 @@ std::string getDataPath(const std::string& file);
 
 std::shared_ptr<repo::core::handler::MongoDatabaseHandler> getHandler();
 
+/*
+* Returns an EmbeddedDatabaseHandler that stores its databases under directory,
+* using the same file store as getHandler.
+*/
+std::shared_ptr<repo::core::handler::EmbeddedDatabaseHandler> getEmbeddedHandler(const std::string& directory);
+
 repo::lib::RepoBounds getGoldenDataForBBoxTest();
 
 /*
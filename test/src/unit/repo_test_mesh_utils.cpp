@@ -282,29 +282,24 @@ std::vector<repo::test::utils::mesh::GenericFace> repo::test::utils::mesh::getFa
 		if (elementsBson.hasField(REPO_NODE_MESH_LABEL_FACES)) {
 
 			int32_t faceCount = bson.getIntField(REPO_NODE_MESH_LABEL_FACES_COUNT);
-			faces.reserve(faceCount);
 
-			std::vector<uint32_t> serialisedFaces = std::vector<uint32_t>();
+			int32_t encoding = MeshNode::FaceEncoding::LEGACY;
+			if (bson.hasField(REPO_NODE_MESH_LABEL_FACES_ENCODING)) {
+				encoding = bson.getIntField(REPO_NODE_MESH_LABEL_FACES_ENCODING);
+			}
+
+			auto primitive = MeshNode::Primitive::TRIANGLES;
+			if (bson.hasField(REPO_NODE_MESH_LABEL_PRIMITIVE)) {
+				primitive = static_cast<MeshNode::Primitive>(bson.getIntField(REPO_NODE_MESH_LABEL_PRIMITIVE));
+			}
+
+			std::vector<uint8_t> serialisedFaces;
 			auto faceBson = elementsBson.getObjectField(REPO_NODE_MESH_LABEL_FACES);
 			deserialiseVector(faceBson, buffer, serialisedFaces);
 
-			int mNumIndicesIndex = 0;
-			while (serialisedFaces.size() > mNumIndicesIndex)
+			if (!MeshNode::deserialiseFaces(serialisedFaces.data(), serialisedFaces.size(), encoding, primitive, faceCount, faces))
 			{
-				int mNumIndices = serialisedFaces[mNumIndicesIndex];
-				if (serialisedFaces.size() > mNumIndicesIndex + mNumIndices)
-				{
-					repo::lib::repo_face_t face;
-					face.resize(mNumIndices);
-					for (int i = 0; i < mNumIndices; ++i)
-						face[i] = serialisedFaces[mNumIndicesIndex + 1 + i];
-					faces.push_back(face);
-					mNumIndicesIndex += mNumIndices + 1;
-				}
-				else
-				{
-					repoError << "Cannot copy all faces. Buffer size is smaller than expected!";
-				}
+				repoError << "Cannot copy all faces. Buffer size is smaller than expected!";
 			}
 
 		}
@@ -19,11 +19,13 @@
 #include "repo_test_utils.h"
 
 #include "repo/core/model/bson/repo_bson.h"
+#include "repo/core/model/bson/repo_bson_builder.h"
 #include "repo/core/handler/database/repo_query.h"
 #include "repo/lib//datastructure/repo_variant.h"
 #include "repo/lib/datastructure/repo_variant_utils.h"
 
 #include <vector>
+#include <set>
 
 using namespace repo::core::handler::database;
 using namespace testing;
@@ -132,6 +134,27 @@ repo::core::model::RepoBSON MockDatabase::findOneByUniqueID(
 	throw MockDatabaseMethodNotImplemented();
 }
 
+void MockDatabase::loadBinaryBuffers(
+	const std::string& database,
+	const std::string& collection,
+	repo::core::model::RepoBSON& bson)
+{
+	// The mock database never unloads the binaries of its internal bsons, so
+	// they are copied back from the document with the same id. This allows
+	// callers to unload and reload them (e.g. when evicting cached geometry).
+
+	auto index = indexes[REPO_NODE_LABEL_ID];
+	if (!index || bson.hasOversizeFiles() || !bson.hasField(REPO_NODE_LABEL_ID)) {
+		return;
+	}
+
+	std::vector<repo::core::model::RepoBSON> results;
+	index->find(bson.getUUIDField(REPO_NODE_LABEL_ID), results);
+	if (results.size()) {
+		bson = repo::core::model::RepoBSON(bson, results[0].getFilesMapping());
+	}
+}
+
 void MockDatabase::dropDocument(
 	const repo::core::model::RepoBSON bson,
 	const std::string& database,
@@ -196,19 +219,122 @@ struct VectorCursor : public repo::core::handler::database::Cursor
 	}
 };
 
-std::unique_ptr<repo::core::handler::database::Cursor> MockDatabase::findCursorByCriteria(
+/*
+* Applies a projection in the same way as Mongo: if any fields are included,
+* only those (and _id, unless it is excluded) are returned. Otherwise all the
+* fields except the excluded ones are returned.
+*/
+static repo::core::model::RepoBSON project(
+	const repo::core::model::RepoBSON& document,
+	const query::RepoQuery& projection)
+{
+	auto builder = std::get_if<query::RepoProjectionBuilder>(&projection);
+	if (!builder) {
+		throw MockDatabase::MockDatabaseMethodNotImplemented();
+	}
+
+	if (builder->includedFields.empty() && builder->excludedFields.empty()) {
+		return document;
+	}
+
+	std::set<std::string> fields;
+	if (builder->includedFields.size()) {
+		fields.insert(builder->includedFields.begin(), builder->includedFields.end());
+		fields.insert(REPO_NODE_LABEL_ID);
+	}
+	else {
+		fields = document.getFieldNames();
+		fields.insert(REPO_LABEL_BINARY_REFERENCE);
+	}
+
+	for (auto& f : builder->excludedFields) {
+		fields.erase(f);
+	}
+
+	repo::core::model::RepoBSONBuilder projected;
+	projected.appendElements(document, fields);
+
+	// The mock's documents hold their binaries directly, rather than in the
+	// file store. They stand in for the binary reference, so they are kept as
+	// long as the projection would keep that.
+
+	if (fields.find(REPO_LABEL_BINARY_REFERENCE) != fields.end()) {
+		return repo::core::model::RepoBSON(projected.obj(), document.getFilesMapping());
+	}
+	else {
+		return projected.obj();
+	}
+}
+
+std::vector<repo::core::model::RepoBSON> MockDatabase::findAllByCriteria(
+	const std::string& database,
+	const std::string& collection,
+	const repo::core::handler::database::query::RepoQuery& criteria,
+	const bool loadBinaries)
+{
+	return findAllByCriteria(database, collection, criteria, query::RepoProjectionBuilder{}, FindOptions{}, loadBinaries);
+}
+
+std::vector<repo::core::model::RepoBSON> MockDatabase::findAllByCriteria(
 	const std::string& database,
 	const std::string& collection,
 	const repo::core::handler::database::query::RepoQuery& filter,
-	const repo::core::handler::database::query::RepoQuery& projection)
+	const repo::core::handler::database::query::RepoQuery& projection,
+	const bool loadBinaries)
 {
-	// The mock ignores the projection for now.
+	return findAllByCriteria(database, collection, filter, projection, FindOptions{}, loadBinaries);
+}
+
+std::vector<repo::core::model::RepoBSON> MockDatabase::findAllByCriteria(
+	const std::string& database,
+	const std::string& collection,
+	const repo::core::handler::database::query::RepoQuery& filter,
+	const repo::core::handler::database::query::RepoQuery& projection,
+	const repo::core::handler::database::FindOptions& options,
+	const bool loadBinaries)
+{
+	// The mock does not support sorting, and as all documents are in memory the
+	// batch size has no effect.
+
+	if (!options.sortField.empty()) {
+		throw MockDatabaseMethodNotImplemented();
+	}
 
 	MockQueryFilterVisitor visitor;
 	visitor.indexes = &indexes;
 	std::visit(visitor, filter);
 
-	return std::make_unique<VectorCursor>(visitor.results);
+	if (options.limit && visitor.results.size() > (size_t)options.limit) {
+		visitor.results.resize(options.limit);
+	}
+
+	std::vector<repo::core::model::RepoBSON> results;
+	results.reserve(visitor.results.size());
+	for (auto& document : visitor.results) {
+		results.push_back(project(document, projection));
+		bytesTransferred += results.back().objsize();
+	}
+
+	return results;
+}
+
+std::unique_ptr<repo::core::handler::database::Cursor> MockDatabase::findCursorByCriteria(
+	const std::string& database,
+	const std::string& collection,
+	const repo::core::handler::database::query::RepoQuery& filter,
+	const repo::core::handler::database::query::RepoQuery& projection)
+{
+	return findCursorByCriteria(database, collection, filter, projection, FindOptions{});
+}
+
+std::unique_ptr<repo::core::handler::database::Cursor> MockDatabase::findCursorByCriteria(
+	const std::string& database,
+	const std::string& collection,
+	const repo::core::handler::database::query::RepoQuery& filter,
+	const repo::core::handler::database::query::RepoQuery& projection,
+	const repo::core::handler::database::FindOptions& options)
+{
+	return std::make_unique<VectorCursor>(findAllByCriteria(database, collection, filter, projection, options));
 }
 
 void MockDatabase::setDocuments(
@@ -20,6 +20,8 @@
 #include "repo/core/handler/repo_database_handler_abstract.h"
 #include "repo/core/model/bson/repo_bson.h"
 
+#include <atomic>
+
 namespace testing {
 
 	struct MockDatabase : public repo::core::handler::AbstractDatabaseHandler
@@ -46,6 +48,11 @@ namespace testing {
 
 		repo::core::model::RepoBSON projectSettings;
 
+		// The total size of the documents returned by the find methods, after
+		// projection. This approximates the bytes that would be transferred from
+		// a real database for the same queries.
+		std::atomic<size_t> bytesTransferred = 0;
+
 		void setDocuments(const std::vector<repo::core::model::RepoBSON>& documents);
 
 		virtual std::vector<repo::core::model::RepoBSON>
@@ -119,18 +126,22 @@ namespace testing {
 			const std::string& database,
 			const std::string& collection,
 			const repo::core::handler::database::query::RepoQuery& criteria,
-			const bool loadBinaries = false) {
-			throw MockDatabaseMethodNotImplemented();
-		}
+			const bool loadBinaries = false) override;
 
 		virtual std::vector<repo::core::model::RepoBSON> findAllByCriteria(
 			const std::string& database,
 			const std::string& collection,
 			const repo::core::handler::database::query::RepoQuery& filter,
 			const repo::core::handler::database::query::RepoQuery& projection,
-			const bool loadBinaries = false) {
-			throw MockDatabaseMethodNotImplemented();
-		}
+			const bool loadBinaries = false) override;
+
+		virtual std::vector<repo::core::model::RepoBSON> findAllByCriteria(
+			const std::string& database,
+			const std::string& collection,
+			const repo::core::handler::database::query::RepoQuery& filter,
+			const repo::core::handler::database::query::RepoQuery& projection,
+			const repo::core::handler::database::FindOptions& options,
+			const bool loadBinaries = false) override;
 
 		virtual std::unique_ptr<repo::core::handler::database::Cursor> findCursorByCriteria(
 			const std::string& database,
@@ -145,6 +156,13 @@ namespace testing {
 			const repo::core::handler::database::query::RepoQuery& filter,
 			const repo::core::handler::database::query::RepoQuery& projection) override;
 
+		virtual std::unique_ptr<repo::core::handler::database::Cursor> findCursorByCriteria(
+			const std::string& database,
+			const std::string& collection,
+			const repo::core::handler::database::query::RepoQuery& filter,
+			const repo::core::handler::database::query::RepoQuery& projection,
+			const repo::core::handler::database::FindOptions& options) override;
+
 		virtual repo::core::model::RepoBSON findOneByCriteria(
 			const std::string& database,
 			const std::string& collection,
@@ -191,8 +209,6 @@ namespace testing {
 		virtual void loadBinaryBuffers(
 			const std::string& database,
 			const std::string& collection,
-			repo::core::model::RepoBSON& bson) {
-			// (The mock database never unloads the binaries of its internal bsons so this is a no-op)
-		}
+			repo::core::model::RepoBSON& bson);
 	};
 }
\ No newline at end of file